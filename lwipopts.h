@@ -13,16 +13,26 @@
 #define LWIP_DHCP                       1
 #define LWIP_DNS                        1
 #define LWIP_UDP                        1
+#define LWIP_IGMP                       1
+#define LWIP_MULTICAST_TX_OPTIONS       1   // TTL for UDP telemetry
 #define LWIP_TCP                        1
 
 // Enable SNTP for NTP time synchronization
 #define LWIP_SNTP                       1
 #define SNTP_SERVER_DNS                 1
+#ifdef __cplusplus
+extern "C" {
+#endif
+void time_utils_clock_stepped(void);  // Invalidates cached local time
+#ifdef __cplusplus
+}
+#endif
 #define SNTP_SET_SYSTEM_TIME_US(sec, us) do { \
     time_t t = (sec); \
     if (t > 1600000000) { \
         struct timeval tv = { .tv_sec = t, .tv_usec = (us) }; \
         settimeofday(&tv, NULL); \
+        time_utils_clock_stepped(); \
     } \
 } while(0)
 
@@ -30,9 +40,9 @@
 #define MEM_SIZE                        8000
 
 #define MEMP_NUM_UDP_PCB                4
-#define MEMP_NUM_TCP_PCB                5
+#define MEMP_NUM_TCP_PCB                6
 #define MEMP_NUM_TCP_SEG                32
-#define MEMP_NUM_SYS_TIMEOUT            8
+#define MEMP_NUM_SYS_TIMEOUT            10
 
 #define TCP_TTL                         255
 #define TCP_QUEUE_OOSEQ                 0
@@ -43,11 +53,28 @@
 
 #define PBUF_POOL_SIZE                  16
 
+// MQTT client: one tick of retained channels plus a telemetry burst fit
+// the output buffer; QoS 1 telemetry messages wait for PUBACK in flight
+#define MQTT_OUTPUT_RINGBUF_SIZE        2048
+#define MQTT_REQ_MAX_IN_FLIGHT          8
+
 #define LWIP_NETIF_STATUS_CALLBACK      1
 #define LWIP_NETIF_LINK_CALLBACK        1
 
-// Disable statistics to reduce code size
-#define LWIP_STATS                      0
+// Statistics: only heap and pool usage, for `mem` and /api/mem
+#define LWIP_STATS                      1
+#define LWIP_STATS_DISPLAY              0
+#define MEM_STATS                       1
+#define MEMP_STATS                      1
+#define LINK_STATS                      0
+#define ETHARP_STATS                    0
+#define IP_STATS                        0
+#define IPFRAG_STATS                    0
+#define ICMP_STATS                      0
+#define IGMP_STATS                      0
+#define UDP_STATS                       0
+#define TCP_STATS                       0
+#define SYS_STATS                       0
 #define LWIP_PROVIDE_ERRNO              1
 
 #endif // _LWIPOPTS_H
@@ -1,15 +1,96 @@
 #include "config.h"
+#include "telemetry_fields.h"
 #include "storage/flash_storage.h"
+#include "utils/crc_utils.h"
+#include "utils/clock.h"
+#include "hardware/sync.h"
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+// Journal record: one config field's new value. Keys name fields, not
+// offsets, so records stay valid when Config grows: 0-31 are the scalars in
+// SCALAR_SLOTS order (append only), 32 + 8 * array + sensor the per-sensor
+// arrays.
+struct ConfigDelta {
+    uint8_t key;
+    uint8_t generation;     // Low byte of the snapshot it applies on top of
+    uint16_t check;         // Low half of the CRC-32 over the record
+    uint32_t value;
+};
+static_assert(sizeof(ConfigDelta) == 8, "ConfigDelta is written as is");
+
+struct ConfigSlot {
+    uint16_t offset;
+    uint8_t size;
+};
+
+#define CONFIG_SLOT(member) { (uint16_t)offsetof(Config, member), (uint8_t)sizeof(((Config*)nullptr)->member) }
+
+static const ConfigSlot SCALAR_SLOTS[] = {
+    CONFIG_SLOT(lights_start_s),
+    CONFIG_SLOT(lights_end_s),
+    CONFIG_SLOT(pump_on_sec),
+    CONFIG_SLOT(pump_period),
+    CONFIG_SLOT(heater_setpoint_c),
+    CONFIG_SLOT(humidity_threshold),
+    CONFIG_SLOT(humidity_mode),
+    CONFIG_SLOT(min_pump_run_sec),
+    CONFIG_SLOT(min_pump_off_sec),
+    CONFIG_SLOT(max_pump_off_sec),
+    CONFIG_SLOT(adaptive_sampling),
+};
+
+static const uint16_t ARRAY_OFFSETS[] = {
+    offsetof(Config, sensor_interval_ms),
+    offsetof(Config, sensor_offset_ms),
+    offsetof(Config, sensor_min_interval_ms),
+    offsetof(Config, sensor_max_interval_ms),
+};
+
+static const uint8_t SCALAR_KEYS = sizeof(SCALAR_SLOTS) / sizeof(SCALAR_SLOTS[0]);
+static const uint8_t ARRAY_KEY_BASE = 32;
+static const uint8_t ARRAY_KEY_STRIDE = 8;
+static const uint8_t ARRAYS = sizeof(ARRAY_OFFSETS) / sizeof(ARRAY_OFFSETS[0]);
+static const uint8_t KEY_END = ARRAY_KEY_BASE + ARRAYS * ARRAY_KEY_STRIDE;
+static const uint8_t MAX_DELTAS = SCALAR_KEYS + ARRAYS * SENSOR_COUNT;
+static_assert(SCALAR_KEYS <= ARRAY_KEY_BASE && SENSOR_COUNT <= ARRAY_KEY_STRIDE, "Journal keys overlap");
+
+// Config only ever grows at the end. The first firmware stored magic through
+// max_pump_off_sec (44 bytes); every snapshot since is that layout plus some
+// of the later fields, so any size in between loads as a prefix.
+static const uint32_t CONFIG_BASELINE_SIZE = offsetof(Config, sensor_interval_ms);
+static_assert(CONFIG_BASELINE_SIZE == 44, "Config fields must be appended, not inserted");
+
+static bool slotFor(uint8_t key, ConfigSlot* slot) {
+    if (key < ARRAY_KEY_BASE) {
+        if (key >= SCALAR_KEYS) return false;
+        *slot = SCALAR_SLOTS[key];
+        return true;
+    }
+    const uint8_t array = (key - ARRAY_KEY_BASE) / ARRAY_KEY_STRIDE;
+    const uint8_t sensor = (key - ARRAY_KEY_BASE) % ARRAY_KEY_STRIDE;
+    if (array >= ARRAYS || sensor >= SENSOR_COUNT) return false;
+    *slot = { (uint16_t)(ARRAY_OFFSETS[array] + sensor * sizeof(uint32_t)), sizeof(uint32_t) };
+    return true;
+}
+
+static uint16_t deltaCheck(const ConfigDelta& delta) {
+    ConfigDelta copy = delta;
+    copy.check = 0;
+    return (uint16_t)CrcUtils::crc32(&copy, sizeof(copy));
+}
 
 ConfigManager& ConfigManager::getInstance() {
     static ConfigManager instance;
     return instance;
 }
 
-ConfigManager::ConfigManager() {
+ConfigManager::ConfigManager()
+    : journal_records_(0), save_pending_(false), batch_seq_(0), save_due_ms_(0), save_deadline_ms_(0) {
     resetToDefaults();
+    toConfig(&persisted_);
 }
 
 void ConfigManager::resetToDefaults() {
@@ -23,94 +104,288 @@ void ConfigManager::resetToDefaults() {
     min_pump_run_sec_ = 30;
     min_pump_off_sec_ = 600;
     max_pump_off_sec_ = 3600;
+    
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        sensor_interval_ms_[i] = DEFAULT_SENSOR_INTERVAL_MS;
+        sensor_min_interval_ms_[i] = DEFAULT_SENSOR_MIN_INTERVAL_MS;
+        sensor_max_interval_ms_[i] = DEFAULT_SENSOR_MAX_INTERVAL_MS;
+    }
+    adaptive_sampling_ = DEFAULT_ADAPTIVE_SAMPLING;
+    sensor_offset_ms_[SENSOR_WATER_TEMP] = DEFAULT_WATER_TEMP_OFFSET_MS;
+    sensor_offset_ms_[SENSOR_TABLE_HUMIDITY] = DEFAULT_TABLE_HUMID_OFFSET_MS;
+    sensor_offset_ms_[SENSOR_AIR] = DEFAULT_AIR_OFFSET_MS;
+    sensor_offset_ms_[SENSOR_NANO] = DEFAULT_NANO_OFFSET_MS;
+}
+
+void ConfigManager::toConfig(Config* config) const {
+    memset(config, 0, sizeof(*config));
+    config->magic = EEPROM_MAGIC;
+    config->lights_start_s = lights_start_s_;
+    config->lights_end_s = lights_end_s_;
+    config->pump_on_sec = pump_on_sec_;
+    config->pump_period = pump_period_;
+    config->heater_setpoint_c = heater_setpoint_c_;
+    config->humidity_threshold = humidity_threshold_;
+    config->humidity_mode = humidity_mode_;
+    config->min_pump_run_sec = min_pump_run_sec_;
+    config->min_pump_off_sec = min_pump_off_sec_;
+    config->max_pump_off_sec = max_pump_off_sec_;
+    memcpy(config->sensor_interval_ms, sensor_interval_ms_, sizeof(config->sensor_interval_ms));
+    memcpy(config->sensor_offset_ms, sensor_offset_ms_, sizeof(config->sensor_offset_ms));
+    memcpy(config->sensor_min_interval_ms, sensor_min_interval_ms_, sizeof(config->sensor_min_interval_ms));
+    memcpy(config->sensor_max_interval_ms, sensor_max_interval_ms_, sizeof(config->sensor_max_interval_ms));
+    config->adaptive_sampling = adaptive_sampling_;
+    config->generation = persisted_.generation;
 }
 
 void ConfigManager::saveConfig() {
-    Config config;
-    config.magic = EEPROM_MAGIC;
-    config.lights_start_s = lights_start_s_;
-    config.lights_end_s = lights_end_s_;
-    config.pump_on_sec = pump_on_sec_;
-    config.pump_period = pump_period_;
-    config.heater_setpoint_c = heater_setpoint_c_;
-    config.humidity_threshold = humidity_threshold_;
-    config.humidity_mode = humidity_mode_;
-    config.min_pump_run_sec = min_pump_run_sec_;
-    config.min_pump_off_sec = min_pump_off_sec_;
-    config.max_pump_off_sec = max_pump_off_sec_;
-    
-    // Store config in LittleFS for wear leveling
+    // Each request pushes the write back, up to CONFIG_SAVE_MAX_DELAY_MS
+    // after the first, so a script's burst of changes costs one write
+    const uint64_t now = Clock::nowMs();
+    if (!save_pending_) {
+        save_deadline_ms_ = now + CONFIG_SAVE_MAX_DELAY_MS;
+    }
+    save_due_ms_ = now + CONFIG_SAVE_DELAY_MS;
+    if (save_due_ms_ > save_deadline_ms_) save_due_ms_ = save_deadline_ms_;
+    save_pending_ = true;
+}
+
+void ConfigManager::beginBatch() {
+    batch_seq_ = batch_seq_ + 1;
+    __dmb();
+}
+
+void ConfigManager::endBatch() {
+    __dmb();
+    batch_seq_ = batch_seq_ + 1;
+}
+
+void ConfigManager::update() {
+    if (!save_pending_ || !Clock::reachedMs(save_due_ms_)) return;
+    
+    // Copy the settings between batches: if core 0 was applying one, or
+    // started one meanwhile, try again on the next pass
+    const uint32_t seq = batch_seq_;
+    if (seq & 1) return;
+    __dmb();
+    Config current;
+    toConfig(&current);
+    __dmb();
+    if (batch_seq_ != seq) return;
+    
+    save_pending_ = false;
+    if (!appendJournal(current)) {
+        saveConfig();  // Try again after another delay
+    }
+}
+
+bool ConfigManager::appendJournal(const Config& current) {
+    // One record per field that differs from what flash holds
+    ConfigDelta records[MAX_DELTAS];
+    uint8_t count = 0;
+    for (uint8_t key = 0; key < KEY_END; key++) {
+        ConfigSlot slot;
+        if (!slotFor(key, &slot)) continue;
+        const uint8_t* now = (const uint8_t*)&current + slot.offset;
+        if (memcmp(now, (const uint8_t*)&persisted_ + slot.offset, slot.size) == 0) continue;
+        
+        ConfigDelta& delta = records[count++];
+        delta.key = key;
+        delta.generation = (uint8_t)persisted_.generation;
+        delta.value = 0;
+        memcpy(&delta.value, now, slot.size);
+        delta.check = deltaCheck(delta);
+    }
+    if (count == 0) return true;
+    
+    // Full journal: compact everything into a new snapshot instead
+    if (journal_records_ + count > CONFIG_JOURNAL_RECORDS) {
+        return writeSnapshot(current);
+    }
+    
     FlashStorage& fs = FlashStorage::getInstance();
-    if (!fs.uploadFile("/config.bin", (const uint8_t*)&config, sizeof(Config))) {
+    if (!fs.appendFile(CONFIG_JOURNAL_PATH, (const uint8_t*)records, count * sizeof(ConfigDelta))) {
+        printf("Failed to append to config journal\n");
+        return false;
+    }
+    
+    journal_records_ += count;
+    persisted_ = current;
+    printf("Config saved: %u changes journaled (%u/%u)\n", count, journal_records_, CONFIG_JOURNAL_RECORDS);
+    return true;
+}
+
+bool ConfigManager::writeSnapshot(const Config& current) {
+    Config snapshot = current;
+    snapshot.generation = persisted_.generation + 1;
+    
+    // LittleFS commits the file on close, so a reset leaves the old or the
+    // new snapshot. Records left in the journal carry the old generation and
+    // are skipped at boot even if the delete below is lost.
+    FlashStorage& fs = FlashStorage::getInstance();
+    if (!fs.uploadFile(CONFIG_FILE_PATH, (const uint8_t*)&snapshot, sizeof(Config))) {
         printf("Failed to save config to LittleFS\n");
-        return;
+        return false;
     }
+    fs.deleteFile(CONFIG_JOURNAL_PATH);
     
-    printf("Config saved to LittleFS\n");
+    journal_records_ = 0;
+    persisted_ = snapshot;
+    printf("Config saved: snapshot %" PRIu32 "\n", snapshot.generation);
+    return true;
 }
 
 bool ConfigManager::loadConfig() {
-    // Load config from LittleFS
+    // Defaults are the base while there is only a journal (no snapshot yet)
+    Config config;
+    toConfig(&config);
+    config.generation = 0;
+    
+    const bool have_snapshot = readSnapshot(&config);
+    const uint16_t replayed = replayJournal(&config);
+    persisted_ = config;
+    if (!have_snapshot && replayed == 0) {
+        printf("No valid config in LittleFS\n");
+        return false;
+    }
+    
+    applyConfig(config);
+    printf("Config loaded from LittleFS (snapshot %" PRIu32 ", %u journal records)\n", config.generation, replayed);
+    return true;
+}
+
+bool ConfigManager::readSnapshot(Config* config) {
     FlashStorage& fs = FlashStorage::getInstance();
     uint8_t* data = nullptr;
     uint32_t size = 0;
     
-    if (!fs.getFile("/config.bin", &data, &size, nullptr)) {
-        printf("No valid config in LittleFS\n");
+    if (!fs.getFile(CONFIG_FILE_PATH, &data, &size, nullptr)) {
         return false;
     }
     
-    if (size != sizeof(Config)) {
-        printf("Config size mismatch: %u vs %u\n", size, sizeof(Config));
+    if (size < CONFIG_BASELINE_SIZE || size > sizeof(Config)) {
+        printf("Config size mismatch: %" PRIu32 " vs %" PRIu32 "..%zu\n", size, CONFIG_BASELINE_SIZE, sizeof(Config));
         fs.freeFile(data);
         return false;
     }
     
-    const Config* config = (const Config*)data;
-    
     // Check magic number
-    if (config->magic != EEPROM_MAGIC) {
+    uint32_t magic;
+    memcpy(&magic, data, sizeof(magic));
+    if (magic != EEPROM_MAGIC) {
         printf("Invalid config magic\n");
         fs.freeFile(data);
         return false;
     }
     
-    // Validate and load lights schedule (seconds in a day: 0-86399)
-    if (config->lights_start_s < 86400 && config->lights_end_s < 86400) {
-        lights_start_s_ = config->lights_start_s;
-        lights_end_s_ = config->lights_end_s;
+    // Fields an older firmware did not store keep the caller's values
+    // (the defaults at boot, generation 0 for snapshots from before the
+    // journal); applyConfig() validates the result
+    memcpy(config, data, size);
+    fs.freeFile(data);
+    if (size < sizeof(Config)) {
+        printf("Config upgraded from a %" PRIu32 "-byte snapshot\n", size);
     }
+    return true;
+}
+
+uint16_t ConfigManager::replayJournal(Config* config) {
+    FlashStorage& fs = FlashStorage::getInstance();
+    const int32_t size = fs.getFileSize(CONFIG_JOURNAL_PATH);
+    journal_records_ = size > 0 ? size / sizeof(ConfigDelta) : 0;
+    if (size <= 0) return 0;
     
-    // Validate and load pump timing
-    if (config->pump_on_sec > 0 && config->pump_on_sec < config->pump_period && 
-        config->pump_period <= 7200) {  // Max 2 hour period
-        pump_on_sec_ = config->pump_on_sec;
-        pump_period_ = config->pump_period;
+    // Records are replayed in order, so the last value of a field wins. A
+    // bad check means an append was cut short: nothing after it is trusted.
+    uint16_t applied = 0;
+    bool damaged = size % sizeof(ConfigDelta) != 0;
+    ConfigDelta chunk[16];
+    for (int32_t offset = 0; offset < size && !damaged; offset += sizeof(chunk)) {
+        const int32_t n = fs.readFile(CONFIG_JOURNAL_PATH, offset, (uint8_t*)chunk, sizeof(chunk));
+        if (n <= 0) break;
+        
+        for (int32_t i = 0; i < n / (int32_t)sizeof(ConfigDelta); i++) {
+            const ConfigDelta& delta = chunk[i];
+            if (delta.check != deltaCheck(delta)) {
+                damaged = true;
+                break;
+            }
+            
+            // Unknown keys (newer firmware) and records from before the
+            // last snapshot are skipped
+            ConfigSlot slot;
+            if (!slotFor(delta.key, &slot) || delta.generation != (uint8_t)config->generation) continue;
+            memcpy((uint8_t*)config + slot.offset, &delta.value, slot.size);
+            applied++;
+        }
     }
     
-    if (config->heater_setpoint_c > -40 && config->heater_setpoint_c < 80) {
-        heater_setpoint_c_ = config->heater_setpoint_c;
+    if (damaged) {
+        // Appends after the damage would never be replayed; compact on the next save
+        printf("Config journal damaged after %u records\n", applied);
+        journal_records_ = CONFIG_JOURNAL_RECORDS;
+    }
+    return applied;
+}
+
+void ConfigManager::applyConfig(const Config& config) {
+    // Settings are checked against the field registry and the pair rules of
+    // SettingsBatch::validate, which every remote setter goes through, so
+    // whatever could be saved loads again. Values that fail keep their
+    // current setting.
+    if (Fields::inRange(FIELD_LIGHTS_START, config.lights_start_s) &&
+        Fields::inRange(FIELD_LIGHTS_END, config.lights_end_s) &&
+        config.lights_start_s != config.lights_end_s) {
+        lights_start_s_ = config.lights_start_s;
+        lights_end_s_ = config.lights_end_s;
+    }
+    
+    if (Fields::inRange(FIELD_PUMP_ON_SEC, config.pump_on_sec) &&
+        Fields::inRange(FIELD_PUMP_PERIOD, config.pump_period) &&
+        config.pump_on_sec < config.pump_period) {
+        pump_on_sec_ = config.pump_on_sec;
+        pump_period_ = config.pump_period;
     }
     
-    if (config->humidity_threshold >= 0 && config->humidity_threshold <= 100) {
-        humidity_threshold_ = config->humidity_threshold;
+    if (Fields::inRange(FIELD_HEATER_SETPOINT, config.heater_setpoint_c)) {
+        heater_setpoint_c_ = config.heater_setpoint_c;
     }
     
-    humidity_mode_ = config->humidity_mode;
+    if (Fields::inRange(FIELD_HUMIDITY_THRESHOLD, config.humidity_threshold)) {
+        humidity_threshold_ = config.humidity_threshold;
+    }
+    
+    humidity_mode_ = config.humidity_mode;
     
-    if (config->min_pump_run_sec >= 5 && config->min_pump_run_sec <= 300) {
-        min_pump_run_sec_ = config->min_pump_run_sec;
+    if (Fields::inRange(FIELD_MIN_PUMP_RUN, config.min_pump_run_sec)) {
+        min_pump_run_sec_ = config.min_pump_run_sec;
     }
     
-    if (config->min_pump_off_sec >= 60 && config->min_pump_off_sec <= 3600) {
-        min_pump_off_sec_ = config->min_pump_off_sec;
+    if (Fields::inRange(FIELD_MIN_PUMP_OFF, config.min_pump_off_sec) &&
+        Fields::inRange(FIELD_MAX_PUMP_OFF, config.max_pump_off_sec) &&
+        config.min_pump_off_sec <= config.max_pump_off_sec) {
+        min_pump_off_sec_ = config.min_pump_off_sec;
+        max_pump_off_sec_ = config.max_pump_off_sec;
     }
     
-    if (config->max_pump_off_sec >= 300 && config->max_pump_off_sec <= 7200) {
-        max_pump_off_sec_ = config->max_pump_off_sec;
+    // Validate and load sensor schedule (offset must lie within one period)
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        if (config.sensor_interval_ms[i] >= SENSOR_MIN_INTERVAL_MS &&
+            config.sensor_interval_ms[i] <= SENSOR_MAX_INTERVAL_MS &&
+            config.sensor_offset_ms[i] < config.sensor_interval_ms[i]) {
+            sensor_interval_ms_[i] = config.sensor_interval_ms[i];
+            sensor_offset_ms_[i] = config.sensor_offset_ms[i];
+        }
+        
+        // Adaptive bounds must bracket the nominal interval
+        if (config.sensor_min_interval_ms[i] >= SENSOR_MIN_INTERVAL_MS &&
+            config.sensor_max_interval_ms[i] <= SENSOR_MAX_INTERVAL_MS &&
+            config.sensor_min_interval_ms[i] <= sensor_interval_ms_[i] &&
+            config.sensor_max_interval_ms[i] >= sensor_interval_ms_[i]) {
+            sensor_min_interval_ms_[i] = config.sensor_min_interval_ms[i];
+            sensor_max_interval_ms_[i] = config.sensor_max_interval_ms[i];
+        }
     }
     
-    fs.freeFile(data);
-    printf("Config loaded from LittleFS\n");
-    return true;
+    adaptive_sampling_ = config.adaptive_sampling;
 }
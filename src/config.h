@@ -45,6 +45,7 @@ static const uint8_t NRF_ADDR_TDS[5] = {'T', 'D', 'S', 's', 'n'};  // TDS sensor
 #define WEB_PORT 80
 #define NTP_SERVER "192.168.0.1"
 #define TZSTR "AST4ADT,M3.2.0,M11.1.0"  // POSIX timezone string
+#define NODE_ID "pico-hydro"  // Names this controller in MQTT topics and UDP telemetry
 
 // Schedule defaults
 #define DEFAULT_LIGHTS_START_S (8 * 3600)   // 08:00
@@ -56,11 +57,136 @@ static const uint8_t NRF_ADDR_TDS[5] = {'T', 'D', 'S', 's', 'n'};  // TDS sensor
 #define DEFAULT_FAN_ON_TEMP_C  24.0
 #define DEFAULT_FAN_OFF_TEMP_C 15.0
 
+// Sensor sampling schedule (per-sensor period and phase offset)
+enum SensorId : uint8_t {
+    SENSOR_WATER_TEMP = 0,   // DS18B20 (1-Wire, 750ms conversion)
+    SENSOR_TABLE_HUMIDITY,   // SHT30 (I2C)
+    SENSOR_AIR,              // DHT22 (bit-banged with IRQs off)
+    SENSOR_NANO,             // NRF24L01 pH/TDS (SPI)
+    SENSOR_COUNT
+};
+
+#define DEFAULT_SENSOR_INTERVAL_MS     30000UL
+#define DEFAULT_WATER_TEMP_OFFSET_MS   0UL
+#define DEFAULT_TABLE_HUMID_OFFSET_MS  7500UL
+#define DEFAULT_AIR_OFFSET_MS          15000UL
+#define DEFAULT_NANO_OFFSET_MS         22500UL
+#define SENSOR_MIN_INTERVAL_MS         2000UL      // DHT22 minimum read interval
+#define SENSOR_MAX_INTERVAL_MS         3600000UL   // 1 hour
+#define SENSOR_BUS_GAP_MS              100UL       // Idle time between bus transactions
+
+// Relay bitmask (snapshot of actuator states)
+enum : uint8_t {
+    RELAY_LIGHTS = 1 << 0,
+    RELAY_PUMP   = 1 << 1,
+    RELAY_HEATER = 1 << 2,
+    RELAY_FAN    = 1 << 3,
+};
+
+// Adaptive sampling: effective period moves within [min, max] per sensor
+#define DEFAULT_ADAPTIVE_SAMPLING      true
+#define DEFAULT_SENSOR_MIN_INTERVAL_MS 10000UL
+#define DEFAULT_SENSOR_MAX_INTERVAL_MS 300000UL
+
+// Sensor history (RAM ring on core 1)
+#define HISTORY_INTERVAL_SEC           60UL
+#define HISTORY_HOURS                  48UL
+// +1: the slot being rewritten is never readable
+#define HISTORY_DEPTH                  (HISTORY_HOURS * 3600UL / HISTORY_INTERVAL_SEC + 1UL)
+#define HISTORY_RAM_BUDGET             (48UL * 1024UL)
+#define HISTORY_MAX_POINTS             2000        // Upper bound for LTTB points=N
+
+// Persistent time-series log (LittleFS /log/, written from core 1)
+#define LOG_DIR                        "/log"
+#define LOG_BLOCK_SIZE                 1024UL      // Max sealed block incl. header
+#define LOG_SEGMENT_SIZE               (64UL * 1024UL)
+#define LOG_BUDGET_BYTES               (1536UL * 1024UL)  // ~7 months; ~5.5 with pH/TDS (tools/log_block_sim.cpp)
+#define LOG_RETENTION_DAYS             366UL       // Age limit; the budget is normally reached first
+#define LOG_FLUSH_INTERVAL_SEC         (4UL * 3600UL)  // Bounds flash writes and loss on power cut
+
+// Rollup tiers beside the raw log: /log/r<seconds>.dat circular record files
+// (15 min x 14 days, 1 h x 92 days, 1 day x 5 years; ~430 KB together)
+#define ROLLUP_15MIN_RECORDS           1344UL
+#define ROLLUP_HOUR_RECORDS            2208UL
+#define ROLLUP_DAY_RECORDS             1830UL
+#define ROLLUP_PENDING_MAX             32          // Closed buckets held for one batched write
+
+// Telemetry store-and-forward spool (/spool/, core 1). Records are 28 bytes.
+#define TELEMETRY_SPOOL_DIR            "/spool"
+#define TELEMETRY_SPOOL_RECORDS        4096UL      // ~2.8 days offline at one sample/min (112 KB)
+#define TELEMETRY_SPOOL_BATCH          16          // Records staged in RAM per flash write
+#define TELEMETRY_REPLAY_BATCH         16          // Records per replay burst
+#define TELEMETRY_REPLAY_INTERVAL_MS   1000UL      // Gap between replay bursts
+#define TELEMETRY_SEQ_BLOCK            1024UL      // Sequence numbers reserved per state write
+#define TELEMETRY_MAX_SINKS            4
+
+// MQTT publisher (core 1). Topics live under MQTT_TOPIC_PREFIX "/" NODE_ID.
+// Off by default: an unreachable broker keeps its records in the flash spool.
+#define MQTT_ENABLED                   0
+#define MQTT_BROKER                    ""          // Broker IPv4 address, required with MQTT_ENABLED
+#define MQTT_PORT                      1883
+#define MQTT_TOPIC_PREFIX              "hydro"
+#define MQTT_KEEPALIVE_SEC             60
+#define MQTT_TICK_MS                   1000UL      // Channels changed within one tick go out together
+#define MQTT_HEARTBEAT_SEC             300UL       // Unchanged channels are republished this often
+#define MQTT_RECONNECT_MS              10000UL
+
+// UDP multicast telemetry: one datagram per spool record (core 1)
+#define TELEMETRY_UDP_ENABLED          0
+#define TELEMETRY_UDP_GROUP            "239.255.42.1"
+#define TELEMETRY_UDP_PORT             47294
+#define TELEMETRY_UDP_TTL              1           // Stay on the local subnet
+
+// Prometheus /metrics: counters fold into a snapshot once per window and the
+// text body is re-rendered at most once per snapshot
+#define METRICS_WINDOW_MS              5000UL
+#define METRICS_DUTY_WINDOW_SEC        3600UL      // Time constant of the relay duty average
+#define METRICS_CACHE_SIZE             6144        // Rendered exposition text
+
+// Core 0 stage profiling (PERF_SCOPE probes, `perf` and /api/perf);
+// 0 compiles the probes out
+#define PERF_ENABLED                   1
+
+// Per-core trace rings (TRACE_SCOPE events, `trace dump`); 0 compiles the
+// probes out
+#define TRACE_ENABLED                  1
+#define TRACE_RING_EVENTS              2048        // Per core, power of two (8 bytes each)
+
+// Deferred logging (LOG_* macros): per-core rings drained to USB by core 1
+#define LOG_RING_BYTES                 4096        // Per core
+#define LOG_MAX_PAYLOAD                96          // Argument bytes per record
+#define LOG_MAX_STRING                 48          // Longest %s argument kept
+#define LOG_DRAIN_RECORDS              8           // Per core, per core 1 loop pass
+#define LOG_DEFAULT_LEVEL              3           // LOG_LEVEL_INFO
+
+// Request-path memory: fixed pools instead of the heap (see `mem`)
+#define WEB_REQUEST_ARENA_BYTES        3072        // Per connection: response stream state
+#define TCP_REQUEST_ARENA_BYTES        3072        // Per connection: history/trace stream state
+#define JSON_POOL_BLOCK_BYTES          2048        // Largest JSON body (/api/perf)
+#define JSON_POOL_BLOCKS               2
+#define UPLOAD_POOL_BLOCK_BYTES        1024        // Upload data staged per flash write
+#define UPLOAD_POOL_BLOCKS             1
+#define REQUEST_RAM_BUDGET_BYTES       12288       // The build fails if the pools above exceed it
+
+// JSON request bodies (parsed on the stack, see utils/json.h)
+#define JSON_MAX_TOKENS                32          // Enough for a flat object of 15 members
+#define JSON_MAX_DEPTH                 4           // Nesting accepted in a body
+
 // Timing constants
-#define SENSOR_READ_INTERVAL_MS 30000UL
 #define STATUS_INTERVAL_MS 5000UL
+#define CONTROL_MAX_SLEEP_MS 1000UL   // Upper bound on one core 0 idle wait
+#define SETTINGS_APPLY_TIMEOUT_MS 250UL   // Longest a commit reply waits for the control loop
 #define HEATER_HYST_C 0.5f
 
+// Config persistence: saves are debounced, then append the changed fields to
+// a journal of small delta records; the full snapshot is only rewritten when
+// the journal is full
+#define CONFIG_FILE_PATH               "/config.bin"
+#define CONFIG_JOURNAL_PATH            "/config.jnl"
+#define CONFIG_JOURNAL_RECORDS         64          // 8 bytes each
+#define CONFIG_SAVE_DELAY_MS           2000UL      // Quiet time before a save is written
+#define CONFIG_SAVE_MAX_DELAY_MS       10000UL     // Upper bound while saves keep coming
+
 // Flash storage configuration
 struct Config {
     uint32_t magic;
@@ -74,6 +200,12 @@ struct Config {
     uint32_t min_pump_run_sec;
     uint32_t min_pump_off_sec;
     uint32_t max_pump_off_sec;
+    uint32_t sensor_interval_ms[SENSOR_COUNT];
+    uint32_t sensor_offset_ms[SENSOR_COUNT];
+    uint32_t sensor_min_interval_ms[SENSOR_COUNT];
+    uint32_t sensor_max_interval_ms[SENSOR_COUNT];
+    bool adaptive_sampling;
+    uint32_t generation;    // Snapshot number; journal records carry its low byte
 };
 
 // Configuration manager class
@@ -92,6 +224,11 @@ public:
     uint32_t getMinPumpRunSec() const { return min_pump_run_sec_; }
     uint32_t getMinPumpOffSec() const { return min_pump_off_sec_; }
     uint32_t getMaxPumpOffSec() const { return max_pump_off_sec_; }
+    uint32_t getSensorIntervalMs(SensorId id) const { return sensor_interval_ms_[id]; }
+    uint32_t getSensorOffsetMs(SensorId id) const { return sensor_offset_ms_[id]; }
+    uint32_t getSensorMinIntervalMs(SensorId id) const { return sensor_min_interval_ms_[id]; }
+    uint32_t getSensorMaxIntervalMs(SensorId id) const { return sensor_max_interval_ms_[id]; }
+    bool getAdaptiveSampling() const { return adaptive_sampling_; }
     
     // Configuration setters
     void setLightsStartS(uint32_t value) { lights_start_s_ = value; }
@@ -104,15 +241,38 @@ public:
     void setMinPumpRunSec(uint32_t value) { min_pump_run_sec_ = value; }
     void setMinPumpOffSec(uint32_t value) { min_pump_off_sec_ = value; }
     void setMaxPumpOffSec(uint32_t value) { max_pump_off_sec_ = value; }
+    void setSensorIntervalMs(SensorId id, uint32_t value) { sensor_interval_ms_[id] = value; }
+    void setSensorOffsetMs(SensorId id, uint32_t value) { sensor_offset_ms_[id] = value; }
+    void setSensorMinIntervalMs(SensorId id, uint32_t value) { sensor_min_interval_ms_[id] = value; }
+    void setSensorMaxIntervalMs(SensorId id, uint32_t value) { sensor_max_interval_ms_[id] = value; }
+    void setAdaptiveSampling(bool value) { adaptive_sampling_ = value; }
     
-    // Storage operations
+    // Storage operations. saveConfig() only schedules the write; update()
+    // (core 1 loop) persists the fields that changed once saves have been
+    // quiet for CONFIG_SAVE_DELAY_MS. loadConfig() reads the snapshot and
+    // replays the journal over it.
     void saveConfig();
     bool loadConfig();
     void resetToDefaults();
+    void update();
+    bool isSavePending() const { return save_pending_; }
+    
+    // Core 0 brackets a settings batch with these, so that update() never
+    // saves half of one (it retries on its next pass instead)
+    void beginBatch();
+    void endBatch();
+    uint16_t getJournalRecords() const { return journal_records_; }
     
 private:
     ConfigManager();
     
+    void toConfig(Config* config) const;
+    void applyConfig(const Config& config);   // Field by field, keeping values that fail validation
+    bool readSnapshot(Config* config);
+    uint16_t replayJournal(Config* config);   // Records applied
+    bool appendJournal(const Config& current);
+    bool writeSnapshot(const Config& current);
+    
     // Configuration values
     uint32_t lights_start_s_;
     uint32_t lights_end_s_;
@@ -124,4 +284,17 @@ private:
     uint32_t min_pump_run_sec_;
     uint32_t min_pump_off_sec_;
     uint32_t max_pump_off_sec_;
+    uint32_t sensor_interval_ms_[SENSOR_COUNT];
+    uint32_t sensor_offset_ms_[SENSOR_COUNT];
+    uint32_t sensor_min_interval_ms_[SENSOR_COUNT];
+    uint32_t sensor_max_interval_ms_[SENSOR_COUNT];
+    bool adaptive_sampling_;
+    
+    // Persistence state (core 1)
+    Config persisted_;              // What flash holds: snapshot plus journal
+    uint16_t journal_records_;
+    volatile bool save_pending_;
+    volatile uint32_t batch_seq_;   // Odd while core 0 applies a batch
+    uint64_t save_due_ms_;
+    uint64_t save_deadline_ms_;     // Written by then even if saves keep coming
 };
@@ -3,11 +3,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-// State structure for control channels
+// No scheduled transition: the channel only changes on sensor events
+#define NO_TRANSITION UINT64_MAX
+
+// State structure for control channels (times in Clock seconds since boot)
 struct ChannelState {
     bool is_on = false;
-    uint32_t next_start_time = 0;
-    uint32_t on_start_time = 0;
+    uint64_t next_start_time = 0;
+    uint64_t on_start_time = 0;
 };
 
 // Base class for all control systems
@@ -18,4 +21,7 @@ public:
     virtual void reset() = 0;
     virtual bool isOn() const = 0;
     virtual const char* getName() const = 0;
+    
+    // Earliest time_us_64() at which update() may switch the relay on its own
+    virtual uint64_t nextTransitionUs() const { return NO_TRANSITION; }
 };
@@ -1,6 +1,7 @@
 #include "fan_controller.h"
 #include "../sensors/sensor_manager.h"
 #include "../utils/gpio_utils.h"
+#include "../utils/log.h"
 #include "pico/stdlib.h"
 #include <stdio.h>
 
@@ -19,7 +20,7 @@ void FanController::update() {
             GpioUtils::setRelay(PIN_FAN, true);
             fan_on_ = true;
             fan_manual_control_ = false;
-            printf("Fan ON (temperature %.1f°C >= %.1f°C - uncontrollable)\n", temperature, FAN_ON_TEMP_C);
+            LOG_INFO(LOG_CONTROL, "Fan ON (temperature %.1f°C >= %.1f°C - uncontrollable)", temperature, FAN_ON_TEMP_C);
         }
     }
     // Below 15°C: uncontrollably OFF
@@ -28,7 +29,7 @@ void FanController::update() {
             GpioUtils::setRelay(PIN_FAN, false);
             fan_on_ = false;
             fan_manual_control_ = false;
-            printf("Fan OFF (temperature %.1f°C <= %.1f°C - uncontrollable)\n", temperature, FAN_OFF_TEMP_C);
+            LOG_INFO(LOG_CONTROL, "Fan OFF (temperature %.1f°C <= %.1f°C - uncontrollable)", temperature, FAN_OFF_TEMP_C);
         }
     }
     // Between 15-24°C: manual control zone (no automatic changes)
@@ -50,6 +51,6 @@ void FanController::setManualControl(bool on) {
         GpioUtils::setRelay(PIN_FAN, on);
         fan_on_ = on;
         fan_manual_control_ = true;
-        printf("Fan %s (manual control at %.1f°C)\n", on ? "ON" : "OFF", temperature);
+        LOG_INFO(LOG_CONTROL, "Fan %s (manual control at %.1f°C)", on ? "ON" : "OFF", temperature);
     }
 }
@@ -1,6 +1,8 @@
 #include "heater_controller.h"
 #include "../sensors/sensor_manager.h"
 #include "../utils/gpio_utils.h"
+#include "../utils/clock.h"
+#include "../utils/log.h"
 #include "pico/stdlib.h"
 #include <stdio.h>
 
@@ -21,12 +23,12 @@ void HeaterController::update() {
     if (should_be_on && !state_.is_on) {
         GpioUtils::setRelay(PIN_HEATER, true);
         state_.is_on = true;
-        state_.on_start_time = to_ms_since_boot(get_absolute_time()) / 1000;
-        printf("Heater ON\n");
+        state_.on_start_time = Clock::nowSec();
+        LOG_INFO(LOG_CONTROL, "Heater ON");
     } else if (!should_be_on && state_.is_on) {
         GpioUtils::setRelay(PIN_HEATER, false);
         state_.is_on = false;
-        printf("Heater OFF\n");
+        LOG_INFO(LOG_CONTROL, "Heater OFF");
     }
 }
 
@@ -41,4 +43,5 @@ void HeaterController::setSetpoint(float setpoint_c) {
     setpoint_c_ = setpoint_c;
     ConfigManager& config = ConfigManager::getInstance();
     config.setHeaterSetpointC(setpoint_c);
+    __sev();  // Apply the new setpoint without waiting for the next sample
 }
@@ -1,17 +1,30 @@
 #include "lights_controller.h"
 #include "../utils/gpio_utils.h"
+#include "../utils/clock.h"
+#include "../utils/log.h"
 #include "pico/stdlib.h"
 #include <stdio.h>
 
-LightsController::LightsController() {
+LightsController::LightsController() 
+    : next_edge_us_(0), plan_generation_(0), replan_(true) {
     ConfigManager& config = ConfigManager::getInstance();
     start_time_ = config.getLightsStartS();
     end_time_ = config.getLightsEndS();
 }
 
 void LightsController::update() {
+    // The window cannot change before the planned edge unless the wall clock
+    // was stepped or the schedule edited
+    const uint32_t generation = TimeUtils::getClockGeneration();
+    if (!replan_ && generation == plan_generation_ && Clock::nowUs() < next_edge_us_) return;
+    replan_ = false;
+    plan_generation_ = generation;
+    
     uint32_t current_seconds = TimeUtils::getSecondsFromMidnight();
-    if (current_seconds == 0) return;  // No time available
+    if (current_seconds == 0) {  // No time available
+        next_edge_us_ = Clock::nowUs() + 1000000ULL;
+        return;
+    }
     
     bool should_be_on = (start_time_ <= end_time_)
         ? (current_seconds >= start_time_ && current_seconds < end_time_)
@@ -20,25 +33,30 @@ void LightsController::update() {
     if (should_be_on && !state_.is_on) {
         GpioUtils::setRelay(PIN_LIGHTS, true);
         state_.is_on = true;
-        state_.on_start_time = to_ms_since_boot(get_absolute_time()) / 1000;
-        printf("Lights ON\n");
+        state_.on_start_time = Clock::nowSec();
+        LOG_INFO(LOG_CONTROL, "Lights ON");
     } else if (!should_be_on && state_.is_on) {
         GpioUtils::setRelay(PIN_LIGHTS, false);
         state_.is_on = false;
-        printf("Lights OFF\n");
+        LOG_INFO(LOG_CONTROL, "Lights OFF");
     }
+    
+    next_edge_us_ = TimeUtils::nextLocalTimeUs(should_be_on ? end_time_ : start_time_);
 }
 
 void LightsController::reset() {
     state_.is_on = false;
     state_.next_start_time = 0;
     state_.on_start_time = 0;
+    replan_ = true;
     GpioUtils::setRelay(PIN_LIGHTS, false);
 }
 
 void LightsController::setSchedule(uint32_t start_s, uint32_t end_s) {
     start_time_ = start_s;
     end_time_ = end_s;
+    replan_ = true;
+    __sev();  // Core 0 may be sleeping until the old edge
     
     // Update configuration
     ConfigManager& config = ConfigManager::getInstance();
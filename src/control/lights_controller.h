@@ -12,6 +12,7 @@ public:
     void reset() override;
     bool isOn() const override { return state_.is_on; }
     const char* getName() const override { return "Lights"; }
+    uint64_t nextTransitionUs() const override { return next_edge_us_; }
     
     // Configuration access
     void setSchedule(uint32_t start_s, uint32_t end_s);
@@ -22,4 +23,9 @@ private:
     ChannelState state_;
     uint32_t start_time_;
     uint32_t end_time_;
+    
+    // Planned edge; re-planned when reached, on a clock step or new schedule
+    uint64_t next_edge_us_;
+    uint32_t plan_generation_;
+    volatile bool replan_;
 };
@@ -1,6 +1,8 @@
 #include "pump_controller.h"
 #include "../sensors/sensor_manager.h"
 #include "../utils/gpio_utils.h"
+#include "../utils/clock.h"
+#include "../utils/log.h"
 #include "pico/stdlib.h"
 #include <stdio.h>
 
@@ -24,8 +26,33 @@ void PumpController::update() {
     }
 }
 
+uint64_t PumpController::nextTransitionUs() const {
+    const uint64_t now = Clock::nowSec();
+    uint64_t edge_sec;
+    
+    if (humidity_mode_ && sensor_manager_->isHumidityValid()) {
+        // Humidity decides on each sample; only the timing limits fall due on their own
+        if (state_.is_on) {
+            edge_sec = state_.on_start_time + min_run_sec_;
+        } else if (state_.next_start_time == 0) {
+            return NO_TRANSITION;
+        } else if (state_.next_start_time > now) {
+            edge_sec = state_.next_start_time;
+        } else {
+            edge_sec = state_.next_start_time - min_off_sec_ + max_off_sec_;
+        }
+        if (edge_sec <= now) return NO_TRANSITION;
+    } else {
+        // Timer mode (or fallback): the whole cycle is known in advance
+        edge_sec = state_.is_on ? state_.on_start_time + on_time_ : state_.next_start_time;
+    }
+    
+    // Clock seconds are whole timer seconds, so the edge is exact
+    return edge_sec * 1000000ULL;
+}
+
 void PumpController::updateTimerMode() {
-    uint32_t current_time = to_ms_since_boot(get_absolute_time()) / 1000;
+    const uint64_t current_time = Clock::nowSec();
     
     if (!state_.is_on) {
         if (state_.next_start_time == 0) {
@@ -36,20 +63,20 @@ void PumpController::updateTimerMode() {
             GpioUtils::setRelay(PIN_PUMP, true);
             state_.is_on = true;
             state_.on_start_time = current_time;
-            printf("Pump ON (timer mode)\n");
+            LOG_INFO(LOG_CONTROL, "Pump ON (timer mode)");
         }
     } else {
         if (current_time - state_.on_start_time >= on_time_) {
             GpioUtils::setRelay(PIN_PUMP, false);
             state_.is_on = false;
             state_.next_start_time = current_time + (period_ - on_time_);
-            printf("Pump OFF (timer mode) - next start in %u seconds\n", period_ - on_time_);
+            LOG_INFO(LOG_CONTROL, "Pump OFF (timer mode) - next start in %u seconds", period_ - on_time_);
         }
     }
 }
 
 void PumpController::updateHumidityMode() {
-    uint32_t current_time = to_ms_since_boot(get_absolute_time()) / 1000;
+    const uint64_t current_time = Clock::nowSec();
     
     if (!sensor_manager_->isHumidityValid()) {
         // No humidity data - fall back to timer mode
@@ -62,14 +89,14 @@ void PumpController::updateHumidityMode() {
                 GpioUtils::setRelay(PIN_PUMP, true);
                 state_.is_on = true;
                 state_.on_start_time = current_time;
-                printf("Pump ON (timer fallback - no humidity data)\n");
+                LOG_INFO(LOG_CONTROL, "Pump ON (timer fallback - no humidity data)");
             }
         } else {
             if (current_time - state_.on_start_time >= on_time_) {
                 GpioUtils::setRelay(PIN_PUMP, false);
                 state_.is_on = false;
                 state_.next_start_time = current_time + (period_ - on_time_);
-                printf("Pump OFF (timer fallback) - next start in %u seconds\n", period_ - on_time_);
+                LOG_INFO(LOG_CONTROL, "Pump OFF (timer fallback) - next start in %u seconds", period_ - on_time_);
             }
         }
         return;
@@ -94,16 +121,16 @@ void PumpController::updateHumidityMode() {
         state_.is_on = true;
         state_.on_start_time = current_time;
         if (maxOffTimeExceeded) {
-            printf("Pump ON (SAFETY - max off time exceeded) - %.1f%%\n", humidity);
+            LOG_INFO(LOG_CONTROL, "Pump ON (SAFETY - max off time exceeded) - %.1f%%", humidity);
         } else {
-            printf("Pump ON (humidity control) - %.1f%% < %.1f%% (threshold)\n", humidity, humidity_threshold_);
+            LOG_INFO(LOG_CONTROL, "Pump ON (humidity control) - %.1f%% < %.1f%% (threshold)", humidity, humidity_threshold_);
         }
     } else if (!should_be_on && state_.is_on && minRunTimeElapsed) {
         GpioUtils::setRelay(PIN_PUMP, false);
         state_.is_on = false;
         state_.next_start_time = current_time + min_off_sec_;
-        printf("Pump OFF (humidity control) - %.1f%% >= %.1f%% (threshold), next start: %ds\n", 
-               humidity, humidity_threshold_, min_off_sec_);
+        LOG_INFO(LOG_CONTROL, "Pump OFF (humidity control) - %.1f%% >= %.1f%% (threshold), next start: %ds", 
+                 humidity, humidity_threshold_, min_off_sec_);
     }
 }
 
@@ -112,6 +139,7 @@ void PumpController::reset() {
     state_.next_start_time = 0;
     state_.on_start_time = 0;
     GpioUtils::setRelay(PIN_PUMP, false);
+    __sev();
 }
 
 void PumpController::setTiming(uint32_t on_sec, uint32_t period_sec) {
@@ -121,11 +149,15 @@ void PumpController::setTiming(uint32_t on_sec, uint32_t period_sec) {
     ConfigManager& config = ConfigManager::getInstance();
     config.setPumpOnSec(on_sec);
     config.setPumpPeriod(period_sec);
+    __sev();  // Core 0 may be sleeping until an edge of the old cycle
 }
 
 void PumpController::setHumidityMode(bool enabled) {
-    humidity_mode_ = enabled;
+    // Restating the current mode must not cut a running cycle short
     ConfigManager& config = ConfigManager::getInstance();
+    if (enabled == humidity_mode_ && enabled == config.getHumidityMode()) return;
+    
+    humidity_mode_ = enabled;
     config.setHumidityMode(enabled);
     
     // Reset pump state when switching modes
@@ -136,22 +168,26 @@ void PumpController::setHumidityThreshold(float threshold) {
     humidity_threshold_ = threshold;
     ConfigManager& config = ConfigManager::getInstance();
     config.setHumidityThreshold(threshold);
+    __sev();
 }
 
 void PumpController::setMinRunTime(uint32_t seconds) {
     min_run_sec_ = seconds;
     ConfigManager& config = ConfigManager::getInstance();
     config.setMinPumpRunSec(seconds);
+    __sev();
 }
 
 void PumpController::setMinOffTime(uint32_t seconds) {
     min_off_sec_ = seconds;
     ConfigManager& config = ConfigManager::getInstance();
     config.setMinPumpOffSec(seconds);
+    __sev();
 }
 
 void PumpController::setMaxOffTime(uint32_t seconds) {
     max_off_sec_ = seconds;
     ConfigManager& config = ConfigManager::getInstance();
     config.setMaxPumpOffSec(seconds);
+    __sev();
 }
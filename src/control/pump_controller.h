@@ -13,6 +13,7 @@ public:
     void reset() override;
     bool isOn() const override { return state_.is_on; }
     const char* getName() const override { return "Pump"; }
+    uint64_t nextTransitionUs() const override;
     
     // Configuration access
     void setTiming(uint32_t on_sec, uint32_t period_sec);
@@ -0,0 +1,154 @@
+#include "settings_batch.h"
+#include "lights_controller.h"
+#include "pump_controller.h"
+#include "heater_controller.h"
+#include "../config.h"
+#include "../utils/log.h"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include <stdio.h>
+#include <math.h>
+
+bool SettingsBatch::set(FieldId id, float value) {
+    if (id >= FIELD_COUNT || !(Fields::info(id).group & FIELD_CONFIG)) return false;
+    mask_ |= 1UL << id;
+    value_[id] = value;
+    return true;
+}
+
+uint8_t SettingsBatch::count() const {
+    uint8_t n = 0;
+    for (uint32_t m = mask_; m; m &= m - 1) n++;
+    return n;
+}
+
+void SettingsBatch::merge(const SettingsBatch& other) {
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        if (other.has((FieldId)i)) set((FieldId)i, other.value_[i]);
+    }
+}
+
+float SettingsBatch::effective(FieldId id) const {
+    if (has(id)) return value_[id];
+    
+    ConfigManager& config = ConfigManager::getInstance();
+    switch (id) {
+        case FIELD_LIGHTS_START: return config.getLightsStartS();
+        case FIELD_LIGHTS_END: return config.getLightsEndS();
+        case FIELD_PUMP_ON_SEC: return config.getPumpOnSec();
+        case FIELD_PUMP_PERIOD: return config.getPumpPeriod();
+        case FIELD_HEATER_SETPOINT: return config.getHeaterSetpointC();
+        case FIELD_HUMIDITY_THRESHOLD: return config.getHumidityThreshold();
+        case FIELD_HUMIDITY_MODE: return config.getHumidityMode() ? 1.0f : 0.0f;
+        case FIELD_MIN_PUMP_RUN: return config.getMinPumpRunSec();
+        case FIELD_MIN_PUMP_OFF: return config.getMinPumpOffSec();
+        case FIELD_MAX_PUMP_OFF: return config.getMaxPumpOffSec();
+        default: return 0.0f;
+    }
+}
+
+bool SettingsBatch::validateFields(char* error, size_t size) const {
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        const FieldId id = (FieldId)i;
+        if (!has(id)) continue;
+    
+        const FieldInfo& f = Fields::info(id);
+        if (!Fields::inRange(id, value_[i])) {
+            snprintf(error, size, "%s out of range (%g..%g%s)", f.label, f.min, f.max, f.unit);
+            return false;
+        }
+        if (f.kind != FIELD_FLOAT && value_[i] != floorf(value_[i])) {
+            snprintf(error, size, "%s must be a whole number", f.label);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SettingsBatch::validate(char* error, size_t size) const {
+    if (isEmpty()) {
+        snprintf(error, size, "No settings in the batch");
+        return false;
+    }
+    if (!validateFields(error, size)) return false;
+    
+    if (effective(FIELD_PUMP_ON_SEC) >= effective(FIELD_PUMP_PERIOD)) {
+        snprintf(error, size, "Pump on time must be shorter than the period");
+        return false;
+    }
+    if (effective(FIELD_MIN_PUMP_OFF) > effective(FIELD_MAX_PUMP_OFF)) {
+        snprintf(error, size, "Min pump off time exceeds the max");
+        return false;
+    }
+    if (effective(FIELD_LIGHTS_START) == effective(FIELD_LIGHTS_END)) {
+        snprintf(error, size, "Lights window duration cannot be zero");
+        return false;
+    }
+    return true;
+}
+
+void SettingsBatch::apply(LightsController* lights, PumpController* pump, HeaterController* heater) const {
+    if (has(FIELD_LIGHTS_START) || has(FIELD_LIGHTS_END)) {
+        lights->setSchedule((uint32_t)effective(FIELD_LIGHTS_START), (uint32_t)effective(FIELD_LIGHTS_END));
+    }
+    if (has(FIELD_PUMP_ON_SEC) || has(FIELD_PUMP_PERIOD)) {
+        pump->setTiming((uint32_t)effective(FIELD_PUMP_ON_SEC), (uint32_t)effective(FIELD_PUMP_PERIOD));
+    }
+    if (has(FIELD_HEATER_SETPOINT)) heater->setSetpoint(value_[FIELD_HEATER_SETPOINT]);
+    if (has(FIELD_HUMIDITY_THRESHOLD)) pump->setHumidityThreshold(value_[FIELD_HUMIDITY_THRESHOLD]);
+    if (has(FIELD_MIN_PUMP_RUN)) pump->setMinRunTime((uint32_t)value_[FIELD_MIN_PUMP_RUN]);
+    if (has(FIELD_MIN_PUMP_OFF)) pump->setMinOffTime((uint32_t)value_[FIELD_MIN_PUMP_OFF]);
+    if (has(FIELD_MAX_PUMP_OFF)) pump->setMaxOffTime((uint32_t)value_[FIELD_MAX_PUMP_OFF]);
+    
+    // Last: switching modes resets the pump cycle, which should start from
+    // the new timing
+    if (has(FIELD_HUMIDITY_MODE)) pump->setHumidityMode(value_[FIELD_HUMIDITY_MODE] != 0.0f);
+}
+
+SettingsCommit& SettingsCommit::getInstance() {
+    static SettingsCommit instance;
+    return instance;
+}
+
+SettingsCommit::SettingsCommit() : has_pending_(false), submitted_seq_(0), applied_seq_(0), save_seq_(0) {
+    critical_section_init(&lock_);
+}
+
+uint32_t SettingsCommit::submit(const SettingsBatch& batch, bool persist) {
+    uint32_t seq = 0;
+    critical_section_enter_blocking(&lock_);
+    if (!has_pending_) {
+        pending_ = batch;
+        has_pending_ = true;
+        seq = ++submitted_seq_;
+    }
+    critical_section_exit(&lock_);
+    
+    if (seq && persist) save_seq_ = seq;
+    if (seq) __sev();  // Core 0 may be sleeping until its next edge
+    return seq;
+}
+
+bool SettingsCommit::applyPending(LightsController* lights, PumpController* pump, HeaterController* heater) {
+    if (!has_pending_) return false;
+    
+    critical_section_enter_blocking(&lock_);
+    SettingsBatch batch = pending_;
+    const uint32_t seq = submitted_seq_;
+    has_pending_ = false;
+    critical_section_exit(&lock_);
+    
+    ConfigManager& config = ConfigManager::getInstance();
+    config.beginBatch();
+    batch.apply(lights, pump, heater);
+    config.endBatch();
+    applied_seq_ = seq;
+    LOG_INFO(LOG_CONTROL, "Settings batch %lu applied (%u settings)", seq, batch.count());
+    return true;
+}
+
+void SettingsCommit::update() {
+    if (save_seq_ == 0 || (int32_t)(applied_seq_ - save_seq_) < 0) return;
+    save_seq_ = 0;
+    ConfigManager::getInstance().saveConfig();
+}
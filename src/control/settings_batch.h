@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "pico/critical_section.h"
+#include "../telemetry_fields.h"
+
+class LightsController;
+class PumpController;
+class HeaterController;
+
+static_assert(FIELD_COUNT <= 32, "SettingsBatch keeps one mask bit per field");
+
+// A set of settings (registry FIELD_CONFIG fields) that is checked and
+// applied as a whole: either every value goes in at the same control pass
+// or none does
+class SettingsBatch {
+public:
+    SettingsBatch() { clear(); }
+    
+    void clear() { mask_ = 0; }
+    
+    // False if id is not a setting
+    bool set(FieldId id, float value);
+    bool has(FieldId id) const { return (mask_ >> id) & 1U; }
+    float get(FieldId id) const { return value_[id]; }
+    uint8_t count() const;
+    bool isEmpty() const { return mask_ == 0; }
+    
+    // Add every setting of other, replacing values already set
+    void merge(const SettingsBatch& other);
+    
+    // Ranges and whole numbers where the field is one, each field alone
+    bool validateFields(char* error, size_t size) const;
+    
+    // validateFields() plus the rules between fields (pump on < period, min
+    // off <= max off, lights window not empty) against the current config
+    // for settings left out. On failure, a message for the client goes to
+    // error. Every path that changes a setting checks it here, so anything
+    // accepted also passes ConfigManager's load-time validation.
+    bool validate(char* error, size_t size) const;
+    
+    // Core 0, between control passes
+    void apply(LightsController* lights, PumpController* pump, HeaterController* heater) const;
+    
+private:
+    // Batch value if set, else the current config value
+    float effective(FieldId id) const;
+    
+    uint32_t mask_;
+    float value_[FIELD_COUNT];
+};
+
+// Hands a validated batch from the network core to the control loop, which
+// applies it before the controllers' next update()
+class SettingsCommit {
+public:
+    static SettingsCommit& getInstance();
+    
+    // Core 1: queue a batch; its sequence number, or 0 while an earlier
+    // batch is still waiting. With persist, update() schedules a config save
+    // once core 0 has applied it, however long that takes.
+    uint32_t submit(const SettingsBatch& batch, bool persist);
+    
+    // Core 1: core 0 has applied batch seq. Servers poll this from the core 1
+    // loop (see SETTINGS_APPLY_TIMEOUT_MS) rather than wait in a callback.
+    bool isApplied(uint32_t seq) const { return (int32_t)(applied_seq_ - seq) >= 0; }
+    
+    // Core 0, at the top of each pass; true if a batch was applied
+    bool applyPending(LightsController* lights, PumpController* pump, HeaterController* heater);
+    
+    // Core 1 loop: hands applied batches that asked for it to saveConfig()
+    void update();
+    
+private:
+    SettingsCommit();
+    
+    critical_section_t lock_;
+    SettingsBatch pending_;
+    volatile bool has_pending_;
+    uint32_t submitted_seq_;
+    volatile uint32_t applied_seq_;
+    uint32_t save_seq_;     // Batch to save once applied (0: none); core 1 only
+};
@@ -6,15 +6,28 @@
 
 #include "hydroponic_controller.h"
 #include "sensors/sensor_manager.h"
+#include "sensors/sensor_history.h"
+#include "storage/timeseries_log.h"
+#include "storage/rollup_store.h"
+#include "network/telemetry_spool.h"
 #include "network/network_manager.h"
 #include "network/tcp_server.h"
 #include "network/web_server.h"
+#include "network/mqtt_client.h"
+#include "network/udp_telemetry.h"
 #include "control/lights_controller.h"
 #include "control/pump_controller.h"
 #include "control/heater_controller.h"
 #include "control/fan_controller.h"
+#include "control/settings_batch.h"
 #include "utils/gpio_utils.h"
 #include "utils/time_utils.h"
+#include "utils/clock.h"
+#include "utils/metrics.h"
+#include "utils/perf.h"
+#include "utils/log.h"
+#include "telemetry_fields.h"
+#include "utils/mem_stats.h"
 #include "config.h"
 
 HydroponicController::HydroponicController() 
@@ -22,10 +35,13 @@ HydroponicController::HydroponicController()
       network_manager_(nullptr),
       tcp_server_(nullptr),
       web_server_(nullptr),
+      mqtt_client_(nullptr),
+      udp_telemetry_(nullptr),
       lights_controller_(nullptr),
       pump_controller_(nullptr),
       heater_controller_(nullptr),
       fan_controller_(nullptr),
+      last_relay_mask_(0),
       last_status_print_ms_(0),
       core1_initialized_(false) {
 }
@@ -37,6 +53,12 @@ HydroponicController::~HydroponicController() {
     if (web_server_) {
         delete web_server_;
     }
+    if (mqtt_client_) {
+        delete mqtt_client_;
+    }
+    if (udp_telemetry_) {
+        delete udp_telemetry_;
+    }
     if (lights_controller_) {
         delete lights_controller_;
     }
@@ -55,7 +77,11 @@ HydroponicController::~HydroponicController() {
 }
 
 void HydroponicController::begin() {
+    MemStats::begin();
     stdio_init_all();
+    Clock::tick();
+    multicore_lockout_victim_init();  // Parked while core 1 writes flash
+    Perf::begin();
     printf("\n=== Pico 2 W Hydroponic Controller Starting ===\n");
     printf("=== Dual-Core Architecture Enabled ===\n");
     printf("Core 0: Control loop and sensors\n");
@@ -66,13 +92,13 @@ void HydroponicController::begin() {
     GpioUtils::setAllRelaysOff();
     printf("GPIO initialized\n");
     
-    // Initialize components
-    initializeComponents();
-    
-    // Try to load config from flash
+    // Load config from flash before components take their settings from it
     ConfigManager& config = ConfigManager::getInstance();
     config.loadConfig();
     
+    // Initialize components
+    initializeComponents();
+    
     printf("Controller ready\n");
     
     // Print initial configuration
@@ -95,24 +121,81 @@ void HydroponicController::loop() {
 
 void HydroponicController::core0Loop() {
     // Core 0: Critical control loop and sensor reading
+    Clock::tick();
     
-    // Read sensors
-    sensor_manager_->readTemperature();
-    sensor_manager_->readHumidity();
-    sensor_manager_->readAirSensor();
-    sensor_manager_->readNanoADCs();
+    {
+        PERF_SCOPE(PERF_LOOP);
+        TRACE_SCOPE(TRACE_LOOP);
+        
+        // Settings committed on core 1 land together, before any controller runs
+        SettingsCommit::getInstance().applyPending(lights_controller_, pump_controller_, heater_controller_);
+        
+        // Read sensors (staggered schedule, one bus transaction per iteration)
+        PERF_STAGE(PERF_SENSORS, sensor_manager_->update());
+        
+        // Update control logic
+        PERF_STAGE(PERF_LIGHTS, lights_controller_->update());
+        PERF_STAGE(PERF_PUMP, pump_controller_->update());
+        PERF_STAGE(PERF_HEATER, heater_controller_->update());
+        PERF_STAGE(PERF_FAN, fan_controller_->update());
+        
+        // An actuator switching means the sensor it drives is about to move
+        uint8_t relays = getRelayMask();
+        uint8_t changed = relays ^ last_relay_mask_;
+        if (changed & RELAY_PUMP) {
+            sensor_manager_->notifyActuatorTransition(SENSOR_TABLE_HUMIDITY);
+        }
+        if (changed & RELAY_HEATER) {
+            sensor_manager_->notifyActuatorTransition(SENSOR_WATER_TEMP);
+        }
+        if (changed & (RELAY_FAN | RELAY_LIGHTS)) {
+            sensor_manager_->notifyActuatorTransition(SENSOR_AIR);
+        }
+        last_relay_mask_ = relays;
+    }
     
-    // Update control logic
-    lights_controller_->update();
-    pump_controller_->update();
-    heater_controller_->update();
-    fan_controller_->update();
+    Metrics::getInstance().recordLoop((uint32_t)(time_us_64() - Clock::nowUs()));
+    waitForNextEvent();
+}
+
+void HydroponicController::waitForNextEvent() {
+    // Nothing changes on core 0 between sensor due times and scheduled relay
+    // edges, so sleep until the earliest one. best_effort_wfe_or_timeout arms
+    // a hardware timer alarm; core 1 issues __sev() (directly, or via
+    // mutex_exit) after changing settings so new schedules apply at once.
+    uint64_t wake_us = sensor_manager_->getNextWakeMs() * 1000ULL;
     
-    tight_loop_contents();
+    ControlBase* controllers[] = { lights_controller_, pump_controller_,
+                                   heater_controller_, fan_controller_ };
+    for (ControlBase* controller : controllers) {
+        uint64_t edge_us = controller->nextTransitionUs();
+        if (edge_us < wake_us) wake_us = edge_us;
+    }
+    
+    const uint64_t limit_us = Clock::nowUs() + CONTROL_MAX_SLEEP_MS * 1000ULL;
+    if (wake_us > limit_us) wake_us = limit_us;
+    if (wake_us <= time_us_64()) return;
+    
+    best_effort_wfe_or_timeout(from_us_since_boot(wake_us));
+}
+
+uint8_t HydroponicController::getRelayMask() const {
+    uint8_t mask = 0;
+    if (lights_controller_->isOn()) mask |= RELAY_LIGHTS;
+    if (pump_controller_->isOn()) mask |= RELAY_PUMP;
+    if (heater_controller_->isOn()) mask |= RELAY_HEATER;
+    if (fan_controller_->isOn()) mask |= RELAY_FAN;
+    return mask;
 }
 
 void HydroponicController::core1Entry() {
+    MemStats::paintStack();
     printf("Core 1 started\n");
+    Clock::tick();
+    // Once running, core 1 owns flash writes (config saves, log, spool) and
+    // parks core 0 for them; core 0 only writes during begin(), before this
+    // core starts. Kept so a stray core 0 write still parks core 1.
+    multicore_lockout_victim_init();
     core1_initialized_ = true;
     
     while (true) {
@@ -122,26 +205,74 @@ void HydroponicController::core1Entry() {
 
 void HydroponicController::core1Loop() {
     // Core 1: Network management and servers
+    Clock::tick();
     
     // Network management
     network_manager_->update();
     
+    // Minute history: RAM ring plus the persistent log
+    updateHistory();
+    
+    // Telemetry backlog replay after an outage
+    TelemetrySpool::getInstance().update();
+    
     // Handle network clients
     if (network_manager_->isConnected()) {
         tcp_server_->handleClients();
         web_server_->handleClients();
     }
     
+    // MQTT: connection upkeep, commands, changed channels
+    if (mqtt_client_) {
+        mqtt_client_->update(getRelayMask());
+    }
+    
+    // Saves asked for by applied settings batches, then the debounced
+    // config write (journal append or snapshot compaction)
+    SettingsCommit::getInstance().update();
+    ConfigManager::getInstance().update();
+    
     // Print status periodically
     printStatusTable();
     
+    // Format the deferred log records from both cores
+    Log::drain(LOG_DRAIN_RECORDS);
+    
+    Metrics& metrics = Metrics::getInstance();
+    metrics.update(getRelayMask());
+    metrics.recordLoop((uint32_t)(time_us_64() - Clock::nowUs()));
+    
     tight_loop_contents();
 }
 
+void HydroponicController::updateHistory() {
+    SensorHistory& history = SensorHistory::getInstance();
+    TimeSeriesLog& log = TimeSeriesLog::getInstance();
+    RollupStore& rollups = RollupStore::getInstance();
+    
+    if (history.update(getRelayMask())) {
+        // Only samples with a wall-clock time are persisted
+        LogSample sample;
+        uint32_t seq = history.getNextSeq() - 1;
+        sample.time = (uint32_t)history.epochForSeq(seq);
+        if (sample.time != 0 && history.getSample(seq, sample.values)) {
+            log.append(sample);
+            rollups.add(sample);
+            TelemetrySpool::getInstance().submit(sample);
+        }
+    }
+    log.update();
+    rollups.update();
+}
+
 void HydroponicController::initializeComponents() {
     // Initialize sensor manager
     sensor_manager_ = new SensorManager();
     sensor_manager_->initialize();
+    SensorHistory::getInstance().begin(sensor_manager_);
+    TimeSeriesLog::getInstance().begin();
+    RollupStore::getInstance().begin();
+    TelemetrySpool::getInstance().begin();
     
     // Initialize network manager
     network_manager_ = &NetworkManager::getInstance();
@@ -152,6 +283,7 @@ void HydroponicController::initializeComponents() {
     pump_controller_ = new PumpController(sensor_manager_);
     heater_controller_ = new HeaterController(sensor_manager_);
     fan_controller_ = new FanController(sensor_manager_);
+    SettingsCommit::getInstance();  // Lock set up before core 1 can submit
     
     // Initialize network servers
     tcp_server_ = new TcpServer(sensor_manager_, lights_controller_, 
@@ -159,6 +291,21 @@ void HydroponicController::initializeComponents() {
     web_server_ = new WebServer(sensor_manager_, lights_controller_, 
                                 pump_controller_, heater_controller_, fan_controller_);
     
+#if MQTT_ENABLED
+    static_assert(sizeof(MQTT_BROKER) > 1, "MQTT_ENABLED needs MQTT_BROKER set");
+    // Connects from the core 1 loop once WiFi is up
+    mqtt_client_ = new MqttClient(lights_controller_, pump_controller_,
+                                  heater_controller_, fan_controller_);
+    TelemetrySpool::getInstance().addSink(mqtt_client_);
+#endif
+    
+#if TELEMETRY_UDP_ENABLED
+    udp_telemetry_ = new UdpTelemetry();
+    if (udp_telemetry_->begin()) {
+        TelemetrySpool::getInstance().addSink(udp_telemetry_);
+    }
+#endif
+    
     if (network_manager_->isConnected()) {
         tcp_server_->start();
         web_server_->start();
@@ -166,59 +313,30 @@ void HydroponicController::initializeComponents() {
 }
 
 void HydroponicController::printStatusTable() {
-    const uint32_t now = to_ms_since_boot(get_absolute_time());
+    const uint64_t now = Clock::nowMs();
     if (now - last_status_print_ms_ < STATUS_INTERVAL_MS) return;
+    last_status_print_ms_ = now;
+    
+    // The table is printed directly, but can be silenced like a log module
+    if (!Log::enabled(LOG_STATUS, LOG_LEVEL_INFO)) return;
     
     uint32_t current_seconds = TimeUtils::getSecondsFromMidnight();
     char timeStr[8];
     TimeUtils::secondsToTimeString(current_seconds, timeStr, sizeof(timeStr));
     
-    ConfigManager& config = ConfigManager::getInstance();
+    const FieldSource src = { sensor_manager_, lights_controller_, pump_controller_,
+                              heater_controller_, fan_controller_ };
+    FieldValues values;
+    Fields::read(src, &values);
+    
+    // Only core 1 prints the table
+    static char rows[2048];
+    Fields::writeText(values, FIELD_ALL, "│ %-20s %-26s │\n", rows, sizeof(rows));
     
     printf("\n┌─────────────────────────────────────────────────┐\n");
-    printf("│              HYDRO CONTROLLER STATUS           │\n");
+    printf("│              HYDRO CONTROLLER STATUS            │\n");
     printf("├─────────────────────────────────────────────────┤\n");
-    printf("│ Time: %s (uptime)                        │\n", timeStr);
-    printf("│ Lights: %s (window %02lu:%02lu-%02lu:%02lu)             │\n",
-           lights_controller_->isOn() ? "ON " : "OFF",
-           config.getLightsStartS() / 3600, (config.getLightsStartS() % 3600) / 60,
-           config.getLightsEndS() / 3600, (config.getLightsEndS() % 3600) / 60);
-    printf("│ Pump: %s (%lus ON every %lus)                │\n",
-           pump_controller_->isOn() ? "ON " : "OFF", config.getPumpOnSec(), config.getPumpPeriod());
-    printf("│ Mode: %s                                   │\n",
-           config.getHumidityMode() ? "Humidity Control" : "Timer");
-    printf("│ Heater: %s                                     │\n",
-           heater_controller_->isOn() ? "ON " : "OFF");
-    printf("│ Setpoint: %.1f°C                                  │\n", config.getHeaterSetpointC());
-    printf("│ Fan: %s (>= %.1f°C: ON, <= %.1f°C: OFF)      │\n",
-           fan_controller_->isOn() ? "ON " : "OFF", 
-           FanController::FAN_ON_TEMP_C, FanController::FAN_OFF_TEMP_C);
-    
-    if (sensor_manager_->isTemperatureValid()) {
-        printf("│ Temperature: %.1f°C                            │\n", sensor_manager_->getLastTemperature());
-    } else {
-        printf("│ Temperature: SENSOR FAILED!                    │\n");
-    }
-    
-    if (sensor_manager_->isHumidityValid()) {
-        printf("│ Humidity: %.1f%%                                  │\n", sensor_manager_->getLastHumidity());
-    } else {
-        printf("│ Humidity: SENSOR FAILED!                       │\n");
-    }
-    
-    if (config.getHumidityMode()) {
-        printf("│ Threshold: %.1f%% (ON: <%.1f%%, OFF: >=%.1f%%)     │\n", 
-               config.getHumidityThreshold(), config.getHumidityThreshold(), config.getHumidityThreshold());
-        printf("│ Min Run: %lus, Min Off: %lus, Max Off: %lus        │\n", 
-               config.getMinPumpRunSec(), config.getMinPumpOffSec(), config.getMaxPumpOffSec());
-    }
-    
-    printf("│ WiFi: %s                                  │\n",
-           network_manager_->isConnected() ? "Connected" : "Disconnected");
-    printf("│ Time Sync: %s                               │\n",
-           network_manager_->isTimeSynced() ? "OK" : "FAILED");
-    
+    printf("│ %-20s %-26s │\n", "Time", timeStr);
+    printf("%s", rows);
     printf("└─────────────────────────────────────────────────┘\n");
-    
-    last_status_print_ms_ = now;
 }
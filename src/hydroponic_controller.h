@@ -8,6 +8,8 @@ class SensorManager;
 class NetworkManager;
 class TcpServer;
 class WebServer;
+class MqttClient;
+class UdpTelemetry;
 class LightsController;
 class PumpController;
 class HeaterController;
@@ -37,18 +39,28 @@ private:
     // Core 1 loop (network and servers)
     void core1Loop();
     
+    // Current relay states as a RELAY_* bitmask
+    uint8_t getRelayMask() const;
+    void waitForNextEvent();
+    void updateHistory();
+    
     // Component references
     SensorManager* sensor_manager_;
     NetworkManager* network_manager_;
     TcpServer* tcp_server_;
     WebServer* web_server_;
+    MqttClient* mqtt_client_;
+    UdpTelemetry* udp_telemetry_;
     LightsController* lights_controller_;
     PumpController* pump_controller_;
     HeaterController* heater_controller_;
     FanController* fan_controller_;
     
+    // Actuator states seen by the previous control pass
+    uint8_t last_relay_mask_;
+    
     // Status printing timing
-    uint32_t last_status_print_ms_;
+    uint64_t last_status_print_ms_;
     static const uint32_t STATUS_INTERVAL_MS = 5000UL;
     
     // Core synchronization
@@ -0,0 +1,66 @@
+#include "http_stats.h"
+#include <string.h>
+
+static const char* const ROUTE_PATHS[HTTP_ROUTE_COUNT] = {
+    "/", "/app.css", "/app.js", "/favicon.ico", "/metrics",
+    "/api/status", "/api/config", "/api/lights", "/api/pump", "/api/heater",
+    "/api/fan", "/api/humidity", "/api/save", "/api/batch", "/api/sensors", "/api/history",
+    "/api/telemetry", "/api/perf", "/api/perf/http", "/api/mem", "other"
+};
+
+static const char* const PHASE_NAMES[HTTP_PHASE_COUNT] = {
+    "parse", "handler", "ttlb"
+};
+
+static const int ERROR_STATUSES[HTTP_ERROR_SLOTS] = {
+    400, 404, 405, 413, 500, 0
+};
+
+HttpStats::HttpStats() {
+    reset();
+}
+
+HttpRoute HttpStats::routeFor(const char* path) {
+    for (uint8_t i = 0; i < HTTP_ROUTE_OTHER; i++) {
+        if (strcmp(path, ROUTE_PATHS[i]) == 0) return (HttpRoute)i;
+    }
+    return HTTP_ROUTE_OTHER;
+}
+
+const char* HttpStats::getRouteName(uint8_t route) {
+    return route < HTTP_ROUTE_COUNT ? ROUTE_PATHS[route] : "unknown";
+}
+
+const char* HttpStats::getPhaseName(uint8_t phase) {
+    return phase < HTTP_PHASE_COUNT ? PHASE_NAMES[phase] : "unknown";
+}
+
+int HttpStats::getErrorStatus(uint8_t slot) {
+    return slot < HTTP_ERROR_SLOTS ? ERROR_STATUSES[slot] : 0;
+}
+
+void HttpStats::addError(HttpRoute route, int status) {
+    uint8_t slot = HTTP_ERROR_SLOTS - 1;
+    for (uint8_t i = 0; i < HTTP_ERROR_SLOTS - 1; i++) {
+        if (ERROR_STATUSES[i] == status) {
+            slot = i;
+            break;
+        }
+    }
+    routes_[route].errors[slot]++;
+}
+
+void HttpStats::addLatency(HttpRoute route, HttpPhase phase, uint32_t us) {
+    HttpLatency& latency = routes_[route].latency[phase];
+    latency.count++;
+    latency.total_us += us;
+    if (us > latency.max_us) latency.max_us = us;
+    
+    uint8_t bucket = 31 - __builtin_clz(us | 1);
+    if (bucket >= HTTP_HIST_BUCKETS) bucket = HTTP_HIST_BUCKETS - 1;
+    latency.hist[bucket]++;
+}
+
+void HttpStats::reset() {
+    memset(routes_, 0, sizeof(routes_));
+}
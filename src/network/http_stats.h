@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Routes with their own statistics, in the order handleHttpRequest tests
+// them; anything else (404s, unparsable requests) counts as "other"
+enum HttpRoute : uint8_t {
+    HTTP_ROUTE_INDEX = 0,
+    HTTP_ROUTE_CSS,
+    HTTP_ROUTE_JS,
+    HTTP_ROUTE_FAVICON,
+    HTTP_ROUTE_METRICS,
+    HTTP_ROUTE_STATUS,
+    HTTP_ROUTE_CONFIG,
+    HTTP_ROUTE_LIGHTS,
+    HTTP_ROUTE_PUMP,
+    HTTP_ROUTE_HEATER,
+    HTTP_ROUTE_FAN,
+    HTTP_ROUTE_HUMIDITY,
+    HTTP_ROUTE_SAVE,
+    HTTP_ROUTE_BATCH,
+    HTTP_ROUTE_SENSORS,
+    HTTP_ROUTE_HISTORY,
+    HTTP_ROUTE_TELEMETRY,
+    HTTP_ROUTE_PERF,
+    HTTP_ROUTE_PERF_HTTP,
+    HTTP_ROUTE_MEM,
+    HTTP_ROUTE_OTHER,
+    HTTP_ROUTE_COUNT
+};
+
+// Timed phases of a request
+enum HttpPhase : uint8_t {
+    HTTP_PHASE_PARSE = 0,   // First request byte until parsed (includes waiting for later segments)
+    HTTP_PHASE_HANDLER,     // Route handler, including queuing the response
+    HTTP_PHASE_TTLB,        // First request byte until the last response byte is ACKed
+                            // (streams: queued, at most one send buffer earlier)
+    HTTP_PHASE_COUNT
+};
+
+// Error statuses counted per route; the last slot takes any other >= 400
+#define HTTP_ERROR_SLOTS 6
+
+// Bucket i counts [2^i, 2^(i+1)) microseconds; the last also takes anything slower
+#define HTTP_HIST_BUCKETS 24
+
+struct HttpLatency {
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t hist[HTTP_HIST_BUCKETS];
+};
+
+struct HttpRouteStats {
+    uint32_t requests;
+    uint64_t bytes_out;                     // Headers and body
+    uint32_t errors[HTTP_ERROR_SLOTS];
+    HttpLatency latency[HTTP_PHASE_COUNT];
+};
+
+// Fixed per-route request table for /api/perf/http. Written and read from
+// the lwIP callbacks only (core 1), so it needs no locking.
+class HttpStats {
+public:
+    HttpStats();
+    
+    static HttpRoute routeFor(const char* path);
+    static const char* getRouteName(uint8_t route);
+    static const char* getPhaseName(uint8_t phase);
+    static int getErrorStatus(uint8_t slot);      // 0 for the catch-all slot
+    
+    void addRequest(HttpRoute route) { routes_[route].requests++; }
+    void addBytes(HttpRoute route, uint32_t bytes) { routes_[route].bytes_out += bytes; }
+    void addError(HttpRoute route, int status);
+    void addLatency(HttpRoute route, HttpPhase phase, uint32_t us);
+    void reset();
+    
+    const HttpRouteStats& get(uint8_t route) const { return routes_[route]; }
+    
+private:
+    HttpRouteStats routes_[HTTP_ROUTE_COUNT];
+};
@@ -0,0 +1,336 @@
+#include "mqtt_client.h"
+#include "network_manager.h"
+#include "../utils/clock.h"
+#include "../utils/time_utils.h"
+#include "../utils/trace.h"
+#include "../control/lights_controller.h"
+#include "../control/pump_controller.h"
+#include "../control/heater_controller.h"
+#include "../control/fan_controller.h"
+#include "../control/settings_batch.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/sync.h"
+#include "lwip/ip_addr.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define MQTT_BASE_TOPIC MQTT_TOPIC_PREFIX "/" NODE_ID
+#define MQTT_SET_PREFIX MQTT_BASE_TOPIC "/set/"
+
+// Telemetry payloads are split into messages of at most this size
+static const size_t TELEMETRY_PAYLOAD_MAX = 1024;
+static const size_t TELEMETRY_LINE_MAX = 96;
+static char telemetry_payload[TELEMETRY_PAYLOAD_MAX];
+
+MqttClient::MqttClient(LightsController* lights_controller,
+                       PumpController* pump_controller,
+                       HeaterController* heater_controller,
+                       FanController* fan_controller)
+    : lights_controller_(lights_controller),
+      pump_controller_(pump_controller),
+      heater_controller_(heater_controller),
+      fan_controller_(fan_controller),
+      client_(nullptr),
+      connected_(false),
+      just_connected_(false),
+      last_attempt_ms_(0),
+      last_tick_ms_(0),
+      published_valid_(false),
+      published_(0),
+      command_head_(0),
+      command_tail_(0),
+      command_len_(0),
+      command_wanted_(false) {
+    memset(published_value_, 0, sizeof(published_value_));
+    memset(published_ms_, 0, sizeof(published_ms_));
+    memset(commands_, 0, sizeof(commands_));
+}
+
+MqttClient::~MqttClient() {
+    if (client_) {
+        cyw43_arch_lwip_begin();
+        mqtt_disconnect(client_);
+        mqtt_client_free(client_);
+        cyw43_arch_lwip_end();
+        client_ = nullptr;
+    }
+}
+
+void MqttClient::update(uint8_t relay_mask) {
+    if (!NetworkManager::getInstance().isConnected()) return;
+    
+    if (!connected_) {
+        if (last_attempt_ms_ == 0 || Clock::elapsedMs(last_attempt_ms_) >= MQTT_RECONNECT_MS) {
+            last_attempt_ms_ = Clock::nowMs();
+            connect();
+        }
+        return;
+    }
+    
+    if (just_connected_) {
+        // Retained values may be stale or missing on the broker: resend all
+        just_connected_ = false;
+        published_valid_ = false;
+        cyw43_arch_lwip_begin();
+        mqtt_subscribe(client_, MQTT_SET_PREFIX "+", 1, nullptr, nullptr);
+        publish("online", "1", 1, 1, true);
+        cyw43_arch_lwip_end();
+    }
+    
+    while (command_tail_ != command_head_) {
+        const Command& command = commands_[command_tail_ % COMMAND_QUEUE];
+        processCommand(command.name, command.value);
+        command_tail_ = command_tail_ + 1;
+    }
+    
+    if (Clock::elapsedMs(last_tick_ms_) < MQTT_TICK_MS) return;
+    last_tick_ms_ = Clock::nowMs();
+    publishChannels(relay_mask);
+}
+
+void MqttClient::connect() {
+    ip_addr_t broker;
+    if (!ipaddr_aton(MQTT_BROKER, &broker)) {
+        printf("MQTT: invalid broker address %s\n", MQTT_BROKER);
+        return;
+    }
+    
+    struct mqtt_connect_client_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.client_id = NODE_ID;
+    info.keep_alive = MQTT_KEEPALIVE_SEC;
+    info.will_topic = MQTT_BASE_TOPIC "/online";
+    info.will_msg = "0";
+    info.will_qos = 1;
+    info.will_retain = 1;
+    
+    cyw43_arch_lwip_begin();
+    if (!client_) {
+        client_ = mqtt_client_new();
+        if (client_) {
+            mqtt_set_inpub_callback(client_, incoming_publish_callback, incoming_data_callback, this);
+        }
+    }
+    err_t err = client_ ? mqtt_client_connect(client_, &broker, MQTT_PORT, connection_callback, this, &info) : ERR_MEM;
+    cyw43_arch_lwip_end();
+    
+    if (err != ERR_OK) {
+        printf("MQTT: connect to %s:%d failed: %d\n", MQTT_BROKER, MQTT_PORT, err);
+    }
+}
+
+void MqttClient::connection_callback(mqtt_client_t* client, void* arg, mqtt_connection_status_t status) {
+    MqttClient* self = static_cast<MqttClient*>(arg);
+    if (status == MQTT_CONNECT_ACCEPTED) {
+        printf("MQTT: connected to %s:%d\n", MQTT_BROKER, MQTT_PORT);
+        self->connected_ = true;
+        self->just_connected_ = true;
+    } else {
+        if (self->connected_) {
+            printf("MQTT: disconnected (%d)\n", status);
+        }
+        self->connected_ = false;
+    }
+}
+
+bool MqttClient::publish(const char* suffix, const char* payload, uint16_t len, uint8_t qos, bool retain) {
+    char topic[64];
+    snprintf(topic, sizeof(topic), "%s/%s", MQTT_BASE_TOPIC, suffix);
+    err_t err = mqtt_publish(client_, topic, payload, len, qos, retain ? 1 : 0, nullptr, nullptr);
+    if (err != ERR_OK) return false;
+    published_++;
+    return true;
+}
+
+void MqttClient::publishChannels(uint8_t relay_mask) {
+    int16_t values[HIST_CHANNEL_COUNT];
+    SensorHistory::getInstance().readCurrent(relay_mask, values);
+    
+    const uint64_t now = Clock::nowMs();
+    const uint64_t heartbeat_ms = MQTT_HEARTBEAT_SEC * 1000ULL;
+    
+    // Every publish of one tick is queued under a single lwIP lock. The MQTT
+    // client still flushes each PUBLISH as it is queued, so this saves lock
+    // round trips, not segments.
+    bool complete = true;
+    cyw43_arch_lwip_begin();
+    for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+        const int16_t value = values[ch];
+        const int16_t last = published_value_[ch];
+        bool due = !published_valid_ || now - published_ms_[ch] >= heartbeat_ms;
+        if (!due) {
+            if ((value == HISTORY_NO_DATA) != (last == HISTORY_NO_DATA)) {
+                due = true;
+            } else if (value != HISTORY_NO_DATA) {
+                const int32_t delta = (int32_t)value - last;
+                const int16_t deadband = SensorHistory::getChannelDeadband((HistoryChannel)ch);
+                due = delta >= deadband || -delta >= deadband;
+            }
+        }
+        if (!due) continue;
+    
+        // No reading clears the retained value (empty payload)
+        char payload[16];
+        int len = SensorHistory::formatFixed(payload, sizeof(payload), value,
+                                             SensorHistory::getChannelScale((HistoryChannel)ch));
+        if (!publish(SensorHistory::getChannelName((HistoryChannel)ch), payload, (uint16_t)len, 0, true)) {
+            complete = false;  // Output buffer full: the rest go out next tick
+            break;
+        }
+        published_value_[ch] = value;
+        published_ms_[ch] = now;
+    }
+    cyw43_arch_lwip_end();
+    
+    // After a reconnect, every channel stays due until all have gone out
+    if (complete) published_valid_ = true;
+}
+
+bool MqttClient::send(const TelemetryRecord* records, size_t count, bool replay) {
+    (void)replay;  // seq identifies replays; consumers drop duplicates by it
+    if (!connected_) return false;
+    
+    // One CSV line per record: seq,time,<channels in history order>
+    bool ok = true;
+    size_t len = 0;
+    cyw43_arch_lwip_begin();
+    for (size_t i = 0; i < count && ok; i++) {
+        const TelemetryRecord& record = records[i];
+        char line[TELEMETRY_LINE_MAX];
+        int n = snprintf(line, sizeof(line), "%lu,%lu", (unsigned long)record.seq, (unsigned long)record.time);
+        for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+            line[n++] = ',';
+            n += SensorHistory::formatFixed(line + n, sizeof(line) - n, record.values[ch],
+                                            SensorHistory::getChannelScale((HistoryChannel)ch));
+        }
+        line[n++] = '\n';
+    
+        if (len + n > sizeof(telemetry_payload)) {
+            ok = publish("telemetry", telemetry_payload, (uint16_t)len, 1, false);
+            len = 0;
+        }
+        memcpy(telemetry_payload + len, line, n);
+        len += n;
+    }
+    if (ok && len > 0) {
+        ok = publish("telemetry", telemetry_payload, (uint16_t)len, 1, false);
+    }
+    cyw43_arch_lwip_end();
+    return ok;
+}
+
+void MqttClient::incoming_publish_callback(void* arg, const char* topic, u32_t tot_len) {
+    MqttClient* self = static_cast<MqttClient*>(arg);
+    const size_t prefix_len = strlen(MQTT_SET_PREFIX);
+    
+    const bool full = (uint8_t)(self->command_head_ - self->command_tail_) >= COMMAND_QUEUE;
+    self->command_wanted_ = !full &&
+                            strncmp(topic, MQTT_SET_PREFIX, prefix_len) == 0 &&
+                            strlen(topic + prefix_len) < sizeof(Command::name) &&
+                            tot_len < sizeof(Command::value);
+    if (!self->command_wanted_) {
+        printf("MQTT: ignored publish on %s\n", topic);
+        return;
+    }
+    strcpy(self->commands_[self->command_head_ % COMMAND_QUEUE].name, topic + prefix_len);
+    self->command_len_ = 0;
+}
+
+void MqttClient::incoming_data_callback(void* arg, const u8_t* data, u16_t len, u8_t flags) {
+    TRACE_SCOPE(TRACE_MQTT_IN, len);
+    MqttClient* self = static_cast<MqttClient*>(arg);
+    if (!self->command_wanted_) return;
+    
+    Command& command = self->commands_[self->command_head_ % COMMAND_QUEUE];
+    if (self->command_len_ + len >= sizeof(command.value)) {
+        self->command_wanted_ = false;
+        return;
+    }
+    memcpy(command.value + self->command_len_, data, len);
+    self->command_len_ += len;
+    
+    if (flags & MQTT_DATA_FLAG_LAST) {
+        command.value[self->command_len_] = '\0';
+        self->command_wanted_ = false;
+        __dmb();  // Command complete before update() can see it
+        self->command_head_ = self->command_head_ + 1;
+    }
+}
+
+void MqttClient::reply(const char* message) {
+    printf("MQTT: %s\n", message);
+    cyw43_arch_lwip_begin();
+    publish("result", message, (uint16_t)strlen(message), 0, false);
+    cyw43_arch_lwip_end();
+}
+
+// Same commands and limits as the TCP interface: settings go through
+// SettingsBatch::validate, so the field registry ranges apply here too
+void MqttClient::processCommand(const char* name, const char* value) {
+    char response[96];
+    SettingsBatch change;
+    
+    if (strcmp(name, "heater") == 0) {
+        change.set(FIELD_HEATER_SETPOINT, atof(value));
+        snprintf(response, sizeof(response), "OK: heater setpoint %.1f", atof(value));
+    } else if (strcmp(name, "humidity") == 0) {
+        change.set(FIELD_HUMIDITY_THRESHOLD, atof(value));
+        snprintf(response, sizeof(response), "OK: humidity threshold %.1f", atof(value));
+    } else if (strcmp(name, "mode") == 0) {
+        if (strcmp(value, "timer") != 0 && strcmp(value, "humidity") != 0) {
+            reply("ERROR: mode must be 'timer' or 'humidity'");
+            return;
+        }
+        change.set(FIELD_HUMIDITY_MODE, strcmp(value, "humidity") == 0 ? 1.0f : 0.0f);
+        snprintf(response, sizeof(response), "OK: pump mode %s", value);
+    } else if (strcmp(name, "pump") == 0) {
+        unsigned long on_sec, period_sec;
+        if (sscanf(value, "%lu %lu", &on_sec, &period_sec) != 2) {
+            reply("ERROR: pump needs ON_SEC PERIOD_SEC");
+            return;
+        }
+        change.set(FIELD_PUMP_ON_SEC, (float)on_sec);
+        change.set(FIELD_PUMP_PERIOD, (float)period_sec);
+        snprintf(response, sizeof(response), "OK: pump %lus every %lus", on_sec, period_sec);
+    } else if (strcmp(name, "lights") == 0) {
+        char start_time[16], end_time[16];
+        if (sscanf(value, "%15s %15s", start_time, end_time) != 2) {
+            reply("ERROR: lights needs HH:MM HH:MM");
+            return;
+        }
+        uint32_t start_sec = TimeUtils::parseTimeToSeconds(start_time);
+        uint32_t end_sec = TimeUtils::parseTimeToSeconds(end_time);
+        if ((start_sec == 0 && strcmp(start_time, "00:00") != 0) ||
+            (end_sec == 0 && strcmp(end_time, "00:00") != 0)) {
+            reply("ERROR: invalid lights window");
+            return;
+        }
+        change.set(FIELD_LIGHTS_START, (float)start_sec);
+        change.set(FIELD_LIGHTS_END, (float)end_sec);
+        snprintf(response, sizeof(response), "OK: lights %s-%s", start_time, end_time);
+    } else if (strcmp(name, "fan") == 0) {
+        if (strcmp(value, "on") != 0 && strcmp(value, "off") != 0) {
+            reply("ERROR: fan must be 'on' or 'off'");
+            return;
+        }
+        fan_controller_->setManualControl(strcmp(value, "on") == 0);
+        snprintf(response, sizeof(response), "OK: fan %s (manual control)", value);
+    } else if (strcmp(name, "save") == 0) {
+        ConfigManager::getInstance().saveConfig();
+        snprintf(response, sizeof(response), "OK: configuration save scheduled");
+    } else {
+        snprintf(response, sizeof(response), "ERROR: unknown setting '%s'", name);
+    }
+    
+    if (!change.isEmpty()) {
+        char error[96];
+        if (!change.validate(error, sizeof(error))) {
+            snprintf(response, sizeof(response), "ERROR: %s", error);
+            reply(response);
+            return;
+        }
+        change.apply(lights_controller_, pump_controller_, heater_controller_);
+    }
+    reply(response);
+}
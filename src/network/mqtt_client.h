@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../config.h"
+#include "../sensors/sensor_history.h"
+#include "telemetry_spool.h"
+#include "lwip/apps/mqtt.h"
+
+class LightsController;
+class PumpController;
+class HeaterController;
+class FanController;
+
+// MQTT 3.1.1 publisher on lwIP's MQTT app (core 1).
+//
+// Topics under <prefix>/<node>/:
+//   <channel>    retained, current value; published when it changes by more
+//                than the channel's deadband, or every MQTT_HEARTBEAT_SEC
+//   online       retained "1", "0" as the last will
+//   telemetry    QoS 1 spool records, one CSV line each (TelemetrySink)
+//   set/<name>   subscribed; setpoint commands routed into the controllers
+//   result       reply to each command
+class MqttClient : public TelemetrySink {
+public:
+    MqttClient(LightsController* lights_controller,
+               PumpController* pump_controller,
+               HeaterController* heater_controller,
+               FanController* fan_controller);
+    ~MqttClient();
+    
+    // (Re)connect, run pending commands and publish changed channels; call
+    // from the core 1 loop
+    void update(uint8_t relay_mask);
+    
+    bool isConnected() const { return connected_; }
+    uint32_t getPublished() const { return published_; }
+    
+    // TelemetrySink
+    const char* getName() const override { return "mqtt"; }
+    bool isReady() override { return connected_; }
+    bool send(const TelemetryRecord* records, size_t count, bool replay) override;
+    
+private:
+    // lwIP callbacks (tcpip context)
+    static void connection_callback(mqtt_client_t* client, void* arg, mqtt_connection_status_t status);
+    static void incoming_publish_callback(void* arg, const char* topic, u32_t tot_len);
+    static void incoming_data_callback(void* arg, const u8_t* data, u16_t len, u8_t flags);
+    
+    void connect();
+    void publishChannels(uint8_t relay_mask);
+    bool publish(const char* suffix, const char* payload, uint16_t len, uint8_t qos, bool retain);
+    void processCommand(const char* name, const char* value);
+    void reply(const char* message);
+    
+    // Component references
+    LightsController* lights_controller_;
+    PumpController* pump_controller_;
+    HeaterController* heater_controller_;
+    FanController* fan_controller_;
+    
+    mqtt_client_t* client_;
+    volatile bool connected_;
+    volatile bool just_connected_;
+    uint64_t last_attempt_ms_;
+    uint64_t last_tick_ms_;
+    
+    // Last published value and time per channel
+    int16_t published_value_[HIST_CHANNEL_COUNT];
+    uint64_t published_ms_[HIST_CHANNEL_COUNT];
+    bool published_valid_;
+    uint32_t published_;
+    
+    // Incoming commands: ring filled by the lwIP callbacks, drained by update()
+    struct Command {
+        char name[16];
+        char value[32];
+    };
+    static const uint8_t COMMAND_QUEUE = 4;
+    Command commands_[COMMAND_QUEUE];
+    volatile uint8_t command_head_;
+    volatile uint8_t command_tail_;
+    uint8_t command_len_;
+    bool command_wanted_;
+};
@@ -1,5 +1,7 @@
 #include "network_manager.h"
 #include "../config.h"
+#include "../utils/time_utils.h"
+#include "../utils/clock.h"
 #include "pico/stdlib.h"
 #include "pico/cyw43_arch.h"
 #include "lwip/tcp.h"
@@ -13,7 +15,7 @@ NetworkManager& NetworkManager::getInstance() {
 
 NetworkManager::NetworkManager() 
     : wifi_connected_(false), time_synced_(false), 
-      last_ntp_sync_(0), last_wifi_attempt_(0) {
+      last_ntp_sync_(0), last_wifi_attempt_(0), reconnects_(0) {
 }
 
 bool NetworkManager::initialize() {
@@ -61,8 +63,8 @@ void NetworkManager::update() {
 }
 
 void NetworkManager::ensureConnected() {
-    static uint32_t last_check = 0;
-    const uint32_t now = to_ms_since_boot(get_absolute_time());
+    static uint64_t last_check = 0;
+    const uint64_t now = Clock::nowMs();
     
     // Check every 5 seconds
     if (now - last_check < 5000) return;
@@ -71,6 +73,7 @@ void NetworkManager::ensureConnected() {
     if (cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_UP) {
         if (!wifi_connected_) {
             wifi_connected_ = true;
+            reconnects_++;
             printf("WiFi reconnected: %s\n", ip4addr_ntoa(netif_ip4_addr(netif_list)));
         }
         return;
@@ -90,7 +93,7 @@ void NetworkManager::ensureConnected() {
 }
 
 void NetworkManager::syncTime() {
-    const uint32_t now = to_ms_since_boot(get_absolute_time());
+    const uint64_t now = Clock::nowMs();
     
     // Sync every 5 minutes
     if (last_ntp_sync_ != 0 && now - last_ntp_sync_ < 300000) return;
@@ -102,6 +105,7 @@ void NetworkManager::syncTime() {
     // Set timezone
     setenv("TZ", TZSTR, 1);
     tzset();
+    TimeUtils::invalidateCache();
     
     // Initialize SNTP if not already done
     if (!sntp_enabled()) {
@@ -138,6 +142,7 @@ void NetworkManager::initializeNTP() {
     // Set timezone
     setenv("TZ", TZSTR, 1);
     tzset();
+    TimeUtils::invalidateCache();
     
     // Initialize SNTP
     sntp_setoperatingmode(SNTP_OPMODE_POLL);
@@ -16,6 +16,7 @@ public:
     
     bool isConnected() const { return wifi_connected_; }
     bool isTimeSynced() const { return time_synced_; }
+    uint32_t getReconnects() const { return reconnects_; }
     
     // Time management
     void syncTime();
@@ -28,6 +29,7 @@ private:
     
     bool wifi_connected_;
     bool time_synced_;
-    uint32_t last_ntp_sync_;
-    uint32_t last_wifi_attempt_;
+    uint64_t last_ntp_sync_;
+    uint64_t last_wifi_attempt_;
+    uint32_t reconnects_;
 };
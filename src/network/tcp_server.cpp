@@ -6,8 +6,19 @@
 #include "../control/pump_controller.h"
 #include "../control/heater_controller.h"
 #include "../control/fan_controller.h"
+#include "../control/settings_batch.h"
 #include "../storage/flash_storage.h"
+#include "../storage/timeseries_log.h"
+#include "../storage/rollup_store.h"
+#include "../storage/history_query.h"
+#include "telemetry_spool.h"
+#include "../utils/perf.h"
+#include "../utils/trace.h"
+#include "../utils/log.h"
+#include "../utils/mem_stats.h"
+#include "../utils/clock.h"
 #include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
 #include "lwip/tcp.h"
 #include "lwip/pbuf.h"
 #include <stdio.h>
@@ -15,6 +26,39 @@
 #include <stdlib.h>
 #include <ctype.h>
 
+enum HistoryAgg : uint8_t { HISTORY_AGG_AVG, HISTORY_AGG_MIN, HISTORY_AGG_MAX, HISTORY_AGG_ALL };
+
+// Longest CSV or binary record formatHistoryRecord() can produce
+static const size_t HISTORY_RECORD_MAX = 64;
+
+// Commands that change state outside the settings registry. They cannot be
+// staged, so inside a batch they would apply at once and escape 'abort'.
+static bool isUnstagedCommand(const char* name, const char* args) {
+    static const char* const commands[] = { "fan", "sensorrange", "adaptive", "save", "load" };
+    for (const char* command : commands) {
+        if (strcmp(name, command) == 0) return true;
+    }
+    // Plain 'sensor' only reports
+    return strcmp(name, "sensor") == 0 && args && *args;
+}
+
+// "90", "90s", "15m", "48h", "7d" -> seconds
+static bool parseDuration(const char* text, uint32_t* seconds) {
+    char* end = nullptr;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text) return false;
+    
+    unsigned long unit = 1;
+    if (*end == 'm') unit = 60;
+    else if (*end == 'h') unit = 3600;
+    else if (*end == 'd') unit = 86400;
+    else if (*end != 's' && *end != '\0') return false;
+    if (*end != '\0' && end[1] != '\0') return false;
+    
+    *seconds = (uint32_t)(value * unit);
+    return true;
+}
+
 TcpServer::TcpServer(SensorManager* sensor_manager, 
                      LightsController* lights_controller,
                      PumpController* pump_controller,
@@ -28,17 +72,31 @@ TcpServer::TcpServer(SensorManager* sensor_manager,
       tcp_server_pcb_(nullptr),
       tcp_client_pcb_(nullptr),
       tcp_command_len_(0),
+      stream_arena_("tcp", stream_arena_buffer_, sizeof(stream_arena_buffer_)),
+      history_query_(nullptr),
+      history_channel_(0),
+      history_agg_(HISTORY_AGG_AVG),
+      history_fields_(1),
+      history_binary_(false),
+      history_finished_(false),
+      history_points_(0),
+      trace_reader_(nullptr),
+      stream_chunk_len_(0),
       upload_in_progress_(false),
       upload_size_(0),
       upload_received_(0),
-      upload_buffer_(nullptr) {
+      upload_buffer_(nullptr),
+      upload_buffered_(0),
+      batch_open_(false), commit_seq_(0), commit_deadline_ms_(0), commit_count_(0),
+      commit_save_(false) {
 }
 
 TcpServer::~TcpServer() {
     stop();
-    if (upload_buffer_) {
-        free(upload_buffer_);
-        upload_buffer_ = nullptr;
+    endHistoryStream();
+    endTraceStream();
+    if (upload_in_progress_) {
+        abortUpload();
     }
 }
 
@@ -78,7 +136,13 @@ void TcpServer::stop() {
 }
 
 void TcpServer::handleClients() {
-    // TCP handling is done in callbacks
+    // TCP handling is done in callbacks, apart from the commit reply, which
+    // waits for core 0 here rather than in the recv callback
+    if (commit_seq_ != 0) {
+        cyw43_arch_lwip_begin();
+        finishCommit();
+        cyw43_arch_lwip_end();
+    }
 }
 
 // Static callback implementations
@@ -88,6 +152,7 @@ err_t TcpServer::tcp_accept_callback(void* arg, struct tcp_pcb* newpcb, err_t er
 }
 
 err_t TcpServer::tcp_recv_callback(void* arg, struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
+    TRACE_SCOPE(TRACE_TCP_RECV, p ? p->tot_len : 0);
     TcpServer* server = (TcpServer*)arg;
     return server->tcpRecv(tpcb, p, err);
 }
@@ -97,16 +162,36 @@ void TcpServer::tcp_err_callback(void* arg, err_t err) {
     server->tcpErr(err);
 }
 
+err_t TcpServer::tcp_sent_callback(void* arg, struct tcp_pcb* tpcb, uint16_t len) {
+    TRACE_SCOPE(TRACE_TCP_SENT, len);
+    TcpServer* server = (TcpServer*)arg;
+    if (!server || tpcb != server->tcp_client_pcb_) return ERR_OK;
+    bool done = (server->history_query_ && server->pumpHistoryStream()) ||
+                (server->trace_reader_ && server->pumpTraceStream());
+    if (done) {
+        // Run commands that arrived while streaming
+        server->processCommandBuffer();
+    }
+    return ERR_OK;
+}
+
 err_t TcpServer::tcpAccept(struct tcp_pcb* newpcb, err_t err) {
     if (err != ERR_OK || newpcb == nullptr) {
         return ERR_VAL;
     }
     
-    printf("TCP client connected\n");
+    LOG_INFO(LOG_TCP, "TCP client connected");
+    
+    if (tcp_client_pcb_) {
+        LOG_INFO(LOG_TCP, "Replacing the previous TCP client");
+        closeClient(tcp_client_pcb_);
+    }
+    resetSession();
     
     tcp_client_pcb_ = newpcb;
     tcp_arg(newpcb, this);
     tcp_recv(newpcb, tcp_recv_callback);
+    tcp_sent(newpcb, tcp_sent_callback);
     tcp_err(newpcb, tcp_err_callback);
     
     // Send welcome message
@@ -117,7 +202,23 @@ err_t TcpServer::tcpAccept(struct tcp_pcb* newpcb, err_t err) {
 }
 
 err_t TcpServer::tcpRecv(struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
+    if (tpcb != tcp_client_pcb_) {
+        // A replaced client: it owns nothing here any more
+        if (p) {
+            tcp_recved(tpcb, p->tot_len);
+            pbuf_free(p);
+        }
+        return closeClient(tpcb);
+    }
+    
     if (err == ERR_OK && p != nullptr) {
+        // Commands sent during a stream wait in the buffer. Once it is full,
+        // hand the data back to lwIP, which holds it and delivers it again
+        // later: answering "too long" now would land inside the stream.
+        if (isHoldingInput() && tcp_command_len_ + p->tot_len > sizeof(tcp_command_buffer_) - 1) {
+            return ERR_MEM;
+        }
+        
         // Copy data to command buffer
         uint16_t len = p->tot_len;
         if (tcp_command_len_ + len > sizeof(tcp_command_buffer_) - 1) {
@@ -135,44 +236,81 @@ err_t TcpServer::tcpRecv(struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
             tcp_command_buffer_[0] = '\0';
         }
         
-        // Process complete commands (ending with \n or \r)
-        char* line_start = tcp_command_buffer_;
-        char* line_end;
-        
-        while ((line_end = strchr(line_start, '\n')) || (line_end = strchr(line_start, '\r'))) {
-            *line_end = '\0';
-            
-            if (strlen(line_start) > 0) {
-                printf("TCP command: %s\n", line_start);
-                processTcpCommand(line_start);
-            }
-            
-            line_start = line_end + 1;
-        }
-        
-        // Move remaining data to start of buffer
-        if (line_start > tcp_command_buffer_) {
-            tcp_command_len_ = strlen(line_start);
-            memmove(tcp_command_buffer_, line_start, tcp_command_len_ + 1);
+        // Commands sent during a stream or a pending commit wait until it ends
+        if (!isHoldingInput()) {
+            processCommandBuffer();
         }
         
         tcp_recved(tpcb, p->tot_len);
         pbuf_free(p);
     } else if (err == ERR_OK && p == nullptr) {
         // Connection closed by client
-        printf("TCP client disconnected\n");
+        LOG_INFO(LOG_TCP, "TCP client disconnected");
+        resetSession();
         tcp_client_pcb_ = nullptr;
-        tcp_command_len_ = 0;
-        tcp_close(tpcb);
+        return closeClient(tpcb);
     }
     
     return ERR_OK;
 }
 
 void TcpServer::tcpErr(err_t err) {
-    printf("TCP error: %d\n", err);
+    // Only the current client has this callback (closeClient() detaches it),
+    // and lwIP has already freed its pcb
+    LOG_WARN(LOG_TCP, "TCP error: %d", err);
     tcp_client_pcb_ = nullptr;
+    resetSession();
+}
+
+err_t TcpServer::closeClient(struct tcp_pcb* pcb) {
+    tcp_arg(pcb, nullptr);
+    tcp_recv(pcb, nullptr);
+    tcp_sent(pcb, nullptr);
+    tcp_err(pcb, nullptr);
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+void TcpServer::resetSession() {
+    endHistoryStream();
+    endTraceStream();
+    batch_open_ = false;
+    batch_.clear();
+    commit_seq_ = 0;  // A committed batch still goes in, unanswered
+    if (upload_in_progress_) {
+        abortUpload();
+    }
     tcp_command_len_ = 0;
+    tcp_command_buffer_[0] = '\0';
+}
+
+void TcpServer::processCommandBuffer() {
+    // Process complete commands (ending with \n or \r)
+    char* line_start = tcp_command_buffer_;
+    char* line_end;
+    
+    while ((line_end = strchr(line_start, '\n')) || (line_end = strchr(line_start, '\r'))) {
+        *line_end = '\0';
+        
+        if (strlen(line_start) > 0) {
+            LOG_INFO(LOG_TCP, "TCP command: %s", line_start);
+            processTcpCommand(line_start);
+        }
+        
+        line_start = line_end + 1;
+        
+        // A stream or a commit owns the connection until it ends
+        if (isHoldingInput()) break;
+    }
+    
+    // Move remaining data to start of buffer
+    if (line_start > tcp_command_buffer_) {
+        tcp_command_len_ = strlen(line_start);
+        memmove(tcp_command_buffer_, line_start, tcp_command_len_ + 1);
+    }
 }
 
 void TcpServer::sendTcpResponse(const char* message) {
@@ -188,6 +326,30 @@ void TcpServer::sendTcpResponse(const char* message) {
     }
 }
 
+void TcpServer::sendStaged() {
+    char response[64];
+    snprintf(response, sizeof(response), "OK: Staged (%u settings in batch)", batch_.count());
+    sendTcpResponse(response);
+}
+
+bool TcpServer::applyNow(const SettingsBatch& change) {
+    char response[128];
+    int len = snprintf(response, sizeof(response), "ERROR: ");
+    const bool ok = batch_open_ ? change.validateFields(response + len, sizeof(response) - len)
+                                : change.validate(response + len, sizeof(response) - len);
+    if (!ok) {
+        sendTcpResponse(response);
+        return false;
+    }
+    
+    if (batch_open_) {
+        batch_.merge(change);
+        sendStaged();
+        return false;
+    }
+    return true;
+}
+
 void TcpServer::processTcpCommand(const char* command) {
     if (!command || strlen(command) == 0) {
         sendTcpResponse("ERROR: Empty command");
@@ -213,6 +375,13 @@ void TcpServer::processTcpCommand(const char* command) {
         cmd_args = space_pos + 1;
     }
     
+    if (batch_open_ && isUnstagedCommand(cmd_name, cmd_args)) {
+        char response[128];
+        snprintf(response, sizeof(response), "ERROR: '%s' cannot be staged; 'commit' or 'abort' the batch first", cmd_name);
+        sendTcpResponse(response);
+        return;
+    }
+    
     // Process commands
     if (strcmp(cmd_name, "lights") == 0) {
         processLightsCommand(cmd_args);
@@ -232,12 +401,40 @@ void TcpServer::processTcpCommand(const char* command) {
         processMaxOffCommand(cmd_args);
     } else if (strcmp(cmd_name, "fan") == 0) {
         processFanCommand(cmd_args);
+    } else if (strcmp(cmd_name, "sensor") == 0) {
+        processSensorCommand(cmd_args);
+    } else if (strcmp(cmd_name, "sensorrange") == 0) {
+        processSensorRangeCommand(cmd_args);
+    } else if (strcmp(cmd_name, "adaptive") == 0) {
+        processAdaptiveCommand(cmd_args);
+    } else if (strcmp(cmd_name, "timebench") == 0) {
+        processTimeBenchCommand();
+    } else if (strcmp(cmd_name, "log") == 0) {
+        processLogCommand(cmd_args);
+    } else if (strcmp(cmd_name, "history") == 0) {
+        processHistoryCommand(cmd_args);
+    } else if (strcmp(cmd_name, "telemetry") == 0) {
+        processTelemetryCommand();
+    } else if (strcmp(cmd_name, "perf") == 0) {
+        processPerfCommand(cmd_args);
+    } else if (strcmp(cmd_name, "trace") == 0) {
+        processTraceCommand(cmd_args);
+    } else if (strcmp(cmd_name, "loglevel") == 0) {
+        processLogLevelCommand(cmd_args);
+    } else if (strcmp(cmd_name, "mem") == 0) {
+        processMemCommand();
     } else if (strcmp(cmd_name, "status") == 0) {
-        processStatusCommand();
+        processStatusCommand(cmd_args);
     } else if (strcmp(cmd_name, "temp") == 0) {
         processTempCommand();
     } else if (strcmp(cmd_name, "humid") == 0) {
         processHumidCommand();
+    } else if (strcmp(cmd_name, "begin") == 0) {
+        processBeginCommand();
+    } else if (strcmp(cmd_name, "commit") == 0) {
+        processCommitCommand(cmd_args);
+    } else if (strcmp(cmd_name, "abort") == 0) {
+        processAbortCommand();
     } else if (strcmp(cmd_name, "save") == 0) {
         processSaveCommand();
     } else if (strcmp(cmd_name, "load") == 0) {
@@ -283,11 +480,10 @@ void TcpServer::processLightsCommand(const char* args) {
         return;
     }
     
-    uint32_t duration = (end_sec >= start_sec) ? (end_sec - start_sec) : (24U * 3600U - start_sec + end_sec);
-    if (duration == 0) {
-        sendTcpResponse("ERROR: Window duration cannot be zero");
-        return;
-    }
+    SettingsBatch change;
+    change.set(FIELD_LIGHTS_START, start_sec);
+    change.set(FIELD_LIGHTS_END, end_sec);
+    if (!applyNow(change)) return;
     
     lights_controller_->setSchedule(start_sec, end_sec);
     
@@ -309,10 +505,10 @@ void TcpServer::processPumpCommand(const char* args) {
         return;
     }
     
-    if (on_sec == 0 || period_sec == 0 || on_sec >= period_sec) {
-        sendTcpResponse("ERROR: Invalid pump timing (ON_SEC must be > 0 and < PERIOD_SEC)");
-        return;
-    }
+    SettingsBatch change;
+    change.set(FIELD_PUMP_ON_SEC, on_sec);
+    change.set(FIELD_PUMP_PERIOD, period_sec);
+    if (!applyNow(change)) return;
     
     pump_controller_->setTiming(on_sec, period_sec);
     
@@ -329,10 +525,9 @@ void TcpServer::processHeaterCommand(const char* args) {
     }
     
     float sp = atof(args);
-    if (sp <= -40.0 || sp >= 80.0) {
-        sendTcpResponse("ERROR: Setpoint out of range (-40..80)°C");
-        return;
-    }
+    SettingsBatch change;
+    change.set(FIELD_HEATER_SETPOINT, sp);
+    if (!applyNow(change)) return;
     
     heater_controller_->setSetpoint(sp);
     
@@ -349,10 +544,9 @@ void TcpServer::processHumidityCommand(const char* args) {
     }
     
     float threshold = atof(args);
-    if (threshold < 0.0 || threshold > 100.0) {
-        sendTcpResponse("ERROR: Threshold out of range (0..100)%");
-        return;
-    }
+    SettingsBatch change;
+    change.set(FIELD_HUMIDITY_THRESHOLD, threshold);
+    if (!applyNow(change)) return;
     
     pump_controller_->setHumidityThreshold(threshold);
     
@@ -383,6 +577,10 @@ void TcpServer::processModeCommand(const char* args) {
     }
     
     bool new_mode = (strcmp(mode_copy, "humidity") == 0);
+    SettingsBatch change;
+    change.set(FIELD_HUMIDITY_MODE, new_mode ? 1.0f : 0.0f);
+    if (!applyNow(change)) return;
+    
     pump_controller_->setHumidityMode(new_mode);
     
     char response[128];
@@ -398,10 +596,9 @@ void TcpServer::processMinRunCommand(const char* args) {
     }
     
     uint32_t run_time = atoi(args);
-    if (run_time < 5 || run_time > 300) {
-        sendTcpResponse("ERROR: Run time out of range (5..300 seconds)");
-        return;
-    }
+    SettingsBatch change;
+    change.set(FIELD_MIN_PUMP_RUN, run_time);
+    if (!applyNow(change)) return;
     
     pump_controller_->setMinRunTime(run_time);
     char response[128];
@@ -417,10 +614,9 @@ void TcpServer::processMinOffCommand(const char* args) {
     }
     
     uint32_t off_time = atoi(args);
-    if (off_time < 60 || off_time > 3600) {
-        sendTcpResponse("ERROR: Off time out of range (60..3600 seconds)");
-        return;
-    }
+    SettingsBatch change;
+    change.set(FIELD_MIN_PUMP_OFF, off_time);
+    if (!applyNow(change)) return;
     
     pump_controller_->setMinOffTime(off_time);
     char response[128];
@@ -436,10 +632,9 @@ void TcpServer::processMaxOffCommand(const char* args) {
     }
     
     uint32_t max_off_time = atoi(args);
-    if (max_off_time < 300 || max_off_time > 7200) {
-        sendTcpResponse("ERROR: Max off time out of range (300..7200 seconds)");
-        return;
-    }
+    SettingsBatch change;
+    change.set(FIELD_MAX_PUMP_OFF, max_off_time);
+    if (!applyNow(change)) return;
     
     pump_controller_->setMaxOffTime(max_off_time);
     char response[128];
@@ -474,99 +669,645 @@ void TcpServer::processFanCommand(const char* args) {
     }
 }
 
-void TcpServer::processStatusCommand() {
-    char response[1024];
-    char time_str[64];
+void TcpServer::processSensorCommand(const char* args) {
+    // Without arguments, list the current sampling schedule
+    if (!args || strlen(args) == 0) {
+        char response[512];
+        int len = snprintf(response, sizeof(response), "=== SENSOR SCHEDULE (adaptive %s) ===",
+                           sensor_manager_->isAdaptiveSampling() ? "ON" : "OFF");
+        for (uint8_t i = 0; i < SENSOR_COUNT && len < (int)sizeof(response); i++) {
+            SensorId id = (SensorId)i;
+            len += snprintf(response + len, sizeof(response) - len,
+                            "\n%-6s every %.1fs, offset %.1fs, now %.1fs (range %.1f-%.1fs)",
+                            SensorManager::getSensorName(id),
+                            sensor_manager_->getIntervalMs(id) / 1000.0f,
+                            sensor_manager_->getOffsetMs(id) / 1000.0f,
+                            sensor_manager_->getEffectiveIntervalMs(id) / 1000.0f,
+                            sensor_manager_->getMinIntervalMs(id) / 1000.0f,
+                            sensor_manager_->getMaxIntervalMs(id) / 1000.0f);
+        }
+        sendTcpResponse(response);
+        return;
+    }
     
-    time_t now = time(nullptr);
-    if (now > 1600000000) {
-        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    } else {
-        strcpy(time_str, "NOT SYNCED");
+    char name[16];
+    float interval_sec = 0.0f;
+    float offset_sec = 0.0f;
+    int parsed = sscanf(args, "%15s %f %f", name, &interval_sec, &offset_sec);
+    if (parsed < 2) {
+        sendTcpResponse("ERROR: sensor command requires NAME INTERVAL_SEC [OFFSET_SEC]");
+        return;
     }
     
-    ConfigManager& config = ConfigManager::getInstance();
+    SensorId id;
+    if (!SensorManager::parseSensorName(name, &id)) {
+        sendTcpResponse("ERROR: Sensor must be 'water', 'table', 'air' or 'nano'");
+        return;
+    }
     
-    // Build response with conditional humidity details
-    char humidity_details[256] = "";
-    if (config.getHumidityMode()) {
-        snprintf(humidity_details, sizeof(humidity_details),
-            "Humidity Threshold: %.1f%%\n"
-            "Pump ON: when humidity < %.1f%%\n"
-            "Pump OFF: when humidity >= %.1f%%\n"
-            "Min Run Time: %lus\n"
-            "Min Off Time: %lus\n"
-            "Max Off Time: %lus (safety)\n",
-            config.getHumidityThreshold(), config.getHumidityThreshold(), config.getHumidityThreshold(),
-            config.getMinPumpRunSec(), config.getMinPumpOffSec(), config.getMaxPumpOffSec());
-    }
-    
-    char temp_str[32], humidity_str[32], air_temp_str[32], air_humidity_str[32], ph_str[32], tds_str[32];
-    if (sensor_manager_->isTemperatureValid()) {
-        snprintf(temp_str, sizeof(temp_str), "%.1f°C", sensor_manager_->getLastTemperature());
-    } else {
-        strcpy(temp_str, "SENSOR FAILED!");
+    uint32_t interval_ms = (uint32_t)(interval_sec * 1000.0f);
+    uint32_t offset_ms = (parsed == 3) ? (uint32_t)(offset_sec * 1000.0f) : sensor_manager_->getOffsetMs(id);
+    
+    if (interval_ms < SENSOR_MIN_INTERVAL_MS || interval_ms > SENSOR_MAX_INTERVAL_MS) {
+        sendTcpResponse("ERROR: Interval out of range (2..3600 seconds)");
+        return;
     }
     
-    if (sensor_manager_->isHumidityValid()) {
-        snprintf(humidity_str, sizeof(humidity_str), "%.1f%%", sensor_manager_->getLastHumidity());
-    } else {
-        strcpy(humidity_str, "SENSOR FAILED!");
+    if (offset_sec < 0.0f || offset_ms >= interval_ms) {
+        sendTcpResponse("ERROR: Offset must be >= 0 and less than the interval");
+        return;
+    }
+    
+    sensor_manager_->setSchedule(id, interval_ms, offset_ms);
+    
+    char response[128];
+    snprintf(response, sizeof(response), "OK: %s sampled every %.1fs, offset %.1fs",
+             name, interval_ms / 1000.0f, offset_ms / 1000.0f);
+    sendTcpResponse(response);
+    printf("Sensor schedule: %s every %lums, offset %lums\n", name, interval_ms, offset_ms);
+}
+
+void TcpServer::processSensorRangeCommand(const char* args) {
+    if (!args || strlen(args) == 0) {
+        sendTcpResponse("ERROR: sensorrange command requires NAME MIN_SEC MAX_SEC");
+        return;
+    }
+    
+    char name[16];
+    float min_sec, max_sec;
+    if (sscanf(args, "%15s %f %f", name, &min_sec, &max_sec) != 3) {
+        sendTcpResponse("ERROR: sensorrange command requires NAME MIN_SEC MAX_SEC");
+        return;
+    }
+    
+    SensorId id;
+    if (!SensorManager::parseSensorName(name, &id)) {
+        sendTcpResponse("ERROR: Sensor must be 'water', 'table', 'air' or 'nano'");
+        return;
+    }
+    
+    uint32_t min_ms = (uint32_t)(min_sec * 1000.0f);
+    uint32_t max_ms = (uint32_t)(max_sec * 1000.0f);
+    if (min_sec < 0.0f || min_ms < SENSOR_MIN_INTERVAL_MS || max_ms > SENSOR_MAX_INTERVAL_MS || min_ms > max_ms) {
+        sendTcpResponse("ERROR: Range must satisfy 2 <= MIN <= MAX <= 3600 seconds");
+        return;
+    }
+    
+    sensor_manager_->setBounds(id, min_ms, max_ms);
+    
+    char response[128];
+    snprintf(response, sizeof(response), "OK: %s adaptive range %.1f-%.1fs", name, min_sec, max_sec);
+    sendTcpResponse(response);
+    printf("Sensor range: %s %lu-%lums\n", name, min_ms, max_ms);
+}
+
+void TcpServer::processAdaptiveCommand(const char* args) {
+    if (!args || strlen(args) == 0) {
+        sendTcpResponse("ERROR: adaptive command requires: on or off");
+        return;
     }
     
-    if (sensor_manager_->isAirTempValid()) {
-        snprintf(air_temp_str, sizeof(air_temp_str), "%.1f°C", sensor_manager_->getLastAirTemp());
+    if (strcmp(args, "on") == 0) {
+        sensor_manager_->setAdaptiveSampling(true);
+        sendTcpResponse("OK: Adaptive sampling enabled");
+    } else if (strcmp(args, "off") == 0) {
+        sensor_manager_->setAdaptiveSampling(false);
+        sendTcpResponse("OK: Adaptive sampling disabled (nominal intervals)");
     } else {
-        strcpy(air_temp_str, "SENSOR FAILED!");
+        sendTcpResponse("ERROR: Adaptive command must be 'on' or 'off'");
+    }
+}
+
+void TcpServer::processTimeBenchCommand() {
+    // Count seconds-since-midnight calls per second, uncached vs cached.
+    // Each run holds core 1 for BENCH_WINDOW_US.
+    const uint64_t BENCH_WINDOW_US = 200000ULL;
+    volatile uint32_t sink = 0;
+    
+    uint32_t uncached_calls = 0;
+    uint64_t start = time_us_64();
+    uint64_t elapsed = 0;
+    while (elapsed < BENCH_WINDOW_US) {
+        for (int i = 0; i < 16; i++) {
+            sink += TimeUtils::getSecondsFromMidnightUncached();
+        }
+        uncached_calls += 16;
+        elapsed = time_us_64() - start;
+    }
+    uint32_t uncached_rate = (uint32_t)((uint64_t)uncached_calls * 1000000ULL / elapsed);
+    
+    uint32_t cached_calls = 0;
+    start = time_us_64();
+    elapsed = 0;
+    while (elapsed < BENCH_WINDOW_US) {
+        for (int i = 0; i < 16; i++) {
+            sink += TimeUtils::getSecondsFromMidnight();
+        }
+        cached_calls += 16;
+        elapsed = time_us_64() - start;
+    }
+    uint32_t cached_rate = (uint32_t)((uint64_t)cached_calls * 1000000ULL / elapsed);
+    (void)sink;
+    
+    char response[160];
+    snprintf(response, sizeof(response),
+             "Seconds-from-midnight: localtime_r %lu calls/s, cached %lu calls/s (%.1fx)",
+             uncached_rate, cached_rate, uncached_rate ? (float)cached_rate / uncached_rate : 0.0f);
+    sendTcpResponse(response);
+}
+
+void TcpServer::processLogCommand(const char* args) {
+    TimeSeriesLog& log = TimeSeriesLog::getInstance();
+    
+    if (args && strcmp(args, "flush") == 0) {
+        // The log belongs to core 1; it flushes on its next loop iteration
+        log.requestFlush();
+        RollupStore::getInstance().requestFlush();
+        sendTcpResponse("OK: Log flush requested");
+        return;
+    } else if (args && strlen(args) > 0) {
+        sendTcpResponse("ERROR: log command takes no argument or 'flush'");
+        return;
+    }
+    
+    char response[256];
+    snprintf(response, sizeof(response),
+             "Log: %lu segments (%08lu-%08lu), %lu/%lu bytes, %lu blocks written, %u samples pending",
+             log.getSegmentCount(), log.getFirstSegment(), log.getLastSegment(),
+             log.getBytesUsed(), (unsigned long)LOG_BUDGET_BYTES,
+             log.getBlocksWritten(), log.getPendingSamples());
+    sendTcpResponse(response);
+}
+
+void TcpServer::processTelemetryCommand() {
+    TelemetrySpool& spool = TelemetrySpool::getInstance();
+    
+    char response[256];
+    int len = snprintf(response, sizeof(response),
+                       "Telemetry: spool %lu/%lu, next seq %lu, %lu live, %lu replayed, %lu dropped",
+                       (unsigned long)spool.getDepth(), (unsigned long)spool.getCapacity(),
+                       (unsigned long)spool.getNextSeq(), (unsigned long)spool.getLiveSent(),
+                       (unsigned long)spool.getReplayed(), (unsigned long)spool.getDropped());
+    if (spool.isReplaying()) {
+        snprintf(response + len, sizeof(response) - len, ", replay %lu/%lu",
+                 (unsigned long)spool.getReplayDone(), (unsigned long)spool.getReplayTotal());
+    }
+    sendTcpResponse(response);
+}
+
+void TcpServer::processPerfCommand(const char* args) {
+    if (!PERF_ENABLED) {
+        sendTcpResponse("ERROR: Profiling compiled out (PERF_ENABLED 0)");
+        return;
+    }
+    
+    if (args && strcmp(args, "reset") == 0) {
+        Perf::requestReset();
+        sendTcpResponse("OK: Profile counters reset");
+        return;
+    }
+    
+    const float mhz = Perf::getTickHz() / 1e6f;
+    
+    // One stage: its log2 latency histogram
+    if (args && strlen(args) > 0) {
+        PerfStage stage;
+        PerfSnapshot snap;
+        if (!Perf::parseStageName(args, &stage)) {
+            sendTcpResponse("ERROR: Unknown stage (loop, sensors, ds18b20, sht30, dht22, nrf24, lights, pump, heater, fan)");
+            return;
+        }
+        if (!Perf::snapshot(stage, &snap) || snap.count == 0) {
+            sendTcpResponse("No samples yet");
+            return;
+        }
+        
+        char response[1024];
+        int len = snprintf(response, sizeof(response), "=== %s: %lu passes ===",
+                           Perf::getStageName(stage), (unsigned long)snap.count);
+        for (uint8_t i = 0; i < PERF_HIST_BUCKETS && len < (int)sizeof(response); i++) {
+            if (snap.hist[i] == 0) continue;
+            len += snprintf(response + len, sizeof(response) - len, "\n< %10.2f us  %lu",
+                            (2ULL << i) / mhz, (unsigned long)snap.hist[i]);
+        }
+        sendTcpResponse(response);
+        return;
+    }
+    
+    char response[1024];
+    int len = snprintf(response, sizeof(response),
+                       "=== CORE 0 PROFILE (%s, %.0f MHz, us) ===\n"
+                       "stage        count      min      avg      max    p50<    p99<",
+                       Perf::getSource(), mhz);
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT && len < (int)sizeof(response); i++) {
+        PerfSnapshot snap;
+        if (!Perf::snapshot((PerfStage)i, &snap) || snap.count == 0) continue;
+        len += snprintf(response + len, sizeof(response) - len,
+                        "\n%-8s %9lu %8.1f %8.1f %8.1f %7.0f %7.0f",
+                        Perf::getStageName((PerfStage)i), (unsigned long)snap.count,
+                        snap.min_ticks / mhz, snap.total_ticks / mhz / snap.count, snap.max_ticks / mhz,
+                        Perf::percentileTicks(snap, 0.5f) / mhz, Perf::percentileTicks(snap, 0.99f) / mhz);
+    }
+    sendTcpResponse(response);
+}
+
+void TcpServer::processTraceCommand(const char* args) {
+    if (!TRACE_ENABLED) {
+        sendTcpResponse("ERROR: Tracing compiled out (TRACE_ENABLED 0)");
+        return;
+    }
+    
+    char action[8] = "";
+    char format[8] = "json";
+    if (args) sscanf(args, "%7s %7s", action, format);
+    
+    if (action[0] == '\0') {
+        char response[160];
+        snprintf(response, sizeof(response),
+                 "Trace: core 0 %lu events, core 1 %lu events (ring %u per core)%s",
+                 (unsigned long)Trace::getWritten(0), (unsigned long)Trace::getWritten(1),
+                 (unsigned)TRACE_RING_EVENTS, Trace::isPaused() ? ", paused for a dump" : "");
+        sendTcpResponse(response);
+        return;
     }
     
-    if (sensor_manager_->isAirHumidityValid()) {
-        snprintf(air_humidity_str, sizeof(air_humidity_str), "%.1f%%", sensor_manager_->getLastAirHumidity());
+    if (strcmp(action, "dump") != 0 || (strcmp(format, "json") != 0 && strcmp(format, "bin") != 0)) {
+        sendTcpResponse("ERROR: trace [dump [json|bin]]");
+        return;
+    }
+    
+    // Streams like history: the rest of the reply follows as the peer ACKs
+    endTraceStream();
+    trace_reader_ = stream_arena_.create<TraceReader>(strcmp(format, "bin") == 0);
+    if (!trace_reader_) {
+        sendTcpResponse("ERROR: Out of stream memory");
+        return;
+    }
+    stream_chunk_len_ = 0;
+    pumpTraceStream();
+}
+
+void TcpServer::processLogLevelCommand(const char* args) {
+    static const char* USAGE = "ERROR: loglevel [MODULE|all off|error|warn|info|debug] or loglevel output text|binary";
+    
+    char first[16] = "";
+    char second[16] = "";
+    if (args) sscanf(args, "%15s %15s", first, second);
+    
+    if (first[0] == '\0') {
+        char response[512];
+        int len = snprintf(response, sizeof(response), "=== LOG LEVELS (output %s) ===",
+                           Log::isBinaryOutput() ? "binary" : "text");
+        for (uint8_t i = 0; i < LOG_MODULE_COUNT && len < (int)sizeof(response); i++) {
+            len += snprintf(response + len, sizeof(response) - len, "\n%-8s %s",
+                            Log::getModuleName(i), Log::getLevelName(Log::getLevel((LogModule)i)));
+        }
+        for (uint8_t core = 0; core < 2 && len < (int)sizeof(response); core++) {
+            len += snprintf(response + len, sizeof(response) - len, "\nCore %u: %lu bytes pending, %lu records dropped",
+                            core, (unsigned long)Log::getPending(core), (unsigned long)Log::getDropped(core));
+        }
+        sendTcpResponse(response);
+        return;
+    }
+    
+    if (strcmp(first, "output") == 0) {
+        if (strcmp(second, "text") != 0 && strcmp(second, "binary") != 0) {
+            sendTcpResponse(USAGE);
+            return;
+        }
+        Log::setBinaryOutput(strcmp(second, "binary") == 0);
+        sendTcpResponse(Log::isBinaryOutput() ? "OK: USB log output binary (decode with tools/log_decode.py)"
+                                              : "OK: USB log output text");
+        return;
+    }
+    
+    LogModule module = LOG_SENSORS;
+    LogLevel level;
+    bool all = strcmp(first, "all") == 0;
+    if ((!all && !Log::parseModuleName(first, &module)) || !Log::parseLevelName(second, &level)) {
+        sendTcpResponse(USAGE);
+        return;
+    }
+    
+    for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+        if (all || i == module) Log::setLevel((LogModule)i, level);
+    }
+    
+    char response[64];
+    snprintf(response, sizeof(response), "OK: %s log level %s", all ? "all" : first, Log::getLevelName(level));
+    sendTcpResponse(response);
+}
+
+void TcpServer::processMemCommand() {
+    HeapStats heap;
+    MemStats::getHeap(&heap);
+    
+    char response[1280];
+    int len = snprintf(response, sizeof(response),
+                       "=== MEMORY ===\n"
+                       "Heap: %lu of %lu bytes claimed, %lu in use, %lu free in %lu chunks\n"
+                       "Buffers: %lu bytes now, %lu peak, %lu allocations, %lu failed",
+                       (unsigned long)heap.arena, (unsigned long)heap.size, (unsigned long)heap.in_use,
+                       (unsigned long)heap.free, (unsigned long)heap.free_chunks,
+                       (unsigned long)MemStats::getAllocCurrent(), (unsigned long)MemStats::getAllocPeak(),
+                       (unsigned long)MemStats::getAllocCount(), (unsigned long)MemStats::getAllocFailed());
+    for (uint8_t core = 0; core < 2; core++) {
+        StackStats stack;
+        MemStats::getStack(core, &stack);
+        if (stack.painted) {
+            len += snprintf(response + len, sizeof(response) - len, "\nStack core %u: %lu of %lu bytes peak",
+                            core, (unsigned long)stack.peak, (unsigned long)stack.size);
+        } else {
+            len += snprintf(response + len, sizeof(response) - len, "\nStack core %u: not painted", core);
+        }
+    }
+    for (const MemPool* p = MemPool::getFirst(); p; p = p->getNext()) {
+        len += snprintf(response + len, sizeof(response) - len, "\nPool %-7s %lu/%lu bytes, peak %lu, %lu failed",
+                        p->getName(), (unsigned long)p->getUsed(), (unsigned long)p->getCapacity(),
+                        (unsigned long)p->getPeak(), (unsigned long)p->getFailed());
+    }
+    
+    PoolStats pool;
+    if (MemStats::getPool(0, &pool)) {
+        len += snprintf(response + len, sizeof(response) - len, "\nlwIP pool         used    max  avail    err");
+    }
+    for (uint8_t i = 0; MemStats::getPool(i, &pool) && len < (int)sizeof(response) - 64; i++) {
+        len += snprintf(response + len, sizeof(response) - len, "\n%-16s %5lu  %5lu  %5lu  %5lu",
+                        pool.name, (unsigned long)pool.used, (unsigned long)pool.max,
+                        (unsigned long)pool.avail, (unsigned long)pool.err);
+    }
+    sendTcpResponse(response);
+}
+
+void TcpServer::processHistoryCommand(const char* args) {
+    static const char* USAGE =
+        "ERROR: history CHANNEL RANGE [STEP] [avg|min|max|all] [csv|bin] (e.g. history water 7d 1h all)";
+    
+    char ch_str[16], range_str[32], step_str[16] = "1m", agg_str[8] = "avg", format_str[8] = "csv";
+    if (!args || sscanf(args, "%15s %31s %15s %7s %7s", ch_str, range_str, step_str, agg_str, format_str) < 2) {
+        sendTcpResponse(USAGE);
+        return;
+    }
+    
+    HistoryChannel channel;
+    if (!SensorHistory::parseChannelName(ch_str, &channel)) {
+        sendTcpResponse("ERROR: Unknown channel (water, table_rh, air_temp, air_rh, ph, tds, relays)");
+        return;
+    }
+    
+    // RANGE is a duration back from now (7d) or FROM..TO in Unix time
+    time_t from = 0;
+    time_t to = 0;
+    const char* dots = strstr(range_str, "..");
+    if (dots) {
+        from = (time_t)strtoll(range_str, nullptr, 10);
+        to = (time_t)strtoll(dots + 2, nullptr, 10);
     } else {
-        strcpy(air_humidity_str, "SENSOR FAILED!");
+        uint32_t duration;
+        time_t now = time(nullptr);
+        if (!parseDuration(range_str, &duration)) {
+            sendTcpResponse(USAGE);
+            return;
+        }
+        if (now < 1600000000) {
+            sendTcpResponse("ERROR: Time not synced; use FROM..TO");
+            return;
+        }
+        from = now - (time_t)duration;
+    }
+    
+    uint32_t step;
+    if (!parseDuration(step_str, &step) || step == 0) {
+        sendTcpResponse(USAGE);
+        return;
+    }
+    
+    if (strcmp(agg_str, "avg") == 0) history_agg_ = HISTORY_AGG_AVG;
+    else if (strcmp(agg_str, "min") == 0) history_agg_ = HISTORY_AGG_MIN;
+    else if (strcmp(agg_str, "max") == 0) history_agg_ = HISTORY_AGG_MAX;
+    else if (strcmp(agg_str, "all") == 0) history_agg_ = HISTORY_AGG_ALL;
+    else {
+        sendTcpResponse(USAGE);
+        return;
+    }
+    
+    if (strcmp(format_str, "csv") != 0 && strcmp(format_str, "bin") != 0) {
+        sendTcpResponse(USAGE);
+        return;
     }
     
-    if (sensor_manager_->isPHValid()) {
-        snprintf(ph_str, sizeof(ph_str), "%.2f", sensor_manager_->getLastPH());
+    endHistoryStream();
+    history_query_ = stream_arena_.create<HistoryQuery>(channel, from, to, step);
+    if (!history_query_) {
+        sendTcpResponse("ERROR: Out of stream memory");
+        return;
+    }
+    history_channel_ = channel;
+    history_binary_ = strcmp(format_str, "bin") == 0;
+    history_fields_ = (history_query_->isAggregated() && history_agg_ == HISTORY_AGG_ALL) ? 3 : 1;
+    history_finished_ = false;
+    history_points_ = 0;
+    
+    // Header line; binary records follow it directly
+    const char* name = SensorHistory::getChannelName(channel);
+    const char* columns = !history_query_->isAggregated() ? "value" :
+                          history_fields_ == 3 ? "avg,min,max" : agg_str;
+    char header[128];
+    if (history_binary_) {
+        snprintf(header, sizeof(header), "BIN %s step=%lu scale=%u fields=%s",
+                 name, (unsigned long)history_query_->getStep(),
+                 (unsigned)SensorHistory::getChannelScale(channel), columns);
+    } else {
+        snprintf(header, sizeof(header), "time,%s", columns);
+    }
+    sendTcpResponse(header);
+    pumpHistoryStream();
+}
+
+size_t TcpServer::formatHistoryRecord(const HistoryPoint& point, char* out) {
+    int16_t values[3];
+    if (history_fields_ == 3) {
+        values[0] = point.avg;
+        values[1] = point.min;
+        values[2] = point.max;
     } else {
-        strcpy(ph_str, "N/A");
+        values[0] = history_agg_ == HISTORY_AGG_MIN ? point.min :
+                    history_agg_ == HISTORY_AGG_MAX ? point.max : point.avg;
+    }
+    if (point.count == 0) {
+        for (uint8_t i = 0; i < history_fields_; i++) values[i] = HISTORY_NO_DATA;
     }
     
-    if (sensor_manager_->isTDSValid()) {
-        snprintf(tds_str, sizeof(tds_str), "%.0f ppm", sensor_manager_->getLastTDS());
+    if (history_binary_) {
+        // Little-endian u32 time, then one int16 per field
+        size_t len = 0;
+        for (uint8_t b = 0; b < 4; b++) out[len++] = (char)(point.time >> (8 * b));
+        for (uint8_t i = 0; i < history_fields_; i++) {
+            out[len++] = (char)((uint16_t)values[i] & 0xFF);
+            out[len++] = (char)((uint16_t)values[i] >> 8);
+        }
+        return len;
+    }
+    
+    const uint16_t scale = SensorHistory::getChannelScale((HistoryChannel)history_channel_);
+    int len = snprintf(out, HISTORY_RECORD_MAX, "%lu", (unsigned long)point.time);
+    for (uint8_t i = 0; i < history_fields_; i++) {
+        out[len++] = ',';
+        len += SensorHistory::formatFixed(out + len, HISTORY_RECORD_MAX - len, values[i], scale);
+    }
+    out[len++] = '\n';
+    return len;
+}
+
+bool TcpServer::pumpHistoryStream() {
+    struct tcp_pcb* pcb = tcp_client_pcb_;
+    if (!pcb) {
+        endHistoryStream();
+        return false;
+    }
+    
+    while (history_query_) {
+        // Fill the chunk with whole records, then the trailer
+        while (!history_finished_ && stream_chunk_len_ + HISTORY_RECORD_MAX <= sizeof(stream_chunk_)) {
+            HistoryPoint point;
+            char* out = stream_chunk_ + stream_chunk_len_;
+            if (history_query_->next(&point)) {
+                stream_chunk_len_ += formatHistoryRecord(point, out);
+                history_points_++;
+                continue;
+            }
+            
+            // Binary streams end with an all-zero record before the text trailer
+            if (history_binary_) {
+                size_t len = 4 + 2 * history_fields_;
+                memset(out, 0, len);
+                out += len;
+                stream_chunk_len_ += len;
+            }
+            stream_chunk_len_ += snprintf(out, HISTORY_RECORD_MAX, "OK: %lu points\n",
+                                           (unsigned long)history_points_);
+            history_finished_ = true;
+        }
+        
+        if (stream_chunk_len_ > 0) {
+            // Wait for ACKs (tcp_sent_callback) when the send buffer is full
+            if (tcp_sndbuf(pcb) < stream_chunk_len_ || tcp_sndqueuelen(pcb) >= TCP_SND_QUEUELEN) break;
+            err_t err = tcp_write(pcb, stream_chunk_, stream_chunk_len_, TCP_WRITE_FLAG_COPY);
+            if (err == ERR_MEM) break;
+            if (err != ERR_OK) {
+                printf("History stream write failed: %d\n", err);
+                endHistoryStream();
+                return false;
+            }
+            stream_chunk_len_ = 0;
+        }
+        
+        if (history_finished_ && stream_chunk_len_ == 0) {
+            endHistoryStream();
+            tcp_output(pcb);
+            return true;
+        }
+    }
+    tcp_output(pcb);
+    return false;
+}
+
+void TcpServer::endHistoryStream() {
+    if (history_query_) {
+        history_query_->~HistoryQuery();
+        history_query_ = nullptr;
+        if (!trace_reader_) stream_arena_.reset();
+    }
+    stream_chunk_len_ = 0;
+    history_finished_ = false;
+}
+
+bool TcpServer::pumpTraceStream() {
+    struct tcp_pcb* pcb = tcp_client_pcb_;
+    if (!pcb) {
+        endTraceStream();
+        return false;
+    }
+    
+    while (trace_reader_) {
+        if (stream_chunk_len_ == 0) {
+            stream_chunk_len_ = trace_reader_->read(stream_chunk_, sizeof(stream_chunk_));
+            if (stream_chunk_len_ == 0) {
+                printf("Trace dump: %lu events\n", (unsigned long)trace_reader_->getEvents());
+                endTraceStream();
+                tcp_output(pcb);
+                return true;
+            }
+        }
+        
+        // Wait for ACKs (tcp_sent_callback) when the send buffer is full
+        if (tcp_sndbuf(pcb) < stream_chunk_len_ || tcp_sndqueuelen(pcb) >= TCP_SND_QUEUELEN) break;
+        err_t err = tcp_write(pcb, stream_chunk_, stream_chunk_len_, TCP_WRITE_FLAG_COPY);
+        if (err == ERR_MEM) break;
+        if (err != ERR_OK) {
+            printf("Trace stream write failed: %d\n", err);
+            endTraceStream();
+            return false;
+        }
+        stream_chunk_len_ = 0;
+    }
+    tcp_output(pcb);
+    return false;
+}
+
+void TcpServer::endTraceStream() {
+    if (trace_reader_) {
+        trace_reader_->~TraceReader();
+        trace_reader_ = nullptr;
+        if (!history_query_) stream_arena_.reset();
+    }
+    stream_chunk_len_ = 0;
+}
+
+void TcpServer::processStatusCommand(const char* args) {
+    const FieldSource src = { sensor_manager_, lights_controller_, pump_controller_,
+                              heater_controller_, fan_controller_ };
+    FieldValues values;
+    Fields::read(src, &values);
+    
+    time_t now = time(nullptr);
+    
+    if (args && strcmp(args, "bin") == 0) {
+        // Schema line, then one binary record (see Fields::writeBinary)
+        char header[512];
+        int len = snprintf(header, sizeof(header), "BIN status fields=");
+        len += Fields::writeSchema(header + len, sizeof(header) - len);
+        uint8_t record[FIELD_BINARY_SIZE];
+        Fields::writeBinary(values, now > 1600000000 ? (uint32_t)now : 0, record, sizeof(record));
+        
+        sendTcpResponse(header);
+        if (tcp_client_pcb_ && tcp_write(tcp_client_pcb_, record, sizeof(record), TCP_WRITE_FLAG_COPY) == ERR_OK) {
+            tcp_output(tcp_client_pcb_);
+        }
+        return;
+    }
+    
+    char time_str[64];
+    if (now > 1600000000) {
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&now));
     } else {
-        strcpy(tds_str, "N/A");
+        strcpy(time_str, "NOT SYNCED");
     }
     
-    snprintf(response, sizeof(response),
-        "=== HYDROPONIC CONTROLLER STATUS ===\n"
-        "Current time: %s\n"
-        "Lights: %s (window %02lu:%02lu-%02lu:%02lu)\n"
-        "Pump: %s (%lus ON every %lus)\n"
-        "Mode: %s\n"
-        "Heater: %s (Setpoint: %.1f°C)\n"
-        "Fan: %s (%.1f°C > %.1f°C ON, < %.1f°C OFF)\n"
-        "Water Temp: %s\n"
-        "Table Humidity: %s\n"
-        "Room Air Temp: %s\n"
-        "Room Air Humidity: %s\n"
-        "pH: %s\n"
-        "TDS: %s\n"
-        "%s"
-        "WiFi: Connected\n"
-        "Time Sync: OK",
-        time_str,
-        lights_controller_->isOn() ? "ON" : "OFF",
-        config.getLightsStartS() / 3600, (config.getLightsStartS() % 3600) / 60,
-        config.getLightsEndS() / 3600, (config.getLightsEndS() % 3600) / 60,
-        pump_controller_->isOn() ? "ON" : "OFF", config.getPumpOnSec(), config.getPumpPeriod(),
-        config.getHumidityMode() ? "Humidity Control" : "Timer",
-        heater_controller_->isOn() ? "ON" : "OFF", config.getHeaterSetpointC(),
-        fan_controller_->isOn() ? "ON" : "OFF", 
-        FanController::FAN_ON_TEMP_C, FanController::FAN_ON_TEMP_C, FanController::FAN_OFF_TEMP_C,
-        temp_str, humidity_str, air_temp_str, air_humidity_str, ph_str, tds_str,
-        humidity_details
-    );
+    char response[1536];
+    int len = snprintf(response, sizeof(response),
+                       "=== HYDROPONIC CONTROLLER STATUS ===\n"
+                       "Current time: %s\n", time_str);
+    len += Fields::writeText(values, FIELD_ALL, "%s: %s\n", response + len, sizeof(response) - len);
+    snprintf(response + len, sizeof(response) - len,
+             "Fan: ON > %.1f°C, OFF < %.1f°C\n"
+             "Sampling: water %.1fs, table %.1fs, air %.1fs, nano %.1fs%s",
+             FanController::FAN_ON_TEMP_C, FanController::FAN_OFF_TEMP_C,
+             sensor_manager_->getEffectiveIntervalMs(SENSOR_WATER_TEMP) / 1000.0f,
+             sensor_manager_->getEffectiveIntervalMs(SENSOR_TABLE_HUMIDITY) / 1000.0f,
+             sensor_manager_->getEffectiveIntervalMs(SENSOR_AIR) / 1000.0f,
+             sensor_manager_->getEffectiveIntervalMs(SENSOR_NANO) / 1000.0f,
+             sensor_manager_->isAdaptiveSampling() ? " (adaptive)" : "");
     
     sendTcpResponse(response);
 }
@@ -594,7 +1335,87 @@ void TcpServer::processHumidCommand() {
 void TcpServer::processSaveCommand() {
     ConfigManager& config = ConfigManager::getInstance();
     config.saveConfig();
-    sendTcpResponse("OK: Configuration saved to flash");
+    sendTcpResponse("OK: Configuration save scheduled (written once changes settle)");
+}
+
+void TcpServer::processBeginCommand() {
+    if (batch_open_) {
+        sendTcpResponse("ERROR: Batch already open ('commit' or 'abort' it first)");
+        return;
+    }
+    
+    batch_.clear();
+    batch_open_ = true;
+    sendTcpResponse("OK: Batch started; settings are staged until 'commit [save]'");
+}
+
+void TcpServer::processCommitCommand(const char* args) {
+    if (!batch_open_) {
+        sendTcpResponse("ERROR: No batch open (start one with 'begin')");
+        return;
+    }
+    
+    const bool save = args && strcmp(args, "save") == 0;
+    if (args && *args && !save) {
+        sendTcpResponse("ERROR: commit takes no argument or 'save'");
+        return;
+    }
+    
+    // A batch that fails validation stays open, so it can be fixed and retried
+    char response[128];
+    int len = snprintf(response, sizeof(response), "ERROR: ");
+    if (!batch_.validate(response + len, sizeof(response) - len)) {
+        sendTcpResponse(response);
+        return;
+    }
+    
+    SettingsCommit& commit = SettingsCommit::getInstance();
+    const uint32_t seq = commit.submit(batch_, save);
+    if (seq == 0) {
+        sendTcpResponse("ERROR: Another batch is being applied, try again");
+        return;
+    }
+    batch_open_ = false;
+    
+    // Answered by finishCommit() from the core 1 loop
+    commit_seq_ = seq;
+    commit_deadline_ms_ = Clock::deadlineMs(SETTINGS_APPLY_TIMEOUT_MS);
+    commit_count_ = batch_.count();
+    commit_save_ = save;
+    batch_.clear();
+}
+
+void TcpServer::finishCommit() {
+    if (commit_seq_ == 0) return;
+    const bool applied = SettingsCommit::getInstance().isApplied(commit_seq_);
+    if (!applied && !Clock::reachedMs(commit_deadline_ms_)) return;
+    commit_seq_ = 0;
+    
+    if (applied) {
+        char response[128];
+        snprintf(response, sizeof(response), "OK: %u settings applied%s", commit_count_,
+                 commit_save_ ? ", save scheduled" : "");
+        sendTcpResponse(response);
+        printf("Settings batch: %u settings%s\n", commit_count_, commit_save_ ? ", save scheduled" : "");
+    } else {
+        // Still queued; core 0 applies it as soon as it gets to it
+        sendTcpResponse(commit_save_ ? "OK: Batch queued, not yet applied (saved once applied)"
+                                     : "OK: Batch queued, not yet applied");
+    }
+    
+    // Run commands that arrived while waiting
+    processCommandBuffer();
+}
+
+void TcpServer::processAbortCommand() {
+    if (!batch_open_) {
+        sendTcpResponse("ERROR: No batch open");
+        return;
+    }
+    
+    batch_open_ = false;
+    batch_.clear();
+    sendTcpResponse("OK: Batch discarded");
 }
 
 void TcpServer::processLoadCommand() {
@@ -607,7 +1428,7 @@ void TcpServer::processLoadCommand() {
 }
 
 void TcpServer::processHelpCommand() {
-    char help[1024];
+    char help[3072];
     snprintf(help, sizeof(help),
         "=== AVAILABLE COMMANDS ===\n"
         "lights HH:MM HH:MM    - Set lights window (e.g. lights 08:30 19:45)\n"
@@ -619,10 +1440,25 @@ void TcpServer::processHelpCommand() {
         "minrun SEC            - Set minimum pump run time in seconds (e.g. minrun 45)\n"
         "minoff SEC            - Set minimum pump off time in seconds (e.g. minoff 600)\n"
         "maxoff SEC            - Set maximum pump off time in seconds (e.g. maxoff 3600)\n"
-        "status                 - Show current configuration and state\n"
+        "sensor [NAME SEC [OFF]] - Show or set sensor sampling (e.g. sensor air 30 15)\n"
+        "sensorrange NAME MIN MAX - Set adaptive sampling range in seconds\n"
+        "adaptive on|off       - Enable or disable adaptive sampling\n"
+        "timebench             - Benchmark cached vs localtime_r local time\n"
+        "log [flush]           - Show persistent log usage or flush pending samples\n"
+        "history CH RANGE [STEP] [AGG] [csv|bin] - Stream history (e.g. history water 7d 1h all)\n"
+        "telemetry             - Show telemetry spool depth and replay progress\n"
+        "perf [STAGE|reset]    - Core 0 loop stage timings, one stage's histogram, or reset\n"
+        "trace [dump [json|bin]] - Trace ring usage, or stream both cores' timelines\n"
+        "loglevel [MODULE|all LEVEL] - Show or set log levels (e.g. loglevel http debug)\n"
+        "loglevel output text|binary - USB log format (binary: tools/log_decode.py)\n"
+        "mem                   - Heap, buffer, stack, request pool and lwIP pool usage\n"
+        "status [bin]           - Show current configuration and state (bin: one binary record)\n"
         "temp                   - Get current temperature reading\n"
         "humid                  - Get current humidity reading\n"
-        "save                   - Save current configuration to flash\n"
+        "begin                  - Start a batch: setting commands are staged, not applied\n"
+        "commit [save]          - Check the batch and apply it at one control pass (save: schedule a save)\n"
+        "abort                  - Discard the open batch\n"
+        "save                   - Save current configuration to flash (debounced)\n"
         "load                   - Load configuration from flash\n"
         "upload PATH SIZE       - Start file upload (e.g. upload /index.html 1024)\n"
         "data BASE64_DATA       - Send file data (base64 encoded)\n"
@@ -659,10 +1495,11 @@ void TcpServer::processUploadCommand(const char* args) {
         return;
     }
     
-    // Allocate buffer for upload
-    upload_buffer_ = (uint8_t*)malloc(size);
+    // One pool block stages the data; each full block is appended to a
+    // temporary file, so the upload size is not bounded by RAM
+    upload_buffer_ = (uint8_t*)g_upload_pool.alloc();
     if (!upload_buffer_) {
-        sendTcpResponse("ERROR: Failed to allocate memory for upload");
+        sendTcpResponse("ERROR: Upload buffer in use");
         return;
     }
     
@@ -671,8 +1508,13 @@ void TcpServer::processUploadCommand(const char* args) {
     upload_path_[sizeof(upload_path_) - 1] = '\0';
     upload_size_ = size;
     upload_received_ = 0;
+    upload_buffered_ = 0;
     upload_in_progress_ = true;
     
+    char temp_path[72];
+    getUploadTempPath(temp_path, sizeof(temp_path));
+    FlashStorage::getInstance().deleteFile(temp_path);  // Left over from an aborted upload
+    
     char response[128];
     snprintf(response, sizeof(response), "READY: Send %lu bytes of data using 'data' command", size);
     sendTcpResponse(response);
@@ -695,8 +1537,7 @@ void TcpServer::processDataCommand(const char* args) {
     
     if (upload_received_ + decoded_len > upload_size_) {
         sendTcpResponse("ERROR: Data exceeds expected file size");
-        free(upload_buffer_);
-        upload_in_progress_ = false;
+        abortUpload();
         return;
     }
     
@@ -723,7 +1564,13 @@ void TcpServer::processDataCommand(const char* args) {
             if (valid_chars == 4) {
                 // Extract 3 bytes from 4 base64 chars
                 for (int j = 0; j < 3 && upload_received_ < upload_size_; j++) {
-                    upload_buffer_[upload_received_++] = (chunk >> (16 - j * 8)) & 0xFF;
+                    if (upload_buffered_ == g_upload_pool.getBlockSize() && !flushUpload()) {
+                        sendTcpResponse("ERROR: Failed to save file to flash storage");
+                        abortUpload();
+                        return;
+                    }
+                    upload_buffer_[upload_buffered_++] = (chunk >> (16 - j * 8)) & 0xFF;
+                    upload_received_++;
                 }
             }
         }
@@ -731,19 +1578,20 @@ void TcpServer::processDataCommand(const char* args) {
     
     // Check if upload is complete
     if (upload_received_ >= upload_size_) {
-        // Save file to flash storage
-        FlashStorage& storage = FlashStorage::getInstance();
-        if (storage.uploadFile(upload_path_, upload_buffer_, upload_size_)) {
+        // The finished file replaces any existing one in a single rename
+        char temp_path[72];
+        getUploadTempPath(temp_path, sizeof(temp_path));
+        if (flushUpload() && FlashStorage::getInstance().renameFile(temp_path, upload_path_)) {
             char response[128];
             snprintf(response, sizeof(response), "OK: Uploaded %s (%lu bytes)", upload_path_, upload_size_);
             sendTcpResponse(response);
+            g_upload_pool.release(upload_buffer_);
+            upload_buffer_ = nullptr;
+            upload_in_progress_ = false;
         } else {
             sendTcpResponse("ERROR: Failed to save file to flash storage");
+            abortUpload();
         }
-        
-        // Clean up
-        free(upload_buffer_);
-        upload_in_progress_ = false;
     } else {
         char response[64];
         snprintf(response, sizeof(response), "RECEIVED: %lu/%lu bytes", upload_received_, upload_size_);
@@ -751,6 +1599,35 @@ void TcpServer::processDataCommand(const char* args) {
     }
 }
 
+void TcpServer::getUploadTempPath(char* out, size_t size) const {
+    snprintf(out, size, "%s.part", upload_path_);
+}
+
+bool TcpServer::flushUpload() {
+    if (upload_buffered_ == 0) {
+        return true;
+    }
+    
+    char temp_path[72];
+    getUploadTempPath(temp_path, sizeof(temp_path));
+    if (!FlashStorage::getInstance().appendFile(temp_path, upload_buffer_, upload_buffered_)) {
+        return false;
+    }
+    upload_buffered_ = 0;
+    return true;
+}
+
+void TcpServer::abortUpload() {
+    char temp_path[72];
+    getUploadTempPath(temp_path, sizeof(temp_path));
+    FlashStorage::getInstance().deleteFile(temp_path);
+    
+    g_upload_pool.release(upload_buffer_);
+    upload_buffer_ = nullptr;
+    upload_buffered_ = 0;
+    upload_in_progress_ = false;
+}
+
 void TcpServer::processListCommand() {
     FlashStorage& storage = FlashStorage::getInstance();
     if (storage.listFiles()) {
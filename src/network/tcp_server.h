@@ -4,12 +4,19 @@
 #include <stdbool.h>
 #include "lwip/tcp.h"
 #include "lwip/pbuf.h"
+#include "../config.h"
+#include "../utils/mem_pool.h"
+#include "../telemetry_fields.h"
+#include "../control/settings_batch.h"
 
 class SensorManager;
 class LightsController;
 class PumpController;
 class HeaterController;
 class FanController;
+class HistoryQuery;
+struct HistoryPoint;
+class TraceReader;
 
 class TcpServer {
 public:
@@ -29,14 +36,48 @@ private:
     static err_t tcp_accept_callback(void* arg, struct tcp_pcb* newpcb, err_t err);
     static err_t tcp_recv_callback(void* arg, struct tcp_pcb* tpcb, struct pbuf* p, err_t err);
     static void tcp_err_callback(void* arg, err_t err);
+    static err_t tcp_sent_callback(void* arg, struct tcp_pcb* tpcb, uint16_t len);
     
     err_t tcpAccept(struct tcp_pcb* newpcb, err_t err);
     err_t tcpRecv(struct tcp_pcb* tpcb, struct pbuf* p, err_t err);
     void tcpErr(err_t err);
     
+    // One client at a time: a new connection replaces the current one, whose
+    // callbacks are detached so nothing it sends later reaches the new
+    // session. ERR_ABRT if the pcb had to be aborted.
+    err_t closeClient(struct tcp_pcb* pcb);
+    
+    // Drop everything the previous client left behind (history or trace
+    // stream, batch, upload, unprocessed input)
+    void resetSession();
+    
     // Command processing
     void processTcpCommand(const char* command);
+    void processCommandBuffer();
     void sendTcpResponse(const char* message);
+    void sendStaged();
+    
+    // True when the caller should apply change now. Otherwise it failed the
+    // checks (error sent) or went into the open batch (range-checked only;
+    // the rules between fields run at commit).
+    bool applyNow(const SettingsBatch& change);
+    
+    // History streaming: refilled from tcp_sent as the peer ACKs; true once
+    // the whole stream is queued
+    bool pumpHistoryStream();
+    void endHistoryStream();
+    size_t formatHistoryRecord(const HistoryPoint& point, char* out);
+    
+    // Trace dump streaming, paced the same way
+    bool pumpTraceStream();
+    void endTraceStream();
+    bool isStreaming() const { return history_query_ || trace_reader_; }
+    
+    // Commit reply, sent from handleClients() once core 0 has applied the
+    // batch or SETTINGS_APPLY_TIMEOUT_MS has passed
+    void finishCommit();
+    // Commands wait in the buffer during a stream or a pending commit reply
+    bool isHoldingInput() const { return isStreaming() || commit_seq_ != 0; }
     
     // Command handlers
     void processLightsCommand(const char* args);
@@ -48,7 +89,21 @@ private:
     void processMinOffCommand(const char* args);
     void processMaxOffCommand(const char* args);
     void processFanCommand(const char* args);
-    void processStatusCommand();
+    void processSensorCommand(const char* args);
+    void processSensorRangeCommand(const char* args);
+    void processAdaptiveCommand(const char* args);
+    void processTimeBenchCommand();
+    void processLogCommand(const char* args);
+    void processHistoryCommand(const char* args);
+    void processTelemetryCommand();
+    void processPerfCommand(const char* args);
+    void processTraceCommand(const char* args);
+    void processLogLevelCommand(const char* args);
+    void processMemCommand();
+    void processStatusCommand(const char* args);
+    void processBeginCommand();
+    void processCommitCommand(const char* args);
+    void processAbortCommand();
     void processSaveCommand();
     void processLoadCommand();
     void processHelpCommand();
@@ -56,6 +111,9 @@ private:
     void processHumidCommand();
     void processUploadCommand(const char* args);
     void processDataCommand(const char* args);
+    bool flushUpload();
+    void abortUpload();
+    void getUploadTempPath(char* out, size_t size) const;
     void processListCommand();
     
     // Component references
@@ -71,10 +129,43 @@ private:
     char tcp_command_buffer_[256];
     uint16_t tcp_command_len_;
     
-    // Upload state
+    // Per-connection memory for stream state (history query or trace
+    // reader), reset when the stream ends
+    alignas(8) uint8_t stream_arena_buffer_[TCP_REQUEST_ARENA_BYTES];
+    Arena stream_arena_;
+    
+    // History stream state
+    HistoryQuery* history_query_;
+    uint8_t history_channel_;
+    uint8_t history_agg_;
+    uint8_t history_fields_;
+    bool history_binary_;
+    bool history_finished_;
+    uint32_t history_points_;
+    
+    // Trace dump state
+    TraceReader* trace_reader_;
+    
+    // Pending output of the active stream
+    char stream_chunk_[512];
+    uint16_t stream_chunk_len_;
+    
+    // Upload state: data is staged in a g_upload_pool block and appended to
+    // <path>.part, which replaces the file once complete
     bool upload_in_progress_;
     char upload_path_[64];
     uint32_t upload_size_;
     uint32_t upload_received_;
     uint8_t* upload_buffer_;
+    uint32_t upload_buffered_;
+    
+    // Settings staged between `begin` and `commit`
+    SettingsBatch batch_;
+    bool batch_open_;
+    
+    // Committed batch awaiting its reply (seq 0: none)
+    uint32_t commit_seq_;
+    uint64_t commit_deadline_ms_;
+    uint8_t commit_count_;
+    bool commit_save_;
 };
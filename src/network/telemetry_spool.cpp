@@ -0,0 +1,376 @@
+#include "telemetry_spool.h"
+#include "network_manager.h"
+#include "../storage/flash_storage.h"
+#include "../utils/clock.h"
+#include "../utils/crc_utils.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SPOOL_FILE        TELEMETRY_SPOOL_DIR "/queue.dat"
+#define SPOOL_STATE_FILE  TELEMETRY_SPOOL_DIR "/state"
+#define SPOOL_STATE_MAGIC 0x4C4F4F53UL  // "SOOL"
+
+// Replayed records between state saves (a reboot may repeat up to this many)
+static const uint32_t STATE_SAVE_INTERVAL = 256;
+
+static const uint32_t SCAN_BATCH = 16;
+static TelemetryRecord scan_buffer[SCAN_BATCH > TELEMETRY_REPLAY_BATCH ? SCAN_BATCH : TELEMETRY_REPLAY_BATCH];
+
+TelemetrySpool& TelemetrySpool::getInstance() {
+    static TelemetrySpool instance;
+    return instance;
+}
+
+TelemetrySpool::TelemetrySpool()
+    : ready_(false), sink_count_(0), next_seq_(1), seq_reserved_(0), replayed_seq_(0),
+      read_slot_(0), write_slot_(0), depth_(0), staged_count_(0), last_replay_ms_(0),
+      unsaved_replays_(0), live_sent_(0), replayed_(0), dropped_(0),
+      replay_done_(0), replay_total_(0) {
+    memset(sinks_, 0, sizeof(sinks_));
+    memset(pending_, 0, sizeof(pending_));
+    memset(live_tail_, 0, sizeof(live_tail_));
+}
+
+uint32_t TelemetrySpool::recordCrc(const TelemetryRecord& record) {
+    TelemetryRecord check = record;
+    check.crc = 0;
+    return CrcUtils::crc32(&check, sizeof(check));
+}
+
+bool TelemetrySpool::begin() {
+    if (!FlashStorage::getInstance().makeDir(TELEMETRY_SPOOL_DIR)) {
+        printf("Telemetry: cannot create %s\n", TELEMETRY_SPOOL_DIR);
+        return false;
+    }
+    
+    State state;
+    bool have_state = loadState(&state);
+    replayed_seq_ = have_state ? state.replayed_seq : 0;
+    
+    uint32_t max_seq = 0;
+    scan(replayed_seq_, &max_seq);
+    for (uint8_t i = 0; i < sink_count_; i++) {
+        pending_[i] = depth_;
+        live_tail_[i] = 0;
+    }
+    
+    // Skip every sequence number that may have gone out before the reset
+    next_seq_ = max_seq + 1;
+    if (have_state && state.seq_reserved > next_seq_) {
+        next_seq_ = state.seq_reserved;
+    }
+    seq_reserved_ = next_seq_ + TELEMETRY_SEQ_BLOCK;
+    saveState();
+    
+    ready_ = true;
+    printf("Telemetry: %lu spooled records, next seq %lu\n",
+           (unsigned long)depth_, (unsigned long)next_seq_);
+    return true;
+}
+
+bool TelemetrySpool::addSink(TelemetrySink* sink) {
+    if (!sink || sink_count_ >= TELEMETRY_MAX_SINKS) return false;
+    // A new sink has not seen any of the backlog
+    pending_[sink_count_] = depth_;
+    live_tail_[sink_count_] = 0;
+    sinks_[sink_count_++] = sink;
+    return true;
+}
+
+void TelemetrySpool::scan(uint32_t replayed_seq, uint32_t* max_seq) {
+    FlashStorage& storage = FlashStorage::getInstance();
+    const uint32_t capacity = TELEMETRY_SPOOL_RECORDS;
+    
+    read_slot_ = 0;
+    write_slot_ = 0;
+    depth_ = 0;
+    *max_seq = replayed_seq;
+    
+    int32_t size = storage.getFileSize(SPOOL_FILE);
+    if (size <= 0) return;
+    uint32_t records = (uint32_t)size / sizeof(TelemetryRecord);
+    if (records > capacity) records = capacity;
+    
+    // Records are written in sequence order, so the undelivered ones form
+    // one run that ends at the newest record
+    uint32_t newest_seq = 0;
+    uint32_t newest_slot = 0;
+    uint32_t oldest_pending_seq = UINT32_MAX;
+    uint32_t oldest_pending_slot = 0;
+    for (uint32_t slot = 0; slot < records; slot += SCAN_BATCH) {
+        uint32_t count = records - slot < SCAN_BATCH ? records - slot : SCAN_BATCH;
+        int32_t n = storage.readFile(SPOOL_FILE, slot * sizeof(TelemetryRecord),
+                                     (uint8_t*)scan_buffer, count * sizeof(TelemetryRecord));
+        if (n != (int32_t)(count * sizeof(TelemetryRecord))) break;
+    
+        for (uint32_t i = 0; i < count; i++) {
+            const TelemetryRecord& record = scan_buffer[i];
+            if (record.seq == 0 || record.crc != recordCrc(record)) continue;
+            if (record.seq > newest_seq) {
+                newest_seq = record.seq;
+                newest_slot = slot + i;
+            }
+            if (record.seq > replayed_seq) {
+                depth_++;
+                if (record.seq < oldest_pending_seq) {
+                    oldest_pending_seq = record.seq;
+                    oldest_pending_slot = slot + i;
+                }
+            }
+        }
+    }
+    
+    if (newest_seq == 0) return;
+    write_slot_ = (newest_slot + 1) % capacity;
+    read_slot_ = depth_ > 0 ? oldest_pending_slot : write_slot_;
+    if (newest_seq > *max_seq) *max_seq = newest_seq;
+}
+
+bool TelemetrySpool::loadState(State* state) {
+    int32_t n = FlashStorage::getInstance().readFile(SPOOL_STATE_FILE, 0, (uint8_t*)state, sizeof(*state));
+    if (n != (int32_t)sizeof(*state) || state->magic != SPOOL_STATE_MAGIC) return false;
+    
+    uint32_t crc = state->crc;
+    state->crc = 0;
+    return CrcUtils::crc32(state, sizeof(*state)) == crc;
+}
+
+bool TelemetrySpool::saveState() {
+    State state;
+    state.magic = SPOOL_STATE_MAGIC;
+    state.seq_reserved = seq_reserved_;
+    state.replayed_seq = replayed_seq_;
+    state.crc = 0;
+    state.crc = CrcUtils::crc32(&state, sizeof(state));
+    
+    unsaved_replays_ = 0;
+    if (!FlashStorage::getInstance().writeFileAt(SPOOL_STATE_FILE, 0, (const uint8_t*)&state, sizeof(state))) {
+        printf("Telemetry: cannot save %s\n", SPOOL_STATE_FILE);
+        return false;
+    }
+    return true;
+}
+
+void TelemetrySpool::submit(const LogSample& sample) {
+    if (!ready_) return;
+    
+    TelemetryRecord record;
+    memset(&record, 0, sizeof(record));
+    record.seq = next_seq_++;
+    record.time = sample.time;
+    memcpy(record.values, sample.values, sizeof(record.values));
+    
+    if (next_seq_ >= seq_reserved_) {
+        seq_reserved_ = next_seq_ + TELEMETRY_SEQ_BLOCK;
+        saveState();
+    }
+    
+    // Live records go straight to every sink that is up, even one still
+    // replaying its backlog. The record is spooled only if some sink missed
+    // it or is behind and needs it in order.
+    const bool connected = NetworkManager::getInstance().isConnected();
+    bool delivered[TELEMETRY_MAX_SINKS];
+    bool sent = false;
+    bool needed = false;
+    for (uint8_t i = 0; i < sink_count_; i++) {
+        delivered[i] = connected && sinks_[i]->isReady() && sinks_[i]->send(&record, 1, false);
+        if (delivered[i]) sent = true;
+        if (!delivered[i] || pending_[i] > 0) needed = true;
+    }
+    if (sent) live_sent_++;
+    if (!needed) return;
+    
+    spool(record);
+    for (uint8_t i = 0; i < sink_count_; i++) {
+        if (delivered[i] && pending_[i] == 0) continue;
+        pending_[i]++;
+        // A miss breaks the run taken live; the sink gets that run again
+        live_tail_[i] = delivered[i] ? live_tail_[i] + 1 : 0;
+    }
+}
+
+void TelemetrySpool::spool(const TelemetryRecord& record) {
+    if (depth_ >= TELEMETRY_SPOOL_RECORDS && flashPending() > 0) {
+        // Full: drop the oldest record on flash
+        read_slot_ = (read_slot_ + 1) % TELEMETRY_SPOOL_RECORDS;
+        depth_--;
+        dropped_++;
+        clampPending();
+    }
+    
+    staged_[staged_count_++] = record;
+    depth_++;
+    if (replay_total_ > 0) replay_total_++;
+    
+    if (staged_count_ == TELEMETRY_SPOOL_BATCH) {
+        writeStaged();
+    }
+}
+
+void TelemetrySpool::clampPending() {
+    for (uint8_t i = 0; i < sink_count_; i++) {
+        if (pending_[i] > depth_) pending_[i] = depth_;
+        if (live_tail_[i] >= pending_[i]) {
+            pending_[i] = 0;
+            live_tail_[i] = 0;
+        }
+    }
+}
+
+bool TelemetrySpool::writeStaged() {
+    const uint32_t capacity = TELEMETRY_SPOOL_RECORDS;
+    const uint32_t count = staged_count_;
+    if (count == 0) return true;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        staged_[i].crc = recordCrc(staged_[i]);
+    }
+    
+    // At most two contiguous runs: up to the end of the file, then from slot 0
+    FlashStorage& storage = FlashStorage::getInstance();
+    const uint32_t first_run = count < capacity - write_slot_ ? count : capacity - write_slot_;
+    bool ok = storage.writeFileAt(SPOOL_FILE, write_slot_ * sizeof(TelemetryRecord),
+                                  (const uint8_t*)staged_, first_run * sizeof(TelemetryRecord));
+    if (ok && first_run < count) {
+        ok = storage.writeFileAt(SPOOL_FILE, 0, (const uint8_t*)(staged_ + first_run),
+                                 (count - first_run) * sizeof(TelemetryRecord));
+    }
+    
+    staged_count_ = 0;
+    if (!ok) {
+        // A failed batch is dropped rather than retried forever
+        printf("Telemetry: write to %s failed, %lu records dropped\n", SPOOL_FILE, (unsigned long)count);
+        depth_ -= count;
+        dropped_ += count;
+        // The dropped records were the newest of every sink's share
+        for (uint8_t i = 0; i < sink_count_; i++) {
+            pending_[i] -= pending_[i] < count ? pending_[i] : count;
+            live_tail_[i] -= live_tail_[i] < count ? live_tail_[i] : count;
+        }
+        clampPending();
+        return false;
+    }
+    write_slot_ = (write_slot_ + count) % capacity;
+    return true;
+}
+
+void TelemetrySpool::update() {
+    if (!ready_) return;
+    
+    trimBacklog();
+    if (depth_ == 0) {
+        if (replay_total_ > 0) {
+            printf("Telemetry: replay complete (%lu records)\n", (unsigned long)replay_done_);
+            replay_total_ = 0;
+            replay_done_ = 0;
+        }
+        if (unsaved_replays_ > 0) saveState();
+        return;
+    }
+    
+    if (!NetworkManager::getInstance().isConnected()) return;
+    
+    bool behind[TELEMETRY_MAX_SINKS];
+    bool any = false;
+    for (uint8_t i = 0; i < sink_count_; i++) {
+        behind[i] = pending_[i] > 0 && sinks_[i]->isReady();
+        if (behind[i]) any = true;
+    }
+    if (!any) return;
+    
+    if (replay_total_ == 0) {
+        replay_total_ = depth_;
+        replay_done_ = 0;
+        printf("Telemetry: replaying %lu spooled records\n", (unsigned long)depth_);
+    }
+    
+    // Rate limit so replay never crowds out live traffic
+    if (Clock::elapsedMs(last_replay_ms_) < TELEMETRY_REPLAY_INTERVAL_MS) return;
+    last_replay_ms_ = Clock::nowMs();
+    for (uint8_t i = 0; i < sink_count_; i++) {
+        if (behind[i]) replayBurst(i);
+    }
+    trimBacklog();
+}
+
+uint32_t TelemetrySpool::readBacklog(uint32_t index, uint32_t count, TelemetryRecord* records) {
+    // Backlog index 0 is the oldest record: flash slots first, then RAM
+    const uint32_t capacity = TELEMETRY_SPOOL_RECORDS;
+    const uint32_t on_flash = flashPending();
+    
+    if (index >= on_flash) {
+        const uint32_t staged = index - on_flash;
+        if (count > staged_count_ - staged) count = staged_count_ - staged;
+        for (uint32_t i = 0; i < count; i++) {
+            records[i] = staged_[staged + i];
+            records[i].crc = recordCrc(records[i]);
+        }
+        return count;
+    }
+    
+    const uint32_t slot = (read_slot_ + index) % capacity;
+    if (count > on_flash - index) count = on_flash - index;
+    if (count > capacity - slot) count = capacity - slot;
+    int32_t n = FlashStorage::getInstance().readFile(SPOOL_FILE, slot * sizeof(TelemetryRecord),
+                                                     (uint8_t*)records, count * sizeof(TelemetryRecord));
+    if (n != (int32_t)(count * sizeof(TelemetryRecord))) {
+        printf("Telemetry: read from %s failed\n", SPOOL_FILE);
+        return 0;
+    }
+    return count;
+}
+
+void TelemetrySpool::replayBurst(uint8_t sink) {
+    const uint32_t wanted = pending_[sink] - live_tail_[sink];
+    uint32_t count = wanted < TELEMETRY_REPLAY_BATCH ? wanted : TELEMETRY_REPLAY_BATCH;
+    count = readBacklog(depth_ - pending_[sink], count, scan_buffer);
+    if (count == 0) return;
+    
+    // Records failing their CRC are dropped
+    uint32_t valid = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (scan_buffer[i].crc == recordCrc(scan_buffer[i])) {
+            scan_buffer[valid++] = scan_buffer[i];
+        }
+    }
+    if (valid > 0 && !sinks_[sink]->send(scan_buffer, valid, true)) return;
+    
+    pending_[sink] -= count;
+    if (pending_[sink] == live_tail_[sink]) {
+        // Caught up with what it took live: back to live only
+        pending_[sink] = 0;
+        live_tail_[sink] = 0;
+    }
+    replayed_ += valid;
+    dropped_ += count - valid;
+}
+
+void TelemetrySpool::trimBacklog() {
+    // Records older than every sink's share are no longer needed
+    uint32_t keep = 0;
+    for (uint8_t i = 0; i < sink_count_; i++) {
+        if (pending_[i] > keep) keep = pending_[i];
+    }
+    if (keep >= depth_ || sink_count_ == 0) return;
+    
+    const uint32_t count = depth_ - keep;
+    TelemetryRecord last;
+    if (readBacklog(count - 1, 1, &last) == 1 && last.crc == recordCrc(last)) {
+        replayed_seq_ = last.seq;
+    }
+    
+    const uint32_t on_flash = flashPending();
+    const uint32_t from_flash = count < on_flash ? count : on_flash;
+    const uint32_t from_ram = count - from_flash;
+    read_slot_ = (read_slot_ + from_flash) % TELEMETRY_SPOOL_RECORDS;
+    if (from_ram > 0) {
+        memmove(staged_, staged_ + from_ram, (staged_count_ - from_ram) * sizeof(TelemetryRecord));
+        staged_count_ -= from_ram;
+    }
+    depth_ -= count;
+    replay_done_ += count;
+    unsaved_replays_ += count;
+    if (unsaved_replays_ >= STATE_SAVE_INTERVAL) {
+        saveState();
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../config.h"
+#include "../storage/log_block.h"
+
+// One outbound telemetry sample. seq increases by one per record across
+// reboots, so consumers can drop duplicates (replays may repeat records).
+struct TelemetryRecord {
+    uint32_t seq;
+    uint32_t time;                         // Unix time
+    int16_t values[HIST_CHANNEL_COUNT];    // Fixed point, see SensorHistory
+    uint16_t reserved;
+    uint32_t crc;                          // CRC-32 (crc = 0); set on flash only
+};
+
+// Destination for telemetry (MQTT, UDP, ...). Called from core 1.
+class TelemetrySink {
+public:
+    virtual ~TelemetrySink() = default;
+    
+    virtual const char* getName() const = 0;
+    
+    // Session up and able to take records now
+    virtual bool isReady() = 0;
+    
+    // Queue records for sending; false if they could not be taken (the spool
+    // keeps them and retries). replay marks records from the backlog.
+    virtual bool send(const TelemetryRecord* records, size_t count, bool replay) = 0;
+};
+
+// Store-and-forward queue in front of the telemetry sinks. Records a sink
+// misses (WiFi link or sink down) are staged in RAM and written in batches
+// to a fixed-size circular file. Each sink keeps its own place in that
+// backlog: a healthy sink keeps getting live records while a failed one is
+// replayed oldest first, in small bursts between live records, once it is
+// back. When full, the oldest records are dropped. Core 1 only.
+class TelemetrySpool {
+public:
+    static TelemetrySpool& getInstance();
+    
+    // Recover the backlog and sequence counter from flash
+    bool begin();
+    
+    bool addSink(TelemetrySink* sink);
+    
+    // Send one sample live, or spool it while offline
+    void submit(const LogSample& sample);
+    
+    // Replay the backlog at the rate limit; call from the core 1 loop
+    void update();
+    
+    // Statistics
+    uint32_t getDepth() const { return depth_; }
+    uint32_t getCapacity() const { return TELEMETRY_SPOOL_RECORDS; }
+    uint32_t getNextSeq() const { return next_seq_; }
+    uint32_t getLiveSent() const { return live_sent_; }
+    uint32_t getReplayed() const { return replayed_; }
+    uint32_t getDropped() const { return dropped_; }
+    bool isReplaying() const { return replay_total_ > 0; }
+    // Progress of the current replay: done of total records
+    uint32_t getReplayDone() const { return replay_done_; }
+    uint32_t getReplayTotal() const { return replay_total_; }
+    
+private:
+    TelemetrySpool();
+    
+    struct State {
+        uint32_t magic;
+        uint32_t seq_reserved;     // Sequence numbers below this may be in use
+        uint32_t replayed_seq;     // Last spooled record every sink has taken
+        uint32_t crc;
+    };
+    
+    void spool(const TelemetryRecord& record);
+    bool writeStaged();
+    void clampPending();
+    uint32_t readBacklog(uint32_t index, uint32_t count, TelemetryRecord* records);
+    void replayBurst(uint8_t sink);
+    void trimBacklog();
+    void scan(uint32_t replayed_seq, uint32_t* max_seq);
+    bool loadState(State* state);
+    bool saveState();
+    uint32_t flashPending() const { return depth_ - staged_count_; }
+    static uint32_t recordCrc(const TelemetryRecord& record);
+    
+    bool ready_;
+    TelemetrySink* sinks_[TELEMETRY_MAX_SINKS];
+    uint8_t sink_count_;
+    // Per sink: it still needs the newest pending_ records of the backlog,
+    // except the newest live_tail_ of those, which it took live while behind
+    uint32_t pending_[TELEMETRY_MAX_SINKS];
+    uint32_t live_tail_[TELEMETRY_MAX_SINKS];
+    
+    uint32_t next_seq_;
+    uint32_t seq_reserved_;
+    uint32_t replayed_seq_;
+    
+    // Backlog: flash slots [read_slot_, write_slot_) then the staged records
+    uint32_t read_slot_;
+    uint32_t write_slot_;
+    uint32_t depth_;
+    TelemetryRecord staged_[TELEMETRY_SPOOL_BATCH];
+    uint8_t staged_count_;
+    
+    uint64_t last_replay_ms_;
+    uint32_t unsaved_replays_;
+    uint32_t live_sent_;
+    uint32_t replayed_;
+    uint32_t dropped_;
+    uint32_t replay_done_;
+    uint32_t replay_total_;
+};
@@ -0,0 +1,83 @@
+#include "udp_telemetry.h"
+#include "../utils/clock.h"
+#include "../utils/crc_utils.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/pbuf.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+UdpTelemetry::UdpTelemetry() : pcb_(nullptr), sent_(0), errors_(0) {
+    memset(&group_, 0, sizeof(group_));
+}
+
+UdpTelemetry::~UdpTelemetry() {
+    if (pcb_) {
+        cyw43_arch_lwip_begin();
+        udp_remove(pcb_);
+        cyw43_arch_lwip_end();
+        pcb_ = nullptr;
+    }
+}
+
+bool UdpTelemetry::begin() {
+    if (!ipaddr_aton(TELEMETRY_UDP_GROUP, &group_)) {
+        printf("UDP telemetry: invalid group %s\n", TELEMETRY_UDP_GROUP);
+        return false;
+    }
+    
+    cyw43_arch_lwip_begin();
+    pcb_ = udp_new();
+    if (pcb_) {
+        udp_set_multicast_ttl(pcb_, TELEMETRY_UDP_TTL);
+    }
+    cyw43_arch_lwip_end();
+    
+    if (!pcb_) {
+        printf("UDP telemetry: cannot create PCB\n");
+        return false;
+    }
+    printf("UDP telemetry: multicast to %s:%d\n", TELEMETRY_UDP_GROUP, TELEMETRY_UDP_PORT);
+    return true;
+}
+
+bool UdpTelemetry::send(const TelemetryRecord* records, size_t count, bool replay) {
+    if (!pcb_) return false;
+    
+    TelemetryDatagram datagram;
+    memset(&datagram, 0, sizeof(datagram));
+    datagram.magic = TELEMETRY_DATAGRAM_MAGIC;
+    datagram.version = TELEMETRY_DATAGRAM_VERSION;
+    datagram.flags = replay ? TELEMETRY_FLAG_REPLAY : 0;
+    datagram.channel_count = HIST_CHANNEL_COUNT;
+    strncpy(datagram.node, NODE_ID, sizeof(datagram.node));
+    datagram.uptime_s = (uint32_t)(Clock::nowMs() / 1000);
+    
+    bool ok = true;
+    cyw43_arch_lwip_begin();
+    for (size_t i = 0; i < count; i++) {
+        datagram.seq = records[i].seq;
+        datagram.time = records[i].time;
+        memcpy(datagram.values, records[i].values, sizeof(datagram.values));
+        datagram.crc = CrcUtils::crc32(&datagram, offsetof(TelemetryDatagram, crc));
+    
+        struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, sizeof(datagram), PBUF_RAM);
+        if (!p) {
+            ok = false;
+            break;
+        }
+        pbuf_take(p, &datagram, sizeof(datagram));
+        err_t err = udp_sendto(pcb_, p, &group_, TELEMETRY_UDP_PORT);
+        pbuf_free(p);
+        if (err != ERR_OK) {
+            ok = false;
+            break;
+        }
+        sent_++;
+    }
+    cyw43_arch_lwip_end();
+    
+    // The spool keeps the records and retries them
+    if (!ok) errors_++;
+    return ok;
+}
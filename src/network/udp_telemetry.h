@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../config.h"
+#include "telemetry_spool.h"
+#include "lwip/udp.h"
+#include "lwip/ip_addr.h"
+
+#define TELEMETRY_DATAGRAM_MAGIC   0x54445948UL  // "HYDT"
+#define TELEMETRY_DATAGRAM_VERSION 1
+
+enum : uint8_t {
+    TELEMETRY_FLAG_REPLAY = 1 << 0,   // Sent from the spool backlog
+};
+
+// Wire format, little endian (tools/telemetry_collector.py decodes it).
+// New fields are appended and bump version; a collector reads the prefix it
+// knows and uses channel_count to find the end of values.
+struct TelemetryDatagram {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t flags;                         // TELEMETRY_FLAG_*
+    uint8_t channel_count;                 // HIST_CHANNEL_COUNT
+    uint8_t reserved;
+    char node[16];                         // NODE_ID, NUL padded
+    uint32_t seq;                          // Spool sequence (duplicates on replay)
+    uint32_t time;                         // Unix time of the sample
+    uint32_t uptime_s;                     // Seconds since boot when sent
+    int16_t values[HIST_CHANNEL_COUNT];    // Fixed point as in /api/history; relays last
+    uint16_t pad;
+    uint32_t crc;                          // CRC-32 of everything before it
+};
+
+// A new registry reading adds a value here: bump version and add the channel
+// to CHANNELS in tools/telemetry_collector.py
+static_assert(sizeof(TelemetryDatagram) == 56, "TelemetryDatagram layout changed");
+
+// Fire-and-forget multicast sink: one datagram per spool record, so a single
+// listener can collect a whole fleet without a connection per controller.
+// Always ready while WiFi is up; core 1 only.
+class UdpTelemetry : public TelemetrySink {
+public:
+    UdpTelemetry();
+    ~UdpTelemetry();
+    
+    bool begin();
+    
+    uint32_t getSent() const { return sent_; }
+    uint32_t getErrors() const { return errors_; }
+    
+    // TelemetrySink
+    const char* getName() const override { return "udp"; }
+    bool isReady() override { return pcb_ != nullptr; }
+    bool send(const TelemetryRecord* records, size_t count, bool replay) override;
+    
+private:
+    struct udp_pcb* pcb_;
+    ip_addr_t group_;
+    uint32_t sent_;
+    uint32_t errors_;
+};
@@ -2,13 +2,321 @@
 #include "config.h"
 #include "storage/flash_storage.h"
 #include "sensors/sensor_manager.h"
+#include "sensors/sensor_history.h"
+#include "storage/history_query.h"
+#include "network/telemetry_spool.h"
+#include "network/network_manager.h"
+#include "utils/metrics.h"
+#include "utils/perf.h"
+#include "utils/trace.h"
+#include "utils/log.h"
+#include "utils/mem_stats.h"
+#include "utils/clock.h"
 #include "control/lights_controller.h"
 #include "control/pump_controller.h"
 #include "control/heater_controller.h"
 #include "control/fan_controller.h"
+#include "control/settings_batch.h"
+#include "telemetry_fields.h"
+#include "utils/cbor.h"
+#include "utils/json.h"
+#include "utils/time_utils.h"
+#include "pico/cyw43_arch.h"
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
+
+// Streams a HistoryQuery as
+// {"channel":..,"step":..,"scale":..,"points":[[t,v],..]} for raw samples
+// and LTTB picks or [[t,avg,min,max],..] for aggregated points, with
+// fixed-point values (divide by scale) and null where a bucket had no valid
+// sample.
+class HistoryStream : public ResponseStream {
+public:
+    // JSON, or with cbor the same document as CBOR: a map whose "points" is
+    // an open-ended array of [t, value] or [t, avg, min, max] arrays
+    HistoryStream(HistoryChannel channel, time_t from, time_t to, uint32_t step,
+                  uint16_t max_points, bool cbor)
+        : channel_(channel), query_(channel, from, to, step), state_(HEADER),
+          first_point_(true), have_point_(false), cbor_(cbor) {
+        if (max_points > 0) query_.setMaxPoints(max_points);
+    }
+    
+    size_t read(char* buffer, size_t max) override {
+        size_t used = 0;
+        char token[160];
+        
+        while (state_ != DONE) {
+            int len = 0;
+            if (state_ == HEADER) {
+                len = cbor_ ? encodeHeader(token, sizeof(token)) : snprintf(token, sizeof(token),
+                    "{\"channel\":\"%s\",\"step\":%lu,\"scale\":%u,\"points\":[",
+                    SensorHistory::getChannelName(channel_),
+                    (unsigned long)query_.getStep(),
+                    (unsigned)SensorHistory::getChannelScale(channel_));
+            } else if (state_ == POINTS) {
+                if (!have_point_) {
+                    if (!query_.next(&point_)) {
+                        state_ = FOOTER;
+                        continue;
+                    }
+                    have_point_ = true;
+                }
+                len = cbor_ ? encodePoint(token, sizeof(token)) : formatPoint(token, sizeof(token));
+            } else if (cbor_) {
+                token[0] = (char)0xFF;  // Break: ends the points array
+                len = 1;
+            } else {
+                len = snprintf(token, sizeof(token), "]}");
+            }
+            
+            if (used + (size_t)len > max) break;  // Resume here on the next call
+            memcpy(buffer + used, token, len);
+            used += len;
+            
+            if (state_ == HEADER) {
+                state_ = POINTS;
+            } else if (state_ == POINTS) {
+                first_point_ = false;
+                have_point_ = false;
+            } else {
+                state_ = DONE;
+            }
+        }
+        return used;
+    }
+    
+private:
+    enum State { HEADER, POINTS, FOOTER, DONE };
+    
+    int formatPoint(char* token, size_t size) {
+        const char* sep = first_point_ ? "" : ",";
+        const unsigned long t = (unsigned long)point_.time;
+        if (point_.count == 0) {
+            return snprintf(token, size, query_.isAggregated() ? "%s[%lu,null,null,null]" : "%s[%lu,null]", sep, t);
+        }
+        if (!query_.isAggregated()) {
+            return snprintf(token, size, "%s[%lu,%d]", sep, t, point_.avg);
+        }
+        return snprintf(token, size, "%s[%lu,%d,%d,%d]", sep, t, point_.avg, point_.min, point_.max);
+    }
+    
+    int encodeHeader(char* token, size_t size) {
+        CborWriter w((uint8_t*)token, size);
+        w.map(4);
+        w.text("channel");
+        w.text(SensorHistory::getChannelName(channel_));
+        w.text("step");
+        w.uinteger(query_.getStep());
+        w.text("scale");
+        w.uinteger(SensorHistory::getChannelScale(channel_));
+        w.text("points");
+        w.openArray();
+        return (int)w.length();
+    }
+    
+    int encodePoint(char* token, size_t size) {
+        CborWriter w((uint8_t*)token, size);
+        const bool aggregated = query_.isAggregated();
+        w.array(aggregated ? 4 : 2);
+        w.uinteger((uint32_t)point_.time);
+        if (point_.count == 0) {
+            w.null();
+            if (aggregated) {
+                w.null();
+                w.null();
+            }
+        } else {
+            w.integer(point_.avg);
+            if (aggregated) {
+                w.integer(point_.min);
+                w.integer(point_.max);
+            }
+        }
+        return (int)w.length();
+    }
+    
+    HistoryChannel channel_;
+    HistoryQuery query_;
+    State state_;
+    bool first_point_;
+    bool have_point_;
+    bool cbor_;
+    HistoryPoint point_;
+};
+
+// Streams a buffer that stays valid until the stream ends
+class BufferStream : public ResponseStream {
+public:
+    BufferStream(const char* data, size_t length) : data_(data), length_(length), pos_(0) {}
+    
+    size_t read(char* buffer, size_t max) override {
+        size_t n = length_ - pos_ < max ? length_ - pos_ : max;
+        memcpy(buffer, data_ + pos_, n);
+        pos_ += n;
+        return n;
+    }
+    
+private:
+    const char* data_;
+    size_t length_;
+    size_t pos_;
+};
+
+// Streams a LittleFS file a chunk at a time, so neither RAM nor the send
+// buffer limits the file size
+class FileStream : public ResponseStream {
+public:
+    explicit FileStream(const char* path) : offset_(0) {
+        strncpy(path_, path, sizeof(path_) - 1);
+        path_[sizeof(path_) - 1] = '\0';
+    }
+    
+    size_t read(char* buffer, size_t max) override {
+        // A read error ends the body early; the close tells the client
+        int32_t n = FlashStorage::getInstance().readFile(path_, offset_, (uint8_t*)buffer, max);
+        if (n <= 0) return 0;
+        offset_ += n;
+        return (size_t)n;
+    }
+    
+private:
+    char path_[64];
+    uint32_t offset_;
+};
+
+// Streams HttpStats as {"routes":[{"route":..,"requests":..,"bytes_out":..,
+// "errors":{"404":n,..},"parse":{..},"handler":{..},"ttlb":{..}},..]}, one
+// route piece at a time; routes without requests are left out
+class HttpStatsStream : public ResponseStream {
+public:
+    explicit HttpStatsStream(const HttpStats& stats)
+        : stats_(stats), route_(0), phase_(0), part_(PART_OPEN), first_(true) {}
+    
+    size_t read(char* buffer, size_t max) override {
+        size_t len = 0;
+        while (part_ != PART_DONE && max - len >= PIECE_MAX) {
+            len += formatPiece(buffer + len);
+        }
+        return len;
+    }
+    
+private:
+    // Longest piece: a phase with every histogram bucket in use
+    static const size_t PIECE_MAX = 400;
+    enum Part : uint8_t { PART_OPEN, PART_ROUTE, PART_PHASE, PART_CLOSE, PART_DONE };
+    
+    size_t formatPiece(char* out) {
+        if (part_ == PART_OPEN) {
+            part_ = PART_ROUTE;
+            return snprintf(out, PIECE_MAX, "{\"routes\":[");
+        }
+        if (part_ == PART_CLOSE) {
+            part_ = PART_DONE;
+            return snprintf(out, PIECE_MAX, "]}");
+        }
+        
+        if (part_ == PART_ROUTE) {
+            while (route_ < HTTP_ROUTE_COUNT && stats_.get(route_).requests == 0) route_++;
+            if (route_ == HTTP_ROUTE_COUNT) {
+                part_ = PART_CLOSE;
+                return 0;
+            }
+            
+            const HttpRouteStats& route = stats_.get(route_);
+            int len = snprintf(out, PIECE_MAX, "%s{\"route\":\"%s\",\"requests\":%lu,\"bytes_out\":%llu,\"errors\":{",
+                               first_ ? "" : ",", HttpStats::getRouteName(route_),
+                               (unsigned long)route.requests, (unsigned long long)route.bytes_out);
+            bool first_error = true;
+            for (uint8_t slot = 0; slot < HTTP_ERROR_SLOTS; slot++) {
+                if (route.errors[slot] == 0) continue;
+                char status[8] = "other";
+                if (HttpStats::getErrorStatus(slot)) snprintf(status, sizeof(status), "%d", HttpStats::getErrorStatus(slot));
+                len += snprintf(out + len, PIECE_MAX - len, "%s\"%s\":%lu",
+                                first_error ? "" : ",", status, (unsigned long)route.errors[slot]);
+                first_error = false;
+            }
+            len += snprintf(out + len, PIECE_MAX - len, "}");
+            first_ = false;
+            phase_ = 0;
+            part_ = PART_PHASE;
+            return len;
+        }
+        
+        // PART_PHASE: one timing histogram, trimmed to its non-empty span
+        const HttpLatency& latency = stats_.get(route_).latency[phase_];
+        int len = snprintf(out, PIECE_MAX, ",\"%s\":{\"count\":%lu", HttpStats::getPhaseName(phase_),
+                           (unsigned long)latency.count);
+        if (latency.count > 0) {
+            uint8_t lo = 0;
+            uint8_t hi = HTTP_HIST_BUCKETS - 1;
+            while (latency.hist[lo] == 0) lo++;
+            while (latency.hist[hi] == 0) hi--;
+            len += snprintf(out + len, PIECE_MAX - len, ",\"avg_us\":%lu,\"max_us\":%lu,\"hist_first\":%u,\"hist\":[",
+                            (unsigned long)(latency.total_us / latency.count), (unsigned long)latency.max_us, lo);
+            for (uint8_t b = lo; b <= hi; b++) {
+                len += snprintf(out + len, PIECE_MAX - len, "%s%lu", b == lo ? "" : ",", (unsigned long)latency.hist[b]);
+            }
+            len += snprintf(out + len, PIECE_MAX - len, "]");
+        }
+        len += snprintf(out + len, PIECE_MAX - len, "}");
+        
+        if (++phase_ == HTTP_PHASE_COUNT) {
+            len += snprintf(out + len, PIECE_MAX - len, "}");
+            route_++;
+            part_ = PART_ROUTE;
+        }
+        return len;
+    }
+    
+    const HttpStats& stats_;
+    uint8_t route_;
+    uint8_t phase_;
+    Part part_;
+    bool first_;
+};
+
+// Each request creates at most one stream in the request arena
+static_assert(sizeof(HistoryStream) <= WEB_REQUEST_ARENA_BYTES &&
+              sizeof(FileStream) <= WEB_REQUEST_ARENA_BYTES &&
+              sizeof(BufferStream) <= WEB_REQUEST_ARENA_BYTES &&
+              sizeof(HttpStatsStream) <= WEB_REQUEST_ARENA_BYTES,
+              "WEB_REQUEST_ARENA_BYTES too small for a response stream");
+
+// Appends Prometheus text exposition lines to a fixed buffer; once it is
+// full, output ends at the last whole line
+class MetricsWriter {
+public:
+    MetricsWriter(char* buffer, size_t size) : buffer_(buffer), size_(size), len_(0), full_(false) {}
+    
+    void family(const char* name, const char* type, const char* help) {
+        line("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+    
+    void line(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        if (full_) return;
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(buffer_ + len_, size_ - len_, format, args);
+        va_end(args);
+        if (n < 0 || (size_t)n >= size_ - len_) {
+            full_ = true;
+            return;
+        }
+        len_ += n;
+    }
+    
+    size_t length() const { return len_; }
+    bool isFull() const { return full_; }
+    
+private:
+    char* buffer_;
+    size_t size_;
+    size_t len_;
+    bool full_;
+};
 
 WebServer::WebServer(SensorManager* sensor_manager, 
                      LightsController* lights_controller,
@@ -22,7 +330,23 @@ WebServer::WebServer(SensorManager* sensor_manager,
       fan_controller_(fan_controller),
       web_server_pcb_(nullptr),
       web_client_pcb_(nullptr),
-      request_buffer_pos_(0) {
+      request_buffer_pos_(0),
+      request_arena_("web", request_arena_buffer_, sizeof(request_arena_buffer_)),
+      stream_(nullptr),
+      stream_chunk_len_(0),
+      http_requests_(0),
+      http_errors_(0),
+      request_route_(HTTP_ROUTE_OTHER),
+      request_start_us_(0),
+      response_pending_(false),
+      batch_seq_(0),
+      batch_deadline_ms_(0),
+      batch_count_(0),
+      batch_persist_(false),
+      metrics_cache_len_(0),
+      metrics_generation_(0),
+      metrics_cached_(false),
+      metrics_renders_(0) {
     memset(request_buffer_, 0, sizeof(request_buffer_));
 }
 
@@ -58,11 +382,17 @@ void WebServer::stop() {
         tcp_close(web_client_pcb_);
         web_client_pcb_ = nullptr;
     }
+    endStream();
 }
 
 void WebServer::handleClients() {
-    // Handle any pending client requests
-    // This is called from the main loop
+    // Requests are handled in callbacks, apart from the /api/batch reply,
+    // which waits for core 0 here rather than in the recv callback
+    if (batch_seq_ != 0) {
+        cyw43_arch_lwip_begin();
+        finishBatch();
+        cyw43_arch_lwip_end();
+    }
 }
 
 err_t WebServer::web_accept_callback(void* arg, struct tcp_pcb* newpcb, err_t err) {
@@ -76,11 +406,12 @@ err_t WebServer::webAccept(struct tcp_pcb* newpcb, err_t err) {
             web_client_pcb_ = newpcb;
             tcp_arg(newpcb, this);
             tcp_recv(newpcb, web_recv_callback);
+            tcp_sent(newpcb, web_sent_callback);
             tcp_err(newpcb, web_err_callback);
-            printf("Web client connected\n");
+            LOG_DEBUG(LOG_HTTP, "Web client connected");
             return ERR_OK;
         } else {
-            printf("Web server busy, rejecting connection\n");
+            LOG_WARN(LOG_HTTP, "Web server busy, rejecting connection");
             tcp_close(newpcb);
             return ERR_ABRT;
         }
@@ -88,7 +419,27 @@ err_t WebServer::webAccept(struct tcp_pcb* newpcb, err_t err) {
     return ERR_ARG;
 }
 
+// Value of header `name` (with its colon) in the request head, or nullptr
+static const char* findHeader(const char* raw_request, const char* headers_end, const char* name) {
+    const size_t name_len = strlen(name);
+    for (const char* line = strstr(raw_request, "\r\n"); line && line < headers_end;
+         line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, name, name_len) == 0) {
+            const char* value = line + 2 + name_len;
+            while (*value == ' ') value++;
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+static uint32_t getContentLength(const char* raw_request, const char* headers_end) {
+    const char* value = findHeader(raw_request, headers_end, "Content-Length:");
+    return value ? strtoul(value, nullptr, 10) : 0;
+}
+
 err_t WebServer::web_recv_callback(void* arg, struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
+    TRACE_SCOPE(TRACE_HTTP_RECV, p ? p->tot_len : 0);
     WebServer* server = static_cast<WebServer*>(arg);
     return server->webRecv(tpcb, p, err);
 }
@@ -96,6 +447,9 @@ err_t WebServer::web_recv_callback(void* arg, struct tcp_pcb* tpcb, struct pbuf*
 err_t WebServer::webRecv(struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
     if (err == ERR_OK && p != nullptr) {
         // Accumulate request data
+        if (request_buffer_pos_ == 0) {
+            request_start_us_ = time_us_64();
+        }
         uint16_t len = p->tot_len;
         if (request_buffer_pos_ + len > sizeof(request_buffer_) - 1) {
             len = sizeof(request_buffer_) - 1 - request_buffer_pos_;
@@ -105,9 +459,21 @@ err_t WebServer::webRecv(struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
             pbuf_copy_partial(p, request_buffer_ + request_buffer_pos_, len, 0);
             request_buffer_pos_ += len;
             request_buffer_[request_buffer_pos_] = '\0';
-        } else if (request_buffer_pos_ >= sizeof(request_buffer_) - 1) {
-            // Buffer full without complete request - reject
-            printf("HTTP request too large\n");
+        }
+        
+        // Complete once the headers and the Content-Length body are in
+        const char* headers_end = strstr(request_buffer_, "\r\n\r\n");
+        const uint32_t content_length = headers_end ? getContentLength(request_buffer_, headers_end) : 0;
+        const size_t body_received = headers_end ? request_buffer_pos_ - (headers_end + 4 - request_buffer_) : 0;
+        const bool buffer_full = request_buffer_pos_ >= sizeof(request_buffer_) - 1;
+        
+        if (content_length >= sizeof(HttpRequest::body) ||
+            (buffer_full && (!headers_end || body_received < content_length))) {
+            // Request or body too large for the buffers - reject
+            LOG_WARN(LOG_HTTP, "HTTP request too large");
+            request_route_ = HTTP_ROUTE_OTHER;
+            http_stats_.addRequest(request_route_);
+            response_pending_ = true;
             sendHttpError(tpcb, 413, "Request Entity Too Large");
             request_buffer_pos_ = 0;
             memset(request_buffer_, 0, sizeof(request_buffer_));
@@ -116,14 +482,32 @@ err_t WebServer::webRecv(struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
             return ERR_OK;
         }
         
-        // Check if we have a complete HTTP request
-        if (strstr(request_buffer_, "\r\n\r\n")) {
+        if (headers_end && body_received >= content_length) {
+            http_requests_++;
             HttpRequest request;
-            if (parseHttpRequest(request_buffer_, &request)) {
+            bool parsed = parseHttpRequest(request_buffer_, &request);
+            const uint64_t parsed_us = time_us_64();
+            
+            request_route_ = parsed ? HttpStats::routeFor(request.path) : HTTP_ROUTE_OTHER;
+            response_pending_ = true;
+            http_stats_.addRequest(request_route_);
+            http_stats_.addLatency(request_route_, HTTP_PHASE_PARSE, (uint32_t)(parsed_us - request_start_us_));
+            
+            // A new request supersedes whatever the last one left behind
+            endStream();
+            batch_seq_ = 0;
+            
+            if (parsed) {
                 handleHttpRequest(tpcb, &request);
             } else {
                 sendHttpError(tpcb, 400, "Bad Request");
             }
+            http_stats_.addLatency(request_route_, HTTP_PHASE_HANDLER, (uint32_t)(time_us_64() - parsed_us));
+            
+            // Nothing left in flight (the write failed, or the ACK already came)
+            if (response_pending_ && !stream_ && batch_seq_ == 0 && tcp_sndbuf(tpcb) >= TCP_SND_BUF) {
+                finishResponse();
+            }
             
             // Reset buffer for next request
             request_buffer_pos_ = 0;
@@ -134,7 +518,10 @@ err_t WebServer::webRecv(struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
         pbuf_free(p);
     } else if (err == ERR_OK && p == nullptr) {
         // Connection closed
-        printf("Web client disconnected\n");
+        LOG_DEBUG(LOG_HTTP, "Web client disconnected");
+        finishResponse();
+        endStream();
+        batch_seq_ = 0;
         web_client_pcb_ = nullptr;
         request_buffer_pos_ = 0;
         memset(request_buffer_, 0, sizeof(request_buffer_));
@@ -147,7 +534,10 @@ err_t WebServer::webRecv(struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
 void WebServer::web_err_callback(void* arg, err_t err) {
     WebServer* server = static_cast<WebServer*>(arg);
     if (server) {
-        printf("Web connection error: %d\n", err);
+        LOG_WARN(LOG_HTTP, "Web connection error: %d", err);
+        server->finishResponse();
+        server->endStream();
+        server->batch_seq_ = 0;
         server->web_client_pcb_ = nullptr;
         server->request_buffer_pos_ = 0;
         memset(server->request_buffer_, 0, sizeof(server->request_buffer_));
@@ -177,21 +567,40 @@ bool WebServer::parseHttpRequest(const char* raw_request, HttpRequest* request)
         request->query[0] = '\0';
     }
     
-    // Parse body for POST requests
-    const char* body_start = strstr(raw_request, "\r\n\r\n");
-    if (body_start) {
-        body_start += 4; // Skip \r\n\r\n
-        strncpy(request->body, body_start, sizeof(request->body) - 1);
-        request->body[sizeof(request->body) - 1] = '\0';
-    } else {
-        request->body[0] = '\0';
+    // Headers: Accept (CBOR instead of JSON where supported) and the body's type and length
+    const char* headers_end = strstr(raw_request, "\r\n\r\n");
+    const char* accept = findHeader(raw_request, headers_end, "Accept:");
+    const char* cbor = accept ? strstr(accept, "application/cbor") : nullptr;
+    request->accept_cbor = cbor && cbor < strstr(accept, "\r\n");
+    
+    const char* content_type = findHeader(raw_request, headers_end, "Content-Type:");
+    size_t type_len = 0;
+    if (content_type) {
+        type_len = strcspn(content_type, ";\r\n");
+        if (type_len >= sizeof(request->content_type)) type_len = sizeof(request->content_type) - 1;
+        memcpy(request->content_type, content_type, type_len);
+    }
+    request->content_type[type_len] = '\0';
+    
+    // Body: Content-Length bytes after the blank line (webRecv waited for them)
+    size_t body_len = 0;
+    if (headers_end) {
+        const char* body_start = headers_end + 4; // Skip \r\n\r\n
+        const size_t available = strlen(body_start);
+        body_len = findHeader(raw_request, headers_end, "Content-Length:") ?
+                   getContentLength(raw_request, headers_end) : available;
+        if (body_len > available) body_len = available;
+        if (body_len >= sizeof(request->body)) body_len = sizeof(request->body) - 1;
+        memcpy(request->body, body_start, body_len);
     }
+    request->body[body_len] = '\0';
+    request->content_length = (uint16_t)body_len;
     
     return true;
 }
 
 void WebServer::handleHttpRequest(struct tcp_pcb* tpcb, const HttpRequest* request) {
-    printf("HTTP %s %s\n", request->method, request->path);
+    LOG_DEBUG(LOG_HTTP, "HTTP %s %s", request->method, request->path);
     
     // Route requests
     if (strcmp(request->path, "/") == 0) {
@@ -202,6 +611,8 @@ void WebServer::handleHttpRequest(struct tcp_pcb* tpcb, const HttpRequest* reque
         serveJs(tpcb);
     } else if (strcmp(request->path, "/favicon.ico") == 0) {
         serveFavicon(tpcb);
+    } else if (strcmp(request->path, "/metrics") == 0) {
+        handleMetrics(tpcb, request);
     } else if (strncmp(request->path, "/api/", 5) == 0) {
         // API endpoints
         if (strcmp(request->path, "/api/status") == 0) {
@@ -220,6 +631,20 @@ void WebServer::handleHttpRequest(struct tcp_pcb* tpcb, const HttpRequest* reque
             handleApiHumidity(tpcb, request);
         } else if (strcmp(request->path, "/api/save") == 0) {
             handleApiSave(tpcb, request);
+        } else if (strcmp(request->path, "/api/batch") == 0) {
+            handleApiBatch(tpcb, request);
+        } else if (strcmp(request->path, "/api/sensors") == 0) {
+            handleApiSensors(tpcb, request);
+        } else if (strcmp(request->path, "/api/history") == 0) {
+            handleApiHistory(tpcb, request);
+        } else if (strcmp(request->path, "/api/telemetry") == 0) {
+            handleApiTelemetry(tpcb, request);
+        } else if (strcmp(request->path, "/api/perf") == 0) {
+            handleApiPerf(tpcb, request);
+        } else if (strcmp(request->path, "/api/perf/http") == 0) {
+            handleApiPerfHttp(tpcb, request);
+        } else if (strcmp(request->path, "/api/mem") == 0) {
+            handleApiMem(tpcb, request);
         } else {
             sendHttpError(tpcb, 404, "Not Found");
         }
@@ -244,41 +669,48 @@ void WebServer::sendHttpResponse(struct tcp_pcb* tpcb, const HttpResponse* respo
         response->body_length
     );
     
+    if (response->status_code >= 400) {
+        http_stats_.addError(request_route_, response->status_code);
+    }
+    
     // Send header
     err_t err = tcp_write(tpcb, header, header_len, TCP_WRITE_FLAG_COPY);
     if (err != ERR_OK) {
-        printf("Failed to send HTTP header\n");
+        LOG_WARN(LOG_HTTP, "Failed to send HTTP header");
         if (response->free_body && response->body) {
-            free(response->body);
+            g_json_pool.release(response->body);
         }
         return;
     }
+    http_stats_.addBytes(request_route_, header_len);
     
     // Send body
     if (response->body_length > 0) {
         err = tcp_write(tpcb, response->body, response->body_length, TCP_WRITE_FLAG_COPY);
         if (err != ERR_OK) {
-            printf("Failed to send HTTP body\n");
+            LOG_WARN(LOG_HTTP, "Failed to send HTTP body");
             if (response->free_body && response->body) {
-                free(response->body);
+                g_json_pool.release(response->body);
             }
             return;
         }
+        http_stats_.addBytes(request_route_, response->body_length);
     }
     
     // Send response
     err = tcp_output(tpcb);
     if (err != ERR_OK) {
-        printf("Failed to output HTTP response\n");
+        LOG_WARN(LOG_HTTP, "Failed to output HTTP response");
     }
     
     // Free body if requested (TCP_WRITE_FLAG_COPY means data was copied)
     if (response->free_body && response->body) {
-        free(response->body);
+        g_json_pool.release(response->body);
     }
 }
 
 void WebServer::sendHttpError(struct tcp_pcb* tpcb, int code, const char* message) {
+    http_errors_++;
     char error_body[256];
     snprintf(error_body, sizeof(error_body),
         "<html><body><h1>%d %s</h1></body></html>", code, message);
@@ -293,6 +725,185 @@ void WebServer::sendHttpError(struct tcp_pcb* tpcb, int code, const char* messag
     sendHttpResponse(tpcb, &response);
 }
 
+void WebServer::sendJsonResult(struct tcp_pcb* tpcb, int code, const char* message) {
+    if (code >= 400) http_errors_++;
+    char body[160];
+    snprintf(body, sizeof(body), "{\"success\": %s, \"message\": \"%s\"}",
+             code < 400 ? "true" : "false", message);
+    
+    HttpResponse response;
+    response.status_code = code;
+    strcpy(response.content_type, "application/json");
+    response.body = body;
+    response.body_length = strlen(body);
+    response.free_body = false;
+    
+    sendHttpResponse(tpcb, &response);
+}
+
+bool WebServer::checkSettings(struct tcp_pcb* tpcb, const SettingsBatch& change) {
+    char message[96];
+    if (change.validate(message, sizeof(message))) return true;
+    sendJsonResult(tpcb, 400, message);
+    return false;
+}
+
+bool WebServer::readJsonBody(struct tcp_pcb* tpcb, const HttpRequest* request, JsonField* fields, uint8_t count) {
+    if (!Json::extract(request->body, request->content_length, fields, count)) {
+        char message[80];
+        snprintf(message, sizeof(message), "Invalid request body: %s", Json::getError());
+        sendJsonResult(tpcb, 400, message);
+        return false;
+    }
+    return true;
+}
+
+bool WebServer::readBatchBody(struct tcp_pcb* tpcb, const HttpRequest* request, SettingsBatch* batch, bool* persist) {
+    JsonToken tokens[JSON_MAX_TOKENS];
+    const int n = Json::tokenize(request->body, request->content_length, tokens, JSON_MAX_TOKENS);
+    if (n < 0 || tokens[0].type != JSON_OBJECT) {
+        sendJsonResult(tpcb, 400, n == JSON_ERROR_NOMEM ? "Invalid request body: too many members" :
+                                  "Invalid request body: expected an object");
+        return false;
+    }
+    
+    // Unlike readJsonBody, a member that is not a setting fails the whole
+    // batch: a typo must not leave part of the set unapplied
+    char message[80];
+    for (int i = 1; i + 1 < n; ) {
+        const JsonToken& key = tokens[i];
+        const JsonToken& value = tokens[i + 1];
+        const char* name = request->body + key.start;
+        const size_t name_len = key.end - key.start;
+        
+        bool ok;
+        if (name_len == 7 && strncmp(name, "persist", 7) == 0) {
+            ok = Json::read(request->body, value, JSON_VALUE_BOOL, persist, 0);
+        } else {
+            const FieldId id = Fields::find(name, name_len);
+            if (id == FIELD_COUNT || !(Fields::info(id).group & FIELD_CONFIG)) {
+                snprintf(message, sizeof(message), "Unknown setting %.*s", (int)name_len, name);
+                sendJsonResult(tpcb, 400, message);
+                return false;
+            }
+            
+            float number = 0.0f;
+            bool flag = false;
+            if (Fields::info(id).kind == FIELD_BOOL) {
+                ok = Json::read(request->body, value, JSON_VALUE_BOOL, &flag, 0);
+                number = flag ? 1.0f : 0.0f;
+            } else {
+                ok = Json::read(request->body, value, JSON_VALUE_FLOAT, &number, 0);
+            }
+            batch->set(id, number);
+        }
+        if (!ok) {
+            snprintf(message, sizeof(message), "Bad value for %.*s", (int)name_len, name);
+            sendJsonResult(tpcb, 400, message);
+            return false;
+        }
+        
+        // Next key: skip the tokens nested in this value
+        i += 2;
+        while (i < n && tokens[i].start < value.end) i++;
+    }
+    return true;
+}
+
+void WebServer::startStream(struct tcp_pcb* tpcb, const char* content_type, ResponseStream* stream) {
+    if (!stream) {
+        // Request arena exhausted
+        sendHttpError(tpcb, 500, "Internal Server Error");
+        return;
+    }
+    
+    char header[256];
+    int header_len = snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        content_type
+    );
+    
+    err_t err = tcp_write(tpcb, header, header_len, TCP_WRITE_FLAG_COPY);
+    if (err != ERR_OK) {
+        LOG_WARN(LOG_HTTP, "Failed to send HTTP header");
+        stream->~ResponseStream();
+        request_arena_.reset();
+        return;
+    }
+    http_stats_.addBytes(request_route_, header_len);
+    
+    stream_ = stream;
+    stream_chunk_len_ = 0;
+    tcp_sent(tpcb, web_sent_callback);
+    pumpStream(tpcb);
+}
+
+void WebServer::pumpStream(struct tcp_pcb* tpcb) {
+    while (stream_) {
+        if (stream_chunk_len_ == 0) {
+            stream_chunk_len_ = stream_->read(stream_chunk_, sizeof(stream_chunk_));
+            if (stream_chunk_len_ == 0) {
+                // Body complete; the close flushes what is still queued
+                finishResponse();
+                endStream();
+                tcp_arg(tpcb, nullptr);
+                tcp_recv(tpcb, nullptr);
+                tcp_sent(tpcb, nullptr);
+                tcp_err(tpcb, nullptr);
+                web_client_pcb_ = nullptr;
+                if (tcp_close(tpcb) != ERR_OK) {
+                    LOG_WARN(LOG_HTTP, "Failed to close streamed response");
+                }
+                return;
+            }
+        }
+        
+        // Wait for ACKs (web_sent_callback) when the send buffer is full
+        if (tcp_sndbuf(tpcb) < stream_chunk_len_) break;
+        err_t err = tcp_write(tpcb, stream_chunk_, stream_chunk_len_, TCP_WRITE_FLAG_COPY);
+        if (err == ERR_MEM) break;
+        if (err != ERR_OK) {
+            LOG_WARN(LOG_HTTP, "Failed to send streamed body: %d", err);
+            endStream();
+            return;
+        }
+        http_stats_.addBytes(request_route_, stream_chunk_len_);
+        stream_chunk_len_ = 0;
+    }
+    tcp_output(tpcb);
+}
+
+void WebServer::finishResponse() {
+    if (!response_pending_) return;
+    response_pending_ = false;
+    http_stats_.addLatency(request_route_, HTTP_PHASE_TTLB, (uint32_t)(time_us_64() - request_start_us_));
+}
+
+void WebServer::endStream() {
+    // Streams live in the request arena, which is released with them
+    if (stream_) stream_->~ResponseStream();
+    stream_ = nullptr;
+    stream_chunk_len_ = 0;
+    request_arena_.reset();
+}
+
+err_t WebServer::web_sent_callback(void* arg, struct tcp_pcb* tpcb, uint16_t len) {
+    TRACE_SCOPE(TRACE_HTTP_SENT, len);
+    WebServer* server = static_cast<WebServer*>(arg);
+    if (!server) return ERR_OK;
+    if (server->stream_) {
+        server->pumpStream(tpcb);
+    } else if (server->response_pending_ && tcp_sndbuf(tpcb) >= TCP_SND_BUF) {
+        // Every byte of a single-buffer response is ACKed
+        server->finishResponse();
+    }
+    return ERR_OK;
+}
+
 void WebServer::serveMainPage(struct tcp_pcb* tpcb) {
     serveStaticFile(tpcb, "/", "text/html");
 }
@@ -310,37 +921,26 @@ void WebServer::serveFavicon(struct tcp_pcb* tpcb) {
 }
 
 void WebServer::serveStaticFile(struct tcp_pcb* tpcb, const char* filename, const char* content_type) {
-    FlashStorage& storage = FlashStorage::getInstance();
-    
-    uint8_t* data = nullptr;
-    uint32_t size = 0;
-    const char* mime_type = nullptr;
-    
     // Map "/" to "/index.html"
     const char* file_path = (strcmp(filename, "/") == 0) ? "/index.html" : filename;
     
-    if (storage.getFile(file_path, &data, &size, &mime_type)) {
-        HttpResponse response;
-        response.status_code = 200;
-        strcpy(response.content_type, mime_type ? mime_type : content_type);
-        response.body = (char*)data;
-        response.body_length = size;
-        response.free_body = true;  // LittleFS allocates memory, must free
-        sendHttpResponse(tpcb, &response);
-    } else {
+    if (FlashStorage::getInstance().getFileSize(file_path) < 0) {
         sendHttpError(tpcb, 404, "Not Found");
+        return;
     }
+    startStream(tpcb, content_type, request_arena_.create<FileStream>(file_path));
 }
 
 // API Endpoint Implementations
 void WebServer::handleApiStatus(struct tcp_pcb* tpcb, const HttpRequest* request) {
-    char* json = generateStatusJson();
-    if (json) {
+    size_t length = 0;
+    char* body = request->accept_cbor ? generateStatusCbor(&length) : generateStatusJson();
+    if (body) {
         HttpResponse response;
         response.status_code = 200;
-        strcpy(response.content_type, "application/json");
-        response.body = json;
-        response.body_length = strlen(json);
+        strcpy(response.content_type, request->accept_cbor ? "application/cbor" : "application/json");
+        response.body = body;
+        response.body_length = request->accept_cbor ? length : strlen(body);
         response.free_body = true;
         sendHttpResponse(tpcb, &response);
     } else {
@@ -349,13 +949,14 @@ void WebServer::handleApiStatus(struct tcp_pcb* tpcb, const HttpRequest* request
 }
 
 void WebServer::handleApiConfig(struct tcp_pcb* tpcb, const HttpRequest* request) {
-    char* json = generateConfigJson();
-    if (json) {
+    size_t length = 0;
+    char* body = request->accept_cbor ? generateConfigCbor(&length) : generateConfigJson();
+    if (body) {
         HttpResponse response;
         response.status_code = 200;
-        strcpy(response.content_type, "application/json");
-        response.body = json;
-        response.body_length = strlen(json);
+        strcpy(response.content_type, request->accept_cbor ? "application/cbor" : "application/json");
+        response.body = body;
+        response.body_length = request->accept_cbor ? length : strlen(body);
         response.free_body = true;
         sendHttpResponse(tpcb, &response);
     } else {
@@ -369,14 +970,38 @@ void WebServer::handleApiLights(struct tcp_pcb* tpcb, const HttpRequest* request
         return;
     }
     
-    const char* response_json = "{\"success\": true, \"message\": \"Lights schedule updated\"}";
-    HttpResponse response;
-    response.status_code = 200;
-    strcpy(response.content_type, "application/json");
-    response.body = (char*)response_json;
-    response.body_length = strlen(response_json);
-    response.free_body = false;
-    sendHttpResponse(tpcb, &response);
+    // Body: {"start_time": "HH:MM", "end_time": "HH:MM"}, or seconds since
+    // midnight as "lights_start_s" / "lights_end_s"
+    char start_time[8], end_time[8];
+    uint32_t start_s = 0, end_s = 0;
+    JsonField fields[] = {
+        { "start_time", JSON_VALUE_STRING, start_time, sizeof(start_time), false },
+        { "end_time", JSON_VALUE_STRING, end_time, sizeof(end_time), false },
+        { "lights_start_s", JSON_VALUE_UINT, &start_s, 0, false },
+        { "lights_end_s", JSON_VALUE_UINT, &end_s, 0, false },
+    };
+    if (!readJsonBody(tpcb, request, fields, 4)) return;
+    
+    if ((fields[0].found && !TimeUtils::isValidTimeString(start_time)) ||
+        (fields[1].found && !TimeUtils::isValidTimeString(end_time))) {
+        sendJsonResult(tpcb, 400, "Times must be HH:MM");
+        return;
+    }
+    if (!(fields[0].found || fields[2].found) || !(fields[1].found || fields[3].found)) {
+        sendJsonResult(tpcb, 400, "Both start and end time are required");
+        return;
+    }
+    if (fields[0].found) start_s = TimeUtils::parseTimeToSeconds(start_time);
+    if (fields[1].found) end_s = TimeUtils::parseTimeToSeconds(end_time);
+    
+    SettingsBatch change;
+    change.set(FIELD_LIGHTS_START, start_s);
+    change.set(FIELD_LIGHTS_END, end_s);
+    if (!checkSettings(tpcb, change)) return;
+    
+    lights_controller_->setSchedule(start_s, end_s);
+    printf("Lights schedule: %lus-%lus\n", start_s, end_s);
+    sendJsonResult(tpcb, 200, "Lights schedule updated");
 }
 
 void WebServer::handleApiPump(struct tcp_pcb* tpcb, const HttpRequest* request) {
@@ -385,14 +1010,54 @@ void WebServer::handleApiPump(struct tcp_pcb* tpcb, const HttpRequest* request)
         return;
     }
     
-    const char* response_json = "{\"success\": true, \"message\": \"Pump settings updated\"}";
-    HttpResponse response;
-    response.status_code = 200;
-    strcpy(response.content_type, "application/json");
-    response.body = (char*)response_json;
-    response.body_length = strlen(response_json);
-    response.free_body = false;
-    sendHttpResponse(tpcb, &response);
+    // Body: {"mode": "timer"|"humidity", "on_sec": 45, "period": 600,
+    // "humidity_threshold": 60.0} and optionally "min_pump_run_sec",
+    // "min_pump_off_sec", "max_pump_off_sec". Members may be left out; all
+    // present ones are checked before any is applied.
+    ConfigManager& config = ConfigManager::getInstance();
+    char mode[12];
+    uint32_t on_sec = config.getPumpOnSec();
+    uint32_t period = config.getPumpPeriod();
+    float threshold = 0.0f;
+    uint32_t min_run = 0, min_off = 0, max_off = 0;
+    JsonField fields[] = {
+        { "mode", JSON_VALUE_STRING, mode, sizeof(mode), false },
+        { "on_sec", JSON_VALUE_UINT, &on_sec, 0, false },
+        { "period", JSON_VALUE_UINT, &period, 0, false },
+        { "humidity_threshold", JSON_VALUE_FLOAT, &threshold, 0, false },
+        { "min_pump_run_sec", JSON_VALUE_UINT, &min_run, 0, false },
+        { "min_pump_off_sec", JSON_VALUE_UINT, &min_off, 0, false },
+        { "max_pump_off_sec", JSON_VALUE_UINT, &max_off, 0, false },
+    };
+    if (!readJsonBody(tpcb, request, fields, 7)) return;
+    
+    const bool humidity_mode = fields[0].found && strcmp(mode, "humidity") == 0;
+    if (fields[0].found && !humidity_mode && strcmp(mode, "timer") != 0) {
+        sendJsonResult(tpcb, 400, "Mode must be 'timer' or 'humidity'");
+        return;
+    }
+    
+    // Same order as fields[1..6]
+    const FieldId ids[] = { FIELD_PUMP_ON_SEC, FIELD_PUMP_PERIOD, FIELD_HUMIDITY_THRESHOLD,
+                            FIELD_MIN_PUMP_RUN, FIELD_MIN_PUMP_OFF, FIELD_MAX_PUMP_OFF };
+    const float values[] = { (float)on_sec, (float)period, threshold,
+                             (float)min_run, (float)min_off, (float)max_off };
+    SettingsBatch change;
+    for (uint8_t i = 0; i < 6; i++) {
+        if (fields[i + 1].found) change.set(ids[i], values[i]);
+    }
+    if (fields[0].found) change.set(FIELD_HUMIDITY_MODE, humidity_mode ? 1.0f : 0.0f);
+    if (!checkSettings(tpcb, change)) return;
+    
+    if (fields[1].found || fields[2].found) pump_controller_->setTiming(on_sec, period);
+    if (fields[0].found) pump_controller_->setHumidityMode(humidity_mode);
+    if (fields[3].found) pump_controller_->setHumidityThreshold(threshold);
+    if (fields[4].found) pump_controller_->setMinRunTime(min_run);
+    if (fields[5].found) pump_controller_->setMinOffTime(min_off);
+    if (fields[6].found) pump_controller_->setMaxOffTime(max_off);
+    printf("Pump settings: %lus ON, %lus period, %s mode\n", on_sec, period,
+           config.getHumidityMode() ? "humidity" : "timer");
+    sendJsonResult(tpcb, 200, "Pump settings updated");
 }
 
 void WebServer::handleApiHeater(struct tcp_pcb* tpcb, const HttpRequest* request) {
@@ -401,14 +1066,24 @@ void WebServer::handleApiHeater(struct tcp_pcb* tpcb, const HttpRequest* request
         return;
     }
     
-    const char* response_json = "{\"success\": true, \"message\": \"Heater setpoint updated\"}";
-    HttpResponse response;
-    response.status_code = 200;
-    strcpy(response.content_type, "application/json");
-    response.body = (char*)response_json;
-    response.body_length = strlen(response_json);
-    response.free_body = false;
-    sendHttpResponse(tpcb, &response);
+    // Body: {"setpoint": 20.5}
+    float setpoint = 0.0f;
+    JsonField fields[] = {
+        { "setpoint", JSON_VALUE_FLOAT, &setpoint, 0, false },
+    };
+    if (!readJsonBody(tpcb, request, fields, 1)) return;
+    
+    if (!fields[0].found) {
+        sendJsonResult(tpcb, 400, "setpoint is required");
+        return;
+    }
+    SettingsBatch change;
+    change.set(FIELD_HEATER_SETPOINT, setpoint);
+    if (!checkSettings(tpcb, change)) return;
+    
+    heater_controller_->setSetpoint(setpoint);
+    printf("Heater setpoint: %.1f°C\n", setpoint);
+    sendJsonResult(tpcb, 200, "Heater setpoint updated");
 }
 
 void WebServer::handleApiFan(struct tcp_pcb* tpcb, const HttpRequest* request) {
@@ -417,164 +1092,646 @@ void WebServer::handleApiFan(struct tcp_pcb* tpcb, const HttpRequest* request) {
         return;
     }
     
-    const char* response_json = "{\"success\": true, \"message\": \"Fan state updated\"}";
+    // Body: {"state": "on"|"off"}
+    char state[8];
+    JsonField fields[] = {
+        { "state", JSON_VALUE_STRING, state, sizeof(state), false },
+    };
+    if (!readJsonBody(tpcb, request, fields, 1)) return;
+    
+    if (!fields[0].found || (strcasecmp(state, "on") != 0 && strcasecmp(state, "off") != 0)) {
+        sendJsonResult(tpcb, 400, "state must be 'on' or 'off'");
+        return;
+    }
+    
+    const bool on = strcasecmp(state, "on") == 0;
+    fan_controller_->setManualControl(on);
+    printf("Fan: %s (manual control)\n", on ? "ON" : "OFF");
+    sendJsonResult(tpcb, 200, "Fan state updated");
+}
+
+void WebServer::handleApiHumidity(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    if (strcmp(request->method, "POST") != 0) {
+        sendHttpError(tpcb, 405, "Method Not Allowed");
+        return;
+    }
+    
+    // Body: {"threshold": 60.0}, or "humidity_threshold" as in /api/config
+    float threshold = 0.0f;
+    JsonField fields[] = {
+        { "threshold", JSON_VALUE_FLOAT, &threshold, 0, false },
+        { "humidity_threshold", JSON_VALUE_FLOAT, &threshold, 0, false },
+    };
+    if (!readJsonBody(tpcb, request, fields, 2)) return;
+    
+    if (!fields[0].found && !fields[1].found) {
+        sendJsonResult(tpcb, 400, "threshold is required");
+        return;
+    }
+    SettingsBatch change;
+    change.set(FIELD_HUMIDITY_THRESHOLD, threshold);
+    if (!checkSettings(tpcb, change)) return;
+    
+    pump_controller_->setHumidityThreshold(threshold);
+    printf("Humidity threshold: %.1f%%\n", threshold);
+    sendJsonResult(tpcb, 200, "Humidity threshold updated");
+}
+
+void WebServer::handleApiSave(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    if (strcmp(request->method, "POST") != 0) {
+        sendHttpError(tpcb, 405, "Method Not Allowed");
+        return;
+    }
+    
+    ConfigManager::getInstance().saveConfig();
+    sendJsonResult(tpcb, 200, "Configuration save scheduled");
+}
+
+void WebServer::handleApiBatch(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    if (strcmp(request->method, "POST") != 0) {
+        sendHttpError(tpcb, 405, "Method Not Allowed");
+        return;
+    }
+    
+    // Body: any settings under their /api/config keys, e.g.
+    // {"lights_start_s": 21600, "pump_on_sec": 45, "heater_setpoint_c": 21.5},
+    // and "persist": true to save them in the same request
+    SettingsBatch batch;
+    bool persist = false;
+    if (!readBatchBody(tpcb, request, &batch, &persist)) return;
+    
+    char message[96];
+    if (!batch.validate(message, sizeof(message))) {
+        sendJsonResult(tpcb, 400, message);
+        return;
+    }
+    
+    SettingsCommit& commit = SettingsCommit::getInstance();
+    const uint32_t seq = commit.submit(batch, persist);
+    if (seq == 0) {
+        sendJsonResult(tpcb, 503, "Another batch is being applied");
+        return;
+    }
+    
+    // Answered by finishBatch() from the core 1 loop
+    batch_seq_ = seq;
+    batch_deadline_ms_ = Clock::deadlineMs(SETTINGS_APPLY_TIMEOUT_MS);
+    batch_count_ = batch.count();
+    batch_persist_ = persist;
+}
+
+void WebServer::finishBatch() {
+    if (batch_seq_ == 0 || !web_client_pcb_) return;
+    const bool applied = SettingsCommit::getInstance().isApplied(batch_seq_);
+    if (!applied && !Clock::reachedMs(batch_deadline_ms_)) return;
+    batch_seq_ = 0;
+    
+    if (!applied) {
+        // Still queued; core 0 applies it as soon as it gets to it, and the
+        // save follows from SettingsCommit::update()
+        sendJsonResult(web_client_pcb_, 202, batch_persist_ ? "Batch queued, not yet applied; saved once applied"
+                                                            : "Batch queued, not yet applied");
+        return;
+    }
+    
+    char message[96];
+    snprintf(message, sizeof(message), "%u settings applied%s", batch_count_, batch_persist_ ? ", save scheduled" : "");
+    printf("Settings batch: %s\n", message);
+    sendJsonResult(web_client_pcb_, 200, message);
+}
+
+void WebServer::handleApiSensors(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    if (strcmp(request->method, "POST") == 0) {
+        // Body: {"sensor": "air", "interval_ms": 30000, "offset_ms": 15000}
+        // Optional: "min_ms", "max_ms" (adaptive range) and "adaptive": true|false
+        char name[16];
+        uint32_t interval_ms = 0, offset_ms = 0, min_ms = 0, max_ms = 0;
+        bool adaptive = false;
+        JsonField fields[] = {
+            { "sensor", JSON_VALUE_STRING, name, sizeof(name), false },
+            { "interval_ms", JSON_VALUE_UINT, &interval_ms, 0, false },
+            { "offset_ms", JSON_VALUE_UINT, &offset_ms, 0, false },
+            { "min_ms", JSON_VALUE_UINT, &min_ms, 0, false },
+            { "max_ms", JSON_VALUE_UINT, &max_ms, 0, false },
+            { "adaptive", JSON_VALUE_BOOL, &adaptive, 0, false },
+        };
+        if (!readJsonBody(tpcb, request, fields, 6)) return;
+        
+        // Everything is checked before anything changes. Members left out
+        // keep their current value, so a lone min_ms or max_ms, or offset_ms
+        // without interval_ms, is checked against the current settings.
+        const bool schedule = fields[1].found || fields[2].found;
+        const bool bounds = fields[3].found || fields[4].found;
+        SensorId id = SENSOR_WATER_TEMP;
+        if ((schedule || bounds) && !fields[0].found) {
+            sendJsonResult(tpcb, 400, "sensor is required");
+            return;
+        }
+        if (fields[0].found && !SensorManager::parseSensorName(name, &id)) {
+            sendJsonResult(tpcb, 400, "Sensor must be 'water', 'table', 'air' or 'nano'");
+            return;
+        }
+        if (schedule) {
+            if (!fields[1].found) interval_ms = sensor_manager_->getIntervalMs(id);
+            if (!fields[2].found) offset_ms = sensor_manager_->getOffsetMs(id);
+            if (interval_ms < SENSOR_MIN_INTERVAL_MS || interval_ms > SENSOR_MAX_INTERVAL_MS) {
+                char message[64];
+                snprintf(message, sizeof(message), "interval_ms out of range (%lu..%lu)",
+                         SENSOR_MIN_INTERVAL_MS, SENSOR_MAX_INTERVAL_MS);
+                sendJsonResult(tpcb, 400, message);
+                return;
+            }
+            if (offset_ms >= interval_ms) {
+                sendJsonResult(tpcb, 400, "offset_ms must be below interval_ms");
+                return;
+            }
+        }
+        if (bounds) {
+            if (!fields[3].found) min_ms = sensor_manager_->getMinIntervalMs(id);
+            if (!fields[4].found) max_ms = sensor_manager_->getMaxIntervalMs(id);
+            if (min_ms < SENSOR_MIN_INTERVAL_MS || max_ms > SENSOR_MAX_INTERVAL_MS || min_ms > max_ms) {
+                char message[80];
+                snprintf(message, sizeof(message), "Range must satisfy %lu <= min_ms <= max_ms <= %lu",
+                         SENSOR_MIN_INTERVAL_MS, SENSOR_MAX_INTERVAL_MS);
+                sendJsonResult(tpcb, 400, message);
+                return;
+            }
+            if (fields[1].found && (interval_ms < min_ms || interval_ms > max_ms)) {
+                sendJsonResult(tpcb, 400, "interval_ms must lie within min_ms..max_ms");
+                return;
+            }
+        }
+        
+        // Bounds before the schedule: setSchedule() widens them if needed
+        if (fields[5].found) {
+            sensor_manager_->setAdaptiveSampling(adaptive);
+        }
+        if (bounds) {
+            sensor_manager_->setBounds(id, min_ms, max_ms);
+            printf("Sensor range: %s %lu-%lums\n", name, min_ms, max_ms);
+        }
+        if (schedule) {
+            sensor_manager_->setSchedule(id, interval_ms, offset_ms);
+            printf("Sensor schedule: %s every %lums, offset %lums\n", name, interval_ms, offset_ms);
+        }
+    } else if (strcmp(request->method, "GET") != 0) {
+        sendHttpError(tpcb, 405, "Method Not Allowed");
+        return;
+    }
+    
+    char* json = generateSensorScheduleJson();
+    if (json) {
+        HttpResponse response;
+        response.status_code = 200;
+        strcpy(response.content_type, "application/json");
+        response.body = json;
+        response.body_length = strlen(json);
+        response.free_body = true;
+        sendHttpResponse(tpcb, &response);
+    } else {
+        sendHttpError(tpcb, 500, "Internal Server Error");
+    }
+}
+
+void WebServer::handleApiHistory(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    char ch_str[16];
+    char num_str[24];
+    HistoryChannel channel;
+    
+    if (!getUrlParam(request->query, "ch", ch_str, sizeof(ch_str)) ||
+        !SensorHistory::parseChannelName(ch_str, &channel)) {
+        sendHttpError(tpcb, 400, "Bad Request");
+        return;
+    }
+    
+    // Default window: what the RAM ring holds
+    time_t now = time(nullptr);
+    time_t from = now > 1600000000 ? now - (time_t)HISTORY_HOURS * 3600 : 0;
+    if (getUrlParam(request->query, "from", num_str, sizeof(num_str))) {
+        from = (time_t)strtoll(num_str, nullptr, 10);
+    }
+    
+    time_t to = 0;
+    if (getUrlParam(request->query, "to", num_str, sizeof(num_str))) {
+        to = (time_t)strtoll(num_str, nullptr, 10);
+    }
+    
+    uint32_t step = HISTORY_INTERVAL_SEC;
+    if (getUrlParam(request->query, "step", num_str, sizeof(num_str))) {
+        step = strtoul(num_str, nullptr, 10);
+    }
+    
+    // points=N: LTTB-downsample to at most N points
+    uint16_t max_points = 0;
+    if (getUrlParam(request->query, "points", num_str, sizeof(num_str))) {
+        unsigned long points = strtoul(num_str, nullptr, 10);
+        if (points < 3 || points > HISTORY_MAX_POINTS) {
+            sendHttpError(tpcb, 400, "Bad Request");
+            return;
+        }
+        max_points = (uint16_t)points;
+    }
+    
+    startStream(tpcb, request->accept_cbor ? "application/cbor" : "application/json",
+                request_arena_.create<HistoryStream>(channel, from, to, step, max_points,
+                                                     request->accept_cbor));
+}
+
+void WebServer::handleApiTelemetry(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    TelemetrySpool& spool = TelemetrySpool::getInstance();
+    
+    char* json = allocJson(256);
+    if (!json) {
+        sendHttpError(tpcb, 500, "Internal Server Error");
+        return;
+    }
+    snprintf(json, 256,
+             "{\"depth\":%lu,\"capacity\":%lu,\"next_seq\":%lu,\"live_sent\":%lu,"
+             "\"replayed\":%lu,\"dropped\":%lu,\"replaying\":%s,\"replay_done\":%lu,\"replay_total\":%lu}",
+             (unsigned long)spool.getDepth(), (unsigned long)spool.getCapacity(),
+             (unsigned long)spool.getNextSeq(), (unsigned long)spool.getLiveSent(),
+             (unsigned long)spool.getReplayed(), (unsigned long)spool.getDropped(),
+             spool.isReplaying() ? "true" : "false",
+             (unsigned long)spool.getReplayDone(), (unsigned long)spool.getReplayTotal());
+    
     HttpResponse response;
     response.status_code = 200;
     strcpy(response.content_type, "application/json");
-    response.body = (char*)response_json;
-    response.body_length = strlen(response_json);
-    response.free_body = false;
+    response.body = json;
+    response.body_length = strlen(json);
+    response.free_body = true;
     sendHttpResponse(tpcb, &response);
 }
 
-void WebServer::handleApiHumidity(struct tcp_pcb* tpcb, const HttpRequest* request) {
-    if (strcmp(request->method, "POST") != 0) {
-        sendHttpError(tpcb, 405, "Method Not Allowed");
+void WebServer::handleApiPerf(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    // POST clears the counters; GET returns per-stage timings in microseconds
+    // with the log2 histogram trimmed to its non-empty span: hist[k] counts
+    // passes of [2^(hist_first+k), 2^(hist_first+k+1)) ticks
+    if (strcmp(request->method, "POST") == 0) {
+        Perf::requestReset();
+    }
+    
+    const size_t size = 2048;
+    char* json = allocJson(size);
+    if (!json) {
+        sendHttpError(tpcb, 500, "Internal Server Error");
         return;
     }
     
-    const char* response_json = "{\"success\": true, \"message\": \"Humidity threshold updated\"}";
+    const float mhz = Perf::getTickHz() / 1e6f;
+    int len = snprintf(json, size, "{\"enabled\":%s,\"source\":\"%s\",\"tick_hz\":%lu,\"stages\":[",
+                       PERF_ENABLED ? "true" : "false", Perf::getSource(),
+                       (unsigned long)Perf::getTickHz());
+    bool first = true;
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++) {
+        PerfSnapshot snap;
+        if (!Perf::snapshot((PerfStage)i, &snap) || snap.count == 0) continue;
+        // Room for the largest stage entry and the closing brackets
+        if (len > (int)size - 512) break;
+        
+        uint8_t lo = 0;
+        uint8_t hi = PERF_HIST_BUCKETS - 1;
+        while (snap.hist[lo] == 0) lo++;
+        while (snap.hist[hi] == 0) hi--;
+        
+        len += snprintf(json + len, size - len,
+                        "%s{\"name\":\"%s\",\"count\":%lu,\"min_us\":%.2f,\"avg_us\":%.2f,"
+                        "\"max_us\":%.2f,\"hist_first\":%u,\"hist\":[",
+                        first ? "" : ",", Perf::getStageName((PerfStage)i), (unsigned long)snap.count,
+                        snap.min_ticks / mhz, snap.total_ticks / mhz / snap.count, snap.max_ticks / mhz, lo);
+        for (uint8_t b = lo; b <= hi; b++) {
+            len += snprintf(json + len, size - len, "%s%lu", b == lo ? "" : ",", (unsigned long)snap.hist[b]);
+        }
+        len += snprintf(json + len, size - len, "]}");
+        first = false;
+    }
+    snprintf(json + len, size - len, "]}");
+    
     HttpResponse response;
     response.status_code = 200;
     strcpy(response.content_type, "application/json");
-    response.body = (char*)response_json;
-    response.body_length = strlen(response_json);
-    response.free_body = false;
+    response.body = json;
+    response.body_length = strlen(json);
+    response.free_body = true;
     sendHttpResponse(tpcb, &response);
 }
 
-void WebServer::handleApiSave(struct tcp_pcb* tpcb, const HttpRequest* request) {
-    if (strcmp(request->method, "POST") != 0) {
-        sendHttpError(tpcb, 405, "Method Not Allowed");
+void WebServer::handleApiPerfHttp(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    // POST clears the table; the reply is streamed since a busy table
+    // outgrows the send buffer
+    if (strcmp(request->method, "POST") == 0) {
+        http_stats_.reset();
+    }
+    startStream(tpcb, "application/json", request_arena_.create<HttpStatsStream>(http_stats_));
+}
+
+void WebServer::handleApiMem(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    // Stack peaks are high-water marks since boot; lwIP pools are all of
+    // lwIP's MEMP pools with "HEAP" (its MEM_SIZE heap) first
+    const size_t size = JSON_POOL_BLOCK_BYTES;
+    char* json = allocJson(size);
+    if (!json) {
+        sendHttpError(tpcb, 500, "Internal Server Error");
         return;
     }
     
-    const char* response_json = "{\"success\": true, \"message\": \"Configuration saved\"}";
+    HeapStats heap;
+    MemStats::getHeap(&heap);
+    int len = snprintf(json, size,
+                       "{\"heap\":{\"size\":%lu,\"arena\":%lu,\"in_use\":%lu,\"free\":%lu,\"free_chunks\":%lu},"
+                       "\"alloc\":{\"current\":%lu,\"peak\":%lu,\"count\":%lu,\"failed\":%lu},\"stacks\":[",
+                       (unsigned long)heap.size, (unsigned long)heap.arena, (unsigned long)heap.in_use,
+                       (unsigned long)heap.free, (unsigned long)heap.free_chunks,
+                       (unsigned long)MemStats::getAllocCurrent(), (unsigned long)MemStats::getAllocPeak(),
+                       (unsigned long)MemStats::getAllocCount(), (unsigned long)MemStats::getAllocFailed());
+    for (uint8_t core = 0; core < 2; core++) {
+        StackStats stack;
+        MemStats::getStack(core, &stack);
+        len += snprintf(json + len, size - len, "%s{\"core\":%u,\"size\":%lu,\"peak\":%lu,\"painted\":%s}",
+                        core ? "," : "", core, (unsigned long)stack.size, (unsigned long)stack.peak,
+                        stack.painted ? "true" : "false");
+    }
+    len += snprintf(json + len, size - len, "],\"pools\":[");
+    for (const MemPool* p = MemPool::getFirst(); p; p = p->getNext()) {
+        len += snprintf(json + len, size - len,
+                        "%s{\"name\":\"%s\",\"capacity\":%lu,\"used\":%lu,\"peak\":%lu,\"failed\":%lu}",
+                        p == MemPool::getFirst() ? "" : ",", p->getName(), (unsigned long)p->getCapacity(),
+                        (unsigned long)p->getUsed(), (unsigned long)p->getPeak(), (unsigned long)p->getFailed());
+    }
+    len += snprintf(json + len, size - len, "],\"lwip\":[");
+    PoolStats pool;
+    for (uint8_t i = 0; MemStats::getPool(i, &pool) && len < (int)size - 128; i++) {
+        len += snprintf(json + len, size - len,
+                        "%s{\"name\":\"%s\",\"avail\":%lu,\"used\":%lu,\"max\":%lu,\"err\":%lu}",
+                        i ? "," : "", pool.name, (unsigned long)pool.avail, (unsigned long)pool.used,
+                        (unsigned long)pool.max, (unsigned long)pool.err);
+    }
+    snprintf(json + len, size - len, "]}");
+    
     HttpResponse response;
     response.status_code = 200;
     strcpy(response.content_type, "application/json");
-    response.body = (char*)response_json;
-    response.body_length = strlen(response_json);
-    response.free_body = false;
+    response.body = json;
+    response.body_length = strlen(json);
+    response.free_body = true;
     sendHttpResponse(tpcb, &response);
 }
 
+void WebServer::handleMetrics(struct tcp_pcb* tpcb, const HttpRequest* request) {
+    if (strcmp(request->method, "GET") != 0) {
+        sendHttpError(tpcb, 405, "Method Not Allowed");
+        return;
+    }
+    
+    // Scrapes within one metrics window share the rendered body
+    const uint32_t generation = Metrics::getInstance().getGeneration();
+    if (!metrics_cached_ || generation != metrics_generation_) {
+        metrics_cache_len_ = renderMetrics(metrics_cache_, sizeof(metrics_cache_));
+        metrics_generation_ = generation;
+        metrics_cached_ = true;
+    }
+    
+    ResponseStream* stream = request_arena_.create<BufferStream>(metrics_cache_, metrics_cache_len_);
+    startStream(tpcb, "text/plain; version=0.0.4", stream);
+}
+
+size_t WebServer::renderMetrics(char* buffer, size_t size) {
+    Metrics& metrics = Metrics::getInstance();
+    metrics_renders_++;
+    
+    // Registry gauges (readings, link state, setpoints) come first
+    FieldValues values;
+    readFields(&values);
+    const size_t field_len = Fields::writeMetrics(values, buffer, size);
+    MetricsWriter w(buffer + field_len, size - field_len);
+    
+    // Relays
+    const bool relay_on[METRICS_RELAY_COUNT] = {
+        lights_controller_->isOn(), pump_controller_->isOn(),
+        heater_controller_->isOn(), fan_controller_->isOn()
+    };
+    w.family("hydro_relay_on", "gauge", "Relay state (1 = on)");
+    for (uint8_t relay = 0; relay < METRICS_RELAY_COUNT; relay++) {
+        w.line("hydro_relay_on{relay=\"%s\"} %d\n", Metrics::getRelayName(relay), relay_on[relay] ? 1 : 0);
+    }
+    w.family("hydro_relay_on_seconds_total", "counter", "Time each relay has been on since boot");
+    for (uint8_t relay = 0; relay < METRICS_RELAY_COUNT; relay++) {
+        w.line("hydro_relay_on_seconds_total{relay=\"%s\"} %.3f\n", Metrics::getRelayName(relay),
+               metrics.getRelayOnMs(relay) / 1000.0);
+    }
+    w.family("hydro_relay_duty_ratio", "gauge", "Relay on fraction, exponential average over one hour");
+    for (uint8_t relay = 0; relay < METRICS_RELAY_COUNT; relay++) {
+        w.line("hydro_relay_duty_ratio{relay=\"%s\"} %.4f\n", Metrics::getRelayName(relay),
+               metrics.getRelayDuty(relay));
+    }
+    
+    // Loop timings (core 0 excludes its idle wait)
+    w.family("hydro_loop_iterations_total", "counter", "Main loop passes per core");
+    for (uint8_t core = 0; core < 2; core++) {
+        w.line("hydro_loop_iterations_total{core=\"%u\"} %llu\n", core,
+               (unsigned long long)metrics.getLoop(core).iterations);
+    }
+    w.family("hydro_loop_busy_seconds_total", "counter", "Time spent in loop passes per core");
+    for (uint8_t core = 0; core < 2; core++) {
+        w.line("hydro_loop_busy_seconds_total{core=\"%u\"} %.6f\n", core,
+               metrics.getLoop(core).busy_us / 1e6);
+    }
+    w.family("hydro_loop_pass_avg_microseconds", "gauge", "Mean loop pass time over the last metrics window");
+    for (uint8_t core = 0; core < 2; core++) {
+        w.line("hydro_loop_pass_avg_microseconds{core=\"%u\"} %lu\n", core,
+               (unsigned long)metrics.getLoop(core).avg_us);
+    }
+    w.family("hydro_loop_pass_max_microseconds", "gauge", "Longest loop pass in the last metrics window");
+    for (uint8_t core = 0; core < 2; core++) {
+        w.line("hydro_loop_pass_max_microseconds{core=\"%u\"} %lu\n", core,
+               (unsigned long)metrics.getLoop(core).max_us);
+    }
+    
+    // HTTP
+    w.family("hydro_http_requests_total", "counter", "HTTP requests received");
+    w.line("hydro_http_requests_total %lu\n", (unsigned long)http_requests_);
+    w.family("hydro_http_errors_total", "counter", "HTTP error responses sent");
+    w.line("hydro_http_errors_total %lu\n", (unsigned long)http_errors_);
+    w.family("hydro_metrics_renders_total", "counter", "Times this exposition was re-rendered");
+    w.line("hydro_metrics_renders_total %lu\n", (unsigned long)metrics_renders_);
+    
+    // Flash
+    FlashStats flash = FlashStorage::getInstance().getStats();
+    w.family("hydro_flash_reads_total", "counter", "LittleFS block reads");
+    w.line("hydro_flash_reads_total %lu\n", (unsigned long)flash.reads);
+    w.family("hydro_flash_programs_total", "counter", "LittleFS flash program operations");
+    w.line("hydro_flash_programs_total %lu\n", (unsigned long)flash.programs);
+    w.family("hydro_flash_program_bytes_total", "counter", "Bytes programmed to flash");
+    w.line("hydro_flash_program_bytes_total %lu\n", (unsigned long)flash.program_bytes);
+    w.family("hydro_flash_erases_total", "counter", "4 KB flash sector erases");
+    w.line("hydro_flash_erases_total %lu\n", (unsigned long)flash.erases);
+    
+    // Radio and network
+    w.family("hydro_nrf_packets_total", "counter", "NRF24L01 packets received from the Nano ADCs");
+    w.line("hydro_nrf_packets_total{sensor=\"ph\"} %lu\n", (unsigned long)sensor_manager_->getNrfPhPackets());
+    w.line("hydro_nrf_packets_total{sensor=\"tds\"} %lu\n", (unsigned long)sensor_manager_->getNrfTdsPackets());
+    NetworkManager& network = NetworkManager::getInstance();
+    w.family("hydro_wifi_reconnects_total", "counter", "WiFi link recoveries after a drop");
+    w.line("hydro_wifi_reconnects_total %lu\n", (unsigned long)network.getReconnects());
+    
+    // Telemetry spool
+    TelemetrySpool& spool = TelemetrySpool::getInstance();
+    w.family("hydro_telemetry_spool_depth", "gauge", "Telemetry records waiting for delivery");
+    w.line("hydro_telemetry_spool_depth %lu\n", (unsigned long)spool.getDepth());
+    w.family("hydro_telemetry_dropped_total", "counter", "Telemetry records lost to overflow or errors");
+    w.line("hydro_telemetry_dropped_total %lu\n", (unsigned long)spool.getDropped());
+    
+    w.family("hydro_uptime_seconds", "gauge", "Seconds since boot");
+    w.line("hydro_uptime_seconds %llu\n", (unsigned long long)Clock::nowSec());
+    
+    if (w.isFull()) {
+        printf("Metrics: exposition truncated at %u bytes\n", (unsigned)(field_len + w.length()));
+    }
+    return field_len + w.length();
+}
+
+void WebServer::readFields(FieldValues* out) {
+    const FieldSource src = { sensor_manager_, lights_controller_, pump_controller_,
+                              heater_controller_, fan_controller_ };
+    Fields::read(src, out);
+}
+
 char* WebServer::generateStatusJson() {
-    char* json = (char*)malloc(1024);
+    char* json = allocJson(1024);
     if (!json) return nullptr;
     
-    ConfigManager& config = ConfigManager::getInstance();
+    FieldValues values;
+    readFields(&values);
     
-    snprintf(json, 1024,
-        "{"
-        "\"temperature\": %.1f,"
-        "\"humidity\": %.1f,"
-        "\"air_temperature\": %.1f,"
-        "\"air_humidity\": %.1f,"
-        "\"ph\": %.2f,"
-        "\"tds\": %.0f,"
-        "\"lights_on\": %s,"
-        "\"pump_on\": %s,"
-        "\"heater_on\": %s,"
-        "\"fan_on\": %s,"
-        "\"wifi_connected\": true,"
-        "\"time_synced\": true,"
-        "\"lights_start_s\": %lu,"
-        "\"lights_end_s\": %lu,"
-        "\"pump_on_sec\": %lu,"
-        "\"pump_period\": %lu,"
-        "\"heater_setpoint_c\": %.1f,"
-        "\"humidity_threshold\": %.1f,"
-        "\"humidity_mode\": %s"
+    // Every registry field, then the sampling schedule
+    int len = snprintf(json, 1024, "{");
+    len += Fields::writeJson(values, FIELD_ALL, json + len, 1024 - len);
+    snprintf(json + len, 1024 - len,
+        ",\"adaptive_sampling\": %s,"
+        "\"sample_interval_ms\": {\"water\": %lu, \"table\": %lu, \"air\": %lu, \"nano\": %lu}"
         "}",
-        sensor_manager_->isTemperatureValid() ? sensor_manager_->getLastTemperature() : -999.0,
-        sensor_manager_->isHumidityValid() ? sensor_manager_->getLastHumidity() : -999.0,
-        sensor_manager_->isAirTempValid() ? sensor_manager_->getLastAirTemp() : -999.0,
-        sensor_manager_->isAirHumidityValid() ? sensor_manager_->getLastAirHumidity() : -999.0,
-        sensor_manager_->isPHValid() ? sensor_manager_->getLastPH() : -999.0,
-        sensor_manager_->isTDSValid() ? sensor_manager_->getLastTDS() : -999.0,
-        lights_controller_->isOn() ? "true" : "false",
-        pump_controller_->isOn() ? "true" : "false",
-        heater_controller_->isOn() ? "true" : "false",
-        fan_controller_->isOn() ? "true" : "false",
-        config.getLightsStartS(),
-        config.getLightsEndS(),
-        config.getPumpOnSec(),
-        config.getPumpPeriod(),
-        config.getHeaterSetpointC(),
-        config.getHumidityThreshold(),
-        config.getHumidityMode() ? "true" : "false"
+        sensor_manager_->isAdaptiveSampling() ? "true" : "false",
+        sensor_manager_->getEffectiveIntervalMs(SENSOR_WATER_TEMP),
+        sensor_manager_->getEffectiveIntervalMs(SENSOR_TABLE_HUMIDITY),
+        sensor_manager_->getEffectiveIntervalMs(SENSOR_AIR),
+        sensor_manager_->getEffectiveIntervalMs(SENSOR_NANO)
     );
     
     return json;
 }
 
 char* WebServer::generateConfigJson() {
-    char* json = (char*)malloc(1024);
+    char* json = allocJson(1024);
     if (!json) return nullptr;
     
-    ConfigManager& config = ConfigManager::getInstance();
+    FieldValues values;
+    readFields(&values);
     
-    snprintf(json, 1024,
-        "{"
-        "\"lights_start_s\": %lu,"
-        "\"lights_end_s\": %lu,"
-        "\"pump_on_sec\": %lu,"
-        "\"pump_period\": %lu,"
-        "\"heater_setpoint_c\": %.1f,"
-        "\"humidity_threshold\": %.1f,"
-        "\"humidity_mode\": %s"
-        "}",
-        config.getLightsStartS(),
-        config.getLightsEndS(),
-        config.getPumpOnSec(),
-        config.getPumpPeriod(),
-        config.getHeaterSetpointC(),
-        config.getHumidityThreshold(),
-        config.getHumidityMode() ? "true" : "false"
-    );
+    int len = snprintf(json, 1024, "{");
+    len += Fields::writeJson(values, FIELD_CONFIG, json + len, 1024 - len);
+    snprintf(json + len, 1024 - len, "}");
     
     return json;
 }
 
-void WebServer::parseQueryParams(const char* query, char* buffer, size_t buffer_size, const char* param) {
-    buffer[0] = '\0';
+char* WebServer::generateStatusCbor(size_t* length) {
+    char* body = allocJson(JSON_POOL_BLOCK_BYTES);
+    if (!body) return nullptr;
     
-    char search_pattern[64];
-    snprintf(search_pattern, sizeof(search_pattern), "\"%s\":", param);
+    FieldValues values;
+    readFields(&values);
     
-    const char* start = strstr(query, search_pattern);
-    if (start) {
-        start += strlen(search_pattern);
-        
-        // Skip whitespace
-        while (*start == ' ' || *start == '\t') start++;
-        
-        // Handle string values
-        if (*start == '"') {
-            start++; // Skip opening quote
-            const char* end = strchr(start, '"');
-            if (end) {
-                size_t len = end - start;
-                if (len < buffer_size) {
-                    strncpy(buffer, start, len);
-                    buffer[len] = '\0';
-                }
-            }
-        }
-        // Handle numeric values
-        else {
-            const char* end = start;
-            while ((*end >= '0' && *end <= '9') || *end == '.' || *end == '-') {
-                end++;
-            }
-            size_t len = end - start;
-            if (len < buffer_size) {
-                strncpy(buffer, start, len);
-                buffer[len] = '\0';
-            }
+    // Same members as generateStatusJson(), encoded straight into the block
+    CborWriter w((uint8_t*)body, JSON_POOL_BLOCK_BYTES);
+    w.openMap();
+    Fields::writeCbor(values, FIELD_ALL, w);
+    w.text("adaptive_sampling");
+    w.boolean(sensor_manager_->isAdaptiveSampling());
+    w.text("sample_interval_ms");
+    w.map(4);
+    w.text("water");
+    w.uinteger(sensor_manager_->getEffectiveIntervalMs(SENSOR_WATER_TEMP));
+    w.text("table");
+    w.uinteger(sensor_manager_->getEffectiveIntervalMs(SENSOR_TABLE_HUMIDITY));
+    w.text("air");
+    w.uinteger(sensor_manager_->getEffectiveIntervalMs(SENSOR_AIR));
+    w.text("nano");
+    w.uinteger(sensor_manager_->getEffectiveIntervalMs(SENSOR_NANO));
+    w.close();
+    
+    if (w.isOverflowed()) {
+        g_json_pool.release(body);
+        return nullptr;
+    }
+    *length = w.length();
+    return body;
+}
+
+char* WebServer::generateConfigCbor(size_t* length) {
+    char* body = allocJson(JSON_POOL_BLOCK_BYTES);
+    if (!body) return nullptr;
+    
+    FieldValues values;
+    readFields(&values);
+    
+    CborWriter w((uint8_t*)body, JSON_POOL_BLOCK_BYTES);
+    w.openMap();
+    Fields::writeCbor(values, FIELD_CONFIG, w);
+    w.close();
+    
+    if (w.isOverflowed()) {
+        g_json_pool.release(body);
+        return nullptr;
+    }
+    *length = w.length();
+    return body;
+}
+
+char* WebServer::generateSensorScheduleJson() {
+    char* json = allocJson(1024);
+    if (!json) return nullptr;
+    
+    int len = snprintf(json, 1024, "{\"adaptive\": %s, \"sensors\": [",
+                       sensor_manager_->isAdaptiveSampling() ? "true" : "false");
+    for (uint8_t i = 0; i < SENSOR_COUNT && len < 1024; i++) {
+        SensorId id = (SensorId)i;
+        len += snprintf(json + len, 1024 - len,
+            "%s{\"name\": \"%s\", \"interval_ms\": %lu, \"offset_ms\": %lu, "
+            "\"min_ms\": %lu, \"max_ms\": %lu, \"effective_ms\": %lu}",
+            i ? "," : "",
+            SensorManager::getSensorName(id),
+            sensor_manager_->getIntervalMs(id),
+            sensor_manager_->getOffsetMs(id),
+            sensor_manager_->getMinIntervalMs(id),
+            sensor_manager_->getMaxIntervalMs(id),
+            sensor_manager_->getEffectiveIntervalMs(id));
+    }
+    if (len < 1024) {
+        snprintf(json + len, 1024 - len, "]}");
+    }
+    
+    return json;
+}
+
+bool WebServer::getUrlParam(const char* query, const char* param, char* buffer, size_t buffer_size) {
+    buffer[0] = '\0';
+    size_t param_len = strlen(param);
+    
+    const char* p = query;
+    while (p && *p) {
+        if (strncmp(p, param, param_len) == 0 && p[param_len] == '=') {
+            const char* value = p + param_len + 1;
+            size_t len = strcspn(value, "&");
+            if (len >= buffer_size) return false;
+            memcpy(buffer, value, len);
+            buffer[len] = '\0';
+            urlDecode(buffer);
+            return true;
         }
+        p = strchr(p, '&');
+        if (p) p++;
     }
+    return false;
 }
 
 void WebServer::urlDecode(char* str) {
@@ -600,13 +1757,18 @@ void WebServer::urlDecode(char* str) {
 
 char* WebServer::createJsonResponse(const char* json_data) {
     size_t len = strlen(json_data);
-    char* response = (char*)malloc(len + 1);
+    char* response = allocJson(len + 1);
     if (response) {
         strcpy(response, json_data);
     }
     return response;
 }
 
+char* WebServer::allocJson(size_t size) {
+    if (size > g_json_pool.getBlockSize()) return nullptr;
+    return (char*)g_json_pool.alloc();
+}
+
 uint32_t WebServer::parseTimeToSeconds(const char* time_str) {
     int hours, minutes;
     if (sscanf(time_str, "%d:%d", &hours, &minutes) == 2) {
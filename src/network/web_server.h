@@ -4,12 +4,18 @@
 #include <stdbool.h>
 #include "lwip/tcp.h"
 #include "lwip/pbuf.h"
+#include "../config.h"
+#include "http_stats.h"
+#include "../utils/mem_pool.h"
+#include "../telemetry_fields.h"
 
 class SensorManager;
 class LightsController;
 class PumpController;
 class HeaterController;
 class FanController;
+struct JsonField;
+class SettingsBatch;
 
 // HTTP request structure
 struct HttpRequest {
@@ -18,7 +24,8 @@ struct HttpRequest {
     char query[256];
     char body[512];
     char content_type[64];
-    uint16_t content_length;
+    uint16_t content_length;    // Body bytes, as announced by Content-Length
+    bool accept_cbor;       // Accept: application/cbor
 };
 
 // HTTP response structure
@@ -27,7 +34,16 @@ struct HttpResponse {
     char content_type[64];
     char* body;
     size_t body_length;
-    bool free_body;
+    bool free_body;         // body is a g_json_pool block
+};
+
+// Body producer for responses sent as the TCP send buffer drains. read()
+// fills at most max bytes (never splitting output it cannot resume) and
+// returns 0 once the body is complete.
+class ResponseStream {
+public:
+    virtual ~ResponseStream() = default;
+    virtual size_t read(char* buffer, size_t max) = 0;
 };
 
 class WebServer {
@@ -47,6 +63,7 @@ private:
     static err_t web_accept_callback(void* arg, struct tcp_pcb* newpcb, err_t err);
     static err_t web_recv_callback(void* arg, struct tcp_pcb* tpcb, struct pbuf* p, err_t err);
     static void web_err_callback(void* arg, err_t err);
+    static err_t web_sent_callback(void* arg, struct tcp_pcb* tpcb, uint16_t len);
     
     err_t webAccept(struct tcp_pcb* newpcb, err_t err);
     err_t webRecv(struct tcp_pcb* tpcb, struct pbuf* p, err_t err);
@@ -58,6 +75,20 @@ private:
     void sendHttpResponse(struct tcp_pcb* tpcb, const HttpResponse* response);
     void sendHttpError(struct tcp_pcb* tpcb, int code, const char* message);
     
+    // {"success":..,"message":..} answers for the settings endpoints
+    void sendJsonResult(struct tcp_pcb* tpcb, int code, const char* message);
+    bool checkSettings(struct tcp_pcb* tpcb, const SettingsBatch& change);
+    
+    // Extract the wanted members of a JSON request body; sends the 400
+    // itself and returns false if the body is unusable
+    bool readJsonBody(struct tcp_pcb* tpcb, const HttpRequest* request, JsonField* fields, uint8_t count);
+    bool readBatchBody(struct tcp_pcb* tpcb, const HttpRequest* request, SettingsBatch* batch, bool* persist);
+    
+    // Streamed responses (close-delimited, no Content-Length)
+    void startStream(struct tcp_pcb* tpcb, const char* content_type, ResponseStream* stream);
+    void pumpStream(struct tcp_pcb* tpcb);
+    void endStream();
+    
     // API endpoints
     void handleApiStatus(struct tcp_pcb* tpcb, const HttpRequest* request);
     void handleApiConfig(struct tcp_pcb* tpcb, const HttpRequest* request);
@@ -67,6 +98,23 @@ private:
     void handleApiFan(struct tcp_pcb* tpcb, const HttpRequest* request);
     void handleApiHumidity(struct tcp_pcb* tpcb, const HttpRequest* request);
     void handleApiSave(struct tcp_pcb* tpcb, const HttpRequest* request);
+    void handleApiBatch(struct tcp_pcb* tpcb, const HttpRequest* request);
+    // /api/batch reply, sent from handleClients() once core 0 has applied
+    // the batch or SETTINGS_APPLY_TIMEOUT_MS has passed
+    void finishBatch();
+    void handleApiSensors(struct tcp_pcb* tpcb, const HttpRequest* request);
+    void handleApiHistory(struct tcp_pcb* tpcb, const HttpRequest* request);
+    void handleApiTelemetry(struct tcp_pcb* tpcb, const HttpRequest* request);
+    void handleApiPerf(struct tcp_pcb* tpcb, const HttpRequest* request);
+    void handleApiPerfHttp(struct tcp_pcb* tpcb, const HttpRequest* request);
+    void handleApiMem(struct tcp_pcb* tpcb, const HttpRequest* request);
+    
+    // Ends the TTLB measurement of the request in flight
+    void finishResponse();
+    
+    // Prometheus exposition, re-rendered only when Metrics moves on
+    void handleMetrics(struct tcp_pcb* tpcb, const HttpRequest* request);
+    size_t renderMetrics(char* buffer, size_t size);
     
     // Static file serving
     void serveStaticFile(struct tcp_pcb* tpcb, const char* filename, const char* content_type);
@@ -76,13 +124,18 @@ private:
     void serveFavicon(struct tcp_pcb* tpcb);
     
     // JSON generation
+    void readFields(FieldValues* out);
     char* generateStatusJson();
     char* generateConfigJson();
+    char* generateStatusCbor(size_t* length);
+    char* generateConfigCbor(size_t* length);
+    char* generateSensorScheduleJson();
     
     // Utility functions
-    void parseQueryParams(const char* query, char* buffer, size_t buffer_size, const char* param);
+    bool getUrlParam(const char* query, const char* param, char* buffer, size_t buffer_size);
     void urlDecode(char* str);
     char* createJsonResponse(const char* json_data);
+    char* allocJson(size_t size);   // g_json_pool block of at least size bytes
     uint32_t parseTimeToSeconds(const char* time_str);
     
     // Component references
@@ -99,4 +152,38 @@ private:
     // Request buffer for multi-packet requests
     char request_buffer_[2048];
     size_t request_buffer_pos_;
+    
+    // Per-connection memory for the request in flight (response streams),
+    // reset when the response ends
+    alignas(8) uint8_t request_arena_buffer_[WEB_REQUEST_ARENA_BYTES];
+    Arena request_arena_;
+    
+    // Active streamed response (one client at a time), in request_arena_
+    static const size_t STREAM_CHUNK_SIZE = 512;
+    ResponseStream* stream_;
+    char stream_chunk_[STREAM_CHUNK_SIZE];
+    size_t stream_chunk_len_;
+    
+    // Request counters
+    uint32_t http_requests_;
+    uint32_t http_errors_;
+    
+    // Per-route statistics and the request in flight
+    HttpStats http_stats_;
+    HttpRoute request_route_;
+    uint64_t request_start_us_;
+    bool response_pending_;
+    
+    // Committed /api/batch awaiting its reply (seq 0: none)
+    uint32_t batch_seq_;
+    uint64_t batch_deadline_ms_;
+    uint8_t batch_count_;
+    bool batch_persist_;
+    
+    // Cached /metrics body, valid for metrics_generation_
+    char metrics_cache_[METRICS_CACHE_SIZE];
+    size_t metrics_cache_len_;
+    uint32_t metrics_generation_;
+    bool metrics_cached_;
+    uint32_t metrics_renders_;
 };
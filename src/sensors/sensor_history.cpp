@@ -0,0 +1,195 @@
+#include "sensor_history.h"
+#include "sensor_manager.h"
+#include "../utils/clock.h"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+static_assert(sizeof(int16_t) * HIST_CHANNEL_COUNT * HISTORY_DEPTH <= HISTORY_RAM_BUDGET,
+              "Sensor history exceeds its RAM budget");
+
+static const time_t MIN_VALID_EPOCH = 1600000000;
+
+SensorHistory& SensorHistory::getInstance() {
+    static SensorHistory instance;
+    return instance;
+}
+
+SensorHistory::SensorHistory()
+    : sensor_manager_(nullptr), started_(false), first_sec_(0), next_seq_(0) {
+}
+
+void SensorHistory::begin(SensorManager* sensor_manager) {
+    sensor_manager_ = sensor_manager;
+    printf("Sensor history: %lu samples x %u channels every %lus (%u bytes)\n",
+           (unsigned long)HISTORY_DEPTH, (unsigned)HIST_CHANNEL_COUNT,
+           (unsigned long)HISTORY_INTERVAL_SEC, (unsigned)sizeof(ring_));
+}
+
+bool SensorHistory::update(uint8_t relay_mask) {
+    if (!sensor_manager_) return false;
+    
+    const uint64_t now = Clock::nowSec();
+    if (!started_) {
+        first_sec_ = now;
+        started_ = true;
+    }
+    
+    uint64_t due = first_sec_ + (uint64_t)next_seq_ * HISTORY_INTERVAL_SEC;
+    if (now < due) return false;
+    
+    // Slots missed while core 1 was busy stay empty so timestamps stay implicit
+    uint32_t missed = 0;
+    while (now >= due + HISTORY_INTERVAL_SEC && missed < HISTORY_DEPTH) {
+        recordGap();
+        due += HISTORY_INTERVAL_SEC;
+        missed++;
+    }
+    if (missed == HISTORY_DEPTH) {
+        next_seq_ = (uint32_t)((now - first_sec_) / HISTORY_INTERVAL_SEC);
+    }
+    
+    record(relay_mask);
+    return true;
+}
+
+int16_t SensorHistory::toFixed(float value, uint16_t scale) {
+    float scaled = roundf(value * scale);
+    if (scaled > INT16_MAX) return INT16_MAX;
+    if (scaled <= INT16_MIN) return INT16_MIN + 1;  // INT16_MIN marks no data
+    return (int16_t)scaled;
+}
+
+void SensorHistory::readCurrent(uint8_t relay_mask, int16_t values[HIST_CHANNEL_COUNT]) const {
+    FieldValues readings;
+    Fields::readSensors(sensor_manager_, &readings);
+    for (uint8_t ch = 0; ch < HIST_RELAYS; ch++) {
+        values[ch] = readings.valid[ch]
+            ? toFixed(readings.value[ch], getChannelScale((HistoryChannel)ch)) : HISTORY_NO_DATA;
+    }
+    values[HIST_RELAYS] = relay_mask;
+}
+
+void SensorHistory::record(uint8_t relay_mask) {
+    const uint32_t seq = next_seq_;
+    const uint32_t slot = seq % HISTORY_DEPTH;
+    
+    int16_t values[HIST_CHANNEL_COUNT];
+    readCurrent(relay_mask, values);
+    for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+        ring_[ch][slot] = values[ch];
+    }
+    
+    // Publish only after the slot is complete
+    __dmb();
+    next_seq_ = seq + 1;
+}
+
+void SensorHistory::recordGap() {
+    const uint32_t seq = next_seq_;
+    const uint32_t slot = seq % HISTORY_DEPTH;
+    for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+        ring_[ch][slot] = HISTORY_NO_DATA;
+    }
+    __dmb();
+    next_seq_ = seq + 1;
+}
+
+uint32_t SensorHistory::getOldestSeq() const {
+    // One slot short of the ring: the next slot to be written is excluded
+    const uint32_t next = next_seq_;
+    return next >= HISTORY_DEPTH ? next - (HISTORY_DEPTH - 1) : 0;
+}
+
+time_t SensorHistory::epochForSeq(uint32_t seq) const {
+    const time_t now = time(nullptr);
+    if (now < MIN_VALID_EPOCH) return 0;
+    
+    const uint64_t sample_sec = first_sec_ + (uint64_t)seq * HISTORY_INTERVAL_SEC;
+    const int64_t age = (int64_t)Clock::nowSec() - (int64_t)sample_sec;
+    return now - (time_t)age;
+}
+
+bool SensorHistory::cursorFrom(time_t from, HistoryCursor* cursor) const {
+    cursor->seq = getOldestSeq();
+    cursor->end = getNextSeq();
+    if (from <= 0) return true;
+    
+    const time_t oldest = epochForSeq(cursor->seq);
+    if (oldest == 0) return false;
+    
+    if (from > oldest) {
+        uint32_t skip = (uint32_t)((from - oldest + HISTORY_INTERVAL_SEC - 1) / HISTORY_INTERVAL_SEC);
+        cursor->seq = (skip < cursor->end - cursor->seq) ? cursor->seq + skip : cursor->end;
+    }
+    return true;
+}
+
+bool SensorHistory::getSample(uint32_t seq, int16_t values[HIST_CHANNEL_COUNT]) const {
+    if (seq < getOldestSeq() || seq >= next_seq_) return false;
+    
+    const uint32_t slot = seq % HISTORY_DEPTH;
+    for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+        values[ch] = ring_[ch][slot];
+    }
+    return true;
+}
+
+size_t SensorHistory::read(HistoryChannel ch, HistoryCursor* cursor, int16_t* out, size_t max) const {
+    if (ch >= HIST_CHANNEL_COUNT) return 0;
+    
+    const uint32_t first = cursor->seq;
+    size_t count = 0;
+    while (count < max && cursor->seq < cursor->end && cursor->seq < next_seq_) {
+        out[count++] = ring_[ch][cursor->seq % HISTORY_DEPTH];
+        cursor->seq++;
+    }
+    
+    // Blank anything the writer overwrote while we were copying, keeping
+    // positions (and so implicit timestamps) intact
+    __dmb();
+    const uint32_t still_oldest = getOldestSeq();
+    for (size_t i = 0; i < count && first + i < still_oldest; i++) {
+        out[i] = HISTORY_NO_DATA;
+    }
+    return count;
+}
+
+const char* SensorHistory::getChannelName(HistoryChannel ch) {
+    if (ch < HIST_RELAYS) return Fields::info((FieldId)ch).channel;
+    return ch == HIST_RELAYS ? "relays" : "unknown";
+}
+
+bool SensorHistory::parseChannelName(const char* name, HistoryChannel* ch) {
+    for (uint8_t i = 0; i < HIST_CHANNEL_COUNT; i++) {
+        if (strcmp(name, getChannelName((HistoryChannel)i)) == 0) {
+            *ch = (HistoryChannel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint16_t SensorHistory::getChannelScale(HistoryChannel ch) {
+    return ch < HIST_RELAYS ? (uint16_t)Fields::info((FieldId)ch).scale : 1;
+}
+
+int16_t SensorHistory::getChannelDeadband(HistoryChannel ch) {
+    return ch < HIST_RELAYS ? Fields::info((FieldId)ch).deadband : 1;  // Relays: any change
+}
+
+int SensorHistory::formatFixed(char* out, size_t size, int16_t value, uint16_t scale) {
+    if (value == HISTORY_NO_DATA) {
+        out[0] = '\0';
+        return 0;
+    }
+    if (scale <= 1) return snprintf(out, size, "%d", value);
+    
+    int decimals = 0;
+    for (uint16_t s = scale; s > 1; s /= 10) decimals++;
+    
+    const int magnitude = value < 0 ? -value : value;
+    return snprintf(out, size, "%s%d.%0*d", value < 0 ? "-" : "", magnitude / scale, decimals, magnitude % scale);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "../config.h"
+#include "../telemetry_fields.h"
+
+class SensorManager;
+
+// One int16 fixed-point ring per channel: channel ch < HIST_RELAYS is
+// registry reading ch (FieldId) at its scale, then the relay mask
+enum HistoryChannel : uint8_t {
+    HIST_RELAYS = FIELD_SENSOR_COUNT,   // RELAY_* bitmask
+    HIST_CHANNEL_COUNT
+};
+
+// Stored when a sensor had no valid reading at sample time
+#define HISTORY_NO_DATA INT16_MIN
+
+// Read position in the history. Samples are numbered from boot (seq 0 is the
+// first sample); sample seq was taken at a fixed Clock second, so timestamps
+// are implicit.
+struct HistoryCursor {
+    uint32_t seq;   // Next sample to read
+    uint32_t end;   // One past the last sample to read
+};
+
+// In-RAM sensor history: a fixed-size structure-of-arrays ring sampled once
+// per HISTORY_INTERVAL_SEC on core 1. Readers never take a lock; samples the
+// writer overwrites while a read is in progress come back as HISTORY_NO_DATA.
+class SensorHistory {
+public:
+    static SensorHistory& getInstance();
+    
+    void begin(SensorManager* sensor_manager);
+    
+    // Record a sample when one is due (called from the core 1 loop);
+    // true when a new sample was taken
+    bool update(uint8_t relay_mask);
+    
+    // Readable range is [getOldestSeq(), getNextSeq())
+    uint32_t getOldestSeq() const;
+    uint32_t getNextSeq() const { return next_seq_; }
+    uint32_t getIntervalSec() const { return HISTORY_INTERVAL_SEC; }
+    
+    // Cursor over every retained sample at or after a wall-clock time
+    // (from = 0 for everything). False if the clock is not synced.
+    bool cursorFrom(time_t from, HistoryCursor* cursor) const;
+    
+    // Wall-clock time of a sample (0 if the clock is not synced)
+    time_t epochForSeq(uint32_t seq) const;
+    
+    // Latest sensor readings in the history's fixed-point format
+    void readCurrent(uint8_t relay_mask, int16_t values[HIST_CHANNEL_COUNT]) const;
+    
+    // All channels of one retained sample
+    bool getSample(uint32_t seq, int16_t values[HIST_CHANNEL_COUNT]) const;
+    
+    // Copy up to max raw values of one channel and advance the cursor
+    size_t read(HistoryChannel ch, HistoryCursor* cursor, int16_t* out, size_t max) const;
+    
+    static const char* getChannelName(HistoryChannel ch);
+    static bool parseChannelName(const char* name, HistoryChannel* ch);
+    static uint16_t getChannelScale(HistoryChannel ch);
+    static int16_t getChannelDeadband(HistoryChannel ch);  // MQTT republish threshold
+    
+    // Fixed point to decimal text with one digit per power of ten in scale
+    // (e.g. 2150 / 100 -> "21.50"); empty for HISTORY_NO_DATA. snprintf's
+    // return value.
+    static int formatFixed(char* out, size_t size, int16_t value, uint16_t scale);
+    
+private:
+    SensorHistory();
+    
+    void record(uint8_t relay_mask);
+    void recordGap();
+    static int16_t toFixed(float value, uint16_t scale);
+    
+    SensorManager* sensor_manager_;
+    bool started_;
+    uint64_t first_sec_;            // Clock second of sample 0
+    volatile uint32_t next_seq_;    // Published after the slot is written
+    
+    // Structure of arrays: each channel is contiguous so a query touches
+    // only the ring it streams
+    int16_t ring_[HIST_CHANNEL_COUNT][HISTORY_DEPTH];
+};
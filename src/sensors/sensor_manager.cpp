@@ -3,16 +3,44 @@
 #include "pico/mutex.h"
 #include "hardware/i2c.h"
 #include "hardware/spi.h"
+#include "../utils/clock.h"
+#include "../utils/perf.h"
+#include "../utils/log.h"
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Per-sensor change model for adaptive sampling: {noise floor, fast rate per
+// minute} for the primary and secondary value. Changes inside the noise
+// floor count as flat; a rate at or above the fast rate counts as activity 1.
+static const float ADAPT_MODEL[SENSOR_COUNT][2][2] = {
+    { { 0.13f, 0.2f }, { 0.0f, 0.0f } },    // Water temp (°C), 2 LSB at 12-bit
+    { { 0.3f,  2.0f }, { 0.0f, 0.0f } },    // Table humidity (%RH)
+    { { 0.2f,  0.5f }, { 1.0f, 3.0f } },    // Air temp (°C), air humidity (%RH)
+    { { 0.05f, 0.1f }, { 10.0f, 20.0f } },  // pH, TDS (ppm)
+};
 
 SensorManager::SensorManager() 
     : one_wire_(nullptr), temp_sensor_(nullptr), humidity_sensor_(nullptr),
       dht22_sensor_(nullptr), nrf_(nullptr), nano_ph_(nullptr), nano_tds_(nullptr),
       sensors_initialized_(false), last_temp_c_(-999.0), 
       last_humidity_(-999.0), last_air_temp_c_(-999.0), last_air_humidity_(-999.0),
-      last_ph_(-999.0), last_tds_(-999.0),
-      last_temp_read_(0), last_humidity_read_(0), last_air_read_(0), last_nano_read_(0) {
+      last_ph_(-999.0), last_tds_(-999.0), nrf_ph_packets_(0), nrf_tds_packets_(0),
+      last_bus_activity_ms_(0), temp_conversion_pending_(false), temp_conversion_start_ms_(0) {
     mutex_init(&sensor_mutex_);
+    
+    ConfigManager& config = ConfigManager::getInstance();
+    adaptive_ = config.getAdaptiveSampling();
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        interval_ms_[i] = config.getSensorIntervalMs((SensorId)i);
+        offset_ms_[i] = config.getSensorOffsetMs((SensorId)i);
+        min_interval_ms_[i] = config.getSensorMinIntervalMs((SensorId)i);
+        max_interval_ms_[i] = config.getSensorMaxIntervalMs((SensorId)i);
+        effective_ms_[i] = interval_ms_[i];
+        next_due_ms_[i] = offset_ms_[i];
+        last_sample_ms_[i] = 0;
+        has_last_sample_[i] = false;
+    }
 }
 
 SensorManager::~SensorManager() {
@@ -115,67 +143,299 @@ bool SensorManager::initialize() {
     return true;
 }
 
-void SensorManager::readTemperature() {
-    const uint32_t now = to_ms_since_boot(get_absolute_time());
-    if (now - last_temp_read_ < SENSOR_INTERVAL_MS) return;
+void SensorManager::update() {
+    const uint64_t now = Clock::nowMs();
+    
+    // Collect a finished DS18B20 conversion; the sensor converts on its own
+    // while the other buses are serviced, so nothing blocks for 750ms
+    if (temp_conversion_pending_) {
+        if (now - temp_conversion_start_ms_ >= DS18B20_CONVERSION_MS) {
+            PERF_STAGE(PERF_READ_WATER, readTemperature());
+            last_bus_activity_ms_ = time_us_64() / 1000;  // When the read finished, not the loop tick
+            return;
+        }
+    }
+    
+    // Leave the buses idle between transactions so that sensors falling due
+    // together are spread over separate loop iterations
+    if (now - last_bus_activity_ms_ < SENSOR_BUS_GAP_MS) return;
+    
+    // Pick the most overdue sensor
+    int8_t due = -1;
+    uint64_t most_late = 0;
+    mutex_enter_blocking(&sensor_mutex_);
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        if (now < next_due_ms_[i]) continue;
+        if (i == SENSOR_WATER_TEMP && temp_conversion_pending_) continue;
+        
+        uint64_t late = now - next_due_ms_[i];
+        if (due < 0 || late > most_late) {
+            due = i;
+            most_late = late;
+        }
+    }
+    
+    if (due >= 0) {
+        // Stay aligned to offset + k * interval even if serviced late
+        next_due_ms_[due] = alignedDueMs(now, offset_ms_[due], effective_ms_[due]);
+    }
+    mutex_exit(&sensor_mutex_);
+    
+    if (due < 0) return;
+    
+    sampleSensor((SensorId)due);
+    last_bus_activity_ms_ = time_us_64() / 1000;
+}
+
+uint64_t SensorManager::getNextWakeMs() {
+    uint64_t wake = UINT64_MAX;
+    if (temp_conversion_pending_) {
+        wake = temp_conversion_start_ms_ + DS18B20_CONVERSION_MS;
+    }
+    
+    mutex_enter_blocking(&sensor_mutex_);
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        if (i == SENSOR_WATER_TEMP && temp_conversion_pending_) continue;
+        if (next_due_ms_[i] < wake) wake = next_due_ms_[i];
+    }
+    mutex_exit(&sensor_mutex_);
+    
+    // Sensors falling due together are still spread by the bus gap
+    const uint64_t gap_end = last_bus_activity_ms_ + SENSOR_BUS_GAP_MS;
+    return wake > gap_end ? wake : gap_end;
+}
+
+uint64_t SensorManager::alignedDueMs(uint64_t now, uint32_t offset_ms, uint32_t interval_ms) {
+    if (now < offset_ms) return offset_ms;
+    return now - ((now - offset_ms) % interval_ms) + interval_ms;
+}
+
+void SensorManager::sampleSensor(SensorId id) {
+    switch (id) {
+        case SENSOR_WATER_TEMP:     PERF_STAGE(PERF_READ_WATER, startTemperatureConversion()); break;
+        case SENSOR_TABLE_HUMIDITY: PERF_STAGE(PERF_READ_TABLE, readHumidity()); break;
+        case SENSOR_AIR:            PERF_STAGE(PERF_READ_AIR, readAirSensor()); break;
+        case SENSOR_NANO:           PERF_STAGE(PERF_READ_NANO, readNanoADCs()); break;
+        default: break;
+    }
+}
+
+void SensorManager::setSchedule(SensorId id, uint32_t interval_ms, uint32_t offset_ms) {
+    if (id >= SENSOR_COUNT) return;
+    
+    const uint64_t now = Clock::nowMs();
+    
+    mutex_enter_blocking(&sensor_mutex_);
+    interval_ms_[id] = interval_ms;
+    offset_ms_[id] = offset_ms;
+    effective_ms_[id] = interval_ms;
+    
+    // Widen the adaptive bounds if the new nominal interval falls outside them
+    if (min_interval_ms_[id] > interval_ms) min_interval_ms_[id] = interval_ms;
+    if (max_interval_ms_[id] < interval_ms) max_interval_ms_[id] = interval_ms;
+    
+    next_due_ms_[id] = alignedDueMs(now, offset_ms, interval_ms);
+    const uint32_t min_ms = min_interval_ms_[id];
+    const uint32_t max_ms = max_interval_ms_[id];
+    mutex_exit(&sensor_mutex_);
+    
+    ConfigManager& config = ConfigManager::getInstance();
+    config.setSensorIntervalMs(id, interval_ms);
+    config.setSensorOffsetMs(id, offset_ms);
+    config.setSensorMinIntervalMs(id, min_ms);
+    config.setSensorMaxIntervalMs(id, max_ms);
+}
+
+void SensorManager::setAdaptiveSampling(bool enabled) {
+    mutex_enter_blocking(&sensor_mutex_);
+    adaptive_ = enabled;
+    if (!enabled) {
+        // Fall back to the nominal schedule
+        for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+            effective_ms_[i] = interval_ms_[i];
+        }
+    }
+    mutex_exit(&sensor_mutex_);
+    
+    ConfigManager& config = ConfigManager::getInstance();
+    config.setAdaptiveSampling(enabled);
+}
+
+void SensorManager::setBounds(SensorId id, uint32_t min_ms, uint32_t max_ms) {
+    if (id >= SENSOR_COUNT) return;
+    
+    const uint64_t now = Clock::nowMs();
+    
+    mutex_enter_blocking(&sensor_mutex_);
+    min_interval_ms_[id] = min_ms;
+    max_interval_ms_[id] = max_ms;
+    
+    // Keep the nominal and effective intervals inside the new bounds, and
+    // the offset inside the interval
+    const uint32_t effective_ms = effective_ms_[id];
+    if (interval_ms_[id] < min_ms) interval_ms_[id] = min_ms;
+    if (interval_ms_[id] > max_ms) interval_ms_[id] = max_ms;
+    if (effective_ms_[id] < min_ms) effective_ms_[id] = min_ms;
+    if (effective_ms_[id] > max_ms) effective_ms_[id] = max_ms;
+    if (offset_ms_[id] >= interval_ms_[id]) offset_ms_[id] %= interval_ms_[id];
+    
+    // A changed period takes effect now, not after the old one runs out
+    if (effective_ms_[id] != effective_ms) {
+        next_due_ms_[id] = alignedDueMs(now, offset_ms_[id], effective_ms_[id]);
+    }
+    const uint32_t interval_ms = interval_ms_[id];
+    const uint32_t offset_ms = offset_ms_[id];
+    mutex_exit(&sensor_mutex_);
+    
+    ConfigManager& config = ConfigManager::getInstance();
+    config.setSensorMinIntervalMs(id, min_ms);
+    config.setSensorMaxIntervalMs(id, max_ms);
+    config.setSensorIntervalMs(id, interval_ms);
+    config.setSensorOffsetMs(id, offset_ms);
+}
+
+void SensorManager::notifyActuatorTransition(SensorId id) {
+    if (id >= SENSOR_COUNT) return;
     
+    mutex_enter_blocking(&sensor_mutex_);
+    if (!adaptive_) {
+        mutex_exit(&sensor_mutex_);
+        return;
+    }
+    // Bounds under the lock: core 1 may be changing them
+    const uint64_t soon = Clock::deadlineMs(min_interval_ms_[id]);
+    effective_ms_[id] = min_interval_ms_[id];
+    if (soon < next_due_ms_[id]) {
+        next_due_ms_[id] = soon;
+    }
+    mutex_exit(&sensor_mutex_);
+}
+
+void SensorManager::recordSample(SensorId id, float primary, float secondary) {
+    const uint64_t now = Clock::nowMs();
+    
+    if (adaptive_ && has_last_sample_[id] && now != last_sample_ms_[id]) {
+        // Normalised rate of change: 1.0 means the "fast" rate for this sensor
+        float minutes = (now - last_sample_ms_[id]) / 60000.0f;
+        float values[2] = { primary, secondary };
+        float activity = 0.0f;
+        for (uint8_t k = 0; k < 2; k++) {
+            const float noise = ADAPT_MODEL[id][k][0];
+            const float fast_rate = ADAPT_MODEL[id][k][1];
+            if (fast_rate <= 0.0f) continue;
+            
+            float delta = fabsf(values[k] - last_sample_value_[id][k]) - noise;
+            if (delta > 0.0f) {
+                activity = fmaxf(activity, delta / minutes / fast_rate);
+            }
+        }
+        adaptInterval(id, activity);
+    }
+    
+    last_sample_value_[id][0] = primary;
+    last_sample_value_[id][1] = secondary;
+    last_sample_ms_[id] = now;
+    has_last_sample_[id] = true;
+}
+
+void SensorManager::adaptInterval(SensorId id, float activity) {
+    mutex_enter_blocking(&sensor_mutex_);
+    uint32_t interval = effective_ms_[id];
+    if (activity >= 1.0f) {
+        // Signal is moving: halve the period
+        interval /= 2;
+    } else if (activity < ADAPT_FLAT_ACTIVITY) {
+        // Signal is flat: back off by 25%
+        interval += interval / 4;
+    }
+    
+    if (interval < min_interval_ms_[id]) interval = min_interval_ms_[id];
+    if (interval > max_interval_ms_[id]) interval = max_interval_ms_[id];
+    effective_ms_[id] = interval;
+    mutex_exit(&sensor_mutex_);
+}
+
+const char* SensorManager::getSensorName(SensorId id) {
+    switch (id) {
+        case SENSOR_WATER_TEMP:     return "water";
+        case SENSOR_TABLE_HUMIDITY: return "table";
+        case SENSOR_AIR:            return "air";
+        case SENSOR_NANO:           return "nano";
+        default:                    return "unknown";
+    }
+}
+
+bool SensorManager::parseSensorName(const char* name, SensorId* id) {
+    if (!name) return false;
+    
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        if (strcmp(name, getSensorName((SensorId)i)) == 0) {
+            *id = (SensorId)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SensorManager::startTemperatureConversion() {
     if (sensors_initialized_ && temp_sensor_) {
         if (!temp_sensor_->requestTemperatures()) {
             mutex_enter_blocking(&sensor_mutex_);
             if (last_temp_c_ > -100.0) {
-                printf("Temperature sensor request failed!\n");
+                LOG_WARN(LOG_SENSORS, "Temperature sensor request failed!");
                 last_temp_c_ = -999.0;
             }
             mutex_exit(&sensor_mutex_);
-            last_temp_read_ = now;
             return;
         }
         
-        // Wait for conversion (max 750ms for 12-bit resolution)
-        // This is acceptable since we read every 30 seconds
-        temp_sensor_->blockTillConversionComplete();
-        float tempC = temp_sensor_->getTempC();
-        
-        if (tempC != DEVICE_DISCONNECTED_C && tempC > -50.0 && tempC < 80.0) {
-            mutex_enter_blocking(&sensor_mutex_);
-            last_temp_c_ = tempC;
-            mutex_exit(&sensor_mutex_);
-            printf("Temperature: %.2f°C\n", tempC);
-        } else {
-            mutex_enter_blocking(&sensor_mutex_);
-            if (last_temp_c_ > -100.0) {
-                printf("Temperature sensor error!\n");
-                last_temp_c_ = -999.0;
-            }
-            mutex_exit(&sensor_mutex_);
-        }
+        // Result is collected by update() once the conversion time has elapsed
+        temp_conversion_pending_ = true;
+        temp_conversion_start_ms_ = Clock::nowMs();
     } else {
         mutex_enter_blocking(&sensor_mutex_);
         if (last_temp_c_ > -100.0) {
-            printf("Temperature sensor not initialized!\n");
+            LOG_WARN(LOG_SENSORS, "Temperature sensor not initialized!");
             last_temp_c_ = -999.0;
         }
         mutex_exit(&sensor_mutex_);
     }
+}
+
+void SensorManager::readTemperature() {
+    temp_conversion_pending_ = false;
+    
+    float tempC = temp_sensor_->getTempC();
     
-    last_temp_read_ = now;
+    if (tempC != DEVICE_DISCONNECTED_C && tempC > -50.0 && tempC < 80.0) {
+        mutex_enter_blocking(&sensor_mutex_);
+        last_temp_c_ = tempC;
+        mutex_exit(&sensor_mutex_);
+        recordSample(SENSOR_WATER_TEMP, tempC, 0.0f);
+        LOG_INFO(LOG_SENSORS, "Temperature: %.2f°C", tempC);
+    } else {
+        mutex_enter_blocking(&sensor_mutex_);
+        if (last_temp_c_ > -100.0) {
+            LOG_WARN(LOG_SENSORS, "Temperature sensor error!");
+            last_temp_c_ = -999.0;
+        }
+        mutex_exit(&sensor_mutex_);
+    }
 }
 
 void SensorManager::readHumidity() {
-    const uint32_t now = to_ms_since_boot(get_absolute_time());
-    if (now - last_humidity_read_ < SENSOR_INTERVAL_MS) return;
-    
     if (sensors_initialized_ && humidity_sensor_) {
         float temp, humidity;
         if (humidity_sensor_->readTemperatureAndHumidity(&temp, &humidity)) {
             mutex_enter_blocking(&sensor_mutex_);
             last_humidity_ = humidity;
             mutex_exit(&sensor_mutex_);
-            printf("Table Humidity (SHT30): %.2f%%\n", last_humidity_);
+            recordSample(SENSOR_TABLE_HUMIDITY, humidity, 0.0f);
+            LOG_INFO(LOG_SENSORS, "Table Humidity (SHT30): %.2f%%", last_humidity_);
         } else {
             mutex_enter_blocking(&sensor_mutex_);
             if (last_humidity_ > -100.0) {
-                printf("Table humidity sensor error!\n");
+                LOG_WARN(LOG_SENSORS, "Table humidity sensor error!");
                 last_humidity_ = -999.0;
             }
             mutex_exit(&sensor_mutex_);
@@ -183,19 +443,14 @@ void SensorManager::readHumidity() {
     } else {
         mutex_enter_blocking(&sensor_mutex_);
         if (last_humidity_ > -100.0) {
-            printf("Table humidity sensor not initialized!\n");
+            LOG_WARN(LOG_SENSORS, "Table humidity sensor not initialized!");
             last_humidity_ = -999.0;
         }
         mutex_exit(&sensor_mutex_);
     }
-    
-    last_humidity_read_ = now;
 }
 
 void SensorManager::readAirSensor() {
-    const uint32_t now = to_ms_since_boot(get_absolute_time());
-    if (now - last_air_read_ < SENSOR_INTERVAL_MS) return;
-    
     if (sensors_initialized_ && dht22_sensor_) {
         float temp, humidity;
         if (dht22_sensor_->readTemperatureAndHumidity(&temp, &humidity)) {
@@ -203,11 +458,12 @@ void SensorManager::readAirSensor() {
             last_air_temp_c_ = temp;
             last_air_humidity_ = humidity;
             mutex_exit(&sensor_mutex_);
-            printf("Room Air (DHT22): %.2f°C, %.2f%% RH\n", temp, humidity);
+            recordSample(SENSOR_AIR, temp, humidity);
+            LOG_INFO(LOG_SENSORS, "Room Air (DHT22): %.2f°C, %.2f%% RH", temp, humidity);
         } else {
             mutex_enter_blocking(&sensor_mutex_);
             if (last_air_temp_c_ > -100.0 || last_air_humidity_ > -100.0) {
-                printf("Room air sensor error!\n");
+                LOG_WARN(LOG_SENSORS, "Room air sensor error!");
                 last_air_temp_c_ = -999.0;
                 last_air_humidity_ = -999.0;
             }
@@ -216,14 +472,12 @@ void SensorManager::readAirSensor() {
     } else {
         mutex_enter_blocking(&sensor_mutex_);
         if (last_air_temp_c_ > -100.0 || last_air_humidity_ > -100.0) {
-            printf("Room air sensor not initialized!\n");
+            LOG_WARN(LOG_SENSORS, "Room air sensor not initialized!");
             last_air_temp_c_ = -999.0;
             last_air_humidity_ = -999.0;
         }
         mutex_exit(&sensor_mutex_);
     }
-    
-    last_air_read_ = now;
 }
 
 
@@ -285,36 +539,41 @@ bool SensorManager::isAirHumidityValid() const {
 }
 
 void SensorManager::readNanoADCs() {
-    const uint32_t now = to_ms_since_boot(get_absolute_time());
-    if (now - last_nano_read_ < SENSOR_INTERVAL_MS) return;
-    
 #if NANO_ADC_ENABLED
     if (sensors_initialized_ && nano_ph_ && nano_tds_) {
+        bool received = false;
+        
         // Read pH
         if (nano_ph_->read()) {
+            nrf_ph_packets_ = nrf_ph_packets_ + 1;
             float ph = nano_ph_->getValue(0);  // A0
             if (ph > 0.0 && ph < 14.0) {
                 mutex_enter_blocking(&sensor_mutex_);
                 last_ph_ = ph;
                 mutex_exit(&sensor_mutex_);
-                printf("pH: %.2f\n", ph);
+                received = true;
+                LOG_INFO(LOG_SENSORS, "pH: %.2f", ph);
             }
         }
         
         // Read TDS
         if (nano_tds_->read()) {
+            nrf_tds_packets_ = nrf_tds_packets_ + 1;
             float tds = nano_tds_->getValue(0);  // A0
             if (tds >= 0.0) {
                 mutex_enter_blocking(&sensor_mutex_);
                 last_tds_ = tds;
                 mutex_exit(&sensor_mutex_);
-                printf("TDS: %.0f ppm\n", tds);
+                received = true;
+                LOG_INFO(LOG_SENSORS, "TDS: %.0f ppm", tds);
             }
         }
+        
+        if (received) {
+            recordSample(SENSOR_NANO, getLastPH(), getLastTDS());
+        }
     }
 #endif
-    
-    last_nano_read_ = now;
 }
 
 float SensorManager::getLastPH() const {
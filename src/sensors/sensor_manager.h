@@ -22,10 +22,27 @@ public:
     ~SensorManager();
     
     bool initialize();
-    void readTemperature();
-    void readHumidity();
-    void readAirSensor();
-    void readNanoADCs();
+    
+    // Service the sampling schedule (at most one bus transaction per call)
+    void update();
+    
+    // Per-sensor sampling schedule
+    void setSchedule(SensorId id, uint32_t interval_ms, uint32_t offset_ms);
+    uint32_t getIntervalMs(SensorId id) const { return interval_ms_[id]; }
+    uint32_t getOffsetMs(SensorId id) const { return offset_ms_[id]; }
+    
+    // Adaptive sampling (effective interval moves within [min, max])
+    void setAdaptiveSampling(bool enabled);
+    bool isAdaptiveSampling() const { return adaptive_; }
+    void setBounds(SensorId id, uint32_t min_ms, uint32_t max_ms);
+    uint32_t getMinIntervalMs(SensorId id) const { return min_interval_ms_[id]; }
+    uint32_t getMaxIntervalMs(SensorId id) const { return max_interval_ms_[id]; }
+    uint32_t getEffectiveIntervalMs(SensorId id) const { return effective_ms_[id]; }
+    void notifyActuatorTransition(SensorId id);  // Expect change: sample at the fastest rate
+    uint64_t getNextWakeMs();  // When update() next has bus work to do
+    
+    static const char* getSensorName(SensorId id);
+    static bool parseSensorName(const char* name, SensorId* id);
     
     // Thread-safe sensor data accessors
     float getLastTemperature() const;  // Water temp from DS18B20
@@ -47,7 +64,22 @@ public:
     bool isDHT22Initialized() const { return dht22_sensor_ != nullptr; }
     bool isNanoADCInitialized() const { return nano_ph_ != nullptr && nano_tds_ != nullptr; }
     
+    // NRF24L01 packets received since boot (pH, TDS)
+    uint32_t getNrfPhPackets() const { return nrf_ph_packets_; }
+    uint32_t getNrfTdsPackets() const { return nrf_tds_packets_; }
+    
 private:
+    // Individual sensor transactions (called by the scheduler)
+    void startTemperatureConversion();
+    void readTemperature();
+    void readHumidity();
+    void readAirSensor();
+    void readNanoADCs();
+    void sampleSensor(SensorId id);
+    void recordSample(SensorId id, float primary, float secondary);
+    void adaptInterval(SensorId id, float activity);
+    static uint64_t alignedDueMs(uint64_t now, uint32_t offset_ms, uint32_t interval_ms);
+    
     // Sensor objects
     OneWirePIO* one_wire_;
     DS18B20* temp_sensor_;
@@ -65,14 +97,32 @@ private:
     float last_air_humidity_;     // Room air humidity
     float last_ph_;               // pH
     float last_tds_;              // TDS
-    uint32_t last_temp_read_;
-    uint32_t last_humidity_read_;
-    uint32_t last_air_read_;
-    uint32_t last_nano_read_;
+    volatile uint32_t nrf_ph_packets_;
+    volatile uint32_t nrf_tds_packets_;
+    
+    // Sampling schedule (due times in Clock milliseconds)
+    uint32_t interval_ms_[SENSOR_COUNT];
+    uint32_t offset_ms_[SENSOR_COUNT];
+    uint64_t next_due_ms_[SENSOR_COUNT];
+    uint64_t last_bus_activity_ms_;
+    
+    // Adaptive sampling state
+    bool adaptive_;
+    uint32_t min_interval_ms_[SENSOR_COUNT];
+    uint32_t max_interval_ms_[SENSOR_COUNT];
+    uint32_t effective_ms_[SENSOR_COUNT];
+    float last_sample_value_[SENSOR_COUNT][2];
+    uint64_t last_sample_ms_[SENSOR_COUNT];
+    bool has_last_sample_[SENSOR_COUNT];
+    
+    // DS18B20 conversion runs in the background between request and read
+    bool temp_conversion_pending_;
+    uint64_t temp_conversion_start_ms_;
     
     // Thread safety
     mutable mutex_t sensor_mutex_;
     
     // Timing
-    static const uint32_t SENSOR_INTERVAL_MS = 30000UL;
+    static const uint32_t DS18B20_CONVERSION_MS = 750UL;  // 12-bit resolution
+    static constexpr float ADAPT_FLAT_ACTIVITY = 0.25f;   // Below this, slow down
 };
@@ -2,38 +2,87 @@
 #include "pico/stdlib.h"
 #include "hardware/flash.h"
 #include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/mutex.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "lfs.h"
+#include "../utils/trace.h"
+#include "../utils/mem_stats.h"
 
 // LittleFS configuration
 static lfs_t lfs;
 static struct lfs_config lfs_cfg;
 static bool lfs_mounted = false;
+static FlashStats flash_stats;  // Updated under fs_mutex
+
+// Cache for the one file open at a time (every open is under fs_mutex and
+// closed before returning), so LittleFS does not malloc one per open
+static const lfs_size_t CACHE_SIZE = 256;
+alignas(4) static uint8_t file_cache[CACHE_SIZE];
+static struct lfs_file_config file_cfg;  // LittleFS keeps a pointer until close
+
+// LittleFS is not reentrant: serialize callers on both cores (log writer,
+// config saves and static files served from lwIP callbacks)
+auto_init_recursive_mutex(fs_mutex);
+
+class FsLock {
+public:
+    FsLock() { recursive_mutex_enter_blocking(&fs_mutex); }
+    ~FsLock() { recursive_mutex_exit(&fs_mutex); }
+};
+
+static int open_file(lfs_file_t* file, const char* path, int flags) {
+    memset(&file_cfg, 0, sizeof(file_cfg));
+    file_cfg.buffer = file_cache;
+    return lfs_file_opencfg(&lfs, file, path, flags, &file_cfg);
+}
+
+// The other core executes from XIP flash, so park it for the duration of a
+// program/erase once it has registered as a lockout victim
+static uint32_t flash_op_begin() {
+    if (multicore_lockout_victim_is_initialized(1 - get_core_num())) {
+        multicore_lockout_start_blocking();
+    }
+    return save_and_disable_interrupts();
+}
+
+static void flash_op_end(uint32_t ints) {
+    restore_interrupts(ints);
+    if (multicore_lockout_victim_is_initialized(1 - get_core_num())) {
+        multicore_lockout_end_blocking();
+    }
+}
 
 // Flash read/write/erase functions for LittleFS
 static int lfs_flash_read(const struct lfs_config *c, lfs_block_t block,
         lfs_off_t off, void *buffer, lfs_size_t size) {
     uint32_t addr = LITTLEFS_FLASH_OFFSET + (block * c->block_size) + off;
     memcpy(buffer, (void*)(XIP_BASE + addr), size);
+    flash_stats.reads++;
     return 0;
 }
 
 static int lfs_flash_prog(const struct lfs_config *c, lfs_block_t block,
         lfs_off_t off, const void *buffer, lfs_size_t size) {
+    TRACE_SCOPE(TRACE_FLASH_PROG, (uint16_t)block);
     uint32_t addr = LITTLEFS_FLASH_OFFSET + (block * c->block_size) + off;
-    uint32_t ints = save_and_disable_interrupts();
+    uint32_t ints = flash_op_begin();
     flash_range_program(addr, (const uint8_t*)buffer, size);
-    restore_interrupts(ints);
+    flash_op_end(ints);
+    flash_stats.programs++;
+    flash_stats.program_bytes += size;
     return 0;
 }
 
 static int lfs_flash_erase(const struct lfs_config *c, lfs_block_t block) {
+    TRACE_SCOPE(TRACE_FLASH_ERASE, (uint16_t)block);
     uint32_t addr = LITTLEFS_FLASH_OFFSET + (block * c->block_size);
-    uint32_t ints = save_and_disable_interrupts();
+    uint32_t ints = flash_op_begin();
     flash_range_erase(addr, c->block_size);
-    restore_interrupts(ints);
+    flash_op_end(ints);
+    flash_stats.erases++;
     return 0;
 }
 
@@ -56,6 +105,7 @@ FlashStorage::~FlashStorage() {
 }
 
 bool FlashStorage::init() {
+    FsLock lock;
     if (initialized_) return true;
     
     // Configure LittleFS with tuned wear leveling
@@ -68,7 +118,7 @@ bool FlashStorage::init() {
     lfs_cfg.prog_size = FLASH_PAGE_SIZE;
     lfs_cfg.block_size = FLASH_SECTOR_SIZE;
     lfs_cfg.block_count = LITTLEFS_FLASH_SIZE / FLASH_SECTOR_SIZE;
-    lfs_cfg.cache_size = 256;
+    lfs_cfg.cache_size = CACHE_SIZE;
     lfs_cfg.lookahead_size = 128;  // Increased for better allocation over larger space
     lfs_cfg.block_cycles = 200;    // Lower value for more aggressive wear leveling
     
@@ -98,12 +148,13 @@ bool FlashStorage::init() {
 }
 
 bool FlashStorage::getFile(const char* path, uint8_t** data, uint32_t* size, const char** mime_type) {
+    FsLock lock;
     if (!initialized_ && !init()) {
         return false;
     }
     
     lfs_file_t file;
-    int err = lfs_file_open(&lfs, &file, path, LFS_O_RDONLY);
+    int err = open_file(&file, path, LFS_O_RDONLY);
     if (err) {
         printf("Failed to open %s: %d\n", path, err);
         return false;
@@ -117,7 +168,7 @@ bool FlashStorage::getFile(const char* path, uint8_t** data, uint32_t* size, con
     }
     
     // Allocate buffer
-    uint8_t* buffer = (uint8_t*)malloc(file_size);
+    uint8_t* buffer = (uint8_t*)MemStats::alloc(file_size);
     if (!buffer) {
         lfs_file_close(&lfs, &file);
         return false;
@@ -128,7 +179,7 @@ bool FlashStorage::getFile(const char* path, uint8_t** data, uint32_t* size, con
     lfs_file_close(&lfs, &file);
     
     if (bytes_read != file_size) {
-        free(buffer);
+        MemStats::release(buffer);
         return false;
     }
     
@@ -143,17 +194,18 @@ bool FlashStorage::getFile(const char* path, uint8_t** data, uint32_t* size, con
 
 void FlashStorage::freeFile(uint8_t* data) {
     if (data) {
-        free(data);
+        MemStats::release(data);
     }
 }
 
 bool FlashStorage::uploadFile(const char* path, const uint8_t* data, uint32_t size) {
+    FsLock lock;
     if (!initialized_ && !init()) {
         return false;
     }
     
     lfs_file_t file;
-    int err = lfs_file_open(&lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    int err = open_file(&file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
     if (err) {
         printf("Failed to create %s: %d\n", path, err);
         return false;
@@ -172,6 +224,7 @@ bool FlashStorage::uploadFile(const char* path, const uint8_t* data, uint32_t si
 }
 
 bool FlashStorage::deleteFile(const char* path) {
+    FsLock lock;
     if (!initialized_ && !init()) {
         return false;
     }
@@ -180,7 +233,22 @@ bool FlashStorage::deleteFile(const char* path) {
     return (err == 0);
 }
 
+bool FlashStorage::renameFile(const char* from, const char* to) {
+    FsLock lock;
+    if (!initialized_ && !init()) {
+        return false;
+    }
+    
+    int err = lfs_rename(&lfs, from, to);
+    if (err) {
+        printf("Failed to rename %s to %s: %d\n", from, to, err);
+        return false;
+    }
+    return true;
+}
+
 bool FlashStorage::listFiles() {
+    FsLock lock;
     if (!initialized_ && !init()) {
         return false;
     }
@@ -203,6 +271,138 @@ bool FlashStorage::listFiles() {
     return true;
 }
 
+bool FlashStorage::appendFile(const char* path, const uint8_t* data, uint32_t size) {
+    FsLock lock;
+    if (!initialized_ && !init()) {
+        return false;
+    }
+    
+    lfs_file_t file;
+    int err = open_file(&file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+    if (err) {
+        printf("Failed to open %s for append: %d\n", path, err);
+        return false;
+    }
+    
+    // Closing commits the append atomically
+    lfs_ssize_t written = lfs_file_write(&lfs, &file, data, size);
+    err = lfs_file_close(&lfs, &file);
+    
+    if (written != (lfs_ssize_t)size || err) {
+        printf("Append to %s failed: %d/%u (%d)\n", path, written, size, err);
+        return false;
+    }
+    return true;
+}
+
+bool FlashStorage::writeFileAt(const char* path, uint32_t offset, const uint8_t* data, uint32_t size) {
+    FsLock lock;
+    if (!initialized_ && !init()) {
+        return false;
+    }
+    
+    lfs_file_t file;
+    int err = open_file(&file, path, LFS_O_RDWR | LFS_O_CREAT);
+    if (err) {
+        printf("Failed to open %s for write: %d\n", path, err);
+        return false;
+    }
+    
+    // Seeking past the end zero-fills the gap
+    lfs_ssize_t written = -1;
+    if (lfs_file_seek(&lfs, &file, offset, LFS_SEEK_SET) >= 0) {
+        written = lfs_file_write(&lfs, &file, data, size);
+    }
+    err = lfs_file_close(&lfs, &file);
+    
+    if (written != (lfs_ssize_t)size || err) {
+        printf("Write to %s at %u failed: %d (%d)\n", path, offset, written, err);
+        return false;
+    }
+    return true;
+}
+
+int32_t FlashStorage::readFile(const char* path, uint32_t offset, uint8_t* buffer, uint32_t size) {
+    FsLock lock;
+    if (!initialized_ && !init()) {
+        return -1;
+    }
+    
+    lfs_file_t file;
+    int err = open_file(&file, path, LFS_O_RDONLY);
+    if (err) {
+        return -1;
+    }
+    
+    lfs_ssize_t bytes_read = -1;
+    if (lfs_file_seek(&lfs, &file, offset, LFS_SEEK_SET) >= 0) {
+        bytes_read = lfs_file_read(&lfs, &file, buffer, size);
+    }
+    lfs_file_close(&lfs, &file);
+    return bytes_read;
+}
+
+int32_t FlashStorage::getFileSize(const char* path) {
+    FsLock lock;
+    if (!initialized_ && !init()) {
+        return -1;
+    }
+    
+    struct lfs_info info;
+    if (lfs_stat(&lfs, path, &info) != 0 || info.type != LFS_TYPE_REG) {
+        return -1;
+    }
+    return (int32_t)info.size;
+}
+
+bool FlashStorage::makeDir(const char* path) {
+    FsLock lock;
+    if (!initialized_ && !init()) {
+        return false;
+    }
+    
+    int err = lfs_mkdir(&lfs, path);
+    return (err == 0 || err == LFS_ERR_EXIST);
+}
+
+bool FlashStorage::listDir(const char* path, DirCallback callback, void* arg) {
+    FsLock lock;
+    if (!initialized_ && !init()) {
+        return false;
+    }
+    
+    lfs_dir_t dir;
+    int err = lfs_dir_open(&lfs, &dir, path);
+    if (err) {
+        return false;
+    }
+    
+    struct lfs_info info;
+    while (lfs_dir_read(&lfs, &dir, &info) > 0) {
+        if (info.type == LFS_TYPE_REG) {
+            callback(info.name, info.size, arg);
+        }
+    }
+    
+    lfs_dir_close(&lfs, &dir);
+    return true;
+}
+
+uint32_t FlashStorage::getUsedBytes() {
+    FsLock lock;
+    if (!initialized_ && !init()) {
+        return 0;
+    }
+    
+    lfs_ssize_t blocks = lfs_fs_size(&lfs);
+    return blocks < 0 ? 0 : (uint32_t)blocks * lfs_cfg.block_size;
+}
+
+FlashStats FlashStorage::getStats() const {
+    FsLock lock;
+    return flash_stats;
+}
+
 const char* FlashStorage::getMimeType(const char* path) {
     const char* ext = strrchr(path, '.');
     if (!ext) return "application/octet-stream";
@@ -12,6 +12,14 @@
 #define LITTLEFS_FLASH_OFFSET (1536 * 1024)      // 1.5MB offset
 #define LITTLEFS_FLASH_SIZE   (2560 * 1024)      // 2.5MB for file system
 
+// Low-level flash operations issued by LittleFS since boot
+struct FlashStats {
+    uint32_t reads;
+    uint32_t programs;
+    uint32_t erases;
+    uint32_t program_bytes;
+};
+
 class FlashStorage {
 public:
     static FlashStorage& getInstance();
@@ -23,8 +31,20 @@ public:
     // File system utilities
     bool uploadFile(const char* path, const uint8_t* data, uint32_t size);
     bool deleteFile(const char* path);
+    bool renameFile(const char* from, const char* to);  // Atomically replaces `to`
     bool listFiles();
     
+    // Incremental access (time-series log)
+    typedef void (*DirCallback)(const char* name, uint32_t size, void* arg);
+    bool appendFile(const char* path, const uint8_t* data, uint32_t size);
+    bool writeFileAt(const char* path, uint32_t offset, const uint8_t* data, uint32_t size);
+    int32_t readFile(const char* path, uint32_t offset, uint8_t* buffer, uint32_t size);  // Bytes read, -1 on error
+    int32_t getFileSize(const char* path);  // -1 if missing
+    bool makeDir(const char* path);
+    bool listDir(const char* path, DirCallback callback, void* arg);
+    uint32_t getUsedBytes();
+    FlashStats getStats() const;
+    
 private:
     FlashStorage();
     ~FlashStorage();
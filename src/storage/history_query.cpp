@@ -0,0 +1,240 @@
+#include "history_query.h"
+#include "timeseries_log.h"
+#include <new>
+
+HistoryQuery::HistoryQuery(HistoryChannel channel, time_t from, time_t to, uint32_t step)
+    : channel_(channel), raw_(true), tier_(ROLLUP_15MIN), from_(0), to_(UINT32_MAX),
+      step_(HISTORY_INTERVAL_SEC), phase_(PHASE_DONE), log_reader_(nullptr),
+      ram_start_(UINT32_MAX), ram_first_seq_(0), ordinal_(0), stored_(0), pending_index_(0), last_time_(0),
+      record_count_(0), record_pos_(0), have_lookahead_(false), downsample_(false),
+      input_done_(false), ready_count_(0), ready_pos_(0) {
+    raw_ = !RollupStore::selectTier(step, &tier_);
+    const uint32_t resolution = raw_ ? HISTORY_INTERVAL_SEC : RollupStore::getTierSeconds(tier_);
+    step_ = step > resolution ? step - step % resolution : resolution;
+    
+    // Buckets are aligned to the step, so start at the one containing from
+    if (from > 0) from_ = (uint32_t)from - (uint32_t)from % step_;
+    if (to > 0) to_ = (uint32_t)to;
+    if (from_ > to_) return;
+    
+    if (raw_) {
+        cursor_.seq = cursor_.end = 0;
+        SensorHistory& history = SensorHistory::getInstance();
+        if (history.cursorFrom(from_, &cursor_) && cursor_.seq < cursor_.end) {
+            time_t start = history.epochForSeq(cursor_.seq);
+            if (start > 0) {
+                ram_start_ = (uint32_t)start;
+                ram_first_seq_ = cursor_.seq;
+            }
+        }
+    
+        // The flash log is only needed for what the ring no longer holds
+        if (from_ < ram_start_) {
+            log_reader_ = new (log_reader_storage_) LogReader((time_t)from_);
+            phase_ = PHASE_LOG;
+        } else {
+            phase_ = PHASE_RAM;
+        }
+    } else {
+        stored_ = RollupStore::getInstance().getStoredCount(tier_);
+        ordinal_ = findFirstStored(stored_);
+        phase_ = PHASE_STORED;
+    }
+}
+
+HistoryQuery::~HistoryQuery() {
+    if (log_reader_) log_reader_->~LogReader();
+}
+
+void HistoryQuery::setMaxPoints(uint16_t points) {
+    // The bucket grid spans from the first sample to the end of the range
+    uint32_t end = to_;
+    if (end == UINT32_MAX) {
+        time_t now = time(nullptr);
+        end = now > 0 ? (uint32_t)now : 0;
+    }
+    lttb_.begin(end, points);
+    downsample_ = true;
+}
+
+bool HistoryQuery::next(HistoryPoint* point) {
+    return downsample_ ? nextDownsampled(point) : nextBucket(point);
+}
+
+bool HistoryQuery::nextDownsampled(HistoryPoint* point) {
+    while (ready_pos_ == ready_count_) {
+        if (input_done_) return false;
+        ready_pos_ = 0;
+        ready_count_ = 0;
+    
+        HistoryPoint in;
+        if (!nextBucket(&in)) {
+            input_done_ = true;
+            ready_count_ = lttb_.finish(ready_);
+        } else if (in.count > 0 && lttb_.push(in.time, in.avg, &ready_[0])) {
+            ready_count_ = 1;
+        }
+    }
+    
+    const LttbPoint& picked = ready_[ready_pos_++];
+    point->time = picked.time;
+    point->count = 1;
+    point->avg = picked.value;
+    point->min = picked.value;
+    point->max = picked.value;
+    return true;
+}
+
+bool HistoryQuery::nextBucket(HistoryPoint* point) {
+    Bucket acc;
+    bool open = false;
+    
+    while (true) {
+        if (!have_lookahead_) {
+            if (!nextSource(&lookahead_)) break;
+            have_lookahead_ = true;
+        }
+    
+        const uint32_t bucket_time = lookahead_.time - lookahead_.time % step_;
+        if (!open) {
+            acc.time = bucket_time;
+            acc.count = 0;
+            acc.sum = 0;
+            acc.min = HISTORY_NO_DATA;
+            acc.max = HISTORY_NO_DATA;
+            open = true;
+        } else if (bucket_time != acc.time) {
+            break;  // Lookahead starts the next point
+        }
+    
+        if (lookahead_.count > 0) {
+            if (acc.count == 0 || lookahead_.min < acc.min) acc.min = lookahead_.min;
+            if (acc.count == 0 || lookahead_.max > acc.max) acc.max = lookahead_.max;
+            acc.sum += lookahead_.sum;
+            acc.count += lookahead_.count;
+        }
+        have_lookahead_ = false;
+    }
+    
+    if (!open) return false;
+    
+    point->time = acc.time;
+    point->count = acc.count;
+    point->min = acc.min;
+    point->max = acc.max;
+    if (acc.count > 0) {
+        // Rounded to nearest
+        int64_t half = (int64_t)acc.count / 2;
+        int64_t avg = acc.sum >= 0 ? (acc.sum + half) / acc.count : (acc.sum - half) / (int64_t)acc.count;
+        point->avg = (int16_t)avg;
+    } else {
+        point->avg = HISTORY_NO_DATA;
+    }
+    return true;
+}
+
+bool HistoryQuery::nextSource(Bucket* bucket) {
+    bool ok = raw_ ? nextRaw(bucket) : nextTier(bucket);
+    if (ok && bucket->time > to_) {
+        phase_ = PHASE_DONE;
+        ok = false;
+    }
+    return ok;
+}
+
+void HistoryQuery::fromSample(uint32_t time, int16_t value, Bucket* bucket) {
+    bucket->time = time;
+    bucket->count = value == HISTORY_NO_DATA ? 0 : 1;
+    bucket->sum = value == HISTORY_NO_DATA ? 0 : value;
+    bucket->min = value;
+    bucket->max = value;
+}
+
+void HistoryQuery::fromRecord(const RollupRecord& record, Bucket* bucket) {
+    bucket->time = record.start;
+    bucket->count = record.count[channel_];
+    bucket->sum = record.sum[channel_];
+    bucket->min = record.min[channel_];
+    bucket->max = record.max[channel_];
+}
+
+bool HistoryQuery::nextRaw(Bucket* bucket) {
+    if (phase_ == PHASE_LOG) {
+        LogSample sample;
+        if (log_reader_->next(&sample) && sample.time < ram_start_) {
+            fromSample(sample.time, sample.values[channel_], bucket);
+            return true;
+        }
+        // Log exhausted, or caught up with what the ring holds
+        log_reader_->~LogReader();
+        log_reader_ = nullptr;
+        phase_ = ram_start_ != UINT32_MAX ? PHASE_RAM : PHASE_DONE;
+    }
+    
+    if (phase_ == PHASE_RAM) {
+        SensorHistory& history = SensorHistory::getInstance();
+        const uint32_t seq = cursor_.seq;
+        int16_t value;
+        if (history.read(channel_, &cursor_, &value, 1) == 1) {
+            fromSample(ram_start_ + (seq - ram_first_seq_) * HISTORY_INTERVAL_SEC, value, bucket);
+            return true;
+        }
+        phase_ = PHASE_DONE;
+    }
+    return false;
+}
+
+uint32_t HistoryQuery::findFirstStored(uint32_t stored) {
+    // Binary search for the first record at or after from; unreadable
+    // records sort low
+    RollupStore& store = RollupStore::getInstance();
+    uint32_t lo = 0;
+    uint32_t hi = stored;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        RollupRecord record;
+        if (store.readStored(tier_, mid, &record, 1) == 1 && record.start >= from_) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+bool HistoryQuery::nextTier(Bucket* bucket) {
+    RollupStore& store = RollupStore::getInstance();
+    RollupRecord record;
+    
+    while (phase_ != PHASE_DONE) {
+        bool have = false;
+        if (phase_ == PHASE_STORED) {
+            if (record_pos_ == record_count_) {
+                record_count_ = ordinal_ < stored_ ? store.readStored(tier_, ordinal_, records_, TIER_BATCH) : 0;
+                record_pos_ = 0;
+                ordinal_ += record_count_;
+                if (record_count_ == 0) {
+                    phase_ = PHASE_PENDING;
+                    continue;
+                }
+            }
+            record = records_[record_pos_++];
+            have = true;
+        } else if (phase_ == PHASE_PENDING) {
+            have = store.readPending(tier_, pending_index_++, &record);
+            if (!have) phase_ = PHASE_OPEN;
+        } else {
+            have = store.readOpen(tier_, &record);
+            phase_ = PHASE_DONE;
+        }
+    
+        // Skip unreadable records, anything before from, and records that
+        // are not newer than the last one (a batch written meanwhile, or a
+        // clock step)
+        if (!have || record.start == 0 || record.start < from_ || record.start <= last_time_) continue;
+        last_time_ = record.start;
+        fromRecord(record, bucket);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "rollup_store.h"
+#include "timeseries_log.h"
+#include "../utils/lttb.h"
+#include "../sensors/sensor_history.h"
+
+// One output point. Values are fixed point (see SensorHistory::getChannelScale);
+// count 0 means the channel had no valid sample in the bucket.
+struct HistoryPoint {
+    uint32_t time;     // Bucket start (Unix time)
+    uint32_t count;    // Samples folded into the point
+    int16_t avg;
+    int16_t min;
+    int16_t max;
+};
+
+// Pull-style range query over one channel. The source is picked from the
+// requested step: raw samples (flash log, then the RAM ring) below the
+// shortest rollup, otherwise the coarsest rollup tier that fits, so the
+// number of records touched is bounded by range / step rather than by the
+// raw sample count. Source points are folded into step-aligned buckets and,
+// with setMaxPoints(), reduced by streaming LTTB.
+class HistoryQuery {
+public:
+    // to = 0 for no upper bound; step is rounded down to a multiple of the
+    // source resolution (and up to at least one sample interval)
+    HistoryQuery(HistoryChannel channel, time_t from, time_t to, uint32_t step);
+    ~HistoryQuery();
+    HistoryQuery(const HistoryQuery&) = delete;
+    HistoryQuery& operator=(const HistoryQuery&) = delete;
+    
+    uint32_t getStep() const { return step_; }
+    
+    // Downsample to at most points points with LTTB (call before next())
+    void setMaxPoints(uint16_t points);
+    
+    // False when each point is a single value (a raw sample or an LTTB pick),
+    // true when avg/min/max describe a bucket
+    bool isAggregated() const { return !downsample_ && !(raw_ && step_ == HISTORY_INTERVAL_SEC); }
+    
+    bool next(HistoryPoint* point);
+    
+private:
+    struct Bucket {
+        uint32_t time;
+        uint32_t count;
+        int64_t sum;
+        int16_t min;
+        int16_t max;
+    };
+    
+    enum Phase { PHASE_LOG, PHASE_RAM, PHASE_STORED, PHASE_PENDING, PHASE_OPEN, PHASE_DONE };
+    static const uint32_t TIER_BATCH = 8;
+    
+    bool nextBucket(HistoryPoint* point);
+    bool nextDownsampled(HistoryPoint* point);
+    bool nextSource(Bucket* bucket);
+    bool nextRaw(Bucket* bucket);
+    bool nextTier(Bucket* bucket);
+    uint32_t findFirstStored(uint32_t stored);
+    void fromSample(uint32_t time, int16_t value, Bucket* bucket);
+    void fromRecord(const RollupRecord& record, Bucket* bucket);
+    
+    HistoryChannel channel_;
+    bool raw_;
+    RollupTier tier_;
+    uint32_t from_;
+    uint32_t to_;
+    uint32_t step_;
+    Phase phase_;
+    
+    // Raw source
+    LogReader* log_reader_;    // In log_reader_storage_ while reading the log
+    alignas(LogReader) uint8_t log_reader_storage_[sizeof(LogReader)];
+    HistoryCursor cursor_;
+    uint32_t ram_start_;       // Time of the first RAM sample (UINT32_MAX if none)
+    uint32_t ram_first_seq_;
+    
+    // Rollup source
+    uint32_t ordinal_;
+    uint32_t stored_;
+    uint32_t pending_index_;
+    uint32_t last_time_;       // Records must be strictly increasing in time
+    RollupRecord records_[TIER_BATCH];
+    uint32_t record_count_;
+    uint32_t record_pos_;
+    
+    Bucket lookahead_;
+    bool have_lookahead_;
+    
+    // Downsampling
+    bool downsample_;
+    bool input_done_;
+    LttbDownsampler lttb_;
+    LttbPoint ready_[3];
+    uint8_t ready_count_;
+    uint8_t ready_pos_;
+};
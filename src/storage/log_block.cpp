@@ -0,0 +1,213 @@
+#include "log_block.h"
+#include "../utils/crc_utils.h"
+#include <string.h>
+
+// Worst case: 4 + 32 timestamp bits, 4 + 16 bits per channel
+static const uint32_t MAX_SAMPLE_BITS = 36 + 20 * HIST_CHANNEL_COUNT;
+
+static inline uint32_t zigzag32(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static inline int32_t unzigzag32(uint32_t z) { return (int32_t)(z >> 1) ^ -(int32_t)(z & 1); }
+static inline uint16_t zigzag16(int16_t v) { return (uint16_t)(((uint16_t)v << 1) ^ (uint16_t)(v >> 15)); }
+static inline int16_t unzigzag16(uint16_t z) { return (int16_t)((z >> 1) ^ (uint16_t)-(int16_t)(z & 1)); }
+
+LogBlockEncoder::LogBlockEncoder() {
+    reset();
+}
+
+void LogBlockEncoder::reset() {
+    memset(block_, 0, sizeof(block_));
+    LogBlockHeader* h = header();
+    h->magic = LOG_BLOCK_MAGIC;
+    h->interval_sec = HISTORY_INTERVAL_SEC;
+    for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+        h->min[ch] = HISTORY_NO_DATA;
+        h->max[ch] = HISTORY_NO_DATA;
+        prev_values_[ch] = 0;
+    }
+    bit_pos_ = 0;
+    prev_time_ = 0;
+    prev_delta_ = HISTORY_INTERVAL_SEC;
+}
+
+bool LogBlockEncoder::append(const LogSample& sample) {
+    LogBlockHeader* h = header();
+    if (h->sample_count == UINT16_MAX) return false;
+    if (bit_pos_ + MAX_SAMPLE_BITS > LOG_PAYLOAD_CAPACITY * 8) return false;
+    
+    if (h->sample_count == 0) {
+        h->start_time = sample.time;
+    } else {
+        int32_t delta = (int32_t)(sample.time - prev_time_);
+        writeDeltaOfDelta(delta - prev_delta_);
+        prev_delta_ = delta;
+    }
+    prev_time_ = sample.time;
+    h->end_time = sample.time;
+    
+    for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+        int16_t v = sample.values[ch];
+        writeValueDelta((int16_t)(uint16_t)((uint16_t)v - (uint16_t)prev_values_[ch]));
+        prev_values_[ch] = v;
+    
+        if (v == HISTORY_NO_DATA) continue;
+        if (h->min[ch] == HISTORY_NO_DATA || v < h->min[ch]) h->min[ch] = v;
+        if (h->max[ch] == HISTORY_NO_DATA || v > h->max[ch]) h->max[ch] = v;
+    }
+    
+    h->sample_count++;
+    return true;
+}
+
+size_t LogBlockEncoder::seal() {
+    LogBlockHeader* h = header();
+    h->payload_bytes = (uint16_t)((bit_pos_ + 7) / 8);
+    h->crc = 0;
+    const size_t length = sizeof(LogBlockHeader) + h->payload_bytes;
+    h->crc = CrcUtils::crc32(block_, length);
+    return length;
+}
+
+void LogBlockEncoder::writeBits(uint32_t value, uint8_t bits) {
+    // MSB first; the payload was zeroed by reset()
+    uint8_t* payload = block_ + sizeof(LogBlockHeader);
+    while (bits--) {
+        if ((value >> bits) & 1) {
+            payload[bit_pos_ >> 3] |= (uint8_t)(0x80 >> (bit_pos_ & 7));
+        }
+        bit_pos_++;
+    }
+}
+
+void LogBlockEncoder::writeDeltaOfDelta(int32_t dod) {
+    uint32_t z = zigzag32(dod);
+    if (z == 0) {
+        writeBits(0x0, 1);
+    } else if (z < (1U << 7)) {
+        writeBits(0x2, 2);
+        writeBits(z, 7);
+    } else if (z < (1U << 9)) {
+        writeBits(0x6, 3);
+        writeBits(z, 9);
+    } else if (z < (1U << 12)) {
+        writeBits(0xE, 4);
+        writeBits(z, 12);
+    } else {
+        writeBits(0xF, 4);
+        writeBits(z, 32);
+    }
+}
+
+void LogBlockEncoder::writeValueDelta(int16_t delta) {
+    uint16_t z = zigzag16(delta);
+    if (z == 0) {
+        writeBits(0x0, 1);
+    } else if (z < (1U << 4)) {
+        writeBits(0x2, 2);
+        writeBits(z, 4);
+    } else if (z < (1U << 8)) {
+        writeBits(0x6, 3);
+        writeBits(z, 8);
+    } else if (z < (1U << 12)) {
+        writeBits(0xE, 4);
+        writeBits(z, 12);
+    } else {
+        writeBits(0xF, 4);
+        writeBits(z, 16);
+    }
+}
+
+LogBlockDecoder::LogBlockDecoder()
+    : payload_(nullptr), bit_pos_(0), bit_len_(0), emitted_(0),
+      prev_time_(0), prev_delta_(0) {
+    memset(&header_, 0, sizeof(header_));
+}
+
+bool LogBlockDecoder::begin(const uint8_t* block, size_t length) {
+    if (length < sizeof(LogBlockHeader)) return false;
+    memcpy(&header_, block, sizeof(header_));
+    if (header_.magic != LOG_BLOCK_MAGIC) return false;
+    if (sizeof(LogBlockHeader) + header_.payload_bytes > length) return false;
+    
+    LogBlockHeader check = header_;
+    check.crc = 0;
+    uint32_t crc = CrcUtils::crc32(&check, sizeof(check));
+    crc = CrcUtils::crc32(block + sizeof(LogBlockHeader), header_.payload_bytes, crc);
+    if (crc != header_.crc) return false;
+    
+    payload_ = block + sizeof(LogBlockHeader);
+    bit_pos_ = 0;
+    bit_len_ = (uint32_t)header_.payload_bytes * 8;
+    emitted_ = 0;
+    prev_time_ = header_.start_time;
+    prev_delta_ = header_.interval_sec;
+    memset(prev_values_, 0, sizeof(prev_values_));
+    return true;
+}
+
+bool LogBlockDecoder::next(LogSample* sample) {
+    if (!payload_ || emitted_ >= header_.sample_count) return false;
+    
+    if (emitted_ == 0) {
+        sample->time = header_.start_time;
+    } else {
+        int32_t dod;
+        if (!readDeltaOfDelta(&dod)) return false;
+        prev_delta_ += dod;
+        prev_time_ += (uint32_t)prev_delta_;
+        sample->time = prev_time_;
+    }
+    
+    for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+        int16_t delta;
+        if (!readValueDelta(&delta)) return false;
+        prev_values_[ch] = (int16_t)(uint16_t)((uint16_t)prev_values_[ch] + (uint16_t)delta);
+        sample->values[ch] = prev_values_[ch];
+    }
+    
+    emitted_++;
+    return true;
+}
+
+bool LogBlockDecoder::readBits(uint8_t bits, uint32_t* value) {
+    if (bit_pos_ + bits > bit_len_) return false;
+    uint32_t v = 0;
+    while (bits--) {
+        v = (v << 1) | ((payload_[bit_pos_ >> 3] >> (7 - (bit_pos_ & 7))) & 1);
+        bit_pos_++;
+    }
+    *value = v;
+    return true;
+}
+
+bool LogBlockDecoder::readDeltaOfDelta(int32_t* dod) {
+    // Count leading 1s of the bucket prefix (at most 4)
+    uint32_t bit;
+    uint8_t ones = 0;
+    while (ones < 4) {
+        if (!readBits(1, &bit)) return false;
+        if (bit == 0) break;
+        ones++;
+    }
+    
+    static const uint8_t WIDTH[5] = { 0, 7, 9, 12, 32 };
+    uint32_t z = 0;
+    if (ones > 0 && !readBits(WIDTH[ones], &z)) return false;
+    *dod = unzigzag32(z);
+    return true;
+}
+
+bool LogBlockDecoder::readValueDelta(int16_t* delta) {
+    uint32_t bit;
+    uint8_t ones = 0;
+    while (ones < 4) {
+        if (!readBits(1, &bit)) return false;
+        if (bit == 0) break;
+        ones++;
+    }
+    
+    static const uint8_t WIDTH[5] = { 0, 4, 8, 12, 16 };
+    uint32_t z = 0;
+    if (ones > 0 && !readBits(WIDTH[ones], &z)) return false;
+    *delta = unzigzag16((uint16_t)z);
+    return true;
+}
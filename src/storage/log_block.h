@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../config.h"
+#include "../sensors/sensor_history.h"
+
+// One logged sample: Unix time plus every history channel in fixed point
+struct LogSample {
+    uint32_t time;
+    int16_t values[HIST_CHANNEL_COUNT];
+};
+
+#define LOG_BLOCK_MAGIC 0x4B4C5354UL  // "TSLK"
+
+// Sealed block = header + bit-packed payload. Timestamps are delta-of-delta
+// coded against interval_sec and values are zigzag deltas, both in
+// Gorilla-style variable-width buckets, so a steady sample costs 1 bit for
+// the timestamp and 1 bit per unchanged channel.
+struct LogBlockHeader {
+    uint32_t magic;
+    uint16_t payload_bytes;
+    uint16_t sample_count;
+    uint32_t start_time;                   // First sample (not in payload)
+    uint32_t end_time;                     // Last sample
+    uint16_t interval_sec;                 // Delta-of-delta base
+    uint16_t reserved;
+    int16_t min[HIST_CHANNEL_COUNT];       // HISTORY_NO_DATA if no valid value
+    int16_t max[HIST_CHANNEL_COUNT];
+    uint32_t crc;                          // CRC-32 of header (crc = 0) + payload
+};
+
+static_assert(sizeof(LogBlockHeader) % 4 == 0, "LogBlockHeader must not need padding");
+
+#define LOG_PAYLOAD_CAPACITY (LOG_BLOCK_SIZE - sizeof(LogBlockHeader))
+
+class LogBlockEncoder {
+public:
+    LogBlockEncoder();
+    
+    void reset();
+    
+    // False (sample not added) once the block cannot hold a worst-case sample
+    bool append(const LogSample& sample);
+    
+    bool isEmpty() const { return header()->sample_count == 0; }
+    uint16_t getSampleCount() const { return header()->sample_count; }
+    uint32_t getStartTime() const { return header()->start_time; }
+    
+    // Finish the header (length, CRC); returns the block size in bytes
+    size_t seal();
+    const uint8_t* data() const { return block_; }
+    
+private:
+    LogBlockHeader* header() { return reinterpret_cast<LogBlockHeader*>(block_); }
+    const LogBlockHeader* header() const { return reinterpret_cast<const LogBlockHeader*>(block_); }
+    
+    void writeBits(uint32_t value, uint8_t bits);
+    void writeDeltaOfDelta(int32_t dod);
+    void writeValueDelta(int16_t delta);
+    
+    alignas(4) uint8_t block_[LOG_BLOCK_SIZE];
+    uint32_t bit_pos_;
+    uint32_t prev_time_;
+    int32_t prev_delta_;
+    int16_t prev_values_[HIST_CHANNEL_COUNT];
+};
+
+class LogBlockDecoder {
+public:
+    LogBlockDecoder();
+    
+    // Validate magic, length and CRC; block must stay valid while decoding
+    bool begin(const uint8_t* block, size_t length);
+    
+    // Next sample in the block; false when exhausted
+    bool next(LogSample* sample);
+    
+    const LogBlockHeader& header() const { return header_; }
+    
+private:
+    bool readBits(uint8_t bits, uint32_t* value);
+    bool readDeltaOfDelta(int32_t* dod);
+    bool readValueDelta(int16_t* delta);
+    
+    LogBlockHeader header_;
+    const uint8_t* payload_;
+    uint32_t bit_pos_;
+    uint32_t bit_len_;
+    uint16_t emitted_;
+    uint32_t prev_time_;
+    int32_t prev_delta_;
+    int16_t prev_values_[HIST_CHANNEL_COUNT];
+};
@@ -0,0 +1,318 @@
+#include "rollup_store.h"
+#include "flash_storage.h"
+#include "timeseries_log.h"
+#include "../utils/clock.h"
+#include "../utils/crc_utils.h"
+#include <stdio.h>
+#include <string.h>
+
+struct TierInfo {
+    uint32_t seconds;
+    uint32_t capacity;
+    const char* path;
+};
+
+// Buckets are aligned to multiples of their length in Unix time (days in UTC)
+static const TierInfo TIERS[ROLLUP_TIER_COUNT] = {
+    { 15 * 60, ROLLUP_15MIN_RECORDS, LOG_DIR "/r900.dat" },
+    { 3600, ROLLUP_HOUR_RECORDS, LOG_DIR "/r3600.dat" },
+    { 86400, ROLLUP_DAY_RECORDS, LOG_DIR "/r86400.dat" },
+};
+
+static const uint32_t SCAN_BATCH = 16;
+static RollupRecord scan_buffer[SCAN_BATCH];
+
+RollupStore& RollupStore::getInstance() {
+    static RollupStore instance;
+    return instance;
+}
+
+RollupStore::RollupStore()
+    : ready_(false), flush_requested_(false), last_flush_sec_(0) {
+    mutex_init(&mutex_);
+    memset(tiers_, 0, sizeof(tiers_));
+}
+
+uint32_t RollupStore::getTierSeconds(RollupTier tier) {
+    return tier < ROLLUP_TIER_COUNT ? TIERS[tier].seconds : 0;
+}
+
+uint32_t RollupStore::getTierCapacity(RollupTier tier) {
+    return tier < ROLLUP_TIER_COUNT ? TIERS[tier].capacity : 0;
+}
+
+const char* RollupStore::getTierPath(RollupTier tier) {
+    return tier < ROLLUP_TIER_COUNT ? TIERS[tier].path : "";
+}
+
+bool RollupStore::selectTier(uint32_t step, RollupTier* tier) {
+    for (int t = ROLLUP_TIER_COUNT - 1; t >= 0; t--) {
+        if (TIERS[t].seconds <= step) {
+            *tier = (RollupTier)t;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t RollupStore::recordCrc(const RollupRecord& record) {
+    RollupRecord check = record;
+    check.crc = 0;
+    return CrcUtils::crc32(&check, sizeof(check));
+}
+
+void RollupStore::startBucket(RollupRecord* record, uint32_t start) {
+    memset(record, 0, sizeof(*record));
+    record->start = start;
+    for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+        record->min[ch] = HISTORY_NO_DATA;
+        record->max[ch] = HISTORY_NO_DATA;
+    }
+}
+
+bool RollupStore::begin() {
+    if (!FlashStorage::getInstance().makeDir(LOG_DIR)) {
+        printf("Rollups: cannot create %s\n", LOG_DIR);
+        return false;
+    }
+    
+    uint32_t resume_from = UINT32_MAX;
+    for (uint8_t t = 0; t < ROLLUP_TIER_COUNT; t++) {
+        scanTier((RollupTier)t);
+        if (tiers_[t].resume_from < resume_from) {
+            resume_from = tiers_[t].resume_from;
+        }
+    }
+    ready_ = true;
+    last_flush_sec_ = Clock::nowSec();
+    
+    // Rebuild buckets lost at the last reset from the raw log; each tier
+    // ignores samples it has already persisted
+    uint32_t replayed = 0;
+    LogReader* reader = new LogReader((time_t)resume_from);
+    LogSample sample;
+    while (reader->next(&sample)) {
+        add(sample);
+        replayed++;
+    }
+    delete reader;
+    
+    for (uint8_t t = 0; t < ROLLUP_TIER_COUNT; t++) {
+        printf("Rollups: %s %lu/%lu records\n", TIERS[t].path,
+               (unsigned long)tiers_[t].stored, (unsigned long)TIERS[t].capacity);
+    }
+    printf("Rollups: replayed %lu samples from the log\n", (unsigned long)replayed);
+    return true;
+}
+
+void RollupStore::scanTier(RollupTier tier) {
+    FlashStorage& storage = FlashStorage::getInstance();
+    TierState& state = tiers_[tier];
+    const TierInfo& info = TIERS[tier];
+    
+    state.next_slot = 0;
+    state.stored = 0;
+    state.resume_from = 0;
+    
+    int32_t size = storage.getFileSize(info.path);
+    if (size <= 0) return;
+    
+    uint32_t records = (uint32_t)size / sizeof(RollupRecord);
+    if (records > info.capacity) records = info.capacity;
+    
+    // The newest valid record marks the write position
+    uint32_t newest_start = 0;
+    uint32_t newest_slot = 0;
+    for (uint32_t slot = 0; slot < records; slot += SCAN_BATCH) {
+        uint32_t count = records - slot < SCAN_BATCH ? records - slot : SCAN_BATCH;
+        int32_t n = storage.readFile(info.path, slot * sizeof(RollupRecord),
+                                     (uint8_t*)scan_buffer, count * sizeof(RollupRecord));
+        if (n != (int32_t)(count * sizeof(RollupRecord))) break;
+    
+        for (uint32_t i = 0; i < count; i++) {
+            const RollupRecord& record = scan_buffer[i];
+            if (record.crc != recordCrc(record)) continue;
+            if (record.start >= newest_start) {
+                newest_start = record.start;
+                newest_slot = slot + i;
+            }
+        }
+    }
+    
+    state.stored = records;
+    if (newest_start != 0) {
+        state.next_slot = (newest_slot + 1) % info.capacity;
+        state.resume_from = newest_start + info.seconds;
+    } else {
+        state.next_slot = records % info.capacity;
+    }
+}
+
+void RollupStore::add(const LogSample& sample) {
+    if (!ready_) return;
+    
+    mutex_enter_blocking(&mutex_);
+    for (uint8_t t = 0; t < ROLLUP_TIER_COUNT; t++) {
+        TierState& state = tiers_[t];
+        if (sample.time < state.resume_from) continue;
+    
+        const uint32_t start = sample.time - sample.time % TIERS[t].seconds;
+        if (state.open_valid && state.open.start != start) {
+            // Late samples (clock stepped back) are dropped rather than
+            // reopening a closed bucket
+            if (start < state.open.start) continue;
+            closeBucket((RollupTier)t);
+        }
+        if (!state.open_valid) {
+            startBucket(&state.open, start);
+            state.open_valid = true;
+        }
+    
+        RollupRecord& open = state.open;
+        for (uint8_t ch = 0; ch < HIST_CHANNEL_COUNT; ch++) {
+            const int16_t v = sample.values[ch];
+            if (v == HISTORY_NO_DATA) continue;
+            if (open.count[ch] == 0 || v < open.min[ch]) open.min[ch] = v;
+            if (open.count[ch] == 0 || v > open.max[ch]) open.max[ch] = v;
+            open.sum[ch] += v;
+            open.count[ch]++;
+        }
+    }
+    mutex_exit(&mutex_);
+}
+
+void RollupStore::closeBucket(RollupTier tier) {
+    TierState& state = tiers_[tier];
+    if (state.pending_count == ROLLUP_PENDING_MAX) {
+        writePending(tier);
+    }
+    if (state.pending_count < ROLLUP_PENDING_MAX) {
+        state.pending[state.pending_count++] = state.open;
+    }
+    state.open_valid = false;
+}
+
+void RollupStore::update() {
+    if (!ready_) return;
+    
+    if (flush_requested_ || Clock::elapsedSec(last_flush_sec_) >= LOG_FLUSH_INTERVAL_SEC) {
+        flush();
+    }
+}
+
+bool RollupStore::flush() {
+    flush_requested_ = false;
+    if (!ready_) return true;
+    
+    bool ok = true;
+    mutex_enter_blocking(&mutex_);
+    for (uint8_t t = 0; t < ROLLUP_TIER_COUNT; t++) {
+        if (!writePending((RollupTier)t)) ok = false;
+    }
+    mutex_exit(&mutex_);
+    
+    last_flush_sec_ = Clock::nowSec();
+    return ok;
+}
+
+bool RollupStore::writePending(RollupTier tier) {
+    TierState& state = tiers_[tier];
+    const uint32_t capacity = TIERS[tier].capacity;
+    const uint32_t count = state.pending_count;
+    if (count == 0) return true;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        state.pending[i].crc = recordCrc(state.pending[i]);
+    }
+    
+    // At most two contiguous runs: up to the end of the file, then from slot 0
+    const uint32_t first_run = count < capacity - state.next_slot ? count : capacity - state.next_slot;
+    bool ok = writeRun(tier, state.next_slot, state.pending, first_run);
+    if (ok && first_run < count) {
+        ok = writeRun(tier, 0, state.pending + first_run, count - first_run);
+    }
+    
+    // A failed batch is dropped rather than retried forever
+    state.pending_count = 0;
+    if (!ok) return false;
+    
+    const uint32_t end = state.next_slot + count;
+    if (end >= capacity) {
+        state.stored = capacity;
+    } else if (end > state.stored) {
+        state.stored = end;
+    }
+    state.next_slot = end % capacity;
+    return true;
+}
+
+bool RollupStore::writeRun(RollupTier tier, uint32_t slot, const RollupRecord* records, uint32_t count) {
+    const char* path = TIERS[tier].path;
+    if (!FlashStorage::getInstance().writeFileAt(path, slot * sizeof(RollupRecord),
+                                                 (const uint8_t*)records, count * sizeof(RollupRecord))) {
+        printf("Rollups: write to %s failed\n", path);
+        return false;
+    }
+    return true;
+}
+
+uint32_t RollupStore::getStoredCount(RollupTier tier) {
+    if (tier >= ROLLUP_TIER_COUNT) return 0;
+    mutex_enter_blocking(&mutex_);
+    uint32_t stored = tiers_[tier].stored;
+    mutex_exit(&mutex_);
+    return stored;
+}
+
+uint32_t RollupStore::readStored(RollupTier tier, uint32_t ordinal, RollupRecord* records, uint32_t max) {
+    if (tier >= ROLLUP_TIER_COUNT) return 0;
+    const uint32_t capacity = TIERS[tier].capacity;
+    
+    mutex_enter_blocking(&mutex_);
+    const uint32_t stored = tiers_[tier].stored;
+    const uint32_t next_slot = tiers_[tier].next_slot;
+    mutex_exit(&mutex_);
+    
+    if (ordinal >= stored) return 0;
+    const uint32_t slot = (next_slot + capacity - stored + ordinal) % capacity;
+    uint32_t count = stored - ordinal;
+    if (count > max) count = max;
+    if (count > capacity - slot) count = capacity - slot;
+    
+    int32_t n = FlashStorage::getInstance().readFile(TIERS[tier].path, slot * sizeof(RollupRecord),
+                                                     (uint8_t*)records, count * sizeof(RollupRecord));
+    if (n != (int32_t)(count * sizeof(RollupRecord))) return 0;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (records[i].crc != recordCrc(records[i])) {
+            records[i].start = 0;
+        }
+    }
+    return count;
+}
+
+uint32_t RollupStore::getPendingCount(RollupTier tier) {
+    if (tier >= ROLLUP_TIER_COUNT) return 0;
+    mutex_enter_blocking(&mutex_);
+    uint32_t count = tiers_[tier].pending_count;
+    mutex_exit(&mutex_);
+    return count;
+}
+
+bool RollupStore::readPending(RollupTier tier, uint32_t index, RollupRecord* record) {
+    if (tier >= ROLLUP_TIER_COUNT) return false;
+    mutex_enter_blocking(&mutex_);
+    bool ok = index < tiers_[tier].pending_count;
+    if (ok) *record = tiers_[tier].pending[index];
+    mutex_exit(&mutex_);
+    return ok;
+}
+
+bool RollupStore::readOpen(RollupTier tier, RollupRecord* record) {
+    if (tier >= ROLLUP_TIER_COUNT) return false;
+    mutex_enter_blocking(&mutex_);
+    bool ok = tiers_[tier].open_valid;
+    if (ok) *record = tiers_[tier].open;
+    mutex_exit(&mutex_);
+    return ok;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/mutex.h"
+#include "log_block.h"
+
+// Aggregation tiers above the raw 1-minute samples
+enum RollupTier : uint8_t {
+    ROLLUP_15MIN = 0,
+    ROLLUP_HOUR,
+    ROLLUP_DAY,
+    ROLLUP_TIER_COUNT
+};
+
+// One aggregated bucket; count 0 means the channel had no valid sample
+struct RollupRecord {
+    uint32_t start;                        // Bucket start (Unix time)
+    uint16_t count[HIST_CHANNEL_COUNT];
+    uint16_t reserved;
+    int32_t sum[HIST_CHANNEL_COUNT];
+    int16_t min[HIST_CHANNEL_COUNT];
+    int16_t max[HIST_CHANNEL_COUNT];
+    uint32_t crc;                          // CRC-32 of the record (crc = 0)
+};
+
+// Incremental min/max/sum/count rollups. Every sample folds into the open
+// bucket of each tier in O(1); closed buckets queue in RAM and are written
+// in one batch per tier to a fixed-size circular file, so a tier costs at
+// most one flash write per LOG_FLUSH_INTERVAL_SEC. Updated from core 1;
+// readers may run on either core.
+class RollupStore {
+public:
+    static RollupStore& getInstance();
+    
+    // Find each tier's write position on flash and rebuild buckets that were
+    // not yet persisted from the raw log (call after TimeSeriesLog::begin)
+    bool begin();
+    
+    void add(const LogSample& sample);
+    
+    // Batch-write closed buckets when due; call periodically
+    void update();
+    bool flush();
+    void requestFlush() { flush_requested_ = true; }
+    
+    static uint32_t getTierSeconds(RollupTier tier);
+    static uint32_t getTierCapacity(RollupTier tier);
+    static const char* getTierPath(RollupTier tier);
+    
+    // Coarsest tier whose bucket fits in step seconds; false means raw samples
+    static bool selectTier(uint32_t step, RollupTier* tier);
+    
+    // Reading in time order: records on flash (0 = oldest), then buckets
+    // still queued in RAM, then the open bucket
+    uint32_t getStoredCount(RollupTier tier);
+    // Up to max consecutive records from ordinal; records failing their CRC
+    // come back with start = 0. Returns the number read.
+    uint32_t readStored(RollupTier tier, uint32_t ordinal, RollupRecord* records, uint32_t max);
+    uint32_t getPendingCount(RollupTier tier);
+    bool readPending(RollupTier tier, uint32_t index, RollupRecord* record);
+    bool readOpen(RollupTier tier, RollupRecord* record);
+    
+private:
+    RollupStore();
+    
+    struct TierState {
+        RollupRecord open;
+        bool open_valid;
+        RollupRecord pending[ROLLUP_PENDING_MAX];
+        uint8_t pending_count;
+        uint32_t next_slot;    // Slot the next record is written to
+        uint32_t stored;       // Valid records on flash
+        uint32_t resume_from;  // Samples before this are already persisted
+    };
+    
+    void scanTier(RollupTier tier);
+    bool writePending(RollupTier tier);
+    bool writeRun(RollupTier tier, uint32_t slot, const RollupRecord* records, uint32_t count);
+    void closeBucket(RollupTier tier);
+    static void startBucket(RollupRecord* record, uint32_t start);
+    static uint32_t recordCrc(const RollupRecord& record);
+    
+    mutex_t mutex_;
+    bool ready_;
+    volatile bool flush_requested_;
+    uint64_t last_flush_sec_;
+    TierState tiers_[ROLLUP_TIER_COUNT];
+};
@@ -0,0 +1,221 @@
+#include "timeseries_log.h"
+#include "flash_storage.h"
+#include "../utils/clock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const time_t MIN_VALID_EPOCH = 1600000000;
+
+TimeSeriesLog& TimeSeriesLog::getInstance() {
+    static TimeSeriesLog instance;
+    return instance;
+}
+
+TimeSeriesLog::TimeSeriesLog()
+    : ready_(false), flush_requested_(false), block_opened_sec_(0),
+      first_segment_(0), last_segment_(0), segment_count_(0),
+      last_segment_size_(0), bytes_used_(0), blocks_written_(0) {
+}
+
+void TimeSeriesLog::segmentPath(uint32_t segment, char* buffer, size_t buffer_size) {
+    snprintf(buffer, buffer_size, LOG_DIR "/%08lu.seg", (unsigned long)segment);
+}
+
+void TimeSeriesLog::scanCallback(const char* name, uint32_t size, void* arg) {
+    TimeSeriesLog* log = static_cast<TimeSeriesLog*>(arg);
+    
+    char* end = nullptr;
+    unsigned long segment = strtoul(name, &end, 10);
+    if (end == name || strcmp(end, ".seg") != 0) return;
+    
+    if (log->segment_count_ == 0 || segment < log->first_segment_) {
+        log->first_segment_ = segment;
+    }
+    if (log->segment_count_ == 0 || segment > log->last_segment_) {
+        log->last_segment_ = segment;
+        log->last_segment_size_ = size;
+    }
+    log->segment_count_++;
+    log->bytes_used_ += size;
+}
+
+bool TimeSeriesLog::begin() {
+    FlashStorage& storage = FlashStorage::getInstance();
+    if (!storage.makeDir(LOG_DIR)) {
+        printf("Time-series log: cannot create %s\n", LOG_DIR);
+        return false;
+    }
+    
+    segment_count_ = 0;
+    bytes_used_ = 0;
+    if (!storage.listDir(LOG_DIR, scanCallback, this)) {
+        printf("Time-series log: cannot scan %s\n", LOG_DIR);
+        return false;
+    }
+    
+    ready_ = true;
+    printf("Time-series log: %lu segments (%lu-%lu), %lu bytes\n",
+           (unsigned long)segment_count_, (unsigned long)first_segment_,
+           (unsigned long)last_segment_, (unsigned long)bytes_used_);
+    return true;
+}
+
+void TimeSeriesLog::append(const LogSample& sample) {
+    if (!ready_) return;
+    
+    if (encoder_.isEmpty()) {
+        block_opened_sec_ = Clock::nowSec();
+    }
+    if (!encoder_.append(sample)) {
+        flush();
+        block_opened_sec_ = Clock::nowSec();
+        encoder_.append(sample);
+    }
+}
+
+void TimeSeriesLog::update() {
+    if (!ready_ || encoder_.isEmpty()) return;
+    
+    if (flush_requested_ || Clock::elapsedSec(block_opened_sec_) >= LOG_FLUSH_INTERVAL_SEC) {
+        flush();
+    }
+}
+
+bool TimeSeriesLog::flush() {
+    flush_requested_ = false;
+    if (!ready_ || encoder_.isEmpty()) return true;
+    
+    size_t length = encoder_.seal();
+    bool ok = writeBlock(encoder_.data(), length);
+    encoder_.reset();  // A failed block is dropped rather than retried forever
+    
+    time_t now = time(nullptr);
+    if (now >= MIN_VALID_EPOCH) {
+        collectGarbage((uint32_t)now);
+    }
+    return ok;
+}
+
+bool TimeSeriesLog::writeBlock(const uint8_t* data, size_t length) {
+    // Rotate before the segment would outgrow LOG_SEGMENT_SIZE
+    if (last_segment_size_ > 0 && last_segment_size_ + length > LOG_SEGMENT_SIZE) {
+        last_segment_++;
+        last_segment_size_ = 0;
+    }
+    
+    char path[32];
+    segmentPath(last_segment_, path, sizeof(path));
+    if (!FlashStorage::getInstance().appendFile(path, data, length)) {
+        printf("Time-series log: write to %s failed\n", path);
+        return false;
+    }
+    
+    if (last_segment_size_ == 0) {
+        if (segment_count_ == 0) first_segment_ = last_segment_;
+        segment_count_++;
+    }
+    last_segment_size_ += length;
+    bytes_used_ += length;
+    blocks_written_++;
+    return true;
+}
+
+uint32_t TimeSeriesLog::readSegmentStart(uint32_t segment) {
+    char path[32];
+    segmentPath(segment, path, sizeof(path));
+    
+    LogBlockHeader header;
+    int32_t n = FlashStorage::getInstance().readFile(path, 0, (uint8_t*)&header, sizeof(header));
+    if (n != (int32_t)sizeof(header) || header.magic != LOG_BLOCK_MAGIC) return 0;
+    return header.start_time;
+}
+
+void TimeSeriesLog::collectGarbage(uint32_t now) {
+    FlashStorage& storage = FlashStorage::getInstance();
+    const uint32_t retention_sec = LOG_RETENTION_DAYS * 86400UL;
+    
+    // Never delete the segment being appended to
+    while (segment_count_ > 1) {
+        bool over_budget = bytes_used_ > LOG_BUDGET_BYTES;
+    
+        // The oldest segment is expired once the next one starts before the cutoff
+        uint32_t next_start = readSegmentStart(first_segment_ + 1);
+        bool expired = next_start != 0 && next_start + retention_sec < now;
+    
+        if (!over_budget && !expired) break;
+    
+        char path[32];
+        segmentPath(first_segment_, path, sizeof(path));
+        int32_t size = storage.getFileSize(path);
+        if (size >= 0) {
+            if (!storage.deleteFile(path)) {
+                printf("Time-series log: cannot delete %s\n", path);
+                break;
+            }
+            bytes_used_ -= (uint32_t)size;
+            segment_count_--;
+            printf("Time-series log: removed %s (%s)\n", path, over_budget ? "budget" : "age");
+        }
+        first_segment_++;
+    }
+}
+
+LogReader::LogReader(time_t from)
+    : from_(from > 0 ? (uint32_t)from : 0), offset_(0), done_(false) {
+    TimeSeriesLog& log = TimeSeriesLog::getInstance();
+    segment_ = log.getFirstSegment();
+    done_ = log.getSegmentCount() == 0;
+}
+
+bool LogReader::next(LogSample* sample) {
+    while (!done_) {
+        if (decoder_.next(sample)) {
+            if (sample->time >= from_) return true;
+            continue;
+        }
+        if (!loadNextBlock()) {
+            done_ = true;
+        }
+    }
+    return false;
+}
+
+bool LogReader::loadNextBlock() {
+    FlashStorage& storage = FlashStorage::getInstance();
+    TimeSeriesLog& log = TimeSeriesLog::getInstance();
+    
+    while (segment_ <= log.getLastSegment()) {
+        // Segments removed by garbage collection meanwhile are skipped
+        if (segment_ < log.getFirstSegment()) {
+            segment_ = log.getFirstSegment();
+            offset_ = 0;
+        }
+    
+        char path[32];
+        TimeSeriesLog::segmentPath(segment_, path, sizeof(path));
+    
+        LogBlockHeader header;
+        int32_t n = storage.readFile(path, offset_, (uint8_t*)&header, sizeof(header));
+        size_t length = sizeof(header) + header.payload_bytes;
+        if (n != (int32_t)sizeof(header) || header.magic != LOG_BLOCK_MAGIC || length > LOG_BLOCK_SIZE) {
+            // End of segment (or unreadable tail): move on
+            segment_++;
+            offset_ = 0;
+            continue;
+        }
+    
+        uint32_t block_offset = offset_;
+        offset_ += length;
+    
+        // The header alone is enough to skip blocks that end before from
+        if (header.end_time < from_) continue;
+    
+        n = storage.readFile(path, block_offset, block_, length);
+        if (n == (int32_t)length && decoder_.begin(block_, length)) {
+            return true;
+        }
+        printf("Time-series log: bad block in %s at %lu\n", path, (unsigned long)block_offset);
+    }
+    return false;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "log_block.h"
+
+// Append-only sensor log in LittleFS. Samples are packed into a RAM block
+// (LogBlockEncoder) that is appended to the current segment file
+// /log/NNNNNNNN.seg only when full or LOG_FLUSH_INTERVAL_SEC old, which
+// bounds flash writes. Segments rotate at LOG_SEGMENT_SIZE and the oldest are
+// deleted once past LOG_RETENTION_DAYS or over LOG_BUDGET_BYTES.
+// Written from core 1 only.
+class TimeSeriesLog {
+public:
+    static TimeSeriesLog& getInstance();
+    
+    // Scan existing segments and resume after the newest one
+    bool begin();
+    
+    // Buffer one sample (sealing the block first if it is full)
+    void append(const LogSample& sample);
+    
+    // Flush on age; call periodically
+    void update();
+    
+    // Seal and write the pending block now
+    bool flush();
+    
+    // Ask the core 1 loop to flush on its next update() (any context)
+    void requestFlush() { flush_requested_ = true; }
+    
+    // Segment range [first, last] currently on flash
+    uint32_t getFirstSegment() const { return first_segment_; }
+    uint32_t getLastSegment() const { return last_segment_; }
+    uint32_t getSegmentCount() const { return segment_count_; }
+    uint32_t getBytesUsed() const { return bytes_used_; }
+    uint32_t getBlocksWritten() const { return blocks_written_; }
+    uint16_t getPendingSamples() const { return encoder_.getSampleCount(); }
+    
+    static void segmentPath(uint32_t segment, char* buffer, size_t buffer_size);
+    
+private:
+    TimeSeriesLog();
+    
+    bool writeBlock(const uint8_t* data, size_t length);
+    void collectGarbage(uint32_t now);
+    uint32_t readSegmentStart(uint32_t segment);
+    static void scanCallback(const char* name, uint32_t size, void* arg);
+    
+    bool ready_;
+    volatile bool flush_requested_;
+    LogBlockEncoder encoder_;
+    uint64_t block_opened_sec_;     // Clock second the pending block started
+    
+    uint32_t first_segment_;
+    uint32_t last_segment_;
+    uint32_t segment_count_;
+    uint32_t last_segment_size_;
+    uint32_t bytes_used_;
+    uint32_t blocks_written_;
+};
+
+// Time-ordered iteration over every sample on flash at or after from.
+// Blocks that end before from are skipped by header alone; blocks failing
+// their CRC are skipped.
+class LogReader {
+public:
+    explicit LogReader(time_t from);
+    
+    bool next(LogSample* sample);
+    
+private:
+    bool loadNextBlock();
+    
+    uint32_t from_;
+    uint32_t segment_;
+    uint32_t offset_;
+    bool done_;
+    LogBlockDecoder decoder_;
+    uint8_t block_[LOG_BLOCK_SIZE];
+};
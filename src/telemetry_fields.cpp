@@ -0,0 +1,161 @@
+#include "telemetry_fields.h"
+#include "utils/cbor.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+
+const FieldInfo Fields::INFO[FIELD_COUNT] = {
+#define FIELD_INFO(id, key, label, kind, group, unit, scale, precision, min, max, valid, value, metric, \
+                   channel, deadband) \
+    { key, label, kind, group, unit, scale, precision, min, max, metric, channel, deadband },
+    TELEMETRY_FIELDS(FIELD_INFO)
+#undef FIELD_INFO
+};
+
+// Appends formatted text, stopping (and staying stopped) once it would overrun
+class FieldWriter {
+public:
+    FieldWriter(char* buffer, size_t size) : buffer_(buffer), size_(size), len_(0), full_(size == 0) {
+        if (size) buffer[0] = '\0';
+    }
+    
+    void append(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        if (full_) return;
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(buffer_ + len_, size_ - len_, format, args);
+        va_end(args);
+        if (n < 0 || (size_t)n >= size_ - len_) {
+            buffer_[len_] = '\0';
+            full_ = true;
+            return;
+        }
+        len_ += n;
+    }
+    
+    size_t length() const { return len_; }
+    
+private:
+    char* buffer_;
+    size_t size_;
+    size_t len_;
+    bool full_;
+};
+
+FieldId Fields::find(const char* key, size_t len) {
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        if (strncmp(INFO[i].key, key, len) == 0 && INFO[i].key[len] == '\0') {
+            return (FieldId)i;
+        }
+    }
+    return FIELD_COUNT;
+}
+
+size_t Fields::writeJson(const FieldValues& values, uint8_t groups, char* buffer, size_t size) {
+    FieldWriter w(buffer, size);
+    bool first = true;
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        const FieldInfo& f = INFO[i];
+        if (!(f.group & groups)) continue;
+    
+        w.append("%s\"%s\": ", first ? "" : ",", f.key);
+        first = false;
+        if (f.kind == FIELD_BOOL) {
+            w.append("%s", values.value[i] != 0.0f ? "true" : "false");
+        } else if (!values.valid[i]) {
+            w.append("-999");
+        } else if (f.kind == FIELD_FLOAT) {
+            w.append("%.*f", f.precision, values.value[i]);
+        } else {
+            w.append("%lu", (unsigned long)values.value[i]);
+        }
+    }
+    return w.length();
+}
+
+void Fields::writeCbor(const FieldValues& values, uint8_t groups, CborWriter& w) {
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        const FieldInfo& f = INFO[i];
+        if (!(f.group & groups)) continue;
+        
+        w.text(f.key);
+        if (f.kind == FIELD_BOOL) {
+            w.boolean(values.value[i] != 0.0f);
+        } else if (!values.valid[i]) {
+            w.null();
+        } else {
+            w.number(values.value[i], f.precision);
+        }
+    }
+}
+
+void Fields::formatValue(FieldId id, const FieldValues& values, char* buffer, size_t size) {
+    const FieldInfo& f = INFO[id];
+    const float value = values.value[id];
+    if (!values.valid[id]) {
+        snprintf(buffer, size, "N/A");
+    } else if (f.kind == FIELD_BOOL) {
+        snprintf(buffer, size, "%s", value != 0.0f ? "ON" : "OFF");
+    } else if (f.kind == FIELD_CLOCK) {
+        const uint32_t sec = (uint32_t)value;
+        snprintf(buffer, size, "%02lu:%02lu", (unsigned long)(sec / 3600), (unsigned long)((sec % 3600) / 60));
+    } else if (f.kind == FIELD_FLOAT) {
+        snprintf(buffer, size, "%.*f%s", f.precision, value, f.unit);
+    } else {
+        snprintf(buffer, size, "%lu%s", (unsigned long)value, f.unit);
+    }
+}
+
+size_t Fields::writeText(const FieldValues& values, uint8_t groups, const char* line_format,
+                         char* buffer, size_t size) {
+    FieldWriter w(buffer, size);
+    char text[24];
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        if (!(INFO[i].group & groups)) continue;
+        formatValue((FieldId)i, values, text, sizeof(text));
+        w.append(line_format, INFO[i].label, text);
+    }
+    return w.length();
+}
+
+size_t Fields::writeMetrics(const FieldValues& values, char* buffer, size_t size) {
+    FieldWriter w(buffer, size);
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        const FieldInfo& f = INFO[i];
+        if (!f.metric) continue;
+    
+        w.append("# HELP %s %s\n# TYPE %s gauge\n", f.metric, f.label, f.metric);
+        // A reading is only exported while it is valid
+        if (!values.valid[i]) continue;
+        if (f.kind == FIELD_FLOAT) {
+            w.append("%s %.2f\n", f.metric, values.value[i]);
+        } else {
+            w.append("%s %lu\n", f.metric, (unsigned long)values.value[i]);
+        }
+    }
+    return w.length();
+}
+
+size_t Fields::writeBinary(const FieldValues& values, uint32_t time, uint8_t* buffer, size_t size) {
+    if (size < FIELD_BINARY_SIZE) return 0;
+    
+    // Little-endian, like the other binary formats on this little-endian MCU
+    memcpy(buffer, &time, 4);
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        int32_t fixed = INT32_MIN;
+        if (values.valid[i]) {
+            fixed = (int32_t)lroundf(values.value[i] * INFO[i].scale);
+        }
+        memcpy(buffer + 4 + 4 * i, &fixed, 4);
+    }
+    return FIELD_BINARY_SIZE;
+}
+
+size_t Fields::writeSchema(char* buffer, size_t size) {
+    FieldWriter w(buffer, size);
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        w.append("%s%s/%ld", i ? "," : "", INFO[i].key, (long)INFO[i].scale);
+    }
+    return w.length();
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+class SensorManager;
+class LightsController;
+class PumpController;
+class HeaterController;
+class FanController;
+class CborWriter;
+
+// Every telemetry and config field, in output order. Adding a reading or a
+// setting means adding one line here; the JSON, Prometheus, TCP/serial
+// text and binary encoders all expand this list.
+//
+// X(id, key, label, kind, group, unit, scale, precision, min, max, valid, value, metric, channel, deadband)
+//   id         FieldId suffix (FIELD_<id>)
+//   key        JSON and binary schema name
+//   label      TCP status and serial table label
+//   kind       FIELD_FLOAT, FIELD_UINT, FIELD_BOOL or FIELD_CLOCK (seconds since midnight)
+//   group      FIELD_SENSOR (reading), FIELD_STATE (output or link), FIELD_CONFIG (setting)
+//   unit       Suffix in text output ("" for none)
+//   scale      Fixed-point factor in the binary record
+//   precision  Decimals in JSON and text
+//   min, max   Accepted range for settings (readings: plausible range, not enforced)
+//   valid      Expression: the value is current (sensor read OK)
+//   value      Expression of src (FieldSource) and cfg (ConfigManager)
+//   metric     Prometheus gauge name, or nullptr to leave it out of /metrics
+//   channel    Readings: history channel and MQTT topic name (nullptr otherwise)
+//   deadband   Readings: change, in scaled units, that republishes the MQTT topic
+//
+// Readings come first. Each is also a minute-history channel, in registry
+// order and at its scale, so it flows into the RAM history, the persistent
+// log, the rollups, the telemetry spool and MQTT without further code.
+#define TELEMETRY_FIELDS(X) \
+    X(WATER_TEMP, "temperature", "Water Temp", FIELD_FLOAT, FIELD_SENSOR, "°C", 100, 1, -10, 60, \
+      src.sensors->isTemperatureValid(), src.sensors->getLastTemperature(), \
+      "hydro_water_temperature_celsius", "water", 5) \
+    X(TABLE_RH, "humidity", "Table Humidity", FIELD_FLOAT, FIELD_SENSOR, "%", 100, 1, 0, 100, \
+      src.sensors->isHumidityValid(), src.sensors->getLastHumidity(), \
+      "hydro_table_humidity_percent", "table_rh", 20) \
+    X(AIR_TEMP, "air_temperature", "Room Air Temp", FIELD_FLOAT, FIELD_SENSOR, "°C", 100, 1, -40, 80, \
+      src.sensors->isAirTempValid(), src.sensors->getLastAirTemp(), \
+      "hydro_air_temperature_celsius", "air_temp", 5) \
+    X(AIR_RH, "air_humidity", "Room Air Humidity", FIELD_FLOAT, FIELD_SENSOR, "%", 100, 1, 0, 100, \
+      src.sensors->isAirHumidityValid(), src.sensors->getLastAirHumidity(), \
+      "hydro_air_humidity_percent", "air_rh", 20) \
+    X(PH, "ph", "pH", FIELD_FLOAT, FIELD_SENSOR, "", 100, 2, 0, 14, \
+      src.sensors->isPHValid(), src.sensors->getLastPH(), \
+      "hydro_ph", "ph", 2) \
+    X(TDS, "tds", "TDS", FIELD_FLOAT, FIELD_SENSOR, " ppm", 1, 0, 0, 5000, \
+      src.sensors->isTDSValid(), src.sensors->getLastTDS(), \
+      "hydro_tds_ppm", "tds", 2) \
+    X(LIGHTS_ON, "lights_on", "Lights", FIELD_BOOL, FIELD_STATE, "", 1, 0, 0, 1, \
+      true, src.lights->isOn(), nullptr, nullptr, 0) \
+    X(PUMP_ON, "pump_on", "Pump", FIELD_BOOL, FIELD_STATE, "", 1, 0, 0, 1, \
+      true, src.pump->isOn(), nullptr, nullptr, 0) \
+    X(HEATER_ON, "heater_on", "Heater", FIELD_BOOL, FIELD_STATE, "", 1, 0, 0, 1, \
+      true, src.heater->isOn(), nullptr, nullptr, 0) \
+    X(FAN_ON, "fan_on", "Fan", FIELD_BOOL, FIELD_STATE, "", 1, 0, 0, 1, \
+      true, src.fan->isOn(), nullptr, nullptr, 0) \
+    X(WIFI_CONNECTED, "wifi_connected", "WiFi", FIELD_BOOL, FIELD_STATE, "", 1, 0, 0, 1, \
+      true, NetworkManager::getInstance().isConnected(), "hydro_wifi_connected", nullptr, 0) \
+    X(TIME_SYNCED, "time_synced", "Time Sync", FIELD_BOOL, FIELD_STATE, "", 1, 0, 0, 1, \
+      true, NetworkManager::getInstance().isTimeSynced(), "hydro_time_synced", nullptr, 0) \
+    X(LIGHTS_START, "lights_start_s", "Lights On At", FIELD_CLOCK, FIELD_CONFIG, "", 1, 0, 0, 86399, \
+      true, cfg.getLightsStartS(), nullptr, nullptr, 0) \
+    X(LIGHTS_END, "lights_end_s", "Lights Off At", FIELD_CLOCK, FIELD_CONFIG, "", 1, 0, 0, 86399, \
+      true, cfg.getLightsEndS(), nullptr, nullptr, 0) \
+    X(PUMP_ON_SEC, "pump_on_sec", "Pump On Time", FIELD_UINT, FIELD_CONFIG, "s", 1, 0, 1, 86399, \
+      true, cfg.getPumpOnSec(), nullptr, nullptr, 0) \
+    X(PUMP_PERIOD, "pump_period", "Pump Period", FIELD_UINT, FIELD_CONFIG, "s", 1, 0, 2, 86400, \
+      true, cfg.getPumpPeriod(), nullptr, nullptr, 0) \
+    X(HEATER_SETPOINT, "heater_setpoint_c", "Heater Setpoint", FIELD_FLOAT, FIELD_CONFIG, "°C", 100, 1, -40, 80, \
+      true, cfg.getHeaterSetpointC(), "hydro_heater_setpoint_celsius", nullptr, 0) \
+    X(HUMIDITY_THRESHOLD, "humidity_threshold", "Humidity Threshold", FIELD_FLOAT, FIELD_CONFIG, "%", 100, 1, 0, 100, \
+      true, cfg.getHumidityThreshold(), "hydro_humidity_threshold_percent", nullptr, 0) \
+    X(HUMIDITY_MODE, "humidity_mode", "Humidity Mode", FIELD_BOOL, FIELD_CONFIG, "", 1, 0, 0, 1, \
+      true, cfg.getHumidityMode(), nullptr, nullptr, 0) \
+    X(MIN_PUMP_RUN, "min_pump_run_sec", "Min Pump Run", FIELD_UINT, FIELD_CONFIG, "s", 1, 0, 5, 300, \
+      true, cfg.getMinPumpRunSec(), nullptr, nullptr, 0) \
+    X(MIN_PUMP_OFF, "min_pump_off_sec", "Min Pump Off", FIELD_UINT, FIELD_CONFIG, "s", 1, 0, 60, 3600, \
+      true, cfg.getMinPumpOffSec(), nullptr, nullptr, 0) \
+    X(MAX_PUMP_OFF, "max_pump_off_sec", "Max Pump Off", FIELD_UINT, FIELD_CONFIG, "s", 1, 0, 300, 7200, \
+      true, cfg.getMaxPumpOffSec(), nullptr, nullptr, 0)
+
+enum FieldId : uint8_t {
+#define FIELD_ENUM(id, ...) FIELD_##id,
+    TELEMETRY_FIELDS(FIELD_ENUM)
+#undef FIELD_ENUM
+    FIELD_COUNT
+};
+
+enum FieldKind : uint8_t {
+    FIELD_FLOAT,
+    FIELD_UINT,
+    FIELD_BOOL,
+    FIELD_CLOCK
+};
+
+// Bit flags, so encoders can take several groups at once
+enum FieldGroup : uint8_t {
+    FIELD_SENSOR = 1,
+    FIELD_STATE  = 2,
+    FIELD_CONFIG = 4,
+    FIELD_ALL    = FIELD_SENSOR | FIELD_STATE | FIELD_CONFIG
+};
+
+// Readings are FieldIds 0 .. FIELD_SENSOR_COUNT - 1
+#define FIELD_IS_SENSOR(id, key, label, kind, group, ...) + ((group) == FIELD_SENSOR ? 1 : 0)
+#define FIELD_SENSOR_AFTER(id, key, label, kind, group, ...) + ((group) == FIELD_SENSOR && FIELD_##id >= FIELD_SENSOR_COUNT ? 1 : 0)
+static const uint8_t FIELD_SENSOR_COUNT = 0 TELEMETRY_FIELDS(FIELD_IS_SENSOR);
+static_assert(0 TELEMETRY_FIELDS(FIELD_SENSOR_AFTER) == 0, "Readings must come first in TELEMETRY_FIELDS");
+#undef FIELD_IS_SENSOR
+#undef FIELD_SENSOR_AFTER
+
+struct FieldInfo {
+    const char* key;
+    const char* label;
+    FieldKind kind;
+    FieldGroup group;
+    const char* unit;
+    int32_t scale;
+    uint8_t precision;
+    float min;
+    float max;
+    const char* metric;
+    const char* channel;
+    int16_t deadband;
+};
+
+// Objects the value expressions read from; config and network state come
+// from their singletons
+struct FieldSource {
+    SensorManager* sensors;
+    LightsController* lights;
+    PumpController* pump;
+    HeaterController* heater;
+    FanController* fan;
+};
+
+// One snapshot of every field. Values are kept as float, which is exact for
+// every integer field's range.
+struct FieldValues {
+    float value[FIELD_COUNT];
+    bool valid[FIELD_COUNT];
+};
+
+// Binary record: uint32 Unix time, then one little-endian int32 per field
+// in registry order (value * scale, rounded; INT32_MIN when not valid)
+#define FIELD_BINARY_SIZE (4 + 4 * FIELD_COUNT)
+
+class Fields {
+public:
+    static const FieldInfo& info(FieldId id) { return INFO[id]; }
+    
+    // Field by JSON key; FIELD_COUNT if there is none
+    static FieldId find(const char* key, size_t len);
+    
+    // Value within the field's [min, max]
+    static bool inRange(FieldId id, float value) {
+        return value >= INFO[id].min && value <= INFO[id].max;
+    }
+    
+    // Read every field once; the list expands to straight-line accessor calls
+    static void read(const FieldSource& src, FieldValues* out);
+    
+    // Only the readings (the first FIELD_SENSOR_COUNT entries of out)
+    static void readSensors(SensorManager* sensors, FieldValues* out);
+    
+    // Encoders over a snapshot, limited to the given FieldGroup bits. Each
+    // returns the bytes written (output is cut short, never overrun).
+    
+    // Members of a JSON object without the braces: "key": value, ... with
+    // -999 for readings that are not valid (what web/app.js expects)
+    static size_t writeJson(const FieldValues& values, uint8_t groups, char* buffer, size_t size);
+    
+    // One line per field, line_format taking the label and the value text
+    static size_t writeText(const FieldValues& values, uint8_t groups, const char* line_format,
+                            char* buffer, size_t size);
+    
+    // The same members as CBOR map keys and values (null for readings that
+    // are not valid); the caller opens and closes the map
+    static void writeCbor(const FieldValues& values, uint8_t groups, CborWriter& w);
+    
+    // Prometheus gauges for the fields that have a metric name
+    static size_t writeMetrics(const FieldValues& values, char* buffer, size_t size);
+    
+    // FIELD_BINARY_SIZE bytes (all groups); 0 if size is too small
+    static size_t writeBinary(const FieldValues& values, uint32_t time, uint8_t* buffer, size_t size);
+    
+    // "key/scale,..." for every field, describing the binary record
+    static size_t writeSchema(char* buffer, size_t size);
+    
+    // Value as text with its unit: "21.5°C", "ON", "08:30", "N/A"
+    static void formatValue(FieldId id, const FieldValues& values, char* buffer, size_t size);
+    
+private:
+    static const FieldInfo INFO[FIELD_COUNT];
+};
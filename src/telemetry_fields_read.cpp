@@ -0,0 +1,34 @@
+#include "telemetry_fields.h"
+#include "config.h"
+#include "sensors/sensor_manager.h"
+#include "network/network_manager.h"
+#include "control/lights_controller.h"
+#include "control/pump_controller.h"
+#include "control/heater_controller.h"
+#include "control/fan_controller.h"
+
+// Kept apart from the encoders in telemetry_fields.cpp, which then build on
+// the host without the SDK (tools/cbor_bench.cpp)
+void Fields::read(const FieldSource& src, FieldValues* out) {
+    ConfigManager& cfg = ConfigManager::getInstance();
+#define FIELD_READ(id, key, label, kind, group, unit, scale, precision, min, max, is_valid, get, metric, ...) \
+    out->valid[FIELD_##id] = (is_valid); \
+    out->value[FIELD_##id] = out->valid[FIELD_##id] ? (float)(get) : 0.0f;
+    TELEMETRY_FIELDS(FIELD_READ)
+#undef FIELD_READ
+}
+
+void Fields::readSensors(SensorManager* sensors, FieldValues* out) {
+    // The other rows are expanded too but their group test is constant, so
+    // the compiler drops them
+    const FieldSource src = { sensors, nullptr, nullptr, nullptr, nullptr };
+    ConfigManager& cfg = ConfigManager::getInstance();
+    (void)cfg;
+#define FIELD_READ_SENSOR(id, key, label, kind, group, unit, scale, precision, min, max, is_valid, get, ...) \
+    if ((group) == FIELD_SENSOR) { \
+        out->valid[FIELD_##id] = (is_valid); \
+        out->value[FIELD_##id] = out->valid[FIELD_##id] ? (float)(get) : 0.0f; \
+    }
+    TELEMETRY_FIELDS(FIELD_READ_SENSOR)
+#undef FIELD_READ_SENSOR
+}
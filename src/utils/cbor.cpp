@@ -0,0 +1,160 @@
+#include "cbor.h"
+#include <string.h>
+#include <math.h>
+
+// Major types (top three bits of the initial byte)
+static const uint8_t MAJOR_UINT = 0;
+static const uint8_t MAJOR_NEGATIVE = 1;
+static const uint8_t MAJOR_TEXT = 3;
+static const uint8_t MAJOR_ARRAY = 4;
+static const uint8_t MAJOR_MAP = 5;
+
+static const uint8_t CBOR_FALSE = 0xF4;
+static const uint8_t CBOR_TRUE = 0xF5;
+static const uint8_t CBOR_NULL = 0xF6;
+static const uint8_t CBOR_HALF = 0xF9;
+static const uint8_t CBOR_SINGLE = 0xFA;
+static const uint8_t CBOR_OPEN_ARRAY = 0x9F;
+static const uint8_t CBOR_OPEN_MAP = 0xBF;
+static const uint8_t CBOR_BREAK = 0xFF;
+
+static const float POW10[] = { 1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f, 100000.0f, 1000000.0f };
+
+// IEEE half precision, if it holds the value exactly
+static bool toHalf(float value, uint16_t* out) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    const uint32_t mantissa = bits & 0x7FFFFF;
+    
+    if ((bits & 0x7FFFFFFF) == 0) {
+        *out = sign;
+        return true;
+    }
+    // Subnormals, infinities and NaN go out as single floats
+    if (exponent <= 0 || exponent >= 31 || (mantissa & 0x1FFF)) {
+        return false;
+    }
+    *out = sign | (uint16_t)(exponent << 10) | (uint16_t)(mantissa >> 13);
+    return true;
+}
+
+CborWriter::CborWriter(uint8_t* buffer, size_t size)
+    : buffer_(buffer), size_(size), len_(0), overflowed_(false) {
+}
+
+void CborWriter::put(const void* data, size_t len) {
+    if (overflowed_ || len > size_ - len_) {
+        overflowed_ = true;
+        return;
+    }
+    memcpy(buffer_ + len_, data, len);
+    len_ += len;
+}
+
+void CborWriter::head(uint8_t major, uint64_t value) {
+    uint8_t bytes[9];
+    size_t n;
+    major <<= 5;
+    if (value < 24) {
+        bytes[0] = major | (uint8_t)value;
+        n = 1;
+    } else if (value <= 0xFF) {
+        bytes[0] = major | 24;
+        bytes[1] = (uint8_t)value;
+        n = 2;
+    } else if (value <= 0xFFFF) {
+        bytes[0] = major | 25;
+        n = 3;
+    } else if (value <= 0xFFFFFFFFULL) {
+        bytes[0] = major | 26;
+        n = 5;
+    } else {
+        bytes[0] = major | 27;
+        n = 9;
+    }
+    // Arguments are big-endian
+    if (n > 2) {
+        for (size_t i = n - 1; i > 0; i--) {
+            bytes[i] = (uint8_t)value;
+            value >>= 8;
+        }
+    }
+    put(bytes, n);
+}
+
+void CborWriter::map(uint32_t pairs) {
+    head(MAJOR_MAP, pairs);
+}
+
+void CborWriter::array(uint32_t items) {
+    head(MAJOR_ARRAY, items);
+}
+
+void CborWriter::openMap() {
+    put(&CBOR_OPEN_MAP, 1);
+}
+
+void CborWriter::openArray() {
+    put(&CBOR_OPEN_ARRAY, 1);
+}
+
+void CborWriter::close() {
+    put(&CBOR_BREAK, 1);
+}
+
+void CborWriter::uinteger(uint64_t value) {
+    head(MAJOR_UINT, value);
+}
+
+void CborWriter::integer(int64_t value) {
+    if (value >= 0) {
+        head(MAJOR_UINT, (uint64_t)value);
+    } else {
+        head(MAJOR_NEGATIVE, (uint64_t)(-1 - value));
+    }
+}
+
+void CborWriter::text(const char* str) {
+    text(str, strlen(str));
+}
+
+void CborWriter::text(const char* str, size_t len) {
+    head(MAJOR_TEXT, len);
+    put(str, len);
+}
+
+void CborWriter::boolean(bool value) {
+    put(value ? &CBOR_TRUE : &CBOR_FALSE, 1);
+}
+
+void CborWriter::null() {
+    put(&CBOR_NULL, 1);
+}
+
+void CborWriter::number(float value, uint8_t decimals) {
+    if (decimals >= sizeof(POW10) / sizeof(POW10[0])) {
+        decimals = sizeof(POW10) / sizeof(POW10[0]) - 1;
+    }
+    const float scale = POW10[decimals];
+    const float rounded = roundf(value * scale) / scale;
+    
+    if (rounded == truncf(rounded) && fabsf(rounded) < 2147483648.0f) {
+        integer((int64_t)rounded);
+        return;
+    }
+    
+    uint16_t half;
+    if (toHalf(rounded, &half)) {
+        const uint8_t bytes[3] = { CBOR_HALF, (uint8_t)(half >> 8), (uint8_t)half };
+        put(bytes, sizeof(bytes));
+        return;
+    }
+    
+    uint32_t bits;
+    memcpy(&bits, &rounded, sizeof(bits));
+    const uint8_t bytes[5] = { CBOR_SINGLE, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16),
+                               (uint8_t)(bits >> 8), (uint8_t)bits };
+    put(bytes, sizeof(bytes));
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Minimal CBOR (RFC 8949) encoder writing into a caller-provided buffer; it
+// never allocates. Once an item does not fit, the writer stops and stays
+// overflowed, so callers check once at the end. Maps and arrays are either
+// sized up front or open-ended (closed with close()).
+class CborWriter {
+public:
+    CborWriter(uint8_t* buffer, size_t size);
+    
+    void map(uint32_t pairs);
+    void array(uint32_t items);
+    void openMap();
+    void openArray();
+    void close();
+    
+    void uinteger(uint64_t value);
+    void integer(int64_t value);
+    void text(const char* str);
+    void text(const char* str, size_t len);
+    void boolean(bool value);
+    void null();
+    
+    // Rounded to `decimals`, then sent in the shortest exact form: an
+    // integer, a half float, or a single float
+    void number(float value, uint8_t decimals);
+    
+    size_t length() const { return len_; }
+    bool isOverflowed() const { return overflowed_; }
+    
+private:
+    void head(uint8_t major, uint64_t value);
+    void put(const void* data, size_t len);
+    
+    uint8_t* buffer_;
+    size_t size_;
+    size_t len_;
+    bool overflowed_;
+};
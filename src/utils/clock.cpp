@@ -0,0 +1,10 @@
+#include "clock.h"
+
+Clock::Tick Clock::ticks_[2] = {};
+
+void Clock::tick() {
+    Tick& t = ticks_[get_core_num()];
+    t.us = time_us_64();
+    t.ms = t.us / 1000ULL;
+    t.sec = t.us / 1000000ULL;
+}
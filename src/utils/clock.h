@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/stdlib.h"
+
+// Monotonic 64-bit time base shared by all controllers.
+//
+// Each core latches the hardware timer once per loop with tick(); everything
+// else on that core reads the cached values, so a loop iteration sees one
+// consistent "now" and the 64-bit divisions happen once. 64-bit timestamps
+// do not wrap in practice, so deadlines compare with plain >=.
+class Clock {
+public:
+    static void tick();
+    
+    // Cached timestamps for the calling core (as of its last tick())
+    static uint64_t nowUs() { return ticks_[get_core_num()].us; }
+    static uint64_t nowMs() { return ticks_[get_core_num()].ms; }
+    static uint64_t nowSec() { return ticks_[get_core_num()].sec; }
+    
+    // Deadline helpers
+    static uint64_t deadlineMs(uint64_t delay_ms) { return nowMs() + delay_ms; }
+    static bool reachedMs(uint64_t deadline_ms) { return nowMs() >= deadline_ms; }
+    static bool reachedSec(uint64_t deadline_sec) { return nowSec() >= deadline_sec; }
+    static uint64_t elapsedMs(uint64_t since_ms) {
+        const uint64_t now = nowMs();
+        return now > since_ms ? now - since_ms : 0;
+    }
+    static uint64_t elapsedSec(uint64_t since_sec) {
+        const uint64_t now = nowSec();
+        return now > since_sec ? now - since_sec : 0;
+    }
+    
+private:
+    struct Tick {
+        uint64_t us;
+        uint64_t ms;
+        uint64_t sec;
+    };
+    
+    static Tick ticks_[2];
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+class CrcUtils {
+public:
+    // CRC-32 (IEEE 802.3, reflected 0xEDB88320). Pass a previous result as
+    // crc to continue a running checksum over several buffers.
+    static uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+};
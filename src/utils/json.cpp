@@ -0,0 +1,288 @@
+#include "json.h"
+#include "../config.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+char Json::error_[48] = "";
+
+// What the innermost open container accepts next
+enum JsonExpect : uint8_t {
+    EXPECT_KEY_OR_END,      // Just after '{'
+    EXPECT_KEY,             // After ',' in an object
+    EXPECT_COLON,
+    EXPECT_VALUE,           // After ':' or after ',' in an array
+    EXPECT_VALUE_OR_END,    // Just after '['
+    EXPECT_COMMA            // After a member or item
+};
+
+struct JsonFrame {
+    uint16_t token;
+    JsonExpect expect;
+};
+
+static bool isPrimitiveChar(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+static bool isValidPrimitive(const char* p, size_t len) {
+    if ((len == 4 && memcmp(p, "true", 4) == 0) || (len == 5 && memcmp(p, "false", 5) == 0) ||
+        (len == 4 && memcmp(p, "null", 4) == 0)) {
+        return true;
+    }
+    // Number: -?digits[.digits][(e|E)[+-]digits]
+    size_t i = 0;
+    if (i < len && p[i] == '-') i++;
+    const size_t int_start = i;
+    while (i < len && p[i] >= '0' && p[i] <= '9') i++;
+    if (i == int_start) return false;
+    if (i < len && p[i] == '.') {
+        const size_t frac_start = ++i;
+        while (i < len && p[i] >= '0' && p[i] <= '9') i++;
+        if (i == frac_start) return false;
+    }
+    if (i < len && (p[i] == 'e' || p[i] == 'E')) {
+        i++;
+        if (i < len && (p[i] == '+' || p[i] == '-')) i++;
+        const size_t exp_start = i;
+        while (i < len && p[i] >= '0' && p[i] <= '9') i++;
+        if (i == exp_start) return false;
+    }
+    return i == len;
+}
+
+int Json::tokenize(const char* json, size_t len, JsonToken* tokens, uint16_t max_tokens) {
+    JsonFrame stack[JSON_MAX_DEPTH];
+    int depth = 0;
+    uint16_t count = 0;
+    bool done = false;
+    
+    if (len > UINT16_MAX) return JSON_ERROR_INVALID;
+    
+    for (size_t i = 0; i < len; i++) {
+        const char c = json[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+        if (done) return JSON_ERROR_INVALID;  // Text after the top-level value
+    
+        JsonFrame* top = depth > 0 ? &stack[depth - 1] : nullptr;
+    
+        if (c == ':') {
+            if (!top || top->expect != EXPECT_COLON) return JSON_ERROR_INVALID;
+            top->expect = EXPECT_VALUE;
+            continue;
+        }
+        if (c == ',') {
+            if (!top || top->expect != EXPECT_COMMA) return JSON_ERROR_INVALID;
+            top->expect = tokens[top->token].type == JSON_OBJECT ? EXPECT_KEY : EXPECT_VALUE;
+            continue;
+        }
+        if (c == '}' || c == ']') {
+            const JsonType type = c == '}' ? JSON_OBJECT : JSON_ARRAY;
+            if (!top || tokens[top->token].type != type) return JSON_ERROR_INVALID;
+            if (top->expect != EXPECT_COMMA &&
+                top->expect != (type == JSON_OBJECT ? EXPECT_KEY_OR_END : EXPECT_VALUE_OR_END)) {
+                return JSON_ERROR_INVALID;
+            }
+            tokens[top->token].end = (uint16_t)(i + 1);
+            depth--;
+            if (depth == 0) done = true;
+            continue;
+        }
+    
+        // A string in key position is a key; anything else must be a value
+        const bool is_key = c == '"' && top && (top->expect == EXPECT_KEY || top->expect == EXPECT_KEY_OR_END);
+        if (!is_key) {
+            if (top) {
+                if (top->expect != EXPECT_VALUE && top->expect != EXPECT_VALUE_OR_END) return JSON_ERROR_INVALID;
+                if (tokens[top->token].type == JSON_ARRAY) tokens[top->token].size++;
+                top->expect = EXPECT_COMMA;
+            }
+        }
+    
+        if (count >= max_tokens) return JSON_ERROR_NOMEM;
+        JsonToken* token = &tokens[count];
+    
+        if (c == '{' || c == '[') {
+            if (depth >= JSON_MAX_DEPTH) return JSON_ERROR_INVALID;
+            *token = { c == '{' ? JSON_OBJECT : JSON_ARRAY, (uint16_t)i, 0, 0 };
+            stack[depth++] = { count, c == '{' ? EXPECT_KEY_OR_END : EXPECT_VALUE_OR_END };
+            count++;
+        } else if (c == '"') {
+            size_t end = i + 1;
+            for (; end < len && json[end] != '"'; end++) {
+                if ((unsigned char)json[end] < 0x20) return JSON_ERROR_INVALID;
+                if (json[end] == '\\') {
+                    if (++end >= len) return JSON_ERROR_PARTIAL;
+                    if (!strchr("\"\\/bfnrtu", json[end])) return JSON_ERROR_INVALID;
+                }
+            }
+            if (end >= len) return JSON_ERROR_PARTIAL;
+            *token = { JSON_STRING, (uint16_t)(i + 1), (uint16_t)end, (uint16_t)(is_key ? 1 : 0) };
+            count++;
+            if (is_key) {
+                tokens[top->token].size++;
+                top->expect = EXPECT_COLON;
+            } else if (!top) {
+                done = true;
+            }
+            i = end;
+        } else if (isPrimitiveChar(c)) {
+            size_t end = i;
+            while (end < len && isPrimitiveChar(json[end])) end++;
+            if (!isValidPrimitive(json + i, end - i)) return JSON_ERROR_INVALID;
+            *token = { JSON_PRIMITIVE, (uint16_t)i, (uint16_t)end, 0 };
+            count++;
+            if (!top) done = true;
+            i = end - 1;
+        } else {
+            return JSON_ERROR_INVALID;
+        }
+    }
+    
+    if (!done) return JSON_ERROR_PARTIAL;
+    return count;
+}
+
+// Decode a string token's escapes into out; false if it does not fit
+static bool copyString(const char* p, size_t len, char* out, size_t out_size) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = p[i];
+        if (c == '\\') {
+            c = p[++i];
+            switch (c) {
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    // Only ASCII is kept; other code points become '?'
+                    if (i + 4 >= len) return false;
+                    char hex[5] = { p[i + 1], p[i + 2], p[i + 3], p[i + 4], '\0' };
+                    const unsigned long code = strtoul(hex, nullptr, 16);
+                    c = code < 0x80 ? (char)code : '?';
+                    i += 4;
+                    break;
+                }
+                default: break;  // '"', '\\' and '/' stand for themselves
+            }
+        }
+        if (n + 1 >= out_size) return false;
+        out[n++] = c;
+    }
+    out[n] = '\0';
+    return true;
+}
+
+// Plain decimals with up to 9 significant digits (all a settings body
+// carries) are converted directly; exponents and longer ones use strtof
+static float parseNumber(const char* p, size_t len) {
+    static const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    const bool negative = p[0] == '-';
+    uint32_t mantissa = 0;
+    uint8_t digits = 0;
+    uint8_t decimals = 0;
+    bool fraction = false;
+    for (size_t i = negative ? 1 : 0; i < len; i++) {
+        if (p[i] == '.') {
+            fraction = true;
+        } else if (p[i] >= '0' && p[i] <= '9' && digits < 9 && decimals < 9) {
+            mantissa = mantissa * 10 + (p[i] - '0');
+            if (mantissa) digits++;
+            if (fraction) decimals++;
+        } else {
+            char number[32];
+            memcpy(number, p, len);
+            number[len] = '\0';
+            return strtof(number, nullptr);
+        }
+    }
+    const float value = (float)(mantissa / POW10[decimals]);
+    return negative ? -value : value;
+}
+
+bool Json::read(const char* json, const JsonToken& token, JsonValueType type, void* out, size_t out_size) {
+    const char* p = json + token.start;
+    const size_t len = token.end - token.start;
+    
+    switch (type) {
+        case JSON_VALUE_STRING:
+            return token.type == JSON_STRING && copyString(p, len, (char*)out, out_size);
+    
+        case JSON_VALUE_BOOL:
+            if (token.type != JSON_PRIMITIVE) return false;
+            if (len == 4 && memcmp(p, "true", 4) == 0) {
+                *(bool*)out = true;
+            } else if (len == 5 && memcmp(p, "false", 5) == 0) {
+                *(bool*)out = false;
+            } else {
+                return false;
+            }
+            return true;
+    
+        case JSON_VALUE_UINT: {
+            if (token.type != JSON_PRIMITIVE || len == 0 || len > 10) return false;
+            uint64_t value = 0;
+            for (size_t i = 0; i < len; i++) {
+                if (p[i] < '0' || p[i] > '9') return false;
+                value = value * 10 + (p[i] - '0');
+            }
+            if (value > UINT32_MAX) return false;
+            *(uint32_t*)out = (uint32_t)value;
+            return true;
+        }
+    
+        case JSON_VALUE_FLOAT: {
+            if (token.type != JSON_PRIMITIVE || len == 0 || len > 31 || (p[0] != '-' && (p[0] < '0' || p[0] > '9'))) {
+                return false;
+            }
+            *(float*)out = parseNumber(p, len);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Json::extract(const char* json, size_t len, JsonField* fields, uint8_t count) {
+    JsonToken tokens[JSON_MAX_TOKENS];
+    for (uint8_t f = 0; f < count; f++) {
+        fields[f].found = false;
+    }
+    
+    const int n = tokenize(json, len, tokens, JSON_MAX_TOKENS);
+    if (n < 0) {
+        snprintf(error_, sizeof(error_), "%s", n == JSON_ERROR_NOMEM ? "too many members" : "malformed JSON");
+        return false;
+    }
+    if (tokens[0].type != JSON_OBJECT) {
+        snprintf(error_, sizeof(error_), "body must be an object");
+        return false;
+    }
+    
+    // Members are key, value pairs in document order; nested values are
+    // skipped by their end offset
+    int i = 1;
+    for (uint16_t member = 0; member < tokens[0].size && i + 1 < n; member++) {
+        const JsonToken& key = tokens[i];
+        const JsonToken& value = tokens[i + 1];
+        const size_t key_len = key.end - key.start;
+    
+        for (uint8_t f = 0; f < count; f++) {
+            const char* name = fields[f].key;
+            if (name[0] != json[key.start] || strncmp(name, json + key.start, key_len) != 0 || name[key_len]) continue;
+            if (value.type == JSON_PRIMITIVE && json[value.start] == 'n') break;  // null: not given
+            if (!read(json, value, fields[f].type, fields[f].out, fields[f].out_size)) {
+                snprintf(error_, sizeof(error_), "bad value for %s", fields[f].key);
+                return false;
+            }
+            fields[f].found = true;
+            break;
+        }
+    
+        i += 2;
+        while (i < n && tokens[i].start < value.end) i++;
+    }
+    error_[0] = '\0';
+    return true;
+}
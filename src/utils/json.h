@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+enum JsonType : uint8_t {
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,        // start/end exclude the quotes; escapes left as is
+    JSON_PRIMITIVE      // Number, true, false or null
+};
+
+struct JsonToken {
+    JsonType type;
+    uint16_t start;
+    uint16_t end;
+    uint16_t size;      // Members of an object (keys) or array; 1 for a key with its value
+};
+
+// Wanted member of a flat request object and where its value goes
+enum JsonValueType : uint8_t {
+    JSON_VALUE_STRING,  // NUL-terminated copy into out (out_size bytes), escapes decoded
+    JSON_VALUE_FLOAT,   // float
+    JSON_VALUE_UINT,    // uint32_t, digits only
+    JSON_VALUE_BOOL     // bool
+};
+
+struct JsonField {
+    const char* key;
+    JsonValueType type;
+    void* out;
+    size_t out_size;
+    bool found;         // Set by extract()
+};
+
+// jsmn-style JSON tokenizer: one pass over the text into a caller's fixed
+// token array, no allocation and no copies. Values are read in place from
+// the token offsets.
+class Json {
+public:
+    // Tokens used, or a negative JsonError
+    static int tokenize(const char* json, size_t len, JsonToken* tokens, uint16_t max_tokens);
+    
+    // Tokenize a request body holding one object (up to JSON_MAX_TOKENS
+    // tokens) and fill the wanted fields in a single walk of its members.
+    // Unknown members are skipped and null counts as absent. False if the
+    // body is malformed, is not an object, or a wanted member has the wrong
+    // type or does not fit.
+    static bool extract(const char* json, size_t len, JsonField* fields, uint8_t count);
+    
+    // One value token as the given type (see JsonValueType); false on a
+    // type mismatch or a string longer than out_size - 1
+    static bool read(const char* json, const JsonToken& token, JsonValueType type, void* out, size_t out_size);
+    
+    // Last tokenize()/extract() problem, for error responses
+    static const char* getError() { return error_; }
+    
+private:
+    static char error_[48];
+};
+
+// tokenize() failures
+enum JsonError {
+    JSON_ERROR_NOMEM = -1,     // More tokens than max_tokens
+    JSON_ERROR_INVALID = -2,   // Not JSON
+    JSON_ERROR_PARTIAL = -3    // Ends early
+};
@@ -0,0 +1,274 @@
+#include "log.h"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include <ctype.h>
+
+static_assert(LOG_MAX_PAYLOAD < 256, "payload length is stored in one byte");
+static_assert(LOG_MAX_STRING < LOG_MAX_PAYLOAD, "LOG_MAX_STRING must fit in a payload");
+
+static const char* const MODULE_NAMES[LOG_MODULE_COUNT] = {
+    "sensors", "control", "http", "tcp", "net", "storage", "status", "system"
+};
+
+static const char* const LEVEL_NAMES[LOG_LEVEL_COUNT] = {
+    "off", "error", "warn", "info", "debug"
+};
+
+static const char LEVEL_TAGS[LOG_LEVEL_COUNT] = { '-', 'E', 'W', 'I', 'D' };
+
+// Frame start for binary output (ASCII record separator, then 'L')
+static const uint8_t FRAME_SYNC = 0x1E;
+
+volatile uint8_t Log::levels_[LOG_MODULE_COUNT] = {
+    LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL,
+    LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL
+};
+volatile bool Log::binary_output_ = false;
+Log::Ring Log::rings_[2];
+
+const char* Log::getModuleName(uint8_t module) {
+    return module < LOG_MODULE_COUNT ? MODULE_NAMES[module] : "unknown";
+}
+
+const char* Log::getLevelName(uint8_t level) {
+    return level < LOG_LEVEL_COUNT ? LEVEL_NAMES[level] : "unknown";
+}
+
+bool Log::parseModuleName(const char* name, LogModule* module) {
+    for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+        if (strcmp(name, MODULE_NAMES[i]) == 0) {
+            *module = (LogModule)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Log::parseLevelName(const char* name, LogLevel* level) {
+    for (uint8_t i = 0; i < LOG_LEVEL_COUNT; i++) {
+        if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+            *level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Log::copyIn(Ring& ring, uint32_t pos, const void* src, size_t len) {
+    const uint32_t offset = pos % LOG_RING_BYTES;
+    const size_t first = len < LOG_RING_BYTES - offset ? len : LOG_RING_BYTES - offset;
+    memcpy(ring.data + offset, src, first);
+    memcpy(ring.data, (const uint8_t*)src + first, len - first);
+}
+
+void Log::copyOut(const Ring& ring, uint32_t pos, void* dst, size_t len) {
+    const uint32_t offset = pos % LOG_RING_BYTES;
+    const size_t first = len < LOG_RING_BYTES - offset ? len : LOG_RING_BYTES - offset;
+    memcpy(dst, ring.data + offset, first);
+    memcpy((uint8_t*)dst + first, ring.data, len - first);
+}
+
+void Log::write(LogModule module, LogLevel level, const char* fmt, const uint8_t* payload, size_t len) {
+    Header header;
+    header.time_ms = (uint32_t)(time_us_64() / 1000);
+    header.fmt = fmt;
+    header.module = module;
+    header.level = level;
+    header.payload_len = (uint8_t)len;
+    header.reserved = 0;
+    const uint32_t total = sizeof(header) + len;
+    
+    // lwIP callbacks log from IRQ context, so mask interrupts for the copy
+    const uint32_t ints = save_and_disable_interrupts();
+    Ring& ring = rings_[get_core_num()];
+    const uint32_t head = ring.head;
+    if (head - ring.tail + total > LOG_RING_BYTES) {
+        ring.dropped = ring.dropped + 1;
+        restore_interrupts(ints);
+        return;
+    }
+    copyIn(ring, head, &header, sizeof(header));
+    copyIn(ring, head + sizeof(header), payload, len);
+    __dmb();
+    ring.head = head + total;
+    restore_interrupts(ints);
+}
+
+void Log::drain(uint32_t max_records) {
+    uint8_t payload[LOG_MAX_PAYLOAD];
+    
+    for (uint8_t core = 0; core < 2; core++) {
+        Ring& ring = rings_[core];
+        for (uint32_t i = 0; i < max_records && ring.tail != ring.head; i++) {
+            __dmb();
+            const uint32_t tail = ring.tail;
+            Header header;
+            copyOut(ring, tail, &header, sizeof(header));
+            copyOut(ring, tail + sizeof(header), payload, header.payload_len);
+            __dmb();
+            ring.tail = tail + sizeof(header) + header.payload_len;
+            
+            emit(core, header, payload);
+        }
+    }
+}
+
+void Log::emit(uint8_t core, const Header& header, const uint8_t* payload) {
+    if (binary_output_) {
+        uint8_t frame[2 + 12 + LOG_MAX_PAYLOAD + 1];
+        const uint32_t fmt = (uint32_t)(uintptr_t)header.fmt;
+        size_t len = 0;
+        frame[len++] = FRAME_SYNC;
+        frame[len++] = 'L';
+        memcpy(frame + len, &header.time_ms, 4);
+        len += 4;
+        memcpy(frame + len, &fmt, 4);
+        len += 4;
+        frame[len++] = header.module;
+        frame[len++] = header.level;
+        frame[len++] = core;
+        frame[len++] = header.payload_len;
+        memcpy(frame + len, payload, header.payload_len);
+        len += header.payload_len;
+        
+        uint8_t sum = 0;
+        for (size_t i = 2; i < len; i++) sum += frame[i];
+        frame[len++] = sum;
+        
+        // Raw output: stdio's CR/LF translation would corrupt the frame
+        for (size_t i = 0; i < len; i++) putchar_raw(frame[i]);
+        return;
+    }
+    
+    char message[256];
+    format(header.fmt, payload, header.payload_len, message, sizeof(message));
+    
+    // Formats may carry the newlines of the printf calls they replaced
+    const char* text = message;
+    while (*text == '\n') text++;
+    size_t len = strlen(text);
+    while (len > 0 && text[len - 1] == '\n') len--;
+    
+    printf("%lu.%03lu %c %s: %.*s\n",
+           (unsigned long)(header.time_ms / 1000), (unsigned long)(header.time_ms % 1000),
+           header.level < LOG_LEVEL_COUNT ? LEVEL_TAGS[header.level] : '?',
+           getModuleName(header.module), (int)len, text);
+}
+
+size_t Log::format(const char* fmt, const uint8_t* payload, size_t payload_len, char* out, size_t size) {
+    size_t pos = 0;
+    size_t arg = 0;
+    bool exhausted = false;
+    
+    while (*fmt && pos + 1 < size) {
+        if (*fmt != '%') {
+            out[pos++] = *fmt++;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            out[pos++] = '%';
+            fmt += 2;
+            continue;
+        }
+        
+        // Split the conversion into flags/width/precision, length and type
+        const char* start = fmt++;
+        while (*fmt && strchr("-+ #0", *fmt)) fmt++;
+        while (isdigit((unsigned char)*fmt) || *fmt == '.') fmt++;
+        const char* length = fmt;
+        int longs = 0;
+        while (*fmt && strchr("hlzjtL", *fmt)) {
+            if (*fmt == 'l') longs++;
+            fmt++;
+        }
+        const char type = *fmt;
+        if (!type) break;
+        fmt++;
+        
+        // Integer width as stored by the encoder for this length modifier
+        size_t width = 4;
+        if (longs >= 2 || length[0] == 'j') width = 8;
+        else if (longs == 1) width = sizeof(long) > 4 ? 8 : 4;
+        else if (length[0] == 'z') width = sizeof(size_t) > 4 ? 8 : 4;
+        
+        // The conversion without its length modifier, so a canonical one
+        // can be put back for the value passed to snprintf
+        char spec[16];
+        size_t spec_len = (size_t)(length - start);
+        if (spec_len > sizeof(spec) - 4) spec_len = sizeof(spec) - 4;
+        memcpy(spec, start, spec_len);
+        
+        const size_t room = size - pos;
+        int n = 0;
+        if (strchr("diouxXc", type)) {
+            if (exhausted || arg + width > payload_len) {
+                exhausted = true;
+            } else {
+                uint64_t raw = 0;
+                memcpy(&raw, payload + arg, width);
+                arg += width;
+                if (type == 'c') {
+                    spec[spec_len] = 'c';
+                    spec[spec_len + 1] = '\0';
+                    n = snprintf(out + pos, room, spec, (int)raw);
+                } else {
+                    spec[spec_len] = 'l';
+                    spec[spec_len + 1] = 'l';
+                    spec[spec_len + 2] = type;
+                    spec[spec_len + 3] = '\0';
+                    if (type == 'd' || type == 'i') {
+                        const long long v = width == 8 ? (long long)(int64_t)raw : (long long)(int32_t)(uint32_t)raw;
+                        n = snprintf(out + pos, room, spec, v);
+                    } else {
+                        n = snprintf(out + pos, room, spec, (unsigned long long)raw);
+                    }
+                }
+            }
+        } else if (strchr("fFeEgGaA", type)) {
+            if (exhausted || arg + sizeof(double) > payload_len) {
+                exhausted = true;
+            } else {
+                double v;
+                memcpy(&v, payload + arg, sizeof(v));
+                arg += sizeof(v);
+                spec[spec_len] = type;
+                spec[spec_len + 1] = '\0';
+                n = snprintf(out + pos, room, spec, v);
+            }
+        } else if (type == 's') {
+            if (exhausted || arg + 1 > payload_len || arg + 1 + payload[arg] > payload_len) {
+                exhausted = true;
+            } else {
+                char text[LOG_MAX_STRING + 1];
+                const uint8_t text_len = payload[arg];
+                memcpy(text, payload + arg + 1, text_len);
+                text[text_len] = '\0';
+                arg += 1 + text_len;
+                spec[spec_len] = 's';
+                spec[spec_len + 1] = '\0';
+                n = snprintf(out + pos, room, spec, text);
+            }
+        } else if (type == 'p') {
+            if (exhausted || arg + 4 > payload_len) {
+                exhausted = true;
+            } else {
+                uint32_t v;
+                memcpy(&v, payload + arg, sizeof(v));
+                arg += sizeof(v);
+                n = snprintf(out + pos, room, "0x%08lx", (unsigned long)v);
+            }
+        } else {
+            // Unsupported conversion: copy it through
+            n = snprintf(out + pos, room, "%.*s", (int)(fmt - start), start);
+        }
+        if (exhausted) {
+            n = snprintf(out + pos, room, "?");
+        }
+        
+        if (n > 0) {
+            pos += (size_t)n < room ? (size_t)n : room - 1;
+        }
+    }
+    out[pos] = '\0';
+    return pos;
+}
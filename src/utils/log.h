@@ -0,0 +1,173 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <type_traits>
+#include "../config.h"
+
+enum LogLevel : uint8_t {
+    LOG_LEVEL_OFF = 0,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_COUNT
+};
+
+enum LogModule : uint8_t {
+    LOG_SENSORS = 0,
+    LOG_CONTROL,
+    LOG_HTTP,
+    LOG_TCP,
+    LOG_NET,
+    LOG_STORAGE,
+    LOG_STATUS,         // Periodic status table
+    LOG_SYSTEM,
+    LOG_MODULE_COUNT
+};
+
+// Deferred logger. A log site stores the address of its format string and
+// the raw argument bytes in the calling core's ring; core 1 formats them
+// later in drain(), or sends them as binary frames that
+// tools/log_decode.py formats on the host from the firmware ELF. Levels are
+// per module and can be changed at runtime.
+//
+// Argument encoding (little endian), by C++ type:
+//   integers of up to 4 bytes    4 bytes (sign- or zero-extended)
+//   8-byte integers              8 bytes
+//   float, double                8-byte double
+//   const char*                  uint8 length + bytes (at most LOG_MAX_STRING)
+//   other pointers               4-byte address
+// The formatter walks the printf conversions of the format string to read
+// them back, so formats must match their arguments (LOG_* checks this at
+// compile time like printf).
+//
+// Binary frame: 0x1E 'L', uint32 time_ms, uint32 format address, uint8
+// module, uint8 level, uint8 core, uint8 payload length, payload, uint8 sum
+// of every byte after 'L'.
+class Log {
+public:
+    static bool enabled(LogModule module, LogLevel level) { return level <= levels_[module]; }
+    
+    static void setLevel(LogModule module, LogLevel level) { levels_[module] = level; }
+    static LogLevel getLevel(LogModule module) { return (LogLevel)levels_[module]; }
+    
+    // Format up to max_records from each core's ring to stdio; core 1 only
+    static void drain(uint32_t max_records);
+    
+    static void setBinaryOutput(bool binary) { binary_output_ = binary; }
+    static bool isBinaryOutput() { return binary_output_; }
+    
+    static uint32_t getDropped(uint8_t core) { return rings_[core].dropped; }
+    static uint32_t getPending(uint8_t core) { return rings_[core].head - rings_[core].tail; }
+    
+    static const char* getModuleName(uint8_t module);
+    static const char* getLevelName(uint8_t level);
+    static bool parseModuleName(const char* name, LogModule* module);
+    static bool parseLevelName(const char* name, LogLevel* level);
+    
+    // Format one record into out (always terminated); also used for tests
+    static size_t format(const char* fmt, const uint8_t* payload, size_t payload_len, char* out, size_t size);
+    
+    template <typename... Args>
+    static void record(LogModule module, LogLevel level, const char* fmt, const Args&... args) {
+        Payload payload;
+        payload.len = 0;
+        payload.full = false;
+        (payload.put(args), ...);
+        write(module, level, fmt, payload.data, payload.len);
+    }
+    
+private:
+    struct Header {
+        uint32_t time_ms;
+        const char* fmt;
+        uint8_t module;
+        uint8_t level;
+        uint8_t payload_len;
+        uint8_t reserved;
+    };
+    
+    // Written by its own core (thread and IRQ), consumed by core 1
+    struct Ring {
+        volatile uint32_t head;
+        volatile uint32_t tail;
+        volatile uint32_t dropped;
+        uint8_t data[LOG_RING_BYTES];
+    };
+    
+    // Argument encoder; once an argument does not fit the rest are dropped
+    // and print as "?"
+    struct Payload {
+        uint8_t data[LOG_MAX_PAYLOAD];
+        size_t len;
+        bool full;
+        
+        void putBytes(const void* src, size_t size) {
+            if (full || len + size > LOG_MAX_PAYLOAD) {
+                full = true;
+                return;
+            }
+            memcpy(data + len, src, size);
+            len += size;
+        }
+        
+        void putString(const char* s) {
+            if (!s) s = "(null)";
+            const uint8_t n = (uint8_t)strnlen(s, LOG_MAX_STRING);
+            if (full || len + 1 + n > LOG_MAX_PAYLOAD) {
+                full = true;
+                return;
+            }
+            putBytes(&n, 1);
+            putBytes(s, n);
+        }
+        
+        template <typename T>
+        void put(const T& value) {
+            if constexpr (std::is_floating_point<T>::value) {
+                const double d = value;
+                putBytes(&d, sizeof(d));
+            } else if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+                if constexpr (sizeof(T) > 4) {
+                    const uint64_t v = (uint64_t)value;
+                    putBytes(&v, sizeof(v));
+                } else {
+                    const uint32_t v = std::is_signed<T>::value ? (uint32_t)(int32_t)value : (uint32_t)value;
+                    putBytes(&v, sizeof(v));
+                }
+            } else if constexpr (std::is_convertible<T, const char*>::value) {
+                putString(value);
+            } else {
+                static_assert(std::is_pointer<T>::value, "unsupported log argument type");
+                const uint32_t v = (uint32_t)(uintptr_t)value;
+                putBytes(&v, sizeof(v));
+            }
+        }
+    };
+    
+    static void write(LogModule module, LogLevel level, const char* fmt, const uint8_t* payload, size_t len);
+    static void copyIn(Ring& ring, uint32_t pos, const void* src, size_t len);
+    static void copyOut(const Ring& ring, uint32_t pos, void* dst, size_t len);
+    static void emit(uint8_t core, const Header& header, const uint8_t* payload);
+    
+    static volatile uint8_t levels_[LOG_MODULE_COUNT];
+    static volatile bool binary_output_;
+    static Ring rings_[2];
+};
+
+// The dead printf call only type-checks the arguments against the format
+#define LOG_AT(level, module, fmt, ...) do { \
+    if (Log::enabled((module), (level))) { \
+        if (false) printf(fmt, ##__VA_ARGS__); \
+        Log::record((module), (level), fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+#define LOG_ERROR(module, fmt, ...) LOG_AT(LOG_LEVEL_ERROR, module, fmt, ##__VA_ARGS__)
+#define LOG_WARN(module, fmt, ...)  LOG_AT(LOG_LEVEL_WARN, module, fmt, ##__VA_ARGS__)
+#define LOG_INFO(module, fmt, ...)  LOG_AT(LOG_LEVEL_INFO, module, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(module, fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, module, fmt, ##__VA_ARGS__)
@@ -0,0 +1,157 @@
+#include "lttb.h"
+
+LttbDownsampler::LttbDownsampler()
+    : end_time_(0), points_(3), first_time_(0), width_(1), started_(false), current_(0) {
+    selected_.time = 0;
+    selected_.value = 0;
+    last_ = selected_;
+    clearBucket(&buckets_[0], 0);
+    clearBucket(&buckets_[1], 0);
+}
+
+void LttbDownsampler::begin(uint32_t end_time, uint16_t points) {
+    end_time_ = end_time;
+    points_ = points < 3 ? 3 : points;
+    started_ = false;
+    current_ = 0;
+    clearBucket(&buckets_[0], 0);
+    clearBucket(&buckets_[1], 0);
+}
+
+void LttbDownsampler::clearBucket(Bucket* bucket, uint32_t index) {
+    bucket->index = index;
+    bucket->count = 0;
+    bucket->sum_x = 0;
+    bucket->sum_y = 0;
+    bucket->upper_count = 0;
+    bucket->lower_count = 0;
+}
+
+int64_t LttbDownsampler::cross(const LttbPoint& o, const LttbPoint& a, const LttbPoint& b) {
+    return ((int64_t)a.time - o.time) * ((int64_t)b.value - o.value) -
+           ((int64_t)a.value - o.value) * ((int64_t)b.time - o.time);
+}
+
+void LttbDownsampler::pushHull(LttbPoint* hull, uint8_t* count, const LttbPoint& point, bool upper) {
+    // Monotone chain: drop vertices that no longer turn the right way
+    while (*count >= 2) {
+        int64_t turn = cross(hull[*count - 2], hull[*count - 1], point);
+        if (upper ? turn < 0 : turn > 0) break;
+        (*count)--;
+    }
+    // A full chain replaces its newest vertex (approximate from here on)
+    if (*count == HULL_MAX) (*count)--;
+    hull[(*count)++] = point;
+}
+
+void LttbDownsampler::addToBucket(Bucket* bucket, const LttbPoint& point) {
+    bucket->count++;
+    bucket->sum_x += point.time;
+    bucket->sum_y += point.value;
+    pushHull(bucket->upper, &bucket->upper_count, point, true);
+    pushHull(bucket->lower, &bucket->lower_count, point, false);
+}
+
+LttbPoint LttbDownsampler::select(const Bucket& bucket, int64_t cx, int64_t cy) const {
+    const int64_t ax = selected_.time;
+    const int64_t ay = selected_.value;
+    
+    LttbPoint best = bucket.upper[0];
+    int64_t best_area = -1;
+    for (uint8_t chain = 0; chain < 2; chain++) {
+        const LttbPoint* hull = chain == 0 ? bucket.upper : bucket.lower;
+        const uint8_t count = chain == 0 ? bucket.upper_count : bucket.lower_count;
+        for (uint8_t i = 0; i < count; i++) {
+            // Twice the triangle area A-B-C
+            int64_t area = (ax - cx) * ((int64_t)hull[i].value - ay) - (ax - (int64_t)hull[i].time) * (cy - ay);
+            if (area < 0) area = -area;
+            if (area > best_area) {
+                best_area = area;
+                best = hull[i];
+            }
+        }
+    }
+    return best;
+}
+
+void LttbDownsampler::emit(const LttbPoint& point, LttbPoint* out) {
+    selected_ = point;
+    *out = point;
+}
+
+bool LttbDownsampler::push(uint32_t time, int16_t value, LttbPoint* out) {
+    LttbPoint point;
+    point.time = time;
+    point.value = value;
+    
+    if (!started_) {
+        // The first sample is always kept and anchors the bucket grid
+        started_ = true;
+        first_time_ = time;
+        const uint32_t span = end_time_ > time ? end_time_ - time : 0;
+        const uint32_t buckets = points_ - 2;
+        width_ = (span + buckets - 1) / buckets;
+        if (width_ == 0) width_ = 1;
+        last_ = point;
+        emit(point, out);
+        return true;
+    }
+    last_ = point;
+    
+    const uint32_t index = (time - first_time_) / width_;
+    Bucket& current = buckets_[current_];
+    Bucket& next = buckets_[current_ ^ 1];
+    
+    if (current.count == 0) {
+        clearBucket(&current, index);
+        addToBucket(&current, point);
+        return false;
+    }
+    if (next.count == 0 && index == current.index) {
+        addToBucket(&current, point);
+        return false;
+    }
+    if (next.count == 0 || index == next.index) {
+        if (next.count == 0) clearBucket(&next, index);
+        addToBucket(&next, point);
+        return false;
+    }
+    
+    // The next bucket is complete: select from the current one against its
+    // average, then shift
+    emit(select(current, next.sum_x / next.count, next.sum_y / next.count), out);
+    clearBucket(&current, index);
+    addToBucket(&current, point);
+    current_ ^= 1;
+    return true;
+}
+
+uint8_t LttbDownsampler::finish(LttbPoint out[3]) {
+    if (!started_) return 0;
+    started_ = false;
+    
+    uint8_t n = 0;
+    Bucket* current = &buckets_[current_];
+    Bucket* next = &buckets_[current_ ^ 1];
+    
+    if (current->count > 0 && next->count > 0) {
+        emit(select(*current, next->sum_x / next->count, next->sum_y / next->count), &out[n++]);
+        current = next;
+    }
+    
+    // The final bucket is weighed against the last sample, which is kept
+    if (current->count > 0) {
+        LttbPoint point = select(*current, last_.time, last_.value);
+        if (point.time != last_.time) {
+            emit(point, &out[n++]);
+        }
+    }
+    if (last_.time != selected_.time) {
+        emit(last_, &out[n++]);
+    }
+    
+    clearBucket(&buckets_[0], 0);
+    clearBucket(&buckets_[1], 0);
+    current_ = 0;
+    return n;
+}
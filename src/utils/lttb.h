@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct LttbPoint {
+    uint32_t time;
+    int16_t value;
+};
+
+// Streaming Largest-Triangle-Three-Buckets downsampler.
+//
+// Input must arrive in time order. [first sample, end_time] is split into
+// points - 2 equal time buckets; from each bucket the point forming the
+// largest triangle with the previously selected point and the average of the
+// next non-empty bucket is emitted as soon as that next bucket is complete.
+// The triangle area is linear in the candidate, so its maximum lies on the
+// bucket's convex hull: only the hull (built incrementally, since x is
+// monotonic) is kept, not the bucket itself. Memory is constant and each
+// sample costs O(1) amortized.
+class LttbDownsampler {
+public:
+    // Vertices kept per hull chain; exact while a bucket's hull fits
+    static const uint8_t HULL_MAX = 16;
+    
+    LttbDownsampler();
+    
+    // points >= 3; end_time is the expected time of the last sample
+    void begin(uint32_t end_time, uint16_t points);
+    
+    // Feed one sample; true when a point was selected into out
+    bool push(uint32_t time, int16_t value, LttbPoint* out);
+    
+    // Flush the remaining buckets and the last sample; returns up to 3 points
+    uint8_t finish(LttbPoint out[3]);
+    
+private:
+    struct Bucket {
+        uint32_t index;
+        uint32_t count;
+        int64_t sum_x;
+        int64_t sum_y;
+        LttbPoint upper[HULL_MAX];
+        LttbPoint lower[HULL_MAX];
+        uint8_t upper_count;
+        uint8_t lower_count;
+    };
+    
+    void clearBucket(Bucket* bucket, uint32_t index);
+    void addToBucket(Bucket* bucket, const LttbPoint& point);
+    LttbPoint select(const Bucket& bucket, int64_t cx, int64_t cy) const;
+    void emit(const LttbPoint& point, LttbPoint* out);
+    static int64_t cross(const LttbPoint& o, const LttbPoint& a, const LttbPoint& b);
+    static void pushHull(LttbPoint* hull, uint8_t* count, const LttbPoint& point, bool upper);
+    
+    uint32_t end_time_;
+    uint16_t points_;
+    uint32_t first_time_;
+    uint32_t width_;            // Seconds per bucket
+    bool started_;
+    LttbPoint selected_;        // Previously emitted point (triangle vertex A)
+    LttbPoint last_;            // Most recent input sample
+    Bucket buckets_[2];         // Current (being selected) and next (averaged)
+    uint8_t current_;
+};
@@ -0,0 +1,66 @@
+#include "mem_pool.h"
+
+// Every request-path pool, including the per-connection arenas that live in
+// the servers, must fit the budget
+static_assert(WEB_REQUEST_ARENA_BYTES + TCP_REQUEST_ARENA_BYTES +
+              JSON_POOL_BLOCKS * JSON_POOL_BLOCK_BYTES +
+              UPLOAD_POOL_BLOCKS * UPLOAD_POOL_BLOCK_BYTES <= REQUEST_RAM_BUDGET_BYTES,
+              "request pools exceed REQUEST_RAM_BUDGET_BYTES");
+static_assert(JSON_POOL_BLOCKS <= 32 && UPLOAD_POOL_BLOCKS <= 32, "BlockPool holds at most 32 blocks");
+
+alignas(8) static uint8_t json_storage[JSON_POOL_BLOCKS * JSON_POOL_BLOCK_BYTES];
+alignas(8) static uint8_t upload_storage[UPLOAD_POOL_BLOCKS * UPLOAD_POOL_BLOCK_BYTES];
+
+MemPool* MemPool::first_ = nullptr;
+
+BlockPool g_json_pool("json", json_storage, JSON_POOL_BLOCK_BYTES, JSON_POOL_BLOCKS);
+BlockPool g_upload_pool("upload", upload_storage, UPLOAD_POOL_BLOCK_BYTES, UPLOAD_POOL_BLOCKS);
+
+MemPool::MemPool(const char* name, uint32_t capacity)
+    : name_(name), capacity_(capacity), used_(0), peak_(0), failed_(0), next_(nullptr) {
+    // Appended, so `mem` lists pools in construction order
+    MemPool** link = &first_;
+    while (*link) link = &(*link)->next_;
+    *link = this;
+}
+
+Arena::Arena(const char* name, uint8_t* buffer, size_t size)
+    : MemPool(name, size), buffer_(buffer), size_(size), offset_(0) {
+}
+
+void* Arena::alloc(size_t size, size_t align) {
+    const uintptr_t base = (uintptr_t)buffer_;
+    const uintptr_t start = (base + offset_ + align - 1) & ~(uintptr_t)(align - 1);
+    if (start + size > base + size_) {
+        addFailed();
+        return nullptr;
+    }
+    offset_ = start + size - base;
+    setUsed(offset_);
+    return (void*)start;
+}
+
+BlockPool::BlockPool(const char* name, uint8_t* storage, size_t block_size, uint8_t block_count)
+    : MemPool(name, block_size * block_count), storage_(storage), block_size_(block_size),
+      block_count_(block_count),
+      free_mask_(block_count >= 32 ? 0xFFFFFFFFUL : (1UL << block_count) - 1) {
+}
+
+void* BlockPool::alloc() {
+    if (free_mask_ == 0) {
+        addFailed();
+        return nullptr;
+    }
+    const uint8_t index = (uint8_t)__builtin_ctz(free_mask_);
+    free_mask_ &= ~(1UL << index);
+    setUsed(getUsed() + block_size_);
+    return storage_ + index * block_size_;
+}
+
+void BlockPool::release(void* block) {
+    if (!block) return;
+    const size_t index = ((uint8_t*)block - storage_) / block_size_;
+    if (index >= block_count_ || (free_mask_ & (1UL << index))) return;  // Not ours, or already free
+    free_mask_ |= 1UL << index;
+    setUsed(getUsed() - block_size_);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include "../config.h"
+
+// Fixed request-path memory, sized at compile time so that worst-case use
+// is known up front and weeks of uptime cannot fragment the heap. Every
+// pool registers itself for `mem` and /api/mem. Pools are used from core 1
+// only (lwIP callbacks and the core 1 loop), so they take no locks.
+class MemPool {
+public:
+    const char* getName() const { return name_; }
+    uint32_t getCapacity() const { return capacity_; }
+    uint32_t getUsed() const { return used_; }
+    uint32_t getPeak() const { return peak_; }
+    uint32_t getFailed() const { return failed_; }
+    
+    static const MemPool* getFirst() { return first_; }
+    const MemPool* getNext() const { return next_; }
+    
+protected:
+    MemPool(const char* name, uint32_t capacity);
+    
+    void setUsed(uint32_t used) {
+        used_ = used;
+        if (used > peak_) peak_ = used;
+    }
+    void addFailed() { failed_++; }
+    
+private:
+    const char* name_;
+    uint32_t capacity_;
+    uint32_t used_;
+    uint32_t peak_;
+    uint32_t failed_;
+    MemPool* next_;
+    
+    static MemPool* first_;
+};
+
+// Bump allocator over a caller-provided buffer; everything is released at
+// once by reset(). One per connection, reset when its request completes.
+class Arena : public MemPool {
+public:
+    Arena(const char* name, uint8_t* buffer, size_t size);
+    
+    void* alloc(size_t size, size_t align = 8);
+    
+    // Construct an object in the arena (nullptr when full). Call its
+    // destructor before reset(); the memory itself is never freed singly.
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        void* p = alloc(sizeof(T), alignof(T));
+        return p ? new (p) T(std::forward<Args>(args)...) : nullptr;
+    }
+    
+    void reset() { offset_ = 0; setUsed(0); }
+    
+private:
+    uint8_t* buffer_;
+    size_t size_;
+    size_t offset_;
+};
+
+// Fixed-size blocks (at most 32) with a free mask
+class BlockPool : public MemPool {
+public:
+    BlockPool(const char* name, uint8_t* storage, size_t block_size, uint8_t block_count);
+    
+    void* alloc();
+    void release(void* block);
+    size_t getBlockSize() const { return block_size_; }
+    
+private:
+    uint8_t* storage_;
+    size_t block_size_;
+    uint8_t block_count_;
+    uint32_t free_mask_;
+};
+
+// Shared request-path pools
+extern BlockPool g_json_pool;      // JSON response bodies (JSON_POOL_BLOCK_BYTES each)
+extern BlockPool g_upload_pool;    // TCP upload staging before each flash write
@@ -0,0 +1,161 @@
+#include "mem_stats.h"
+#include "pico/stdlib.h"
+#include "pico/critical_section.h"
+#include "hardware/sync.h"
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Linker symbols (pico memmap_default.ld). multicore_launch_core1() puts
+// core 1's stack in SCRATCH_X; core 0's is in SCRATCH_Y.
+extern "C" {
+extern uint8_t __end__;
+extern uint8_t __HeapLimit;
+extern uint32_t __StackBottom;
+extern uint32_t __StackTop;
+extern uint32_t __StackOneBottom;
+extern uint32_t __StackOneTop;
+}
+
+static const uint32_t STACK_PAINT = 0x5741434BUL;  // "KCAW"
+
+// Left unpainted below the painter's own frame
+static const uint32_t STACK_PAINT_MARGIN = 64;
+
+// Size prefix on blocks from alloc(), keeping malloc's 8-byte alignment
+static const size_t ALLOC_HEADER = 8;
+
+static critical_section_t alloc_lock;
+
+volatile uint32_t MemStats::alloc_current_ = 0;
+volatile uint32_t MemStats::alloc_peak_ = 0;
+volatile uint32_t MemStats::alloc_count_ = 0;
+volatile uint32_t MemStats::alloc_failed_ = 0;
+volatile bool MemStats::painted_[2] = {false, false};
+
+#if LWIP_STATS && MEMP_STATS
+static const char* const POOL_NAMES[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name, num, size, desc) #name,
+#include "lwip/priv/memp_std.h"
+};
+#endif
+
+static void stackBounds(uint8_t core, uint32_t** bottom, uint32_t** top) {
+    if (core == 0) {
+        *bottom = &__StackBottom;
+        *top = &__StackTop;
+    } else {
+        *bottom = &__StackOneBottom;
+        *top = &__StackOneTop;
+    }
+}
+
+void MemStats::begin() {
+    critical_section_init(&alloc_lock);
+    paintStack();
+}
+
+void MemStats::paintStack() {
+    const uint8_t core = get_core_num();
+    uint32_t* bottom;
+    uint32_t* top;
+    stackBounds(core, &bottom, &top);
+    
+    uint32_t marker;
+    uint32_t* limit = (uint32_t*)((uintptr_t)&marker - STACK_PAINT_MARGIN);
+    if (limit > top) limit = top;
+    
+    // An interrupt taken now would push its frame into the painted area
+    const uint32_t ints = save_and_disable_interrupts();
+    for (volatile uint32_t* p = bottom; p < limit; p++) {
+        *p = STACK_PAINT;
+    }
+    restore_interrupts(ints);
+    painted_[core] = true;
+}
+
+bool MemStats::getStack(uint8_t core, StackStats* out) {
+    if (core > 1) return false;
+    
+    uint32_t* bottom;
+    uint32_t* top;
+    stackBounds(core, &bottom, &top);
+    out->size = (uint32_t)((uintptr_t)top - (uintptr_t)bottom);
+    out->painted = painted_[core];
+    out->peak = 0;
+    if (!out->painted) return true;
+    
+    // The stack grows down: the first overwritten word from the bottom
+    // marks the deepest point reached
+    const volatile uint32_t* p = bottom;
+    while (p < top && *p == STACK_PAINT) p++;
+    out->peak = (uint32_t)((uintptr_t)top - (uintptr_t)p);
+    return true;
+}
+
+void* MemStats::alloc(size_t size) {
+    uint8_t* block = (uint8_t*)malloc(size + ALLOC_HEADER);
+    
+    critical_section_enter_blocking(&alloc_lock);
+    if (!block) {
+        alloc_failed_ = alloc_failed_ + 1;
+    } else {
+        alloc_count_ = alloc_count_ + 1;
+        alloc_current_ = alloc_current_ + size;
+        if (alloc_current_ > alloc_peak_) alloc_peak_ = alloc_current_;
+    }
+    critical_section_exit(&alloc_lock);
+    
+    if (!block) return nullptr;
+    memcpy(block, &size, sizeof(size));
+    return block + ALLOC_HEADER;
+}
+
+void MemStats::release(void* ptr) {
+    if (!ptr) return;
+    uint8_t* block = (uint8_t*)ptr - ALLOC_HEADER;
+    size_t size;
+    memcpy(&size, block, sizeof(size));
+    
+    critical_section_enter_blocking(&alloc_lock);
+    alloc_current_ = alloc_current_ - size;
+    critical_section_exit(&alloc_lock);
+    
+    free(block);
+}
+
+void MemStats::getHeap(HeapStats* out) {
+    struct mallinfo info = mallinfo();
+    out->size = (uint32_t)(&__HeapLimit - &__end__);
+    out->arena = (uint32_t)info.arena;
+    out->in_use = (uint32_t)info.uordblks;
+    out->free = (uint32_t)info.fordblks;
+    out->free_chunks = (uint32_t)info.ordblks;
+}
+
+bool MemStats::getPool(uint8_t index, PoolStats* out) {
+#if LWIP_STATS && MEM_STATS && MEMP_STATS
+    const struct stats_mem* stats;
+    if (index == 0) {
+        out->name = "HEAP";
+        stats = &lwip_stats.mem;
+    } else if (index <= MEMP_MAX) {
+        out->name = POOL_NAMES[index - 1];
+        stats = lwip_stats.memp[index - 1];
+        if (!stats) return false;
+    } else {
+        return false;
+    }
+    out->avail = stats->avail;
+    out->used = stats->used;
+    out->max = stats->max;
+    out->err = stats->err;
+    return true;
+#else
+    (void)index;
+    (void)out;
+    return false;
+#endif
+}
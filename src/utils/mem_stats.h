@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../config.h"
+
+// newlib heap, from mallinfo() and the linker's heap bounds
+struct HeapStats {
+    uint32_t size;          // __end__ to __HeapLimit
+    uint32_t arena;         // Claimed from the heap so far (sbrk)
+    uint32_t in_use;        // Allocated bytes, including malloc overhead
+    uint32_t free;          // Free bytes inside the arena
+    uint32_t free_chunks;   // Free chunks inside the arena (fragmentation)
+};
+
+// One core's stack, measured against the paint pattern
+struct StackStats {
+    uint32_t size;
+    uint32_t peak;          // Deepest use seen since painting
+    bool painted;
+};
+
+// lwIP heap (index 0) or one memp pool
+struct PoolStats {
+    const char* name;
+    uint32_t avail;
+    uint32_t used;
+    uint32_t max;
+    uint32_t err;
+};
+
+// Memory usage for `mem` and /api/mem: the newlib heap, buffers allocated
+// through alloc() (peak and failures), per-core stack high-water marks and
+// lwIP's MEM/MEMP pools. Any core may read; alloc() and release() are safe
+// from either core and from lwIP callbacks.
+class MemStats {
+public:
+    // Set up the allocation lock and paint core 0's stack; call first thing
+    static void begin();
+    
+    // Fill the unused part of the calling core's stack with a pattern; call
+    // once from core 1 on entry (begin() covers core 0)
+    static void paintStack();
+    
+    // malloc()/free() for runtime buffers, counting current and peak bytes
+    // and failed requests. Blocks from alloc() must go back through release().
+    static void* alloc(size_t size);
+    static void release(void* ptr);
+    
+    static uint32_t getAllocCurrent() { return alloc_current_; }
+    static uint32_t getAllocPeak() { return alloc_peak_; }
+    static uint32_t getAllocCount() { return alloc_count_; }
+    static uint32_t getAllocFailed() { return alloc_failed_; }
+    
+    static void getHeap(HeapStats* out);
+    static bool getStack(uint8_t core, StackStats* out);
+    
+    // Pool 0 is lwIP's heap; false past the last pool or with LWIP_STATS 0
+    static bool getPool(uint8_t index, PoolStats* out);
+    
+private:
+    static volatile uint32_t alloc_current_;
+    static volatile uint32_t alloc_peak_;
+    static volatile uint32_t alloc_count_;
+    static volatile uint32_t alloc_failed_;
+    static volatile bool painted_[2];
+};
@@ -0,0 +1,101 @@
+#include "metrics.h"
+#include "clock.h"
+#include "pico/stdlib.h"
+#include <string.h>
+
+static const char* const RELAY_NAMES[METRICS_RELAY_COUNT] = {
+    "lights", "pump", "heater", "fan"
+};
+
+Metrics& Metrics::getInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+Metrics::Metrics()
+    : last_update_ms_(0), window_start_ms_(0), relay_mask_(0), started_(false), generation_(0) {
+    memset((void*)counters_, 0, sizeof(counters_));
+    memset(last_iterations_, 0, sizeof(last_iterations_));
+    memset(last_busy_us_, 0, sizeof(last_busy_us_));
+    memset(loop_, 0, sizeof(loop_));
+    memset(relay_on_ms_, 0, sizeof(relay_on_ms_));
+    memset(window_on_ms_, 0, sizeof(window_on_ms_));
+    memset(relay_duty_, 0, sizeof(relay_duty_));
+}
+
+const char* Metrics::getRelayName(uint8_t relay) {
+    return relay < METRICS_RELAY_COUNT ? RELAY_NAMES[relay] : "unknown";
+}
+
+void Metrics::recordLoop(uint32_t busy_us) {
+    LoopCounter& counter = counters_[get_core_num()];
+    if (counter.reset_max) {
+        counter.max_us = 0;
+        counter.reset_max = false;
+    }
+    if (busy_us > counter.max_us) counter.max_us = busy_us;
+    counter.busy_us = counter.busy_us + busy_us;
+    counter.iterations = counter.iterations + 1;
+}
+
+void Metrics::update(uint8_t relay_mask) {
+    const uint64_t now = Clock::nowMs();
+    if (!started_) {
+        started_ = true;
+        last_update_ms_ = now;
+        window_start_ms_ = now;
+        relay_mask_ = relay_mask;
+        return;
+    }
+    
+    // The mask held since the previous call
+    const uint32_t elapsed = (uint32_t)(now - last_update_ms_);
+    if (elapsed > 0) {
+        for (uint8_t relay = 0; relay < METRICS_RELAY_COUNT; relay++) {
+            if (relay_mask_ & (1u << relay)) window_on_ms_[relay] += elapsed;
+        }
+        last_update_ms_ = now;
+    }
+    relay_mask_ = relay_mask;
+    
+    if (now - window_start_ms_ >= METRICS_WINDOW_MS) {
+        closeWindow(now);
+    }
+}
+
+void Metrics::closeWindow(uint64_t now_ms) {
+    const uint32_t window_ms = (uint32_t)(now_ms - window_start_ms_);
+    window_start_ms_ = now_ms;
+    
+    for (uint8_t core = 0; core < 2; core++) {
+        LoopCounter& counter = counters_[core];
+        const uint32_t iterations = counter.iterations;
+        const uint32_t busy_us = counter.busy_us;
+        const uint32_t passes = iterations - last_iterations_[core];
+        const uint32_t busy = busy_us - last_busy_us_[core];
+        last_iterations_[core] = iterations;
+        last_busy_us_[core] = busy_us;
+    
+        LoopWindow& window = loop_[core];
+        window.iterations += passes;
+        window.busy_us += busy;
+        window.avg_us = passes > 0 ? busy / passes : 0;
+        window.max_us = counter.max_us;
+        counter.reset_max = true;
+    }
+    
+    // Exponential average of the on fraction over METRICS_DUTY_WINDOW_SEC
+    const float alpha = (float)window_ms / (METRICS_DUTY_WINDOW_SEC * 1000.0f);
+    for (uint8_t relay = 0; relay < METRICS_RELAY_COUNT; relay++) {
+        const float on = window_ms > 0 ? (float)window_on_ms_[relay] / window_ms : 0.0f;
+        if (generation_ == 0) {
+            relay_duty_[relay] = on;
+        } else {
+            relay_duty_[relay] += (on - relay_duty_[relay]) * (alpha < 1.0f ? alpha : 1.0f);
+        }
+        relay_on_ms_[relay] += window_on_ms_[relay];
+        window_on_ms_[relay] = 0;
+    }
+    
+    generation_ = generation_ + 1;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../config.h"
+
+// Relays in RELAY_* bit order
+#define METRICS_RELAY_COUNT 4
+
+// Loop statistics of one core over the last closed window
+struct LoopWindow {
+    uint64_t iterations;       // Since boot
+    uint64_t busy_us;          // Since boot
+    uint32_t avg_us;           // Last window
+    uint32_t max_us;           // Last window
+};
+
+// Runtime statistics for /metrics. Both cores record loop passes; core 1
+// folds them, together with relay on-time, into a snapshot once per
+// METRICS_WINDOW_MS and bumps the generation, so renderers can cache their
+// output until the generation moves.
+class Metrics {
+public:
+    static Metrics& getInstance();
+    
+    // Busy time of one loop pass on the calling core
+    void recordLoop(uint32_t busy_us);
+    
+    // Core 1: integrate relay on-time and close windows
+    void update(uint8_t relay_mask);
+    
+    uint32_t getGeneration() const { return generation_; }
+    
+    // Snapshot as of the last closed window (core 1)
+    const LoopWindow& getLoop(uint8_t core) const { return loop_[core]; }
+    uint64_t getRelayOnMs(uint8_t relay) const { return relay_on_ms_[relay]; }
+    float getRelayDuty(uint8_t relay) const { return relay_duty_[relay]; }
+    static const char* getRelayName(uint8_t relay);
+    
+private:
+    Metrics();
+    
+    // Written by its own core only; read when core 1 closes a window
+    struct LoopCounter {
+        volatile uint32_t iterations;
+        volatile uint32_t busy_us;     // Wraps; windows use differences
+        volatile uint32_t max_us;
+        volatile bool reset_max;       // Set by core 1, cleared by the owner
+    };
+    
+    void closeWindow(uint64_t now_ms);
+    
+    LoopCounter counters_[2];
+    uint32_t last_iterations_[2];
+    uint32_t last_busy_us_[2];
+    
+    LoopWindow loop_[2];
+    uint64_t relay_on_ms_[METRICS_RELAY_COUNT];
+    uint32_t window_on_ms_[METRICS_RELAY_COUNT];
+    float relay_duty_[METRICS_RELAY_COUNT];
+    
+    uint64_t last_update_ms_;
+    uint64_t window_start_ms_;
+    uint8_t relay_mask_;
+    bool started_;
+    volatile uint32_t generation_;
+};
@@ -0,0 +1,118 @@
+#include "perf.h"
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include <string.h>
+
+static const char* const STAGE_NAMES[PERF_STAGE_COUNT] = {
+    "loop", "sensors", "ds18b20", "sht30", "dht22", "nrf24",
+    "lights", "pump", "heater", "fan"
+};
+
+Perf::Stage Perf::stages_[PERF_STAGE_COUNT];
+
+void Perf::begin() {
+#if PERF_ENABLED && defined(__ARM_ARCH_8M_MAIN__)
+    m33_hw->demcr |= M33_DEMCR_TRCENA_BITS;
+    m33_hw->dwt_cyccnt = 0;
+    m33_hw->dwt_ctrl |= M33_DWT_CTRL_CYCCNTENA_BITS;
+#endif
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++) {
+        stages_[i].reset = true;
+    }
+}
+
+void Perf::record(PerfStage stage, uint32_t ticks) {
+    Stage& s = stages_[stage];
+    s.seq = s.seq + 1;
+    __dmb();
+    
+    if (s.reset) {
+        s.count = 0;
+        s.total_ticks = 0;
+        s.min_ticks = UINT32_MAX;
+        s.max_ticks = 0;
+        memset(s.hist, 0, sizeof(s.hist));
+        s.reset = false;
+    }
+    
+    s.count++;
+    s.total_ticks += ticks;
+    if (ticks < s.min_ticks) s.min_ticks = ticks;
+    if (ticks > s.max_ticks) s.max_ticks = ticks;
+    // Index of the highest set bit; 0 and 1 tick both land in bucket 0
+    s.hist[31 - __builtin_clz(ticks | 1)]++;
+    
+    __dmb();
+    s.seq = s.seq + 1;
+}
+
+bool Perf::snapshot(PerfStage stage, PerfSnapshot* out) {
+    if (stage >= PERF_STAGE_COUNT) return false;
+    const Stage& s = stages_[stage];
+    
+    // A record() takes well under a microsecond, so a few retries suffice
+    for (int attempt = 0; attempt < 8; attempt++) {
+        const uint32_t seq = s.seq;
+        if (seq & 1) continue;
+        __dmb();
+        
+        out->count = s.count;
+        out->total_ticks = s.total_ticks;
+        out->min_ticks = s.count > 0 ? s.min_ticks : 0;
+        out->max_ticks = s.max_ticks;
+        memcpy(out->hist, s.hist, sizeof(out->hist));
+        
+        __dmb();
+        if (s.seq == seq) return !s.reset;
+    }
+    return false;
+}
+
+void Perf::requestReset() {
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++) {
+        stages_[i].reset = true;
+    }
+}
+
+uint64_t Perf::percentileTicks(const PerfSnapshot& snapshot, float fraction) {
+    const uint32_t target = (uint32_t)(snapshot.count * fraction + 0.5f);
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < PERF_HIST_BUCKETS; i++) {
+        seen += snapshot.hist[i];
+        if (seen >= target && seen > 0) return 2ULL << i;
+    }
+    return 0;
+}
+
+const char* Perf::getStageName(PerfStage stage) {
+    return stage < PERF_STAGE_COUNT ? STAGE_NAMES[stage] : "unknown";
+}
+
+bool Perf::parseStageName(const char* name, PerfStage* stage) {
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++) {
+        if (strcmp(name, STAGE_NAMES[i]) == 0) {
+            *stage = (PerfStage)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* Perf::getSource() {
+#if !PERF_ENABLED
+    return "disabled";
+#elif defined(__ARM_ARCH_8M_MAIN__)
+    return "dwt";
+#else
+    return "timer";
+#endif
+}
+
+uint32_t Perf::getTickHz() {
+#if PERF_ENABLED && defined(__ARM_ARCH_8M_MAIN__)
+    return clock_get_hz(clk_sys);
+#else
+    return 1000000;
+#endif
+}
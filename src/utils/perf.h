@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../config.h"
+#include "trace.h"
+
+// Profiled sections of the core 0 loop
+enum PerfStage : uint8_t {
+    PERF_LOOP = 0,          // Whole pass, excluding the idle wait
+    PERF_SENSORS,           // SensorManager::update()
+    PERF_READ_WATER,        // DS18B20 conversion start or readout
+    PERF_READ_TABLE,        // SHT30
+    PERF_READ_AIR,          // DHT22
+    PERF_READ_NANO,         // NRF24L01 pH/TDS packets
+    PERF_LIGHTS,
+    PERF_PUMP,
+    PERF_HEATER,
+    PERF_FAN,
+    PERF_STAGE_COUNT
+};
+
+static_assert((int)PERF_STAGE_COUNT == (int)TRACE_TCP_RECV, "PerfStage and TraceId must line up");
+
+// Latency buckets: bucket i counts passes of [2^i, 2^(i+1)) ticks
+#define PERF_HIST_BUCKETS 32
+
+// Consistent copy of one stage's statistics
+struct PerfSnapshot {
+    uint32_t count;
+    uint64_t total_ticks;
+    uint32_t min_ticks;
+    uint32_t max_ticks;
+    uint32_t hist[PERF_HIST_BUCKETS];
+};
+
+// Per-stage latency statistics for the core 0 loop. Ticks are CPU cycles
+// from the Cortex-M33 DWT counter (or microseconds from the system timer
+// on RISC-V builds). Only the owning core calls record(); other cores read
+// through snapshot(), which retries while a record is in progress, and ask
+// for a reset, which the owner applies on its next record.
+class Perf {
+public:
+    // Start the cycle counter on the calling core
+    static void begin();
+    
+    static inline uint32_t now();
+    static void record(PerfStage stage, uint32_t ticks);
+    
+    static bool snapshot(PerfStage stage, PerfSnapshot* out);
+    static void requestReset();
+    
+    // Upper bound of the histogram bucket holding the given fraction of passes
+    static uint64_t percentileTicks(const PerfSnapshot& snapshot, float fraction);
+    
+    static const char* getStageName(PerfStage stage);
+    static bool parseStageName(const char* name, PerfStage* stage);
+    static const char* getSource();
+    static uint32_t getTickHz();
+    static float ticksToUs(uint64_t ticks) { return (float)ticks * 1e6f / (float)getTickHz(); }
+    
+private:
+    struct Stage {
+        volatile uint32_t seq;     // Odd while record() is writing
+        volatile bool reset;
+        uint32_t count;
+        uint64_t total_ticks;
+        uint32_t min_ticks;
+        uint32_t max_ticks;
+        uint32_t hist[PERF_HIST_BUCKETS];
+    };
+    
+    static Stage stages_[PERF_STAGE_COUNT];
+};
+
+#if PERF_ENABLED
+
+#if defined(__ARM_ARCH_8M_MAIN__)
+#include "hardware/structs/m33.h"
+inline uint32_t Perf::now() { return m33_hw->dwt_cyccnt; }
+#else
+#include "hardware/timer.h"
+inline uint32_t Perf::now() { return time_us_32(); }
+#endif
+
+// Times the enclosing scope into one stage
+class PerfScope {
+public:
+    explicit PerfScope(PerfStage stage) : stage_(stage), start_(Perf::now()) {}
+    ~PerfScope() { Perf::record(stage_, Perf::now() - start_); }
+    
+private:
+    PerfStage stage_;
+    uint32_t start_;
+};
+
+#define PERF_CONCAT_(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+#define PERF_SCOPE(stage) PerfScope PERF_CONCAT(perf_scope_, __LINE__)(stage)
+// Times a statement and records it as a trace span
+#define PERF_STAGE(stage, statement) do { PERF_SCOPE(stage); TRACE_SCOPE((TraceId)(stage)); statement; } while (0)
+
+#else
+
+inline uint32_t Perf::now() { return 0; }
+#define PERF_SCOPE(stage) do {} while (0)
+#define PERF_STAGE(stage, statement) do { TRACE_SCOPE((TraceId)(stage)); statement; } while (0)
+
+#endif
@@ -1,9 +1,126 @@
 #include "time_utils.h"
+#include "trace.h"
 #include "pico/stdlib.h"
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
+
+// Local time anchored to the monotonic timer. Between anchor_us and
+// expires_us the wall clock advances 1:1 with time_us_64(), so seconds since
+// midnight is anchor_sod plus elapsed seconds. One cache per core keeps the
+// fast path lock-free.
+struct LocalTimeCache {
+    bool valid;
+    uint32_t generation;
+    uint64_t anchor_us;
+    uint32_t anchor_sod;
+    uint64_t expires_us;
+};
+
+static LocalTimeCache time_cache[2];
+volatile uint32_t TimeUtils::clock_generation_ = 1;
+
+static const time_t MIN_VALID_EPOCH = 1600000000;
+static const uint64_t UNSYNCED_RETRY_US = 1000000ULL;
+
+static void rebuildCache(LocalTimeCache* cache) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    const uint64_t now_us = time_us_64();
+    
+    cache->generation = TimeUtils::getClockGeneration();
+    
+    if (tv.tv_sec < MIN_VALID_EPOCH) {
+        cache->valid = false;
+        cache->expires_us = now_us + UNSYNCED_RETRY_US;
+        return;
+    }
+    
+    const time_t now = tv.tv_sec;
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    const uint32_t sod = (uint32_t)timeinfo.tm_hour * 3600U +
+                         (uint32_t)timeinfo.tm_min * 60U +
+                         (uint32_t)timeinfo.tm_sec;
+    
+    // Wall clock runs straight until the next local midnight...
+    uint32_t span = 86400U - sod;
+    
+    // ...unless a DST transition comes first; binary search for its second
+    struct tm end_info;
+    time_t end = now + span;
+    localtime_r(&end, &end_info);
+    if (end_info.tm_isdst != timeinfo.tm_isdst) {
+        time_t lo = now;
+        time_t hi = end;
+        while (hi - lo > 1) {
+            time_t mid = lo + (hi - lo) / 2;
+            struct tm mid_info;
+            localtime_r(&mid, &mid_info);
+            if (mid_info.tm_isdst == timeinfo.tm_isdst) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        span = (uint32_t)(hi - now);
+    }
+    
+    // Anchor on the whole second so the cached value ticks with time()
+    cache->anchor_us = now_us - (uint64_t)tv.tv_usec;
+    cache->anchor_sod = sod;
+    cache->expires_us = cache->anchor_us + (uint64_t)span * 1000000ULL;
+    cache->valid = true;
+}
+
+static LocalTimeCache* currentCache(uint64_t* now_us) {
+    LocalTimeCache* cache = &time_cache[get_core_num()];
+    *now_us = time_us_64();
+    
+    if (cache->generation != TimeUtils::getClockGeneration() || *now_us >= cache->expires_us) {
+        rebuildCache(cache);
+        *now_us = time_us_64();
+    }
+    return cache;
+}
 
 uint32_t TimeUtils::getSecondsFromMidnight() {
+    uint64_t now_us;
+    const LocalTimeCache* cache = currentCache(&now_us);
+    
+    if (!cache->valid) return 0;  // No valid time available
+    return cache->anchor_sod + (uint32_t)((now_us - cache->anchor_us) / 1000000ULL);
+}
+
+uint64_t TimeUtils::nextLocalTimeUs(uint32_t target_sod) {
+    uint64_t now_us;
+    const LocalTimeCache* cache = currentCache(&now_us);
+    
+    if (!cache->valid) return now_us + UNSYNCED_RETRY_US;
+    
+    // Whole seconds from the anchor to the next time the clock shows target_sod
+    const uint32_t elapsed = (uint32_t)((now_us - cache->anchor_us) / 1000000ULL);
+    const uint32_t sod = cache->anchor_sod + elapsed;
+    uint32_t ahead = (target_sod % 86400U + 86400U - sod % 86400U) % 86400U;
+    if (ahead == 0) ahead = 86400U;
+    
+    const uint64_t edge_us = cache->anchor_us + (uint64_t)(elapsed + ahead) * 1000000ULL;
+    
+    // Past the span the mapping from wall time to timer ticks changes
+    return edge_us < cache->expires_us ? edge_us : cache->expires_us;
+}
+
+void TimeUtils::invalidateCache() {
+    clock_generation_++;
+    __sev();  // Wake core 0 so schedules are re-planned on the new clock
+}
+
+extern "C" void time_utils_clock_stepped(void) {
+    TRACE_MARK(TRACE_SNTP_SET, 0);
+    TimeUtils::invalidateCache();
+}
+
+uint32_t TimeUtils::getSecondsFromMidnightUncached() {
     time_t now = time(nullptr);
     if (now < 1600000000) return 0;  // No valid time available
     
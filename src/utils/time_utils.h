@@ -5,8 +5,32 @@
 
 class TimeUtils {
 public:
+    // Local wall-clock seconds since midnight (0 if time is not synced).
+    // Served from a per-core cache that is rebuilt only at local midnight,
+    // at a DST transition, or after the system clock is stepped.
     static uint32_t getSecondsFromMidnight();
+    
+    // Direct time() + localtime_r() computation, bypassing the cache
+    static uint32_t getSecondsFromMidnightUncached();
+    
+    // time_us_64() at which local time next reads target_sod. Clamped to the
+    // end of the current cache span (midnight, DST shift) so callers re-plan
+    // there; a short retry while time is not synced.
+    static uint64_t nextLocalTimeUs(uint32_t target_sod);
+    
+    // Drop cached local time (SNTP step, TZ change)
+    static void invalidateCache();
+    
+    // Changes whenever cached local time is invalidated
+    static uint32_t getClockGeneration() { return clock_generation_; }
+    
     static uint32_t parseTimeToSeconds(const char* timeStr);
     static void secondsToTimeString(uint32_t seconds, char* buffer, size_t bufferSize);
     static bool isValidTimeString(const char* timeStr);
+    
+private:
+    static volatile uint32_t clock_generation_;
 };
+
+// C hook for lwIP's SNTP_SET_SYSTEM_TIME_US (see lwipopts.h)
+extern "C" void time_utils_clock_stepped(void);
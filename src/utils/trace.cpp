@@ -0,0 +1,142 @@
+#include "trace.h"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include <stdio.h>
+#include <string.h>
+
+// Longest formatted event, and the room read() needs for the header
+static const size_t RECORD_MAX = 128;
+static const size_t HEADER_MAX = 384;
+
+static const char* const TRACE_NAMES[TRACE_ID_COUNT] = {
+    "loop", "sensors", "ds18b20", "sht30", "dht22", "nrf24",
+    "lights", "pump", "heater", "fan",
+    "tcp_recv", "tcp_sent", "http_recv", "http_sent", "mqtt_in",
+    "flash_prog", "flash_erase", "sntp_set"
+};
+
+Trace::Ring Trace::rings_[2];
+volatile uint8_t Trace::paused_ = 0;
+
+void Trace::record(TraceId id, TracePhase phase, uint16_t arg) {
+    if (paused_) return;
+    
+    const uint32_t ints = save_and_disable_interrupts();
+    Ring& ring = rings_[get_core_num()];
+    const uint32_t head = ring.head;
+    TraceEvent& event = ring.events[head & (TRACE_RING_EVENTS - 1)];
+    event.time_us = time_us_32();
+    event.id = id;
+    event.phase = phase;
+    event.arg = arg;
+    __dmb();
+    ring.head = head + 1;
+    restore_interrupts(ints);
+}
+
+void Trace::pause() {
+    paused_ = paused_ + 1;
+    __dmb();
+}
+
+void Trace::resume() {
+    if (paused_ > 0) paused_ = paused_ - 1;
+}
+
+const char* Trace::getName(uint8_t id) {
+    return id < TRACE_ID_COUNT ? TRACE_NAMES[id] : "unknown";
+}
+
+TraceReader::TraceReader(bool binary)
+    : binary_(binary), part_(PART_HEADER), core_(0), events_(0) {
+    Trace::pause();
+    now_us_ = time_us_64();
+    now_lo_ = (uint32_t)now_us_;
+    
+    for (uint8_t core = 0; core < 2; core++) {
+        // Once a ring has wrapped, its oldest slot may be mid-overwrite by a
+        // write that began before the pause, so it is skipped
+        const uint32_t head = Trace::rings_[core].head;
+        const uint32_t count = head < TRACE_RING_EVENTS ? head : TRACE_RING_EVENTS - 1;
+        pos_[core] = head - count;
+        end_[core] = head;
+    }
+}
+
+TraceReader::~TraceReader() {
+    Trace::resume();
+}
+
+size_t TraceReader::formatEvent(const TraceEvent& event, char* out) {
+    if (binary_) {
+        memcpy(out, &event, sizeof(event));
+        return sizeof(event);
+    }
+    
+    int len = snprintf(out, RECORD_MAX, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":%u",
+                       Trace::getName(event.id), event.phase,
+                       (unsigned long long)unwrap(event.time_us), core_);
+    if (event.phase == TRACE_INSTANT) {
+        len += snprintf(out + len, RECORD_MAX - len, ",\"s\":\"t\"");
+    }
+    if (event.arg) {
+        len += snprintf(out + len, RECORD_MAX - len, ",\"args\":{\"arg\":%u}", event.arg);
+    }
+    len += snprintf(out + len, RECORD_MAX - len, "}");
+    return len;
+}
+
+size_t TraceReader::read(char* buffer, size_t max) {
+    size_t len = 0;
+    
+    while (part_ != PART_DONE) {
+        if (part_ == PART_HEADER) {
+            if (max < HEADER_MAX) break;
+            if (binary_) {
+                len += snprintf(buffer, max, "TRACE v1 cores=2 now_us=%llu names=",
+                                (unsigned long long)now_us_);
+                for (uint8_t id = 0; id < TRACE_ID_COUNT; id++) {
+                    len += snprintf(buffer + len, max - len, "%s%s", id ? "," : "", TRACE_NAMES[id]);
+                }
+                buffer[len++] = '\n';
+                part_ = PART_CORE;
+            } else {
+                len += snprintf(buffer, max,
+                                "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                                "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}},\n"
+                                "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"core 0\"}},\n"
+                                "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"core 1\"}}",
+                                NODE_ID);
+                part_ = PART_EVENTS;
+            }
+        } else if (part_ == PART_CORE) {
+            if (max - len < 8) break;
+            const uint32_t count = end_[core_] - pos_[core_];
+            buffer[len] = core_;
+            memset(buffer + len + 1, 0, 3);
+            memcpy(buffer + len + 4, &count, sizeof(count));
+            len += 8;
+            part_ = PART_EVENTS;
+        } else if (part_ == PART_EVENTS) {
+            const Trace::Ring& ring = Trace::rings_[core_];
+            while (pos_[core_] != end_[core_] && max - len >= RECORD_MAX) {
+                const TraceEvent event = ring.events[pos_[core_] & (TRACE_RING_EVENTS - 1)];
+                len += formatEvent(event, buffer + len);
+                pos_[core_]++;
+                events_++;
+            }
+            if (pos_[core_] != end_[core_]) break;
+            core_++;
+            part_ = core_ < 2 ? (binary_ ? PART_CORE : PART_EVENTS) : PART_FOOTER;
+        } else if (part_ == PART_FOOTER) {
+            if (max - len < 32) break;
+            if (binary_) {
+                len += snprintf(buffer + len, max - len, "OK: %lu events\n", (unsigned long)events_);
+            } else {
+                len += snprintf(buffer + len, max - len, "\n]}\n");
+            }
+            part_ = PART_DONE;
+        }
+    }
+    return len;
+}
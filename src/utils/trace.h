@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../config.h"
+
+// Traced sections. The first entries mirror PerfStage so PERF_STAGE probes
+// double as trace spans.
+enum TraceId : uint8_t {
+    TRACE_LOOP = 0,
+    TRACE_SENSORS,
+    TRACE_READ_WATER,
+    TRACE_READ_TABLE,
+    TRACE_READ_AIR,
+    TRACE_READ_NANO,
+    TRACE_LIGHTS,
+    TRACE_PUMP,
+    TRACE_HEATER,
+    TRACE_FAN,
+    TRACE_TCP_RECV,         // lwIP callbacks
+    TRACE_TCP_SENT,
+    TRACE_HTTP_RECV,
+    TRACE_HTTP_SENT,
+    TRACE_MQTT_IN,
+    TRACE_FLASH_PROG,       // Both cores stall while these run
+    TRACE_FLASH_ERASE,
+    TRACE_SNTP_SET,         // Instant: system clock stepped
+    TRACE_ID_COUNT
+};
+
+enum TracePhase : uint8_t {
+    TRACE_BEGIN = 'B',
+    TRACE_END = 'E',
+    TRACE_INSTANT = 'i',
+};
+
+// One ring entry; also the record format of binary dumps
+struct TraceEvent {
+    uint32_t time_us;       // Low 32 bits of time_us_64()
+    uint8_t id;             // TraceId
+    uint8_t phase;          // TracePhase
+    uint16_t arg;           // Event specific (flash block, bytes, ...)
+};
+
+static_assert(sizeof(TraceEvent) == 8, "TraceEvent layout changed");
+static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "TRACE_RING_EVENTS must be a power of two");
+
+// Fixed-size event rings, one per core. A core only writes its own ring
+// (interrupts masked for the few cycles of a write, since lwIP callbacks
+// run in IRQ context), so the cores never contend. Dumping pauses
+// recording until the dump ends; the newest TRACE_RING_EVENTS per core are
+// kept. Timestamps are 32-bit, so events older than ~71 minutes at dump
+// time come out with wrong times.
+class Trace {
+public:
+    static void record(TraceId id, TracePhase phase, uint16_t arg = 0);
+    
+    static void pause();
+    static void resume();
+    static bool isPaused() { return paused_ > 0; }
+    
+    // Events recorded by a core since boot (the ring keeps the newest)
+    static uint32_t getWritten(uint8_t core) { return rings_[core].head; }
+    
+    static const char* getName(uint8_t id);
+    
+private:
+    friend class TraceReader;
+    
+    struct Ring {
+        volatile uint32_t head;     // Events ever written
+        TraceEvent events[TRACE_RING_EVENTS];
+    };
+    
+    static Ring rings_[2];
+    static volatile uint8_t paused_;
+};
+
+// Streams both rings as Chrome trace-event JSON (open in Perfetto or
+// chrome://tracing) or as the compact binary format read by
+// tools/trace_convert.py:
+//   "TRACE v1 cores=2 now_us=<T> names=<n0,n1,..>\n"
+//   per core: uint8 core, uint8[3] 0, uint32 count, count x TraceEvent (LE)
+//   "OK: <N> events\n"
+// Recording stays paused while a reader exists.
+class TraceReader {
+public:
+    explicit TraceReader(bool binary);
+    ~TraceReader();
+    
+    // Fill buffer with whole records; 0 once everything has been read
+    size_t read(char* buffer, size_t max);
+    
+    uint32_t getEvents() const { return events_; }
+    
+private:
+    enum Part : uint8_t { PART_HEADER, PART_CORE, PART_EVENTS, PART_FOOTER, PART_DONE };
+    
+    size_t formatEvent(const TraceEvent& event, char* out);
+    uint64_t unwrap(uint32_t time_us) const { return now_us_ - (uint32_t)(now_lo_ - time_us); }
+    
+    bool binary_;
+    Part part_;
+    uint8_t core_;
+    uint32_t pos_[2];
+    uint32_t end_[2];
+    uint64_t now_us_;
+    uint32_t now_lo_;
+    uint32_t events_;
+};
+
+#if TRACE_ENABLED
+
+// Records a begin/end span around the enclosing scope
+class TraceScope {
+public:
+    explicit TraceScope(TraceId id, uint16_t arg = 0) : id_(id) { Trace::record(id, TRACE_BEGIN, arg); }
+    ~TraceScope() { Trace::record(id_, TRACE_END); }
+    
+private:
+    TraceId id_;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+#define TRACE_MARK(id, arg) Trace::record((id), TRACE_INSTANT, (arg))
+
+#else
+
+#define TRACE_SCOPE(...) do {} while (0)
+#define TRACE_MARK(id, arg) do {} while (0)
+
+#endif
@@ -0,0 +1,168 @@
+// Host benchmark for the CBOR encoders against the JSON ones they mirror.
+//
+// Build and run on the development machine:
+//   g++ -O2 -std=c++17 -Isrc tools/cbor_bench.cpp src/telemetry_fields.cpp src/utils/cbor.cpp -o cbor_bench
+//   ./cbor_bench [out_dir]
+//
+// Encodes a representative /api/status and /api/config snapshot and a
+// 2000-point aggregated /api/history body both ways, and reports bytes and
+// encode time per document. With out_dir it also writes each body there
+// (status.json, status.cbor, ...) for tools/cbor_check.py, which decodes the
+// CBOR with a reference library and compares it with the JSON.
+
+#include "telemetry_fields.h"
+#include "utils/cbor.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static FieldValues makeSnapshot() {
+    FieldValues v;
+    const float sample[FIELD_COUNT] = {
+        21.37f, 63.2f, 23.9f, 48.1f, 6.12f, 842.0f,          // readings
+        1, 0, 0, 1, 1, 1,                                      // relays and link
+        8 * 3600, 20 * 3600, 45, 600, 18.5f, 60.0f, 0, 45, 600, 3600  // settings
+    };
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        v.value[i] = i < sizeof(sample) / sizeof(sample[0]) ? sample[i] : 0.0f;
+        v.valid[i] = true;
+    }
+    v.valid[FIELD_PH] = false;  // One missing reading, as with a silent Nano
+    v.value[FIELD_PH] = 0.0f;
+    return v;
+}
+
+static size_t statusJson(const FieldValues& v, uint8_t groups, char* out, size_t size) {
+    size_t len = snprintf(out, size, "{");
+    len += Fields::writeJson(v, groups, out + len, size - len);
+    len += snprintf(out + len, size - len, "}");
+    return len;
+}
+
+static size_t statusCbor(const FieldValues& v, uint8_t groups, uint8_t* out, size_t size) {
+    CborWriter w(out, size);
+    w.openMap();
+    Fields::writeCbor(v, groups, w);
+    w.close();
+    return w.length();
+}
+
+struct Point {
+    uint32_t time;
+    int16_t avg, min, max;
+    bool valid;
+};
+
+static std::vector<Point> makeHistory(size_t count) {
+    std::vector<Point> points;
+    for (size_t i = 0; i < count; i++) {
+        const int16_t base = (int16_t)(2000 + (int)(300 * ((i % 96) / 96.0)));
+        points.push_back({ 1735689600u + (uint32_t)i * 900, base, (int16_t)(base - 40),
+                           (int16_t)(base + 55), i % 97 != 13 });
+    }
+    return points;
+}
+
+// Same output as the firmware's HistoryStream for aggregated queries
+static size_t historyJson(const std::vector<Point>& points, char* out, size_t size) {
+    size_t len = snprintf(out, size, "{\"channel\":\"water\",\"step\":900,\"scale\":100,\"points\":[");
+    for (size_t i = 0; i < points.size() && len < size; i++) {
+        const Point& p = points[i];
+        const char* sep = i ? "," : "";
+        if (!p.valid) {
+            len += snprintf(out + len, size - len, "%s[%lu,null,null,null]", sep, (unsigned long)p.time);
+        } else {
+            len += snprintf(out + len, size - len, "%s[%lu,%d,%d,%d]", sep, (unsigned long)p.time,
+                            p.avg, p.min, p.max);
+        }
+    }
+    len += snprintf(out + len, size - len, "]}");
+    return len;
+}
+
+static size_t historyCbor(const std::vector<Point>& points, uint8_t* out, size_t size) {
+    CborWriter w(out, size);
+    w.map(4);
+    w.text("channel");
+    w.text("water");
+    w.text("step");
+    w.uinteger(900);
+    w.text("scale");
+    w.uinteger(100);
+    w.text("points");
+    w.openArray();
+    for (const Point& p : points) {
+        w.array(4);
+        w.uinteger(p.time);
+        if (!p.valid) {
+            w.null();
+            w.null();
+            w.null();
+        } else {
+            w.integer(p.avg);
+            w.integer(p.min);
+            w.integer(p.max);
+        }
+    }
+    w.close();
+    return w.length();
+}
+
+template <typename F>
+static double nsPerCall(F&& encode, int iterations) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) encode();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+static void save(const char* dir, const char* name, const void* data, size_t len) {
+    if (!dir) return;
+    const std::string path = std::string(dir) + "/" + name;
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        perror(path.c_str());
+        return;
+    }
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+int main(int argc, char** argv) {
+    const char* out_dir = argc > 1 ? argv[1] : nullptr;
+    static char json[96 * 1024];
+    static uint8_t cbor[96 * 1024];
+    volatile size_t sink = 0;
+
+    const FieldValues snapshot = makeSnapshot();
+    const std::vector<Point> history = makeHistory(2000);
+
+    printf("%-10s %10s %10s %8s %12s %12s\n", "body", "json B", "cbor B", "ratio", "json ns", "cbor ns");
+
+    struct Case {
+        const char* name;
+        uint8_t groups;
+    } cases[] = { { "status", FIELD_ALL }, { "config", FIELD_CONFIG } };
+    for (const Case& c : cases) {
+        const size_t json_len = statusJson(snapshot, c.groups, json, sizeof(json));
+        const size_t cbor_len = statusCbor(snapshot, c.groups, cbor, sizeof(cbor));
+        const double json_ns = nsPerCall([&] { sink = sink + statusJson(snapshot, c.groups, json, sizeof(json)); }, 20000);
+        const double cbor_ns = nsPerCall([&] { sink = sink + statusCbor(snapshot, c.groups, cbor, sizeof(cbor)); }, 20000);
+        printf("%-10s %10zu %10zu %7.2fx %12.0f %12.0f\n", c.name, json_len, cbor_len,
+               (double)json_len / cbor_len, json_ns, cbor_ns);
+        save(out_dir, (std::string(c.name) + ".json").c_str(), json, json_len);
+        save(out_dir, (std::string(c.name) + ".cbor").c_str(), cbor, cbor_len);
+    }
+
+    const size_t json_len = historyJson(history, json, sizeof(json));
+    const size_t cbor_len = historyCbor(history, cbor, sizeof(cbor));
+    const double json_ns = nsPerCall([&] { sink = sink + historyJson(history, json, sizeof(json)); }, 200);
+    const double cbor_ns = nsPerCall([&] { sink = sink + historyCbor(history, cbor, sizeof(cbor)); }, 200);
+    printf("%-10s %10zu %10zu %7.2fx %12.0f %12.0f\n", "history", json_len, cbor_len,
+           (double)json_len / cbor_len, json_ns, cbor_ns);
+    save(out_dir, "history.json", json, json_len);
+    save(out_dir, "history.cbor", cbor, cbor_len);
+    return 0;
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Check the controller's CBOR responses against its JSON ones
+
+Decodes each CBOR body with the cbor2 reference decoder and compares it with
+the JSON body for the same document: same keys, numbers equal to the JSON
+decimals, null where JSON has -999 (a reading that is not valid). Reports
+the size of both. Either compare bodies written by tools/cbor_bench.cpp, or
+fetch them from a running controller (the two requests are a moment apart,
+so live sensor values may differ slightly).
+
+Usage:
+    pip install cbor2
+    ./cbor_bench /tmp/cbor && python3 tools/cbor_check.py --dir /tmp/cbor
+    python3 tools/cbor_check.py --url http://192.168.0.50
+"""
+import argparse
+import json
+import os
+import sys
+import urllib.request
+
+try:
+    import cbor2
+except ImportError:
+    sys.exit('cbor_check.py needs the cbor2 package (pip install cbor2)')
+
+DOCUMENTS = ['status', 'config', 'history']
+URLS = {
+    'status': '/api/status',
+    'config': '/api/config',
+    'history': '/api/history?ch=water&step=3600',
+}
+INVALID = -999
+LIVE_KEYS = {'temperature', 'humidity', 'air_temperature', 'air_humidity', 'ph', 'tds'}
+
+
+def compare(path, want, got, errors, tolerance):
+    if isinstance(want, dict):
+        if not isinstance(got, dict) or set(want) != set(got):
+            errors.append(f'{path}: keys differ: {sorted(want)} vs {sorted(got) if isinstance(got, dict) else got!r}')
+            return
+        for key in want:
+            tol = tolerance if key in LIVE_KEYS else 0.0
+            compare(f'{path}.{key}', want[key], got[key], errors, tol)
+    elif isinstance(want, list):
+        if not isinstance(got, list) or len(want) != len(got):
+            errors.append(f'{path}: list length differs')
+            return
+        for i, (a, b) in enumerate(zip(want, got)):
+            compare(f'{path}[{i}]', a, b, errors, tolerance)
+    elif isinstance(want, bool) or want is None:
+        if want is not got:
+            errors.append(f'{path}: {want!r} vs {got!r}')
+    elif want == INVALID:
+        if got is not None:
+            errors.append(f'{path}: -999 in JSON but {got!r} in CBOR')
+    elif isinstance(want, (int, float)):
+        # CBOR carries the value rounded to the JSON decimals, possibly as a float
+        if not isinstance(got, (int, float)) or isinstance(got, bool) or abs(want - got) > max(tolerance, 1e-3 * max(1.0, abs(want))):
+            errors.append(f'{path}: {want!r} vs {got!r}')
+    elif want != got:
+        errors.append(f'{path}: {want!r} vs {got!r}')
+
+
+def fetch(base, path, accept):
+    request = urllib.request.Request(base.rstrip('/') + path, headers={'Accept': accept})
+    with urllib.request.urlopen(request, timeout=10) as response:
+        content_type = response.headers.get('Content-Type', '')
+        body = response.read()
+    if not content_type.startswith(accept):
+        raise ValueError(f'{path}: asked for {accept}, got {content_type}')
+    return body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--dir', help='directory written by cbor_bench')
+    source.add_argument('--url', help='controller base URL')
+    args = parser.parse_args()
+
+    failed = False
+    print(f'{"body":<10} {"json B":>8} {"cbor B":>8} {"ratio":>7}  result')
+    for name in DOCUMENTS:
+        if args.dir:
+            with open(os.path.join(args.dir, name + '.json'), 'rb') as f:
+                json_body = f.read()
+            with open(os.path.join(args.dir, name + '.cbor'), 'rb') as f:
+                cbor_body = f.read()
+            tolerance = 0.0
+        else:
+            json_body = fetch(args.url, URLS[name], 'application/json')
+            cbor_body = fetch(args.url, URLS[name], 'application/cbor')
+            tolerance = 1.0
+
+        errors = []
+        try:
+            decoded = cbor2.loads(cbor_body)
+        except Exception as e:  # noqa: BLE001 - report any decode failure
+            errors.append(f'CBOR decode failed: {e}')
+        else:
+            compare(name, json.loads(json_body), decoded, errors, tolerance)
+
+        print(f'{name:<10} {len(json_body):>8} {len(cbor_body):>8} {len(json_body) / max(1, len(cbor_body)):>6.2f}x  '
+              f'{"OK" if not errors else "FAIL"}')
+        for error in errors[:10]:
+            print('    ' + error)
+        failed = failed or bool(errors)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,138 @@
+// Host benchmark for the request body parser.
+//
+// Build and run on the development machine:
+//   g++ -O2 -std=c++17 -Isrc tools/json_bench.cpp src/utils/json.cpp -o json_bench
+//   ./json_bench
+//
+// Parses the bodies web/app.js posts (plus a sensor schedule body and a
+// padded one) with Json::extract, and with the strstr-per-field scan the web
+// server used before, and reports ns per body. Both must agree on the values.
+
+#include "utils/json.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// The previous WebServer::parseQueryParams: one strstr over the body per field
+static void strstrField(const char* body, char* buffer, size_t buffer_size, const char* param) {
+    buffer[0] = '\0';
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", param);
+    const char* start = strstr(body, pattern);
+    if (!start) return;
+    start += strlen(pattern);
+    while (*start == ' ' || *start == '\t') start++;
+    if (*start == '"') {
+        start++;
+        const char* end = strchr(start, '"');
+        if (end && (size_t)(end - start) < buffer_size) {
+            memcpy(buffer, start, end - start);
+            buffer[end - start] = '\0';
+        }
+    } else {
+        const char* end = start;
+        while ((*end >= '0' && *end <= '9') || *end == '.' || *end == '-') end++;
+        if ((size_t)(end - start) < buffer_size) {
+            memcpy(buffer, start, end - start);
+            buffer[end - start] = '\0';
+        }
+    }
+}
+
+struct Wanted {
+    const char* key;
+    JsonValueType type;
+};
+
+struct Case {
+    const char* name;
+    const char* body;
+    Wanted fields[7];
+    uint8_t count;
+};
+
+static const Case CASES[] = {
+    { "lights", "{\"start_time\":\"06:00\",\"end_time\":\"22:30\"}",
+      { { "start_time", JSON_VALUE_STRING }, { "end_time", JSON_VALUE_STRING } }, 2 },
+    { "pump", "{\"mode\":\"humidity\",\"on_sec\":45,\"period\":600,\"humidity_threshold\":62.5}",
+      { { "mode", JSON_VALUE_STRING }, { "on_sec", JSON_VALUE_UINT }, { "period", JSON_VALUE_UINT },
+        { "humidity_threshold", JSON_VALUE_FLOAT }, { "min_pump_run_sec", JSON_VALUE_UINT },
+        { "min_pump_off_sec", JSON_VALUE_UINT }, { "max_pump_off_sec", JSON_VALUE_UINT } }, 7 },
+    { "heater", "{\"setpoint\":20.5}", { { "setpoint", JSON_VALUE_FLOAT } }, 1 },
+    { "fan", "{\"state\":\"on\"}", { { "state", JSON_VALUE_STRING } }, 1 },
+    { "sensors", "{\"sensor\": \"air\", \"interval_ms\": 30000, \"offset_ms\": 15000, \"min_ms\": 5000, \"max_ms\": 120000}",
+      { { "sensor", JSON_VALUE_STRING }, { "interval_ms", JSON_VALUE_UINT }, { "offset_ms", JSON_VALUE_UINT },
+        { "min_ms", JSON_VALUE_UINT }, { "max_ms", JSON_VALUE_UINT } }, 5 },
+    { "padded", "{\n  \"note\": \"sent by a script, with unused members first\",\n  \"tags\": [\"a\", \"b\", \"c\"],\n"
+                "  \"client\": {\"name\": \"cron\", \"version\": 3},\n  \"mode\": \"timer\",\n  \"on_sec\": 30,\n"
+                "  \"period\": 900\n}",
+      { { "mode", JSON_VALUE_STRING }, { "on_sec", JSON_VALUE_UINT }, { "period", JSON_VALUE_UINT },
+        { "humidity_threshold", JSON_VALUE_FLOAT } }, 4 },
+};
+
+union Value {
+    char text[24];
+    float f;
+    uint32_t u;
+    bool b;
+};
+
+static bool parseJson(const Case& c, Value* values) {
+    JsonField fields[7];
+    for (uint8_t i = 0; i < c.count; i++) {
+        fields[i] = { c.fields[i].key, c.fields[i].type, &values[i], sizeof(values[i].text), false };
+    }
+    return Json::extract(c.body, strlen(c.body), fields, c.count);
+}
+
+static void parseStrstr(const Case& c, Value* values) {
+    for (uint8_t i = 0; i < c.count; i++) {
+        char text[24];
+        strstrField(c.body, text, sizeof(text), c.fields[i].key);
+        if (c.fields[i].type == JSON_VALUE_STRING) {
+            memcpy(values[i].text, text, sizeof(text));
+        } else if (c.fields[i].type == JSON_VALUE_FLOAT) {
+            values[i].f = strtof(text, nullptr);
+        } else {
+            values[i].u = strtoul(text, nullptr, 10);
+        }
+    }
+}
+
+template <typename F>
+static double nsPerCall(F&& parse, int iterations) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) parse();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+int main() {
+    const int iterations = 200000;
+    volatile uint32_t sink = 0;
+    int failed = 0;
+
+    printf("%-10s %6s %6s %12s %12s  %s\n", "body", "bytes", "fields", "json ns", "strstr ns", "values");
+    for (const Case& c : CASES) {
+        Value a[7] = {}, b[7] = {};
+        const bool ok = parseJson(c, a);
+        parseStrstr(c, b);
+
+        bool same = ok;
+        for (uint8_t i = 0; i < c.count && same; i++) {
+            if (c.fields[i].type == JSON_VALUE_STRING) {
+                same = strcmp(a[i].text, b[i].text) == 0;
+            } else {
+                same = memcmp(&a[i], &b[i], 4) == 0;
+            }
+        }
+        failed += !same;
+
+        const double json_ns = nsPerCall([&] { Value v[7]; sink = sink + parseJson(c, v); }, iterations);
+        const double strstr_ns = nsPerCall([&] { Value v[7]; parseStrstr(c, v); sink = sink + v[0].u; }, iterations);
+        printf("%-10s %6zu %6u %12.0f %12.0f  %s\n", c.name, strlen(c.body), c.count, json_ns, strstr_ns,
+               same ? "match" : (ok ? "DIFFER" : Json::getError()));
+    }
+    return failed ? 1 : 0;
+}
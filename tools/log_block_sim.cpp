@@ -0,0 +1,160 @@
+// Host simulation and round-trip check for the persistent log block codec
+// (src/storage/log_block.cpp).
+//
+// Build and run on the development machine:
+//   g++ -O2 -std=c++17 -Isrc -o log_block_sim tools/log_block_sim.cpp
+//       src/storage/log_block.cpp src/utils/crc_utils.cpp
+//   ./log_block_sim [days]
+//
+// Generates minute samples shaped like the controller's channels at their
+// registry scale and sensor resolution (DS18B20 1/16 degC steps, DHT22 0.1
+// steps, pH and TDS from the Nano), with sensor dropouts, clock steps and
+// the relay mask. Blocks are sealed when full or after LOG_FLUSH_INTERVAL_SEC
+// like TimeSeriesLog does. Every sealed block is decoded and compared with
+// its input, and a flipped bit must fail the CRC. Reports bytes per sample,
+// the size of a year and how many days fit in LOG_BUDGET_BYTES, with and
+// without the Nano.
+
+#include "storage/log_block.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static const uint32_t START = 1735689600;
+static const uint32_t SAMPLE_SEC = 60;
+
+struct Result {
+    uint64_t samples;
+    uint64_t bytes;
+    uint32_t blocks;
+    bool ok;
+};
+
+static int16_t quantize(double value, double step, double scale) {
+    return (int16_t)lround(round(value / step) * step * scale);
+}
+
+// Decode a sealed block and compare it with the samples that went in
+static bool checkBlock(const uint8_t* block, size_t length, const std::vector<LogSample>& in) {
+    LogBlockDecoder decoder;
+    if (!decoder.begin(block, length)) {
+        printf("  block at %lu: header or CRC rejected\n", (unsigned long)in.front().time);
+        return false;
+    }
+    LogSample out;
+    size_t k = 0;
+    while (decoder.next(&out)) {
+        if (k >= in.size() || out.time != in[k].time ||
+            memcmp(out.values, in[k].values, sizeof(out.values)) != 0) {
+            printf("  block at %lu: sample %zu differs\n", (unsigned long)in.front().time, k);
+            return false;
+        }
+        k++;
+    }
+    if (k != in.size()) {
+        printf("  block at %lu: %zu of %zu samples decoded\n", (unsigned long)in.front().time, k, in.size());
+        return false;
+    }
+    
+    // Any flipped bit must be caught
+    std::vector<uint8_t> corrupt(block, block + length);
+    corrupt[length / 2] ^= 0x10;
+    if (decoder.begin(corrupt.data(), length)) {
+        printf("  block at %lu: corruption not detected\n", (unsigned long)in.front().time);
+        return false;
+    }
+    return true;
+}
+
+static Result simulate(uint32_t days, bool nano, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    
+    LogBlockEncoder encoder;
+    std::vector<LogSample> pending;
+    Result result = {0, 0, 0, true};
+    uint32_t opened = START;
+    
+    auto seal = [&]() {
+        if (encoder.isEmpty()) return;
+        size_t length = encoder.seal();
+        if (!checkBlock(encoder.data(), length, pending)) result.ok = false;
+        result.bytes += length;
+        result.blocks++;
+        encoder.reset();
+        pending.clear();
+    };
+    
+    double water_drift = 0.0, ph = 6.0, tds = 800.0;
+    bool heater = false;
+    uint32_t time = START;
+    for (uint64_t i = 0; i < (uint64_t)days * 86400 / SAMPLE_SEC; i++) {
+        time += SAMPLE_SEC;
+        // Rare clock corrections (NTP step) and late samples
+        if (uniform(rng) < 0.0005) time += (uint32_t)(rng() % 5);
+    
+        const double day = (time % 86400) / 86400.0;
+        const double season = sin(2 * M_PI * (time - START) / (365.0 * 86400));
+        const bool lights = day >= 0.25 && day < 0.833;
+        const bool pump = (time % 600) < 45;
+    
+        water_drift += noise(rng) * 0.002;
+        const double water = 21.0 + 1.5 * sin(2 * M_PI * day) + 2 * season + water_drift + noise(rng) * 0.03;
+        const double table_rh = 60 + 15 * exp(-fmod(time, 600.0) / 120.0) + noise(rng) * 0.3;
+        const double air = 22.0 + 3 * sin(2 * M_PI * day) + 4 * season + noise(rng) * 0.1;
+        const double air_rh = 50 - 10 * sin(2 * M_PI * day) + noise(rng) * 0.3;
+        ph += noise(rng) * 0.002 + (6.0 - ph) * 0.001;
+        tds += noise(rng) * 0.5 + (800.0 - tds) * 0.001;
+        if (water < 20.5) heater = true;
+        if (water > 21.5) heater = false;
+    
+        LogSample sample;
+        sample.time = time;
+        sample.values[FIELD_WATER_TEMP] = quantize(water, 0.0625, 100);
+        sample.values[FIELD_TABLE_RH] = quantize(table_rh, 0.1, 100);
+        sample.values[FIELD_AIR_TEMP] = quantize(air, 0.1, 100);
+        sample.values[FIELD_AIR_RH] = quantize(air_rh, 0.1, 100);
+        sample.values[FIELD_PH] = nano ? quantize(ph + noise(rng) * 0.015, 0.01, 100) : HISTORY_NO_DATA;
+        sample.values[FIELD_TDS] = nano ? quantize(tds + noise(rng) * 3, 1, 1) : HISTORY_NO_DATA;
+        // Occasional failed reads
+        for (uint8_t ch = 0; ch < FIELD_SENSOR_COUNT; ch++) {
+            if (uniform(rng) < 0.001) sample.values[ch] = HISTORY_NO_DATA;
+        }
+        sample.values[HIST_RELAYS] = (lights ? RELAY_LIGHTS : 0) | (pump ? RELAY_PUMP : 0) |
+                                     (heater ? RELAY_HEATER : 0) | (air > 26 ? RELAY_FAN : 0);
+    
+        if (time - opened >= LOG_FLUSH_INTERVAL_SEC) seal();
+        if (encoder.isEmpty()) opened = time;
+        if (!encoder.append(sample)) {
+            seal();
+            opened = time;
+            encoder.append(sample);
+        }
+        pending.push_back(sample);
+        result.samples++;
+    }
+    seal();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    const uint32_t days = argc > 1 ? (uint32_t)atoi(argv[1]) : 366;
+    
+    bool ok = true;
+    for (int nano = 0; nano < 2; nano++) {
+        Result r = simulate(days, nano != 0, 1 + nano);
+        const double per_sample = (double)r.bytes / r.samples;
+        const double per_year = per_sample * 525960;
+        printf("%-14s %lu samples, %u blocks, %.2f bytes/sample, %.2f MB/year, "
+               "%.0f days in %lu KB, round trip %s\n",
+               nano ? "with pH/TDS" : "without Nano", (unsigned long)r.samples, r.blocks,
+               per_sample, per_year / (1024 * 1024), LOG_BUDGET_BYTES / (per_sample * 1440),
+               (unsigned long)(LOG_BUDGET_BYTES / 1024), r.ok ? "ok" : "FAILED");
+        ok = ok && r.ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""
+Decode the controller's binary USB log output
+
+With `loglevel output binary` the firmware sends each log record as a small
+frame holding the address of its format string and the raw arguments (see
+src/utils/log.h). This tool looks the format strings up in the firmware ELF,
+formats the records on the host and passes any other console text through.
+
+Usage:
+    stty -F /dev/ttyACM0 raw
+    python3 tools/log_decode.py build/hydroponic_controller.elf /dev/ttyACM0
+    python3 tools/log_decode.py build/hydroponic_controller.elf capture.bin
+"""
+import argparse
+import re
+import struct
+import sys
+
+# Keep in step with LogModule / LogLevel in src/utils/log.h
+MODULES = ['sensors', 'control', 'http', 'tcp', 'net', 'storage', 'status', 'system']
+LEVELS = ['-', 'E', 'W', 'I', 'D']
+
+SYNC = b'\x1eL'
+FRAME_HEADER = struct.Struct('<IIBBBB')
+
+SPEC = re.compile(r'%([-+ #0]*[0-9]*(?:\.[0-9]*)?)(hh|h|ll|l|z|j|t|L)?([diouxXcfFeEgGaAsp%])')
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+
+class Elf:
+    """Loadable sections of a 32-bit little-endian ELF, for string lookups"""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            data = f.read()
+        if data[:4] != b'\x7fELF' or data[4] != 1 or data[5] != 1:
+            raise ValueError(f'{path}: not a 32-bit little-endian ELF')
+        shoff, = struct.unpack_from('<I', data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            (_, sh_type, flags, addr, offset, size,
+             _, _, _, _) = struct.unpack_from('<IIIIIIIIII', data, shoff + i * shentsize)
+            if flags & SHF_ALLOC and sh_type != SHT_NOBITS and size:
+                self.sections.append((addr, data[offset:offset + size]))
+        self.cache = {}
+
+    def string(self, addr):
+        if addr not in self.cache:
+            text = None
+            for base, blob in self.sections:
+                if base <= addr < base + len(blob):
+                    end = blob.find(b'\0', addr - base)
+                    text = blob[addr - base:end if end >= 0 else None].decode('utf-8', 'replace')
+                    break
+            self.cache[addr] = text
+        return self.cache[addr]
+
+
+def format_record(fmt, payload):
+    """Mirror of Log::format(); on the RP2350 long and size_t are 4 bytes"""
+    pos = 0
+    exhausted = False
+
+    def take(size):
+        nonlocal pos, exhausted
+        if exhausted or pos + size > len(payload):
+            exhausted = True
+            return None
+        value = payload[pos:pos + size]
+        pos += size
+        return value
+
+    def convert(match):
+        flags, length, kind = match.groups()
+        if kind == '%':
+            return '%'
+        if kind in 'diouxXc':
+            raw = take(8 if length in ('ll', 'j') else 4)
+            if raw is None:
+                return '?'
+            signed = kind in 'di'
+            value = int.from_bytes(raw, 'little', signed=signed)
+            if kind == 'c':
+                return chr(value & 0xFF)
+            return ('%' + flags + ('d' if kind == 'u' else kind)) % value
+        if kind in 'fFeEgGaA':
+            raw = take(8)
+            if raw is None:
+                return '?'
+            value, = struct.unpack('<d', raw)
+            if kind in 'aA':
+                return value.hex()
+            return ('%' + flags + kind) % value
+        if kind == 's':
+            size = take(1)
+            text = take(size[0]) if size is not None else None
+            if text is None:
+                return '?'
+            return ('%' + flags + 's') % text.decode('utf-8', 'replace')
+        raw = take(4)
+        return '?' if raw is None else '0x%08x' % int.from_bytes(raw, 'little')
+
+    return SPEC.sub(convert, fmt)
+
+
+def decode(elf, stream, out):
+    buffer = b''
+    while True:
+        chunk = stream.read1(4096) if hasattr(stream, 'read1') else stream.read(4096)
+        if not chunk:
+            break
+        buffer += chunk
+
+        while True:
+            start = buffer.find(SYNC)
+            if start < 0:
+                # Keep a trailing 0x1E that may start the next frame
+                keep = 1 if buffer.endswith(SYNC[:1]) else 0
+                out.write(buffer[:len(buffer) - keep].decode('utf-8', 'replace'))
+                buffer = buffer[len(buffer) - keep:]
+                break
+            out.write(buffer[:start].decode('utf-8', 'replace'))
+            buffer = buffer[start:]
+
+            if len(buffer) < 2 + FRAME_HEADER.size:
+                break
+            time_ms, fmt_addr, module, level, core, length = FRAME_HEADER.unpack_from(buffer, 2)
+            end = 2 + FRAME_HEADER.size + length
+            if len(buffer) < end + 1:
+                break
+            if sum(buffer[2:end]) & 0xFF != buffer[end]:
+                # Not a frame (or a damaged one): emit the sync byte as text
+                out.write(buffer[:1].decode('latin-1'))
+                buffer = buffer[1:]
+                continue
+
+            fmt = elf.string(fmt_addr)
+            payload = buffer[2 + FRAME_HEADER.size:end]
+            if fmt is None:
+                message = f'<unknown format 0x{fmt_addr:08x}: {payload.hex()}>'
+            else:
+                message = format_record(fmt, payload).strip('\n')
+            out.write('%d.%03d %s %s: %s [core %d]\n' % (
+                time_ms // 1000, time_ms % 1000,
+                LEVELS[level] if level < len(LEVELS) else '?',
+                MODULES[module] if module < len(MODULES) else 'unknown',
+                message, core))
+            buffer = buffer[end + 1:]
+        out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    parser.add_argument('elf', help='firmware ELF the device is running')
+    parser.add_argument('input', nargs='?', default='-', help='serial device or capture file (default stdin)')
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    stream = sys.stdin.buffer if args.input == '-' else open(args.input, 'rb', buffering=0)
+    try:
+        decode(elf, stream, sys.stdout)
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
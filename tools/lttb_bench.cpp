@@ -0,0 +1,209 @@
+// Host benchmark for the streaming LTTB downsampler (src/utils/lttb.cpp).
+//
+// Build and run on the development machine:
+//   g++ -O2 -std=c++17 -Isrc tools/lttb_bench.cpp src/utils/lttb.cpp -o lttb_bench
+//   ./lttb_bench [points]
+//
+// Generates synthetic week-long traces shaped like the controller's channels
+// (diurnal water temperature, humidity with pump spikes, relay bitmask) and
+// compares the streaming version against classic in-memory LTTB and plain
+// decimation: throughput, output size as /api/history JSON, how many extremes
+// survive, the share of the full min..max range kept, and the mean
+// interpolation error against the full trace.
+
+#include "utils/lttb.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+struct Trace {
+    const char* name;
+    std::vector<LttbPoint> samples;
+};
+
+static const uint32_t WEEK_START = 1735689600;
+static const uint32_t WEEK_SEC = 7 * 86400;
+
+static Trace makeTrace(const char* name, uint32_t interval, int kind, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    Trace trace{name, {}};
+    double drift = 0.0;
+    bool relay = false;
+    for (uint32_t t = WEEK_START; t < WEEK_START + WEEK_SEC; t += interval) {
+        const double day = (t % 86400) / 86400.0;
+        double v = 0.0;
+        if (kind == 0) {
+            // Water temperature, deg C x100: slow diurnal swing plus drift
+            drift += noise(rng) * 0.5;
+            v = 2100 + 150 * sin(2 * M_PI * day) + drift + noise(rng) * 3;
+        } else if (kind == 1) {
+            // Table humidity, %RH x100: decays, jumps when the pump runs
+            v = 6000 + 1500 * exp(-fmod(t, 1800.0) / 300.0) + noise(rng) * 40;
+            if (rng() % 5000 == 0) v += 2500;  // Rare spikes
+        } else {
+            // Relay bitmask: pump toggles, lights on 06:00-20:00
+            if (rng() % 60 == 0) relay = !relay;
+            v = (relay ? 2 : 0) | (day >= 0.25 && day < 0.833 ? 1 : 0);
+        }
+        trace.samples.push_back({t, (int16_t)lround(v)});
+    }
+    return trace;
+}
+
+static std::vector<LttbPoint> runStreaming(const std::vector<LttbPoint>& in, uint16_t points) {
+    std::vector<LttbPoint> out;
+    LttbDownsampler lttb;
+    lttb.begin(in.back().time, points);
+    LttbPoint p;
+    LttbPoint tail[3];
+    for (const LttbPoint& s : in) {
+        if (lttb.push(s.time, s.value, &p)) out.push_back(p);
+    }
+    uint8_t n = lttb.finish(tail);
+    out.insert(out.end(), tail, tail + n);
+    return out;
+}
+
+// Reference: classic LTTB with count-based buckets over the whole array
+static std::vector<LttbPoint> runClassic(const std::vector<LttbPoint>& in, uint16_t points) {
+    std::vector<LttbPoint> out;
+    const size_t n = in.size();
+    if (points >= n || points < 3) return in;
+    const double every = (double)(n - 2) / (points - 2);
+    size_t a = 0;
+    out.push_back(in[0]);
+    for (uint16_t i = 0; i < points - 2; i++) {
+        size_t next_start = (size_t)floor((i + 1) * every) + 1;
+        size_t next_end = (size_t)floor((i + 2) * every) + 1;
+        if (next_end > n) next_end = n;
+        double cx = 0, cy = 0;
+        for (size_t j = next_start; j < next_end; j++) {
+            cx += in[j].time;
+            cy += in[j].value;
+        }
+        size_t len = next_end > next_start ? next_end - next_start : 1;
+        cx /= len;
+        cy /= len;
+    
+        size_t start = (size_t)floor(i * every) + 1;
+        size_t end = (size_t)floor((i + 1) * every) + 1;
+        double best = -1;
+        size_t pick = start;
+        for (size_t j = start; j < end; j++) {
+            double area = fabs(((double)in[a].time - cx) * ((double)in[j].value - in[a].value) -
+                               ((double)in[a].time - in[j].time) * (cy - in[a].value));
+            if (area > best) {
+                best = area;
+                pick = j;
+            }
+        }
+        out.push_back(in[pick]);
+        a = pick;
+    }
+    out.push_back(in[n - 1]);
+    return out;
+}
+
+static std::vector<LttbPoint> runDecimate(const std::vector<LttbPoint>& in, uint16_t points) {
+    std::vector<LttbPoint> out;
+    const size_t every = (in.size() + points - 1) / points;
+    for (size_t i = 0; i < in.size(); i += every) out.push_back(in[i]);
+    return out;
+}
+
+// Mean |original - linear interpolation of the downsampled series|
+static double interpolationError(const std::vector<LttbPoint>& in, const std::vector<LttbPoint>& out) {
+    double total = 0;
+    size_t k = 0;
+    for (const LttbPoint& s : in) {
+        while (k + 1 < out.size() && out[k + 1].time <= s.time) k++;
+        double v = out[k].value;
+        if (k + 1 < out.size() && out[k + 1].time > out[k].time) {
+            double f = (double)(s.time - out[k].time) / (out[k + 1].time - out[k].time);
+            v = out[k].value + f * (out[k + 1].value - out[k].value);
+        }
+        total += fabs(s.value - v);
+    }
+    return total / in.size();
+}
+
+// Fraction of the 20 largest and 20 smallest samples kept in the output
+static double extremesKept(const std::vector<LttbPoint>& in, const std::vector<LttbPoint>& out) {
+    std::vector<LttbPoint> sorted = in;
+    std::sort(sorted.begin(), sorted.end(), [](const LttbPoint& x, const LttbPoint& y) { return x.value < y.value; });
+    const size_t k = 20;
+    size_t kept = 0;
+    for (size_t i = 0; i < 2 * k; i++) {
+        const LttbPoint& e = i < k ? sorted[i] : sorted[sorted.size() - 1 - (i - k)];
+        for (const LttbPoint& o : out) {
+            if (o.value == e.value) {
+                kept++;
+                break;
+            }
+        }
+    }
+    return (double)kept / (2 * k);
+}
+
+// Share of the full trace's min..max range the output still spans
+static double rangeKept(const std::vector<LttbPoint>& in, const std::vector<LttbPoint>& out) {
+    auto less = [](const LttbPoint& x, const LttbPoint& y) { return x.value < y.value; };
+    auto in_range = std::minmax_element(in.begin(), in.end(), less);
+    auto out_range = std::minmax_element(out.begin(), out.end(), less);
+    const double full = in_range.second->value - in_range.first->value;
+    return full > 0 ? (out_range.second->value - out_range.first->value) / full : 1.0;
+}
+
+static size_t jsonBytes(const std::vector<LttbPoint>& out) {
+    char token[32];
+    size_t bytes = strlen("{\"channel\":\"water\",\"step\":60,\"scale\":100,\"points\":[]}");
+    for (const LttbPoint& p : out) {
+        bytes += snprintf(token, sizeof(token), ",[%lu,%d]", (unsigned long)p.time, p.value);
+    }
+    return bytes;
+}
+
+int main(int argc, char** argv) {
+    const uint16_t points = argc > 1 ? (uint16_t)atoi(argv[1]) : 500;
+    
+    std::vector<Trace> traces;
+    traces.push_back(makeTrace("water (5 s)", 5, 0, 1));
+    traces.push_back(makeTrace("table_rh (5 s)", 5, 1, 2));
+    traces.push_back(makeTrace("relays (5 s)", 5, 2, 3));
+    traces.push_back(makeTrace("water (60 s)", 60, 0, 4));
+    
+    printf("LTTB to %u points, synthetic one-week traces\n\n", points);
+    printf("%-16s %8s  %-10s %7s %9s %8s %9s %8s %7s\n",
+           "trace", "samples", "method", "points", "json B", "ns/smp", "mean err", "extrema", "range");
+    
+    for (const Trace& trace : traces) {
+        struct Method {
+            const char* name;
+            std::vector<LttbPoint> (*run)(const std::vector<LttbPoint>&, uint16_t);
+        } methods[] = {
+            { "streaming", runStreaming },
+            { "classic", runClassic },
+            { "decimate", runDecimate },
+        };
+        for (const Method& m : methods) {
+            const int reps = 20;
+            std::vector<LttbPoint> out;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int r = 0; r < reps; r++) out = m.run(trace.samples, points);
+            auto t1 = std::chrono::steady_clock::now();
+            double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / reps / trace.samples.size();
+    
+            printf("%-16s %8zu  %-10s %7zu %9zu %8.1f %9.2f %7.0f%% %6.0f%%\n",
+                   trace.name, trace.samples.size(), m.name, out.size(), jsonBytes(out), ns,
+                   interpolationError(trace.samples, out), 100.0 * extremesKept(trace.samples, out),
+                   100.0 * rangeKept(trace.samples, out));
+        }
+    }
+    return 0;
+}
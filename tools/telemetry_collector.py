@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+Collect UDP multicast telemetry from a fleet of hydroponic controllers into SQLite
+
+Each controller built with TELEMETRY_UDP_ENABLED sends one datagram per minute
+sample to TELEMETRY_UDP_GROUP:TELEMETRY_UDP_PORT (see src/network/udp_telemetry.h
+for the layout). Samples are keyed by (node, seq), so records replayed after an
+outage are stored once.
+
+Usage:
+    python3 tools/telemetry_collector.py --db fleet.db
+    python3 tools/telemetry_collector.py --iface 192.168.0.10 --group 239.255.42.1
+"""
+import argparse
+import socket
+import sqlite3
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = 0x54445948  # "HYDT"
+HEADER = struct.Struct('<IBBBB16sIII')
+FLAG_REPLAY = 0x01
+NO_DATA = -32768
+
+# History channels in wire order: (column, scale)
+CHANNELS = [
+    ('water', 100),
+    ('table_rh', 100),
+    ('air_temp', 100),
+    ('air_rh', 100),
+    ('ph', 100),
+    ('tds', 1),
+    ('relays', 1),
+]
+
+SCHEMA = f"""
+CREATE TABLE IF NOT EXISTS samples (
+    node TEXT NOT NULL,
+    seq INTEGER NOT NULL,
+    time INTEGER NOT NULL,
+    uptime INTEGER NOT NULL,
+    replay INTEGER NOT NULL,
+    received REAL NOT NULL,
+    addr TEXT NOT NULL,
+    {', '.join(f"{name} {'REAL' if scale != 1 else 'INTEGER'}" for name, scale in CHANNELS)},
+    PRIMARY KEY (node, seq)
+) WITHOUT ROWID;
+CREATE INDEX IF NOT EXISTS samples_time ON samples (node, time);
+"""
+
+def decode(data):
+    """Decode one datagram into a dict, or None if it is not valid telemetry"""
+    if len(data) < HEADER.size + 4:
+        return None
+    magic, version, flags, count, _, node, seq, ts, uptime = HEADER.unpack_from(data)
+    if magic != MAGIC or version < 1:
+        return None
+    # The CRC is always the last field and covers everything before it
+    (crc,) = struct.unpack_from('<I', data, len(data) - 4)
+    if zlib.crc32(data[:-4]) != crc:
+        return None
+    if HEADER.size + 2 * count > len(data) - 4:
+        return None
+
+    raw = struct.unpack_from(f'<{count}h', data, HEADER.size)
+    values = {}
+    for i, (name, scale) in enumerate(CHANNELS):
+        if i < count and raw[i] != NO_DATA:
+            values[name] = raw[i] / scale if scale != 1 else raw[i]
+        else:
+            values[name] = None
+    return {
+        'node': node.rstrip(b'\0').decode('ascii', 'replace'),
+        'seq': seq,
+        'time': ts,
+        'uptime': uptime,
+        'replay': 1 if flags & FLAG_REPLAY else 0,
+        'values': values,
+    }
+
+def open_socket(group, port, iface):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind(('', port))
+    membership = struct.pack('4s4s', socket.inet_aton(group), socket.inet_aton(iface))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+    return sock
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('--db', default='telemetry.db', help='SQLite database (default: telemetry.db)')
+    parser.add_argument('--group', default='239.255.42.1', help='Multicast group')
+    parser.add_argument('--port', type=int, default=47294, help='UDP port')
+    parser.add_argument('--iface', default='0.0.0.0', help='Local interface address to join on')
+    parser.add_argument('--commit-interval', type=float, default=1.0,
+                        help='Seconds between SQLite commits (batches inserts)')
+    parser.add_argument('--quiet', action='store_true', help='Only print periodic totals')
+    args = parser.parse_args()
+
+    db = sqlite3.connect(args.db)
+    db.execute('PRAGMA journal_mode=WAL')
+    db.execute('PRAGMA synchronous=NORMAL')
+    db.executescript(SCHEMA)
+
+    columns = ['node', 'seq', 'time', 'uptime', 'replay', 'received', 'addr'] + [name for name, _ in CHANNELS]
+    insert = f"INSERT OR IGNORE INTO samples ({', '.join(columns)}) VALUES ({', '.join('?' * len(columns))})"
+
+    sock = open_socket(args.group, args.port, args.iface)
+    sock.settimeout(args.commit_interval)
+    print(f"Listening on {args.group}:{args.port}, writing {args.db}")
+
+    pending = []
+    stored = duplicates = invalid = 0
+    nodes = set()
+    last_commit = last_report = time.monotonic()
+    try:
+        while True:
+            try:
+                data, (addr, _) = sock.recvfrom(2048)
+                sample = decode(data)
+                if sample is None:
+                    invalid += 1
+                else:
+                    nodes.add(sample['node'])
+                    pending.append([sample['node'], sample['seq'], sample['time'], sample['uptime'],
+                                    sample['replay'], time.time(), addr] +
+                                   [sample['values'][name] for name, _ in CHANNELS])
+                    if not args.quiet:
+                        print(f"{sample['node']:16} seq {sample['seq']:8} "
+                              f"{'replay' if sample['replay'] else 'live  '} {sample['values']}")
+            except socket.timeout:
+                pass
+
+            now = time.monotonic()
+            if pending and now - last_commit >= args.commit_interval:
+                before = db.total_changes
+                db.executemany(insert, pending)
+                db.commit()
+                added = db.total_changes - before
+                stored += added
+                duplicates += len(pending) - added
+                pending.clear()
+                last_commit = now
+            if now - last_report >= 60:
+                print(f"{len(nodes)} nodes, {stored} stored, {duplicates} duplicates, {invalid} invalid")
+                last_report = now
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if pending:
+            db.executemany(insert, pending)
+            db.commit()
+        db.close()
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Convert a controller trace dump into Chrome trace-event JSON for Perfetto
+
+Accepts the output of the TCP `trace dump bin` or `trace dump json` command
+as captured with netcat (the connection banner before the dump is skipped).
+The binary layout is described in src/utils/trace.h.
+
+Usage:
+    echo "trace dump bin" | nc -q 5 [device-ip] 47293 > dump.bin
+    python3 tools/trace_convert.py dump.bin -o trace.json
+    # then open trace.json at https://ui.perfetto.dev
+"""
+import argparse
+import json
+import struct
+import sys
+
+EVENT = struct.Struct('<IBBH')
+CORE_HEADER = struct.Struct('<B3xI')
+
+
+def parse_binary(data, start):
+    end = data.index(b'\n', start)
+    fields = dict(f.split('=', 1) for f in data[start:end].decode().split()[2:])
+    now_us = int(fields['now_us'])
+    names = fields['names'].split(',')
+    now_lo = now_us & 0xFFFFFFFF
+    pos = end + 1
+
+    events = []
+    for _ in range(int(fields['cores'])):
+        core, count = CORE_HEADER.unpack_from(data, pos)
+        pos += CORE_HEADER.size
+        depth = 0
+        for _ in range(count):
+            time_us, ident, phase, arg = EVENT.unpack_from(data, pos)
+            pos += EVENT.size
+            phase = chr(phase)
+            # The ring may start inside a span; drop ends without a begin
+            if phase == 'E':
+                if depth == 0:
+                    continue
+                depth -= 1
+            elif phase == 'B':
+                depth += 1
+            event = {
+                'name': names[ident] if ident < len(names) else f'id{ident}',
+                'ph': phase,
+                'ts': now_us - ((now_lo - time_us) & 0xFFFFFFFF),
+                'pid': 1,
+                'tid': core,
+            }
+            if phase == 'i':
+                event['s'] = 't'
+            if arg:
+                event['args'] = {'arg': arg}
+            events.append(event)
+
+    meta = [{'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': core, 'args': {'name': f'core {core}'}}
+            for core in range(int(fields['cores']))]
+    return {'displayTimeUnit': 'ms', 'traceEvents': meta + events}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a trace dump to Chrome trace-event JSON')
+    parser.add_argument('dump', help='captured `trace dump` output')
+    parser.add_argument('-o', '--output', help='JSON file to write (default: stdout)')
+    args = parser.parse_args()
+
+    with open(args.dump, 'rb') as f:
+        data = f.read()
+
+    start = data.find(b'TRACE v1 ')
+    if start >= 0:
+        trace = parse_binary(data, start)
+    else:
+        start = data.find(b'{"displayTimeUnit"')
+        if start < 0:
+            sys.exit('no trace dump found in ' + args.dump)
+        end = data.rindex(b']}') + 2
+        trace = json.loads(data[start:end])
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+    json.dump(trace, out, separators=(',', ':'))
+    if args.output:
+        out.close()
+        print(f"{len(trace['traceEvents'])} events written to {args.output}", file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()